@@ -20,10 +20,62 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <time.h>
+#include <pthread.h>
 #include "tcam_defs.h"
 #include "tcam.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HW_LOOKUP_X86
+#endif
 
-static uint64_t hw_access ;
+// number of writes the programming thread takes from the queue at once
+#define HW_QUEUE_BURST 64
+
+// number of words of a plane of the key memory is a multiple of this, so
+// that the planes start on a cache line
+#define HW_KEY_ALIGN 16
+
+/* A write queued for the programming thread. 'seq' is the number of writes
+ * queued when it was the last one. Its key, if it has one, is kept by the
+ * queue next to it, see hw_queue_key().
+ */
+typedef struct hw_write_ {
+    uint32_t position;
+    entry_t ent;
+    uint64_t seq;
+    bool has_key;
+} hw_write_t;
+
+/* Programming queue of an asynchronous hw tcam.
+ * ring       - queued writes, 'count' of them from 'head'
+ * ring_keys  - keys of the queued writes, 2 * key_words words per write
+ * burst_keys - keys of the writes taken by the programming thread
+ * shadow     - content of the hw tcam once the queued writes are done, and
+ *              shadow_keys the keys of its slots
+ * queued_seq - number of writes queued, dropped ones included, counted
+ *              like hw_access
+ * done_seq   - number of them done in the hw tcam
+ * busy       - the programming thread is doing writes taken from the ring
+ */
+struct hw_queue_ {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t progress;
+    hw_write_t *ring;
+    uint32_t *ring_keys;
+    uint32_t *burst_keys;
+    uint32_t depth;
+    uint32_t head;
+    uint32_t count;
+    entry_t *shadow;
+    uint32_t *shadow_keys;
+    uint64_t queued_seq;
+    uint64_t done_seq;
+    bool busy;
+    bool stop;
+};
 
 /*
  * Description :
@@ -31,11 +83,192 @@ static uint64_t hw_access ;
  *     NB API to initialize the HW TCAM 
  * Arguments:
  * hw_tcam - hw tcam
+ * mem - memory of the hw tcam
  * size - size of the tcam
  */
-void hw_tcam_init(entry_t *hw_tcam, uint32_t size) {
-     memset(hw_tcam,0,  sizeof(entry_t)*size);
-    hw_access = 0;
+void hw_tcam_init(hw_tcam_t *hw_tcam, entry_t *mem, uint32_t size) {
+     memset(mem,0,  sizeof(entry_t)*size);
+    hw_tcam->mem = mem;
+    hw_tcam->size = size;
+    hw_tcam->hw_access = 0;
+    hw_tcam->write_ns = 0;
+    hw_tcam->coalesced = 0;
+    hw_tcam->fail_at = 0;
+    hw_tcam->queue = NULL;
+    hw_tcam->keys = NULL;
+    hw_tcam->key_words = 0;
+    hw_tcam->key_stride = 0;
+    hw_tcam->watch = NULL;
+    hw_tcam->watch_arg = NULL;
+    hw_tcam_set_lookup(hw_tcam, TCAM_LOOKUP_AUTO);
+}
+
+/*
+ * Description :
+ *     Sets the width of the keys of the hw tcam and clears them.
+ * Arguments:
+ * hw_tcam   - hw tcam
+ * key_words - width of the keys in 32 bit words
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t hw_tcam_set_key_width(hw_tcam_t *hw_tcam, uint32_t key_words)
+{
+    uint32_t stride = (hw_tcam->size + HW_KEY_ALIGN - 1) / HW_KEY_ALIGN * HW_KEY_ALIGN;
+    uint32_t depth = (hw_tcam->queue != NULL) ? hw_tcam->queue->depth : 0;
+    uint32_t *keys = NULL;
+
+    if (key_words > 0) {
+        keys = aligned_alloc(HW_KEY_ALIGN * sizeof(uint32_t),
+                             2 * key_words * stride * sizeof(uint32_t));
+        if (keys == NULL)
+            return TCAM_ERR_MEM_ALLOC_FAIL;
+        memset(keys, 0, 2 * key_words * stride * sizeof(uint32_t));
+    }
+    // the programming queue keeps keys of the old width
+    hw_tcam_stop_async(hw_tcam);
+    free(hw_tcam->keys);
+    hw_tcam->keys = keys;
+    hw_tcam->key_words = key_words;
+    hw_tcam->key_stride = stride;
+    if (depth > 0)
+        return hw_tcam_start_async(hw_tcam, depth);
+    return TCAM_ERR_SUCCESS;
+}
+
+/*
+ * Description :
+ *     Stops the programming queue of the hw tcam and frees its key memory.
+ * Arguments:
+ * hw_tcam - hw tcam
+ */
+void hw_tcam_destroy(hw_tcam_t *hw_tcam)
+{
+    hw_tcam_stop_async(hw_tcam);
+    free(hw_tcam->keys);
+    hw_tcam->keys = NULL;
+    hw_tcam->key_words = 0;
+}
+
+/* Key of the i-th write of the ring of the programming queue */
+static uint32_t *hw_queue_key(hw_tcam_t *hw_tcam, uint32_t i)
+{
+    return &hw_tcam->queue->ring_keys[i * 2 * hw_tcam->key_words];
+}
+
+/* Writes an entry in the hw tcam, taking the simulated latency */
+static void hw_tcam_write(hw_tcam_t *hw_tcam, entry_t *ent, const uint32_t *key, uint32_t position)
+{
+    struct timespec start, now;
+    uint32_t w;
+
+    memcpy(hw_tcam->mem+position, ent, sizeof(entry_t));
+    if (key != NULL) {
+        for (w = 0; w < 2 * hw_tcam->key_words; w++)
+            hw_tcam->keys[w * hw_tcam->key_stride + position] = key[w];
+    }
+    if (hw_tcam->watch != NULL)
+        hw_tcam->watch(hw_tcam->watch_arg, position);
+    if (hw_tcam->write_ns == 0)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec) * 1000000000LL + (now.tv_nsec - start.tv_nsec) <
+             hw_tcam->write_ns);
+}
+
+/* Programming thread of an asynchronous hw tcam */
+static void *hw_tcam_drain(void *arg)
+{
+    hw_tcam_t *hw_tcam = arg;
+    struct hw_queue_ *queue = hw_tcam->queue;
+    hw_write_t burst[HW_QUEUE_BURST];
+    uint32_t i, n, words = 2 * hw_tcam->key_words;
+
+    pthread_mutex_lock(&queue->lock);
+    for (;;) {
+        while ((queue->count == 0) && !queue->stop)
+            pthread_cond_wait(&queue->work, &queue->lock);
+        if (queue->count == 0)
+            break;
+        n = (queue->count < HW_QUEUE_BURST) ? queue->count : HW_QUEUE_BURST;
+        for (i = 0; i < n; i++) {
+            burst[i] = queue->ring[(queue->head + i) % queue->depth];
+            memcpy(&queue->burst_keys[i * words], hw_queue_key(hw_tcam, (queue->head + i) % queue->depth),
+                   words * sizeof(uint32_t));
+        }
+        queue->head = (queue->head + n) % queue->depth;
+        queue->count -= n;
+        queue->busy = TRUE;
+        pthread_cond_broadcast(&queue->progress);
+        pthread_mutex_unlock(&queue->lock);
+
+        for (i = 0; i < n; i++)
+            hw_tcam_write(hw_tcam, &burst[i].ent, burst[i].has_key ? &queue->burst_keys[i * words] : NULL,
+                          burst[i].position);
+
+        pthread_mutex_lock(&queue->lock);
+        queue->busy = FALSE;
+        // the writes dropped since the burst was taken are done as well
+        queue->done_seq = (queue->count == 0) ? queue->queued_seq : burst[n-1].seq;
+        pthread_cond_broadcast(&queue->progress);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+/* Queues a write for the programming thread */
+static void hw_tcam_queue(hw_tcam_t *hw_tcam, entry_t *ent, const uint32_t *key, uint32_t position)
+{
+    struct hw_queue_ *queue = hw_tcam->queue;
+    size_t key_size = 2 * hw_tcam->key_words * sizeof(uint32_t);
+    uint32_t *shadow_key = &queue->shadow_keys[position * 2 * hw_tcam->key_words];
+    hw_write_t *last;
+    uint32_t i;
+
+    pthread_mutex_lock(&queue->lock);
+    // the write is only counted once it has room, else the programming
+    // thread could empty the ring meanwhile and report it as done
+    while (queue->count == queue->depth)
+        pthread_cond_wait(&queue->progress, &queue->lock);
+    queue->queued_seq++;
+    if ((memcmp(&queue->shadow[position], ent, sizeof(entry_t)) == 0) &&
+        ((key == NULL) || (memcmp(shadow_key, key, key_size) == 0))) {
+        // no change once the queued writes are done
+        hw_tcam->coalesced++;
+        if (queue->count > 0)
+            queue->ring[(queue->head + queue->count - 1) % queue->depth].seq = queue->queued_seq;
+        else if (!queue->busy)
+            queue->done_seq = queue->queued_seq;
+        pthread_mutex_unlock(&queue->lock);
+        return;
+    }
+    queue->shadow[position] = *ent;
+    if (key != NULL)
+        memcpy(shadow_key, key, key_size);
+    i = (queue->head + queue->count - 1) % queue->depth;
+    last = &queue->ring[i];
+    if ((queue->count > 0) && (last->position == position)) {
+        // nothing is written in between, the last write is not needed. It
+        // keeps its key if this one has none
+        last->ent = *ent;
+        last->seq = queue->queued_seq;
+        hw_tcam->coalesced++;
+    } else {
+        i = (queue->head + queue->count) % queue->depth;
+        last = &queue->ring[i];
+        last->position = position;
+        last->ent = *ent;
+        last->seq = queue->queued_seq;
+        last->has_key = FALSE;
+        queue->count++;
+        pthread_cond_signal(&queue->work);
+    }
+    if (key != NULL) {
+        memcpy(hw_queue_key(hw_tcam, i), key, key_size);
+        last->has_key = TRUE;
+    }
+    pthread_mutex_unlock(&queue->lock);
 }
 
 /* Description  
@@ -44,17 +277,24 @@ void hw_tcam_init(entry_t *hw_tcam, uint32_t size) {
  *  Arguments 
  *  hw_tcam - hardware tcam
  *  ent - contains the id and priority of the entry to be programmed in tcam   
+ *  key - value then mask of the key of the entry, NULL keeps the key of the
+ *        slot
  *  position - position where the entry has to be programmed 
  * Return: TCAM_ERR_SUCCESS or appropriate error code. 
  */
 
-tcam_err_t tcam_program(entry_t *hw_tcam, entry_t *ent, uint32_t position) {
+tcam_err_t tcam_program(hw_tcam_t *hw_tcam, entry_t *ent, const uint32_t *key, uint32_t position) {
 
-    if (position >= TCAM_MAX_ENTRIES)
+    if (position >= hw_tcam->size)
         return TCAM_ERR_EINVAL;
+    if ((hw_tcam->fail_at != 0) && (--hw_tcam->fail_at == 0))
+        return TCAM_ERR_HW_FAIL;
 
-    memcpy(hw_tcam+position, ent, sizeof(entry_t));
-    hw_access++;
+    if (hw_tcam->queue != NULL)
+        hw_tcam_queue(hw_tcam, ent, key, position);
+    else
+        hw_tcam_write(hw_tcam, ent, key, position);
+    hw_tcam->hw_access++;
 
     return TCAM_ERR_SUCCESS;
 }
@@ -63,10 +303,338 @@ tcam_err_t tcam_program(entry_t *hw_tcam, entry_t *ent, uint32_t position) {
  *   This is used to get the count for the accesses to the hw tcam . This
  *   would help the caller to check the number of accessed to hw tcam
  *  Arguments
+ *  hw_tcam - hardware tcam
  * Return: The number of accesses to hw tcam 
  */
-uint64_t tcam_get_hw_access_cnt()
+uint64_t tcam_get_hw_access_cnt(hw_tcam_t *hw_tcam)
+{
+    return hw_tcam->hw_access;
+}
+
+/* Frees a programming queue and its buffers */
+static void hw_queue_free(struct hw_queue_ *queue)
+{
+    free(queue->ring);
+    free(queue->ring_keys);
+    free(queue->burst_keys);
+    free(queue->shadow);
+    free(queue->shadow_keys);
+    free(queue);
+}
+
+/* Description
+ *   Starts programming the hw tcam asynchronously, with a queue of 'depth'
+ *   writes drained by a programming thread.
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ *  depth   - number of writes the queue can hold
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t hw_tcam_start_async(hw_tcam_t *hw_tcam, uint32_t depth)
+{
+    struct hw_queue_ *queue;
+    uint32_t i, w;
+
+    if (depth == 0)
+        return TCAM_ERR_EINVAL;
+    hw_tcam_stop_async(hw_tcam);
+    queue = calloc(1, sizeof(struct hw_queue_));
+    if (queue == NULL)
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    queue->ring = calloc(depth, sizeof(hw_write_t));
+    // one more word each, so that keys without any word are not a failure
+    queue->ring_keys = malloc((depth * 2 * hw_tcam->key_words + 1) * sizeof(uint32_t));
+    queue->burst_keys = malloc((HW_QUEUE_BURST * 2 * hw_tcam->key_words + 1) * sizeof(uint32_t));
+    queue->shadow = malloc(hw_tcam->size * sizeof(entry_t));
+    queue->shadow_keys = malloc((hw_tcam->size * 2 * hw_tcam->key_words + 1) * sizeof(uint32_t));
+    if ((queue->ring == NULL) || (queue->ring_keys == NULL) || (queue->burst_keys == NULL) ||
+        (queue->shadow == NULL) || (queue->shadow_keys == NULL)) {
+        hw_queue_free(queue);
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    }
+    memcpy(queue->shadow, hw_tcam->mem, hw_tcam->size * sizeof(entry_t));
+    for (i = 0; i < hw_tcam->size; i++) {
+        for (w = 0; w < 2 * hw_tcam->key_words; w++)
+            queue->shadow_keys[i * 2 * hw_tcam->key_words + w] = hw_tcam->keys[w * hw_tcam->key_stride + i];
+    }
+    queue->depth = depth;
+    // the writes are numbered like hw_access, so that the fences still hold
+    // when the queue is restarted
+    queue->queued_seq = hw_tcam->hw_access;
+    queue->done_seq = hw_tcam->hw_access;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->work, NULL);
+    pthread_cond_init(&queue->progress, NULL);
+    hw_tcam->queue = queue;
+    if (pthread_create(&queue->thread, NULL, hw_tcam_drain, hw_tcam) != 0) {
+        hw_tcam->queue = NULL;
+        pthread_mutex_destroy(&queue->lock);
+        pthread_cond_destroy(&queue->work);
+        pthread_cond_destroy(&queue->progress);
+        hw_queue_free(queue);
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    }
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Description
+ *   Waits until the queued writes are done and goes back to programming the
+ *   hw tcam synchronously.
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ */
+void hw_tcam_stop_async(hw_tcam_t *hw_tcam)
+{
+    struct hw_queue_ *queue = hw_tcam->queue;
+
+    if (queue == NULL)
+        return;
+    pthread_mutex_lock(&queue->lock);
+    queue->stop = TRUE;
+    pthread_cond_signal(&queue->work);
+    pthread_mutex_unlock(&queue->lock);
+    pthread_join(queue->thread, NULL);
+    hw_tcam->queue = NULL;
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->work);
+    pthread_cond_destroy(&queue->progress);
+    hw_queue_free(queue);
+}
+
+/* Description
+ *   Returns a fence for the writes queued so far.
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ * Return: The fence
+ */
+uint64_t hw_tcam_fence(hw_tcam_t *hw_tcam)
+{
+    struct hw_queue_ *queue = hw_tcam->queue;
+    uint64_t fence;
+
+    if (queue == NULL)
+        return hw_tcam->hw_access;
+    pthread_mutex_lock(&queue->lock);
+    fence = queue->queued_seq;
+    pthread_mutex_unlock(&queue->lock);
+    return fence;
+}
+
+/* Description
+ *   Waits until the writes queued before 'fence' was taken are done.
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ *  fence   - fence returned by hw_tcam_fence()
+ */
+void hw_tcam_wait(hw_tcam_t *hw_tcam, uint64_t fence)
+{
+    struct hw_queue_ *queue = hw_tcam->queue;
+
+    if (queue == NULL)
+        return;
+    pthread_mutex_lock(&queue->lock);
+    while (queue->done_seq < fence)
+        pthread_cond_wait(&queue->progress, &queue->lock);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* Description
+ *   Returns the number of writes done in the hw tcam, counted like
+ *   hw_access.
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ * Return: The number of writes done
+ */
+uint64_t hw_tcam_done(hw_tcam_t *hw_tcam)
+{
+    struct hw_queue_ *queue = hw_tcam->queue;
+    uint64_t done;
+
+    if (queue == NULL)
+        return hw_tcam->hw_access;
+    pthread_mutex_lock(&queue->lock);
+    done = queue->done_seq;
+    pthread_mutex_unlock(&queue->lock);
+    return done;
+}
+
+/* Lookup in the hw tcam.
+ *
+ * Each implementation returns the first busy slot whose entry matches the
+ * key, -1 if none. The word w of the key is compared with the plane w of
+ * several slots at once, and the next plane is only read for the slots
+ * which still match, so a block of slots whose first words differ from the
+ * key costs one load per plane of the values and of the masks. The planes
+ * are padded to a cache line, the padding slots are skipped. The vector
+ * implementations are compiled for their instruction set whatever the flags
+ * of the build and are only called once the cpu is known to support it.
+ */
+
+static int32_t hw_lookup_scalar(hw_tcam_t *hw_tcam, const uint32_t *key)
+{
+    const uint32_t *val = hw_tcam->keys, *mask;
+    uint32_t i, w, stride = hw_tcam->key_stride, words = hw_tcam->key_words;
+
+    mask = val + words * stride;
+    for (i = 0; i < hw_tcam->size; i++) {
+        for (w = 0; w < words; w++) {
+            if ((key[w] ^ val[w * stride + i]) & mask[w * stride + i])
+                break;
+        }
+        if ((w == words) && (hw_tcam->mem[i].id != TCAM_CELL_STATE_EMPTY))
+            return i;
+    }
+    return -1;
+}
+
+/* Returns the first busy slot of the block of slots starting at 'i' among
+ * those of 'bits', -1 if none
+ */
+static inline int32_t hw_lookup_busy(hw_tcam_t *hw_tcam, uint32_t i, uint32_t bits)
+{
+    uint32_t k;
+
+    for (; bits != 0; bits &= bits - 1) {
+        k = i + __builtin_ctz(bits);
+        if ((k < hw_tcam->size) && (hw_tcam->mem[k].id != TCAM_CELL_STATE_EMPTY))
+            return k;
+    }
+    return -1;
+}
+
+#ifdef HW_LOOKUP_X86
+__attribute__((target("sse2")))
+static int32_t hw_lookup_sse2(hw_tcam_t *hw_tcam, const uint32_t *key)
+{
+    const uint32_t *val = hw_tcam->keys, *mask;
+    uint32_t i, w, bits, stride = hw_tcam->key_stride, words = hw_tcam->key_words;
+    __m128i match, diff, zero = _mm_setzero_si128();
+    int32_t slot;
+
+    mask = val + words * stride;
+    for (i = 0; i < hw_tcam->size; i += 4) {
+        match = _mm_cmpeq_epi32(zero, zero);
+        for (w = 0; w < words; w++) {
+            diff = _mm_and_si128(_mm_xor_si128(_mm_load_si128((const __m128i *) &val[w * stride + i]),
+                                               _mm_set1_epi32(key[w])),
+                                 _mm_load_si128((const __m128i *) &mask[w * stride + i]));
+            match = _mm_and_si128(match, _mm_cmpeq_epi32(diff, zero));
+            if (_mm_movemask_epi8(match) == 0)
+                break;
+        }
+        // one bit per slot which matched
+        bits = _mm_movemask_ps(_mm_castsi128_ps(match));
+        if ((bits != 0) && ((slot = hw_lookup_busy(hw_tcam, i, bits)) >= 0))
+            return slot;
+    }
+    return -1;
+}
+
+__attribute__((target("avx2")))
+static int32_t hw_lookup_avx2(hw_tcam_t *hw_tcam, const uint32_t *key)
+{
+    const uint32_t *val = hw_tcam->keys, *mask;
+    uint32_t i, w, bits, stride = hw_tcam->key_stride, words = hw_tcam->key_words;
+    __m256i match, diff, zero = _mm256_setzero_si256();
+    int32_t slot;
+
+    mask = val + words * stride;
+    for (i = 0; i < hw_tcam->size; i += 8) {
+        match = _mm256_cmpeq_epi32(zero, zero);
+        for (w = 0; w < words; w++) {
+            diff = _mm256_and_si256(_mm256_xor_si256(_mm256_load_si256((const __m256i *) &val[w * stride + i]),
+                                                     _mm256_set1_epi32(key[w])),
+                                    _mm256_load_si256((const __m256i *) &mask[w * stride + i]));
+            match = _mm256_and_si256(match, _mm256_cmpeq_epi32(diff, zero));
+            if (_mm256_testz_si256(match, match))
+                break;
+        }
+        // one bit per slot which matched
+        bits = _mm256_movemask_ps(_mm256_castsi256_ps(match));
+        if ((bits != 0) && ((slot = hw_lookup_busy(hw_tcam, i, bits)) >= 0))
+            return slot;
+    }
+    return -1;
+}
+#endif
+
+/* Returns TRUE if the cpu supports the implementation */
+static bool hw_lookup_supported(tcam_lookup_impl_t impl)
+{
+#ifdef HW_LOOKUP_X86
+    __builtin_cpu_init();
+    if (impl == TCAM_LOOKUP_SSE2)
+        return __builtin_cpu_supports("sse2") ? TRUE : FALSE;
+    if (impl == TCAM_LOOKUP_AVX2)
+        return __builtin_cpu_supports("avx2") ? TRUE : FALSE;
+#endif
+    return (impl == TCAM_LOOKUP_SCALAR) ? TRUE : FALSE;
+}
+
+/* Description
+ *   Sets the implementation of the key compare of hw_tcam_lookup().
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ *  impl    - one of tcam_lookup_impl_t
+ * Return: TCAM_ERR_SUCCESS or TCAM_ERR_EINVAL if the cpu does not support it
+ */
+tcam_err_t hw_tcam_set_lookup(hw_tcam_t *hw_tcam, tcam_lookup_impl_t impl)
 {
-    return hw_access;
+    if (impl == TCAM_LOOKUP_AUTO) {
+        impl = TCAM_LOOKUP_AVX2;
+        while (!hw_lookup_supported(impl))
+            impl--;
+    } else if ((impl > TCAM_LOOKUP_AVX2) || !hw_lookup_supported(impl)) {
+        return TCAM_ERR_EINVAL;
+    }
+    hw_tcam->lookup = impl;
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Description
+ *   Looks up a key in the hw tcam and returns the matching entry of the
+ *   lowest slot.
+ *  Arguments
+ *  hw_tcam  - hardware tcam
+ *  key      - key of TCAM_KEY_WORDS words
+ *  position - filled with the slot of the matching entry
+ * Return: TCAM_ERR_SUCCESS, TCAM_ERR_NO_MATCH if no entry matches the key or
+ *         appropriate error code.
+ */
+tcam_err_t hw_tcam_lookup(hw_tcam_t *hw_tcam, const uint32_t *key, uint32_t *position)
+{
+    int32_t slot;
+
+    if ((key == NULL) || (position == NULL))
+        return TCAM_ERR_EINVAL;
+    switch (hw_tcam->lookup) {
+#ifdef HW_LOOKUP_X86
+    case TCAM_LOOKUP_AVX2:
+        slot = hw_lookup_avx2(hw_tcam, key);
+        break;
+    case TCAM_LOOKUP_SSE2:
+        slot = hw_lookup_sse2(hw_tcam, key);
+        break;
+#endif
+    default:
+        slot = hw_lookup_scalar(hw_tcam, key);
+        break;
+    }
+    if (slot < 0)
+        return TCAM_ERR_NO_MATCH;
+    *position = slot;
+    return TCAM_ERR_SUCCESS;
 }
 
+/* Description
+ *   Sets the function called after each write to the hw tcam.
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ *  fn      - function called with 'arg' and the slot written, NULL for none
+ *  arg     - argument of fn
+ */
+void hw_tcam_set_watch(hw_tcam_t *hw_tcam, tcam_watch_fn_t fn, void *arg)
+{
+    hw_tcam->watch = fn;
+    hw_tcam->watch_arg = arg;
+}
@@ -5,16 +5,78 @@
 #ifndef __TCAM_H__
 #define __TCAM_H__
 
+/* A hw_tcam served by a TCAM Bank handler. Each hw_tcam counts its own
+ * accesses so that the banks do not share any state.
+ * mem       - memory of the hw tcam, the id and priority of each slot
+ * size      - number of entries of the hw tcam
+ * hw_access - number of entries programmed in the hw tcam
+ * write_ns  - simulated latency of a write to the hw tcam, in nanoseconds
+ * coalesced - number of writes dropped by the programming queue
+ * fail_at   - the write which fails with a simulated hw error, counting
+ *             from 1 from now on, 0 if none
+ * queue     - programming queue, NULL when the hw tcam is programmed
+ *             synchronously, see hw_tcam_start_async()
+ * lookup    - implementation of the key compare of hw_tcam_lookup(), never
+ *             TCAM_LOOKUP_AUTO
+ * keys      - key memory of the hw tcam, in planes of key_stride words
+ *             aligned on a cache line : key_words planes of the key values
+ *             then key_words planes of the masks. Word w of the value of
+ *             slot i is keys[w * key_stride + i] and word w of its mask is
+ *             keys[(key_words + w) * key_stride + i], so that a lookup
+ *             compares the same word of consecutive slots at once.
+ * key_words - width of the keys in 32 bit words, see hw_tcam_set_key_width()
+ * key_stride- number of words of a plane, the size rounded up to a multiple
+ *             of a cache line
+ * watch     - called after each write with watch_arg, NULL if none
+ */
+typedef struct hw_tcam_ {
+    entry_t *mem;
+    uint32_t size;
+    uint64_t hw_access;
+    uint32_t write_ns;
+    uint64_t coalesced;
+    uint32_t fail_at;
+    struct hw_queue_ *queue;
+    tcam_lookup_impl_t lookup;
+    uint32_t *keys;
+    uint32_t key_words;
+    uint32_t key_stride;
+    tcam_watch_fn_t watch;
+    void *watch_arg;
+} hw_tcam_t;
+
 /*
  * Description :
  *     This is the southbound API which is invoked by the tcam_insert() and
  *     NB API to initialize the HW TCAM
  * Arguments:
  * hw_tcam - hw tcam
+ * mem - memory of the hw tcam
  * size - size of the tcam
  */
 
-void hw_tcam_init() ;
+void hw_tcam_init(hw_tcam_t *hw_tcam, entry_t *mem, uint32_t size) ;
+
+/*
+ * Description :
+ *     Sets the width of the keys of the hw tcam. The key memory is allocated
+ *     again and every key is cleared, so it is meant for an empty hw tcam.
+ *     The keys have no word after hw_tcam_init().
+ * Arguments:
+ * hw_tcam   - hw tcam
+ * key_words - width of the keys in 32 bit words
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t hw_tcam_set_key_width(hw_tcam_t *hw_tcam, uint32_t key_words);
+
+/*
+ * Description :
+ *     Stops the programming queue of the hw tcam and frees its key memory.
+ *     The memory given to hw_tcam_init() belongs to the caller.
+ * Arguments:
+ * hw_tcam - hw tcam
+ */
+void hw_tcam_destroy(hw_tcam_t *hw_tcam);
 
 /* Description
  *   This is the southbound API which implements the HW programming.
@@ -22,10 +84,106 @@ void hw_tcam_init() ;
  *  Arguments
  *  hw_tcam - hardware tcam
  *  ent - contains the id and priority of the entry to be programmed in tcam
+ *  key - value then mask of the key of the entry, key_words words each. NULL
+ *        keeps the key of the slot, to invalidate an entry
  *  position - position where the entry has to be programmed
  * Return: TCAM_ERR_SUCCESS or appropriate error code.
  */
 
-tcam_err_t tcam_program(entry_t *hw_tcam, entry_t *ent, uint32_t position);
-uint64_t tcam_get_hw_access_cnt();
+tcam_err_t tcam_program(hw_tcam_t *hw_tcam, entry_t *ent, const uint32_t *key, uint32_t position);
+
+/* Description
+ *   This is used to get the count for the accesses to the hw tcam .
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ * Return: The number of accesses to hw tcam
+ */
+uint64_t tcam_get_hw_access_cnt(hw_tcam_t *hw_tcam);
+
+/* Description
+ *   Starts programming the hw tcam asynchronously. tcam_program() then only
+ *   queues the write and returns, and a programming thread does the writes
+ *   in the order of the queue, so that the order which keeps the moved
+ *   entries in the hw tcam is kept. A write which would not change the hw
+ *   tcam once the queued writes are done is dropped, and so is a queued
+ *   write which is overwritten by the next write to the queue. When the
+ *   queue is full, tcam_program() waits for the programming thread.
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ *  depth   - number of writes the queue can hold
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t hw_tcam_start_async(hw_tcam_t *hw_tcam, uint32_t depth);
+
+/* Description
+ *   Waits until the queued writes are done and goes back to programming the
+ *   hw tcam synchronously. Nothing is done if the hw tcam is synchronous.
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ */
+void hw_tcam_stop_async(hw_tcam_t *hw_tcam);
+
+/* Description
+ *   Returns a fence for the writes queued so far, to be given to
+ *   hw_tcam_wait().
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ * Return: The fence
+ */
+uint64_t hw_tcam_fence(hw_tcam_t *hw_tcam);
+
+/* Description
+ *   Waits until the writes queued before 'fence' was taken are done in the
+ *   hw tcam.
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ *  fence   - fence returned by hw_tcam_fence()
+ */
+void hw_tcam_wait(hw_tcam_t *hw_tcam, uint64_t fence);
+
+/* Description
+ *   Returns the number of writes done in the hw tcam, counted like
+ *   hw_access. It does not change as long as the content of the hw tcam
+ *   does not, so a lookup result stays valid until it does.
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ * Return: The number of writes done
+ */
+uint64_t hw_tcam_done(hw_tcam_t *hw_tcam);
+
+/* Description
+ *   Looks up a key in the hw tcam like the hardware does : the busy entries
+ *   are compared with the key and the matching entry of the lowest slot,
+ *   which is the one of the highest priority, is returned. The hw tcam is
+ *   read as it is, so with an asynchronous hw tcam only the writes done by
+ *   the programming thread are seen.
+ *  Arguments
+ *  hw_tcam  - hardware tcam
+ *  key      - key of key_words words
+ *  position - filled with the slot of the matching entry
+ * Return: TCAM_ERR_SUCCESS, TCAM_ERR_NO_MATCH if no entry matches the key or
+ *         appropriate error code.
+ */
+tcam_err_t hw_tcam_lookup(hw_tcam_t *hw_tcam, const uint32_t *key, uint32_t *position);
+
+/* Description
+ *   Sets the implementation of the key compare of hw_tcam_lookup(). It is
+ *   TCAM_LOOKUP_AUTO after hw_tcam_init().
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ *  impl    - one of tcam_lookup_impl_t
+ * Return: TCAM_ERR_SUCCESS or TCAM_ERR_EINVAL if the cpu does not support it
+ */
+tcam_err_t hw_tcam_set_lookup(hw_tcam_t *hw_tcam, tcam_lookup_impl_t impl);
+
+/* Description
+ *   Sets the function called after each write to the hw tcam, to follow the
+ *   states it goes through. With a programming queue, it is called by the
+ *   programming thread.
+ *  Arguments
+ *  hw_tcam - hardware tcam
+ *  fn      - function called with 'arg' and the slot written, NULL for none
+ *  arg     - argument of fn
+ */
+void hw_tcam_set_watch(hw_tcam_t *hw_tcam, tcam_watch_fn_t fn, void *arg);
 #endif
@@ -0,0 +1,1315 @@
+/********************************************************************
+ *
+ *      File:   tcam_bench.c
+ *
+ *       Description:
+ *  This  file contains the benchmarks of the TCAM Bank Handler code.
+ *  snapshot - measures the throughput of tcam_snapshot() readers, first on
+ *             an idle bank and then while a writer inserts and deletes
+ *             entries without a pause.
+ *  shard    - measures the insert throughput of the shard manager when the
+ *             same capacity is split in more and more banks.
+ *  async    - measures the latency of the calls when hw_tcam is programmed
+ *             synchronously and through the programming queue, with a
+ *             simulated latency of the writes to hw_tcam.
+ *  scale    - measures the time of single entry insertions which do not
+ *             shift any entry, for growing bank sizes.
+ *  lookup   - measures the throughput of tcam_lookup() in full banks of
+ *             growing sizes, with each key compare the cpu supports and
+ *             with the flow cache, for the default and the widest keys.
+ *  tss      - compares the lookups of the Tuple Space Search classifier
+ *             with the linear match of tcam_lookup() on the same rules, for
+ *             growing numbers of rules and of distinct masks, and the memory
+ *             each one takes.
+ *  workload - runs workloads of priorities and orders of insertion met in
+ *             practice and reports, for each one, the operations per second,
+ *             the writes to hw_tcam per operation, the latency percentiles of
+ *             the calls and the peak memory, as a table, CSV or JSON so that
+ *             versions can be compared.
+ *             The calls of a single workload can be recorded to a trace.
+ *  replay   - replays a trace recorded by tcam_set_trace(), as fast as
+ *             possible or at the recorded pace, and reports the same
+ *             metrics as workload. "-" reads the trace from the standard
+ *             input.
+ *
+ *  Usage: tcam_bench [snapshot [readers] [seconds] | shard [max banks] |
+ *                     async [write ns] | scale | lookup | tss |
+ *                     workload [table|csv|json] [workload|all] [bank size] [fill %]
+ *                              [trace] |
+ *                     replay trace|- [fast|paced] [table|csv|json]]
+ *  Without arguments, all the benchmarks but replay are run with their
+ *  defaults.
+ *
+ *********************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include "tcam_entry_mgr.h"
+#include "tcam_shard_mgr.h"
+#include "tcam_tss.h"
+#include "tcam_trace.h"
+
+#define BENCH_ENTRIES     1024
+#define BENCH_MAX_READERS 64
+#define BENCH_BATCH       32
+
+#define SHARD_CAPACITY    16384
+#define SHARD_FILL        12288
+#define SHARD_MAX_BANKS   16
+
+#define ASYNC_CALLS       4000
+#define ASYNC_DEPTH       4096
+
+#define SCALE_MIN_SIZE    1024
+#define SCALE_MAX_SIZE    262144
+#define SCALE_CALLS       20000
+
+#define LOOKUP_MIN_SIZE   2048
+#define LOOKUP_MAX_SIZE   131072
+#define LOOKUP_COMPARES   (1 << 27)
+#define LOOKUP_KEYS       1024
+#define LOOKUP_FLOW_LOOKUPS (1 << 22)
+
+#define TSS_MIN_RULES     1024
+#define TSS_MAX_RULES     65536
+#define TSS_MAX_MASKS     256
+#define TSS_PRIOS         4096
+#define TSS_LOOKUPS       (1 << 22)
+
+#define WORK_SIZE         4096
+#define WORK_FILL         90
+#define WORK_PRIOS        65536
+#define WORK_ZIPF_PRIOS   4096
+#define WORK_CALLS        20000
+#define WORK_MAX_BURST    256
+
+static entry_t hw_tcam[BENCH_ENTRIES];
+
+typedef struct bench_reader_ {
+    pthread_t thread;
+    void *tcam;
+    volatile int *stop;
+    uint64_t reads;
+    uint64_t torn;
+    double cpu;
+} bench_reader_t;
+
+typedef struct bench_writer_ {
+    pthread_t thread;
+    void *tcam;
+    volatile int *stop;
+    uint64_t batches;
+} bench_writer_t;
+
+static double bench_clock(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Description :
+ *     Takes snapshots of the whole bank until it is stopped. A snapshot whose
+ *     busy slots are not sorted by priority shows the middle of a batch and is
+ *     counted as torn.
+ */
+static void *bench_read(void *arg)
+{
+    bench_reader_t *reader = arg;
+    entry_t buf[BENCH_ENTRIES];
+    int i, last;
+
+    while (!*reader->stop) {
+        tcam_snapshot(reader->tcam, 0, BENCH_ENTRIES, buf, NULL);
+        for (i = 0, last = -1; i < BENCH_ENTRIES; i++) {
+            if (buf[i].id == TCAM_CELL_STATE_EMPTY)
+                continue;
+            if ((last >= 0) && (buf[i].prio < buf[last].prio)) {
+                reader->torn++;
+                break;
+            }
+            last = i;
+        }
+        reader->reads++;
+    }
+    reader->cpu = bench_clock(CLOCK_THREAD_CPUTIME_ID);
+    return NULL;
+}
+
+/* Description :
+ *     Inserts batches of entries and deletes the oldest batch until it is
+ *     stopped, keeping the bank about half full.
+ */
+static void *bench_write(void *arg)
+{
+    bench_writer_t *writer = arg;
+    entry_t entry[BENCH_BATCH];
+    uint32_t next = 1, oldest = 1;
+    int i;
+
+    while (!*writer->stop) {
+        for (i = 0; i < BENCH_BATCH; i++) {
+            entry[i].id = next + i;
+            entry[i].prio = (next + i) * 2654435761u % 256;
+        }
+        tcam_insert(writer->tcam, entry, BENCH_BATCH);
+        next += BENCH_BATCH;
+        while (next - oldest > BENCH_ENTRIES / 2)
+            tcam_remove(writer->tcam, oldest++);
+        writer->batches++;
+    }
+    return NULL;
+}
+
+/* Description :
+ *     Runs 'num' readers, and a writer if 'churn' is set, for 'secs' seconds
+ *     and returns the snapshots per second of all the readers. 'per_cpu' is
+ *     filled with the snapshots per second of cpu time used by the readers,
+ *     which does not depend on how many cpus the writer leaves to them.
+ */
+static double bench_run(void *tcam, int num, int churn, double secs, double *per_cpu,
+                        uint64_t *torn, uint64_t *batches)
+{
+    bench_reader_t readers[BENCH_MAX_READERS];
+    bench_writer_t writer;
+    volatile int stop = 0;
+    uint64_t reads = 0;
+    double start, cpu = 0;
+    int i;
+
+    memset(readers, 0, sizeof(readers));
+    memset(&writer, 0, sizeof(writer));
+    writer.tcam = tcam;
+    writer.stop = &stop;
+    start = bench_clock(CLOCK_MONOTONIC);
+    for (i = 0; i < num; i++) {
+        readers[i].tcam = tcam;
+        readers[i].stop = &stop;
+        pthread_create(&readers[i].thread, NULL, bench_read, &readers[i]);
+    }
+    if (churn)
+        pthread_create(&writer.thread, NULL, bench_write, &writer);
+    usleep(secs * 1e6);
+    stop = 1;
+    for (i = 0; i < num; i++) {
+        pthread_join(readers[i].thread, NULL);
+        reads += readers[i].reads;
+        cpu += readers[i].cpu;
+        *torn += readers[i].torn;
+    }
+    if (churn)
+        pthread_join(writer.thread, NULL);
+    *batches = writer.batches;
+    *per_cpu = reads / cpu;
+    return reads / (bench_clock(CLOCK_MONOTONIC) - start);
+}
+
+/* Description :
+ *     Runs the snapshot benchmark with 'num' readers for 'secs' seconds per
+ *     phase and prints its report to 'out'.
+ * Return: 0 if no snapshot was torn
+ */
+static int bench_snapshot(FILE *out, int num, double secs)
+{
+    uint64_t torn = 0, batches = 0;
+    double idle, busy, idle_cpu, busy_cpu;
+    void *tcam = NULL;
+
+    if ((tcam_init(hw_tcam, BENCH_ENTRIES, &tcam) != TCAM_ERR_SUCCESS) ||
+        (tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE) != TCAM_ERR_SUCCESS)) {
+        fprintf(stderr, "tcam_init failed\n");
+        return 1;
+    }
+    idle = bench_run(tcam, num, FALSE, secs, &idle_cpu, &torn, &batches);
+    busy = bench_run(tcam, num, TRUE, secs, &busy_cpu, &torn, &batches);
+    tcam_cache_destroy(tcam);
+
+    fprintf(out, "snapshot readers   : %d\n", num);
+    fprintf(out, "snapshot size      : %d entries\n", BENCH_ENTRIES);
+    fprintf(out, "cpus               : %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(out, "idle reads/s       : %.0f (%.0f per cpu second)\n", idle, idle_cpu);
+    fprintf(out, "under churn reads/s: %.0f (%.0f per cpu second, %.1f%% of idle)\n", busy,
+            busy_cpu, 100 * busy_cpu / idle_cpu);
+    fprintf(out, "writer batches/s   : %.0f (%d entries inserted and deleted each)\n",
+            batches / secs, BENCH_BATCH);
+    fprintf(out, "torn snapshots     : %llu\n", (unsigned long long) torn);
+    return (torn == 0) ? 0 : 1;
+}
+
+/* Description :
+ *     Fills SHARD_FILL of SHARD_CAPACITY slots split in 1, 2, 4 ... 'max'
+ *     banks, by batches of random priorities, and prints the insert
+ *     throughput and the writes to the banks per entry to 'out'.
+ * Return: 0 if all the inserts succeeded
+ */
+static int bench_shard(FILE *out, int max)
+{
+    entry_t *hw_ptrs[SHARD_MAX_BANKS];
+    uint32_t sizes[SHARD_MAX_BANKS];
+    entry_t entry[BENCH_BATCH];
+    tcam_stats_t stats;
+    uint64_t writes;
+    double start, secs;
+    void *mgr, *tcam;
+    int banks, b, i, n;
+
+    fprintf(out, "shard: %d entries into %d slots, batches of %d, %ld cpus\n", SHARD_FILL,
+            SHARD_CAPACITY, BENCH_BATCH, sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(out, "%6s %12s %12s %14s\n", "banks", "bank size", "entries/s", "writes/entry");
+    for (banks = 1; banks <= max; banks *= 2) {
+        for (b = 0; b < banks; b++) {
+            sizes[b] = SHARD_CAPACITY / banks;
+            hw_ptrs[b] = calloc(sizes[b], sizeof(entry_t));
+        }
+        if (tcam_shard_init(hw_ptrs, sizes, banks, 65535, &mgr) != TCAM_ERR_SUCCESS) {
+            fprintf(stderr, "tcam_shard_init failed\n");
+            return 1;
+        }
+        for (b = 0; b < banks; b++) {
+            tcam_shard_get_bank(mgr, b, &tcam);
+            tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE);
+        }
+        srand(1);
+        start = bench_clock(CLOCK_MONOTONIC);
+        for (n = 0; n < SHARD_FILL; n += BENCH_BATCH) {
+            for (i = 0; i < BENCH_BATCH; i++) {
+                entry[i].id = n + i + 1;
+                entry[i].prio = rand() % 65536;
+            }
+            if (tcam_shard_insert(mgr, entry, BENCH_BATCH) != TCAM_ERR_SUCCESS) {
+                fprintf(stderr, "tcam_shard_insert failed\n");
+                return 1;
+            }
+        }
+        secs = bench_clock(CLOCK_MONOTONIC) - start;
+        for (b = 0, writes = 0; b < banks; b++) {
+            tcam_shard_get_bank(mgr, b, &tcam);
+            tcam_get_stats(tcam, &stats);
+            writes += stats.insert_hw_writes;
+        }
+        fprintf(out, "%6d %12d %12.0f %14.2f\n", banks, SHARD_CAPACITY / banks, SHARD_FILL / secs,
+                (double) writes / SHARD_FILL);
+        tcam_shard_destroy(mgr);
+        for (b = 0; b < banks; b++)
+            free(hw_ptrs[b]);
+    }
+    return 0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* Description :
+ *     Replaces entries of a half full bank one by one, a deletion and an
+ *     insertion with the same priority or with a new one, with hw_tcam
+ *     programmed synchronously and then through a queue of ASYNC_DEPTH writes.
+ *     Prints the latency of the calls, the time until the last fence is
+ *     reached and the writes coalesced by the queue to 'out'.
+ * Return: 0 if all the calls succeeded
+ */
+static int bench_async(FILE *out, uint32_t write_ns)
+{
+    static double lat[2 * ASYNC_CALLS];
+    entry_t entry[BENCH_ENTRIES / 2];
+    tcam_stats_t stats;
+    uint64_t fence, requests;
+    double start, t, total;
+    void *tcam;
+    int run, async, new_prio, i;
+
+    fprintf(out, "async: %d replacements in a half full bank of %d, %u ns per write, %ld cpus\n",
+            ASYNC_CALLS, BENCH_ENTRIES, write_ns, sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(out, "%6s %9s %10s %10s %10s %12s %12s\n", "mode", "priority", "p50 us", "p99 us",
+            "max us", "total ms", "coalesced");
+    for (run = 0; run < 4; run++) {
+        async = run % 2;
+        new_prio = run / 2;
+        if ((tcam_init(hw_tcam, BENCH_ENTRIES, &tcam) != TCAM_ERR_SUCCESS) ||
+            (tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE) != TCAM_ERR_SUCCESS) ||
+            (tcam_set_option(tcam, TCAM_OPT_ASYNC_DEPTH, async ? ASYNC_DEPTH : 0) != TCAM_ERR_SUCCESS)) {
+            fprintf(stderr, "tcam_init failed\n");
+            return 1;
+        }
+        srand(1);
+        for (i = 0; i < BENCH_ENTRIES / 2; i++) {
+            entry[i].id = i + 1;
+            entry[i].prio = rand() % 64;
+        }
+        tcam_insert(tcam, entry, BENCH_ENTRIES / 2);
+        tcam_fence(tcam, &fence);
+        tcam_fence_wait(tcam, fence);
+        tcam_set_option(tcam, TCAM_OPT_HW_WRITE_NS, write_ns);
+        tcam_get_stats(tcam, &stats);
+        requests = stats.coalesced_writes;
+
+        start = bench_clock(CLOCK_MONOTONIC);
+        for (i = 0; i < ASYNC_CALLS; i++) {
+            entry_t *ent = &entry[rand() % (BENCH_ENTRIES / 2)];
+
+            t = bench_clock(CLOCK_MONOTONIC);
+            if (tcam_remove(tcam, ent->id) != TCAM_ERR_SUCCESS) {
+                fprintf(stderr, "tcam_remove failed\n");
+                return 1;
+            }
+            lat[2 * i] = bench_clock(CLOCK_MONOTONIC) - t;
+            ent->id += BENCH_ENTRIES / 2;
+            if (new_prio)
+                ent->prio = rand() % 64;
+            t = bench_clock(CLOCK_MONOTONIC);
+            if (tcam_insert(tcam, ent, 1) != TCAM_ERR_SUCCESS) {
+                fprintf(stderr, "tcam_insert failed\n");
+                return 1;
+            }
+            lat[2 * i + 1] = bench_clock(CLOCK_MONOTONIC) - t;
+        }
+        tcam_fence(tcam, &fence);
+        tcam_fence_wait(tcam, fence);
+        total = bench_clock(CLOCK_MONOTONIC) - start;
+        tcam_get_stats(tcam, &stats);
+        tcam_cache_destroy(tcam);
+
+        qsort(lat, 2 * ASYNC_CALLS, sizeof(double), cmp_double);
+        fprintf(out, "%6s %9s %10.1f %10.1f %10.1f %12.1f %12llu\n", async ? "async" : "sync",
+                new_prio ? "new" : "same", lat[ASYNC_CALLS] * 1e6, lat[2 * ASYNC_CALLS * 99 / 100] * 1e6,
+                lat[2 * ASYNC_CALLS - 1] * 1e6, total * 1e3,
+                (unsigned long long) (stats.coalesced_writes - requests));
+    }
+    return 0;
+}
+
+/* Description :
+ *     Fills half of banks of SCALE_MIN_SIZE to SCALE_MAX_SIZE slots with
+ *     groups of two entries, then replaces the first entry of a group by a
+ *     new entry of the same priority, which takes the slot left empty without
+ *     shifting anything. Prints the time of the insertions to 'out', which
+ *     should not depend on the bank size.
+ * Return: 0 if all the calls succeeded
+ */
+static int bench_scale(FILE *out)
+{
+    entry_t *mem, *entry, ent;
+    double start, secs;
+    uint32_t size, i, k;
+    void *tcam;
+
+    fprintf(out, "scale: %d single entry insertions into half full banks\n", SCALE_CALLS);
+    fprintf(out, "%10s %14s\n", "bank size", "ns/insert");
+    for (size = SCALE_MIN_SIZE; size <= SCALE_MAX_SIZE; size *= 4) {
+        mem = calloc(size, sizeof(entry_t));
+        entry = calloc(size / 2, sizeof(entry_t));
+        if ((mem == NULL) || (entry == NULL) || (tcam_init(mem, size, &tcam) != TCAM_ERR_SUCCESS) ||
+            (tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE) != TCAM_ERR_SUCCESS)) {
+            fprintf(stderr, "tcam_init failed\n");
+            return 1;
+        }
+        // the latest entry of a batch is the first of its group
+        for (i = 0; i < size / 2; i++) {
+            entry[i].id = i + 1;
+            entry[i].prio = i / 2;
+        }
+        tcam_insert(tcam, entry, size / 2);
+        srand(1);
+        secs = 0;
+        for (k = 0; k < SCALE_CALLS; k++) {
+            i = 2 * (rand() % (size / 4)) + 1;
+            tcam_remove(tcam, entry[i].id);
+            entry[i].id += size / 2;
+            ent = entry[i];
+            start = bench_clock(CLOCK_MONOTONIC);
+            if (tcam_insert(tcam, &ent, 1) != TCAM_ERR_SUCCESS) {
+                fprintf(stderr, "tcam_insert failed\n");
+                return 1;
+            }
+            secs += bench_clock(CLOCK_MONOTONIC) - start;
+        }
+        fprintf(out, "%10u %14.0f\n", size, secs * 1e9 / SCALE_CALLS);
+        tcam_cache_destroy(tcam);
+        free(entry);
+        free(mem);
+    }
+    return 0;
+}
+
+/* Description :
+ *     Looks up 'n' times keys matching the entries 'pick' in turn, then n / 2
+ *     times the key after the last entry, which matches none, in a full bank
+ *     of 'size' entries whose keys are 'keys'. The keys are looked up once
+ *     before, to fill the flow cache. Prints a row of the lookups per second
+ *     to 'out', named 'name'.
+ * Return: 0 if all the lookups returned the expected entry
+ */
+static int bench_lookup_rates(FILE *out, void *tcam, const char *name, uint32_t *keys,
+                              uint32_t *pick, uint32_t size, uint32_t words, uint32_t n)
+{
+    uint32_t i, position;
+    entry_t ent;
+    double start, hit_secs, miss_secs;
+
+    for (i = 0; i <= LOOKUP_KEYS; i++)
+        tcam_lookup(tcam, &keys[((i < LOOKUP_KEYS) ? pick[i] : size) * 2 * words], NULL, &position);
+    start = bench_clock(CLOCK_MONOTONIC);
+    for (i = 0; i < n; i++) {
+        if ((tcam_lookup(tcam, &keys[pick[i % LOOKUP_KEYS] * 2 * words], &ent, &position) !=
+             TCAM_ERR_SUCCESS) || (ent.id != pick[i % LOOKUP_KEYS] + 1)) {
+            fprintf(stderr, "tcam_lookup failed\n");
+            return 1;
+        }
+    }
+    hit_secs = (bench_clock(CLOCK_MONOTONIC) - start) / n;
+    n /= 2;
+    start = bench_clock(CLOCK_MONOTONIC);
+    for (i = 0; i < n; i++) {
+        if (tcam_lookup(tcam, &keys[size * 2 * words], NULL, &position) != TCAM_ERR_NO_MATCH) {
+            fprintf(stderr, "tcam_lookup failed\n");
+            return 1;
+        }
+    }
+    miss_secs = (bench_clock(CLOCK_MONOTONIC) - start) / n;
+    fprintf(out, "%10u %8s %14.0f %14.0f\n", size, name, 1 / hit_secs, 1 / miss_secs);
+    return 0;
+}
+
+/* Description :
+ *     Fills banks of LOOKUP_MIN_SIZE to LOOKUP_MAX_SIZE slots with entries
+ *     whose first key word tells them apart and whose other words are
+ *     compared on half of their bits, for keys of 'bits' bits. Then looks up
+ *     keys matching random entries, which scans half of the bank on average,
+ *     and a key matching none, which scans all of it, with every key compare
+ *     the cpu supports and then through the flow cache. Prints the lookups
+ *     per second to 'out'.
+ * Return: 0 if all the lookups returned the expected entry
+ */
+static int bench_lookup(FILE *out, uint32_t bits)
+{
+    static const char *names[] = {"auto", "scalar", "sse2", "avx2"};
+    uint32_t words = bits / 32, size, i, w, *keys, *pick, *k;
+    entry_t *mem, *entry;
+    int impl;
+    void *tcam;
+
+    fprintf(out, "lookup: %u bit keys in full banks, lookups per second\n", bits);
+    fprintf(out, "%10s %8s %14s %14s\n", "bank size", "compare", "hit", "miss");
+    pick = malloc(LOOKUP_KEYS * sizeof(uint32_t));
+    for (size = LOOKUP_MIN_SIZE; size <= LOOKUP_MAX_SIZE; size *= 4) {
+        mem = calloc(size, sizeof(entry_t));
+        entry = calloc(size + 1, sizeof(entry_t));
+        keys = malloc((size + 1) * 2 * words * sizeof(uint32_t));
+        if ((pick == NULL) || (mem == NULL) || (entry == NULL) || (keys == NULL) ||
+            (tcam_init(mem, size, &tcam) != TCAM_ERR_SUCCESS) ||
+            (tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE) != TCAM_ERR_SUCCESS) ||
+            (tcam_set_option(tcam, TCAM_OPT_KEY_BITS, bits) != TCAM_ERR_SUCCESS)) {
+            fprintf(stderr, "tcam_init failed\n");
+            return 1;
+        }
+        // the key after the last entry matches none
+        srand(1);
+        for (i = 0; i <= size; i++) {
+            k = &keys[i * 2 * words];
+            entry[i].id = i + 1;
+            entry[i].prio = i / 4;
+            k[0] = i;
+            k[words] = 0xffffffff;
+            for (w = 1; w < words; w++) {
+                k[w] = rand();
+                k[words + w] = 0xff00ff00;
+            }
+        }
+        if (tcam_insert_keys(tcam, entry, keys, size) != TCAM_ERR_SUCCESS) {
+            fprintf(stderr, "tcam_insert failed\n");
+            return 1;
+        }
+        for (i = 0; i < LOOKUP_KEYS; i++)
+            pick[i] = rand() % size;
+
+        for (impl = TCAM_LOOKUP_SCALAR; impl <= TCAM_LOOKUP_AVX2; impl++) {
+            if ((tcam_set_option(tcam, TCAM_OPT_LOOKUP, impl) == TCAM_ERR_SUCCESS) &&
+                bench_lookup_rates(out, tcam, names[impl], keys, pick, size, words,
+                                   2 * (LOOKUP_COMPARES / size)))
+                return 1;
+        }
+        // the picked keys all fit in the flow cache, with room for the
+        // uneven spread over the sets
+        if ((tcam_set_option(tcam, TCAM_OPT_LOOKUP, TCAM_LOOKUP_AUTO) != TCAM_ERR_SUCCESS) ||
+            (tcam_set_option(tcam, TCAM_OPT_FLOW_CACHE, 8 * LOOKUP_KEYS) != TCAM_ERR_SUCCESS) ||
+            bench_lookup_rates(out, tcam, "flow", keys, pick, size, words, LOOKUP_FLOW_LOOKUPS))
+            return 1;
+        tcam_cache_destroy(tcam);
+        free(keys);
+        free(entry);
+        free(mem);
+    }
+    free(pick);
+    return 0;
+}
+
+/* Description :
+ *     Fills banks of TSS_MIN_RULES to TSS_MAX_RULES rules with TCAM_KEY_BITS
+ *     bit keys, whose masks are prefixes of random lengths on each word,
+ *     taken from a few to TSS_MAX_MASKS distinct masks, and whose priorities
+ *     are random. The same rules are put in a Tuple Space Search classifier.
+ *     Then looks up keys matching random rules in both and prints the
+ *     lookups per second and the memory of the rules in each to 'out'. The
+ *     memory of the linear match is the one of the entries and of their keys
+ *     in hw_tcam.
+ * Return: 0 if both returned a rule of the same priority for every key
+ */
+static int bench_tss(FILE *out)
+{
+    uint32_t words = TCAM_KEY_BITS / 32, size, masks, i, w, n, position;
+    uint32_t *mask_set, *keys, *key, *pick, *k;
+    entry_t *mem, *entry, ent, tss_ent;
+    double start, linear_secs, tss_secs;
+    tcam_tss_stats_t stats;
+    void *tcam, *tss;
+
+    fprintf(out, "tss: %u bit keys, random priorities, lookups per second and bytes\n", TCAM_KEY_BITS);
+    fprintf(out, "%8s %6s %6s %12s %12s %12s %12s\n", "rules", "masks", "tuples", "linear", "tss",
+            "linear mem", "tss mem");
+    mask_set = malloc(TSS_MAX_MASKS * words * sizeof(uint32_t));
+    pick = malloc(LOOKUP_KEYS * sizeof(uint32_t));
+    key = malloc(LOOKUP_KEYS * words * sizeof(uint32_t));
+    for (size = TSS_MIN_RULES; size <= TSS_MAX_RULES; size *= 8) {
+        for (masks = 4; masks <= TSS_MAX_MASKS; masks *= 4) {
+            mem = calloc(size, sizeof(entry_t));
+            entry = calloc(size, sizeof(entry_t));
+            keys = malloc(size * 2 * words * sizeof(uint32_t));
+            if ((mask_set == NULL) || (pick == NULL) || (key == NULL) || (mem == NULL) ||
+                (entry == NULL) || (keys == NULL) || (tcam_init(mem, size, &tcam) != TCAM_ERR_SUCCESS) ||
+                (tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE) != TCAM_ERR_SUCCESS) ||
+                (tcam_tss_init(TCAM_KEY_BITS, &tss) != TCAM_ERR_SUCCESS)) {
+                fprintf(stderr, "tcam_init failed\n");
+                return 1;
+            }
+            srand(size + masks);
+            for (i = 0; i < masks * words; i++)
+                mask_set[i] = (rand() % 4) ? ~0U << (rand() % 32) : 0;
+            for (i = 0; i < size; i++) {
+                k = &keys[i * 2 * words];
+                entry[i].id = i + 1;
+                entry[i].prio = rand() % TSS_PRIOS;
+                memcpy(&k[words], &mask_set[(rand() % masks) * words], words * sizeof(uint32_t));
+                for (w = 0; w < words; w++)
+                    k[w] = rand() & k[words + w];
+            }
+            if (tcam_insert_keys(tcam, entry, keys, size) != TCAM_ERR_SUCCESS) {
+                fprintf(stderr, "tcam_insert failed\n");
+                return 1;
+            }
+            for (i = 0; i < size; i++) {
+                if (tcam_tss_insert(tss, &entry[i], &keys[i * 2 * words]) != TCAM_ERR_SUCCESS) {
+                    fprintf(stderr, "tcam_tss_insert failed\n");
+                    return 1;
+                }
+            }
+            // keys matching a rule, the bits out of its mask are random
+            for (i = 0; i < LOOKUP_KEYS; i++) {
+                pick[i] = rand() % size;
+                k = &keys[pick[i] * 2 * words];
+                for (w = 0; w < words; w++)
+                    key[i * words + w] = k[w] | (rand() & ~k[words + w]);
+                if ((tcam_lookup(tcam, &key[i * words], &ent, &position) != TCAM_ERR_SUCCESS) ||
+                    (tcam_tss_lookup(tss, &key[i * words], &tss_ent) != TCAM_ERR_SUCCESS) ||
+                    (ent.prio != tss_ent.prio)) {
+                    fprintf(stderr, "tcam_tss_lookup failed\n");
+                    return 1;
+                }
+            }
+            n = 2 * (LOOKUP_COMPARES / size);
+            start = bench_clock(CLOCK_MONOTONIC);
+            for (i = 0; i < n; i++)
+                tcam_lookup(tcam, &key[(i % LOOKUP_KEYS) * words], NULL, &position);
+            linear_secs = (bench_clock(CLOCK_MONOTONIC) - start) / n;
+            // a lookup probes up to one hash table per mask
+            n = TSS_LOOKUPS / masks;
+            start = bench_clock(CLOCK_MONOTONIC);
+            for (i = 0; i < n; i++)
+                tcam_tss_lookup(tss, &key[(i % LOOKUP_KEYS) * words], &tss_ent);
+            tss_secs = (bench_clock(CLOCK_MONOTONIC) - start) / n;
+            tcam_tss_get_stats(tss, &stats);
+            fprintf(out, "%8u %6u %6u %12.0f %12.0f %12llu %12llu\n", size, masks, stats.tuples,
+                    1 / linear_secs, 1 / tss_secs,
+                    (unsigned long long) size * (sizeof(entry_t) + 2 * words * sizeof(uint32_t)),
+                    (unsigned long long) stats.bytes);
+            tcam_tss_destroy(tss);
+            tcam_cache_destroy(tcam);
+            free(keys);
+            free(entry);
+            free(mem);
+        }
+    }
+    free(key);
+    free(pick);
+    free(mask_set);
+    return 0;
+}
+
+/* Workloads of bench_workload(), see work_run() */
+enum {
+    WORK_UNIFORM,
+    WORK_ZIPF,
+    WORK_ASCENDING,
+    WORK_DESCENDING,
+    WORK_HOT_GROUP,
+    WORK_CHURN,
+    WORK_BURST,
+    WORK_COUNT
+};
+
+static const char *work_names[] = {"uniform", "zipf", "ascending", "descending", "hot-group",
+                                   "churn", "burst"};
+
+/* Output formats of bench_workload() */
+enum {
+    WORK_TABLE,
+    WORK_CSV,
+    WORK_JSON
+};
+
+/* Result of a workload, see work_run()
+ * ops    - number of entries inserted and deleted while measured
+ * secs   - time taken by these operations
+ * writes - number of writes to hw_tcam done by them
+ * insert - latency of the calls to tcam_insert()
+ * remove - latency of the calls to tcam_remove() and tcam_remove_batch()
+ * rss_kb - peak resident memory of the process so far, in KiB
+ */
+typedef struct work_result_ {
+    uint64_t ops;
+    double secs;
+    uint64_t writes;
+    tcam_latency_t insert;
+    tcam_latency_t remove;
+    long rss_kb;
+} work_result_t;
+
+/* Ids of entries of a bank, deleted in a random order */
+typedef struct work_list_ {
+    uint32_t *ids;
+    uint32_t num;
+} work_list_t;
+
+/* Returns a priority drawn from the Zipf distribution of exponent 1 over
+ * WORK_ZIPF_PRIOS priorities, whose cumulative distribution is 'cdf'. The
+ * priorities are spread over the priority space so that the large groups
+ * are not next to each other.
+ */
+static uint32_t work_zipf(const double *cdf)
+{
+    double u = rand() / (RAND_MAX + 1.0);
+    uint32_t lo = 0, hi = WORK_ZIPF_PRIOS - 1, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (lo * 2654435761u) % WORK_PRIOS;
+}
+
+/* Inserts 'num' entries of the priorities 'prios' in one call and adds them
+ * to 'list'. 'next_id' is the id of the first one.
+ */
+static int work_insert(void *tcam, work_list_t *list, uint32_t *next_id, const uint32_t *prios,
+                       uint32_t num)
+{
+    entry_t entry[WORK_MAX_BURST];
+    uint32_t i;
+
+    for (i = 0; i < num; i++) {
+        entry[i].id = (*next_id)++;
+        entry[i].prio = prios[i];
+    }
+    if (tcam_insert(tcam, entry, num) != TCAM_ERR_SUCCESS) {
+        fprintf(stderr, "tcam_insert failed\n");
+        return 1;
+    }
+    for (i = 0; i < num; i++)
+        list->ids[list->num++] = entry[i].id;
+    return 0;
+}
+
+/* Deletes 'num' random entries of 'list', one by one or in one call if
+ * 'batch' is set.
+ */
+static int work_remove(void *tcam, work_list_t *list, uint32_t num, int batch)
+{
+    uint32_t ids[WORK_MAX_BURST], i, k;
+
+    for (i = 0; i < num; i++) {
+        k = rand() % list->num;
+        ids[i] = list->ids[k];
+        list->ids[k] = list->ids[--list->num];
+        if (!batch && (tcam_remove(tcam, ids[i]) != TCAM_ERR_SUCCESS)) {
+            fprintf(stderr, "tcam_remove failed\n");
+            return 1;
+        }
+    }
+    if (batch && (tcam_remove_batch(tcam, ids, num, NULL) != TCAM_ERR_SUCCESS)) {
+        fprintf(stderr, "tcam_remove_batch failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+/* Prints the header of the rows of work_print() in 'format' */
+static void work_header(FILE *out, int format)
+{
+    if (format == WORK_TABLE) {
+        fprintf(out, "%-10s %8s %12s %9s %8s %8s %8s %8s %8s %8s %10s\n", "workload", "ops",
+                "ops/s", "writes/op", "ins p50", "ins p99", "ins p999", "rem p50", "rem p99",
+                "rem p999", "rss KiB");
+    } else if (format == WORK_CSV) {
+        fprintf(out, "workload,size,fill,ops,ops_per_sec,writes_per_op,insert_p50_ns,insert_p99_ns,"
+                "insert_p999_ns,remove_p50_ns,remove_p99_ns,remove_p999_ns,peak_rss_kb\n");
+    } else {
+        fprintf(out, "[");
+    }
+}
+
+/* Prints the result 'res' of the workload 'name' in a bank of 'size' slots
+ * filled to 'fill' percent, as the row number 'row' in 'format'. The JSON
+ * array is closed by the caller.
+ */
+static void work_print(FILE *out, int format, int row, const char *name, uint32_t size,
+                       uint32_t fill, const work_result_t *res)
+{
+    double rate = (res->secs > 0) ? res->ops / res->secs : 0;
+    double writes = (res->ops > 0) ? (double) res->writes / res->ops : 0;
+
+    if (format == WORK_TABLE) {
+        fprintf(out, "%-10s %8llu %12.0f %9.2f %8llu %8llu %8llu %8llu %8llu %8llu %10ld\n",
+                name, (unsigned long long) res->ops, rate, writes,
+                (unsigned long long) res->insert.p50, (unsigned long long) res->insert.p99,
+                (unsigned long long) res->insert.p999, (unsigned long long) res->remove.p50,
+                (unsigned long long) res->remove.p99, (unsigned long long) res->remove.p999,
+                res->rss_kb);
+    } else if (format == WORK_CSV) {
+        fprintf(out, "%s,%u,%u,%llu,%.0f,%.3f,%llu,%llu,%llu,%llu,%llu,%llu,%ld\n",
+                name, size, fill, (unsigned long long) res->ops, rate, writes,
+                (unsigned long long) res->insert.p50, (unsigned long long) res->insert.p99,
+                (unsigned long long) res->insert.p999, (unsigned long long) res->remove.p50,
+                (unsigned long long) res->remove.p99, (unsigned long long) res->remove.p999,
+                res->rss_kb);
+    } else {
+        fprintf(out, "%s\n  {\"workload\": \"%s\", \"size\": %u, \"fill\": %u, \"ops\": %llu, "
+                "\"ops_per_sec\": %.0f, \"writes_per_op\": %.3f,\n"
+                "   \"insert_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu}, "
+                "\"remove_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu}, "
+                "\"peak_rss_kb\": %ld}", row ? "," : "",
+                name, size, fill, (unsigned long long) res->ops, rate, writes,
+                (unsigned long long) res->insert.p50, (unsigned long long) res->insert.p99,
+                (unsigned long long) res->insert.p999, (unsigned long long) res->remove.p50,
+                (unsigned long long) res->remove.p99, (unsigned long long) res->remove.p999,
+                res->rss_kb);
+    }
+    fflush(out);
+}
+
+/* Description :
+ *     Runs the workload 'work' in a bank of 'size' slots filled to 'fill'
+ *     percent and fills 'res' with what was measured:
+ *     uniform    - installs the entries one by one with random priorities
+ *     zipf       - the same with the priorities of a Zipf distribution, a
+ *                  few large groups and many small ones
+ *     ascending  - installs the entries one by one, each after the others
+ *     descending - installs the entries one by one, each before the others
+ *     hot-group  - a quarter of the entries of the filled bank have the same
+ *                  priority, then WORK_CALLS times one of them is replaced
+ *                  by a new entry of that priority
+ *     churn      - WORK_CALLS times a random entry of the filled bank is
+ *                  replaced by an entry of a random priority
+ *     burst      - batches of 1 to WORK_MAX_BURST entries of random
+ *                  priorities are inserted into the filled bank, each one
+ *                  after a batch deletion of the random entries it would not
+ *                  fit without, until WORK_CALLS entries were inserted
+ *     The installations are measured, and for the others only what follows
+ *     the filling of the bank. The calls are recorded to 'trace' if it is
+ *     not NULL, see tcam_set_trace().
+ * Return: 0 if all the calls succeeded
+ */
+static int work_run(int work, uint32_t size, uint32_t fill, const double *zipf_cdf,
+                    FILE *trace, work_result_t *res)
+{
+    uint32_t prios[WORK_MAX_BURST], target = (uint64_t) size * fill / 100, next_id = 1;
+    uint32_t i, n, num, excess;
+    work_list_t list, hot, *pick;
+    struct rusage usage;
+    tcam_stats_t stats;
+    entry_t *mem;
+    double start;
+    void *tcam;
+
+    memset(res, 0, sizeof(*res));
+    mem = calloc(size, sizeof(entry_t));
+    list.ids = malloc(size * sizeof(uint32_t));
+    hot.ids = malloc(size * sizeof(uint32_t));
+    list.num = hot.num = 0;
+    if ((mem == NULL) || (list.ids == NULL) || (hot.ids == NULL) ||
+        (tcam_init(mem, size, &tcam) != TCAM_ERR_SUCCESS) ||
+        (tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE) != TCAM_ERR_SUCCESS)) {
+        fprintf(stderr, "tcam_init failed\n");
+        return 1;
+    }
+    if ((trace != NULL) && (tcam_set_trace(tcam, trace) != TCAM_ERR_SUCCESS)) {
+        fprintf(stderr, "tcam_set_trace failed\n");
+        return 1;
+    }
+    srand(1);
+    if (work >= WORK_HOT_GROUP) {
+        for (i = 0; i < target; i++) {
+            pick = ((work == WORK_HOT_GROUP) && (i % 4 == 0)) ? &hot : &list;
+            prios[0] = (pick == &hot) ? WORK_PRIOS / 2 : rand() % WORK_PRIOS;
+            if (work_insert(tcam, pick, &next_id, prios, 1))
+                return 1;
+        }
+    }
+    if (tcam_set_option(tcam, TCAM_OPT_LATENCY, 1) != TCAM_ERR_SUCCESS) {
+        fprintf(stderr, "tcam_set_option failed\n");
+        return 1;
+    }
+    tcam_get_stats(tcam, &stats);
+    res->writes = stats.hw_writes;
+
+    start = bench_clock(CLOCK_MONOTONIC);
+    switch (work) {
+    case WORK_UNIFORM:
+    case WORK_ZIPF:
+    case WORK_ASCENDING:
+    case WORK_DESCENDING:
+        for (i = 0; i < target; i++) {
+            if (work == WORK_UNIFORM)
+                prios[0] = rand() % WORK_PRIOS;
+            else if (work == WORK_ZIPF)
+                prios[0] = work_zipf(zipf_cdf);
+            else if (work == WORK_ASCENDING)
+                prios[0] = (uint64_t) i * WORK_PRIOS / target;
+            else
+                prios[0] = (uint64_t) (target - 1 - i) * WORK_PRIOS / target;
+            if (work_insert(tcam, &list, &next_id, prios, 1))
+                return 1;
+        }
+        res->ops = target;
+        break;
+    case WORK_HOT_GROUP:
+    case WORK_CHURN:
+        pick = (work == WORK_HOT_GROUP) ? &hot : &list;
+        for (n = 0; n < WORK_CALLS; n++) {
+            prios[0] = (pick == &hot) ? WORK_PRIOS / 2 : rand() % WORK_PRIOS;
+            if (work_remove(tcam, pick, 1, FALSE) || work_insert(tcam, pick, &next_id, prios, 1))
+                return 1;
+        }
+        res->ops = 2 * WORK_CALLS;
+        break;
+    case WORK_BURST:
+        for (n = 0; n < WORK_CALLS; n += num) {
+            num = 1 + rand() % ((target < WORK_MAX_BURST) ? target : WORK_MAX_BURST);
+            if (list.num + num > target) {
+                excess = list.num + num - target;
+                if (work_remove(tcam, &list, excess, TRUE))
+                    return 1;
+                res->ops += excess;
+            }
+            for (i = 0; i < num; i++)
+                prios[i] = rand() % WORK_PRIOS;
+            if (work_insert(tcam, &list, &next_id, prios, num))
+                return 1;
+            res->ops += num;
+        }
+        break;
+    }
+    res->secs = bench_clock(CLOCK_MONOTONIC) - start;
+
+    tcam_get_stats(tcam, &stats);
+    res->writes = stats.hw_writes - res->writes;
+    tcam_get_latency(tcam, TCAM_LAT_INSERT, &res->insert);
+    tcam_get_latency(tcam, TCAM_LAT_REMOVE, &res->remove);
+    if ((trace != NULL) && (tcam_set_trace(tcam, NULL) != TCAM_ERR_SUCCESS)) {
+        fprintf(stderr, "the trace could not be written\n");
+        return 1;
+    }
+    tcam_cache_destroy(tcam);
+    free(hot.ids);
+    free(list.ids);
+    free(mem);
+    getrusage(RUSAGE_SELF, &usage);
+    res->rss_kb = usage.ru_maxrss;
+    return 0;
+}
+
+/* Description :
+ *     Runs every workload of work_run(), or only the one named 'name' if it
+ *     is not NULL, in a bank of 'size' slots filled to 'fill' percent.
+ *     Prints a row per workload to 'out', as a table, CSV or JSON according
+ *     to 'format', with the entries inserted or deleted per second, the
+ *     writes to hw_tcam per entry, the latency of the calls in nanoseconds
+ *     and the peak resident memory of the process. The calls of the workload
+ *     named are recorded to the file 'trace_path' if it is not NULL, to be
+ *     replayed by bench_replay().
+ * Return: 0 if all the calls succeeded
+ */
+static int bench_workload(FILE *out, int format, const char *name, uint32_t size, uint32_t fill,
+                          const char *trace_path)
+{
+    FILE *trace = NULL;
+    double *zipf_cdf, sum = 0;
+    work_result_t res;
+    int work, rows = 0;
+    uint32_t r;
+
+    for (work = 0; (name != NULL) && (work < WORK_COUNT) && strcmp(name, work_names[work]); work++)
+        ;
+    if (work == WORK_COUNT) {
+        fprintf(stderr, "unknown workload %s\n", name);
+        return 1;
+    }
+    if ((trace_path != NULL) && ((trace = fopen(trace_path, "wb")) == NULL)) {
+        fprintf(stderr, "cannot write %s\n", trace_path);
+        return 1;
+    }
+    if ((zipf_cdf = malloc(WORK_ZIPF_PRIOS * sizeof(double))) == NULL)
+        return 1;
+    for (r = 0; r < WORK_ZIPF_PRIOS; r++)
+        zipf_cdf[r] = (sum += 1.0 / (r + 1));
+    for (r = 0; r < WORK_ZIPF_PRIOS; r++)
+        zipf_cdf[r] /= sum;
+
+    if (format == WORK_TABLE)
+        fprintf(out, "workload: bank of %u slots filled to %u%%, latency in ns\n", size, fill);
+    work_header(out, format);
+    for (work = 0; work < WORK_COUNT; work++) {
+        if ((name != NULL) && strcmp(name, work_names[work]))
+            continue;
+        if (work_run(work, size, fill, zipf_cdf, trace, &res)) {
+            free(zipf_cdf);
+            return 1;
+        }
+        work_print(out, format, rows, work_names[work], size, fill, &res);
+        rows++;
+    }
+    if (format == WORK_JSON)
+        fprintf(out, "\n]\n");
+    free(zipf_cdf);
+    if ((trace != NULL) && (fclose(trace) != 0)) {
+        fprintf(stderr, "cannot write %s\n", trace_path);
+        return 1;
+    }
+    return 0;
+}
+
+/* State of the replay of a bank, see bench_replay()
+ * secs_start - time the measure started, after the entries of the bank at
+ *              the start of the recording were inserted
+ * pace_start - time the bank was created, which the recorded times of its
+ *              calls are relative to
+ * rec_start  - recorded time of the creation of the bank
+ * key_words  - number of words of a value or a mask of the keys of the bank
+ */
+typedef struct replay_bank_ {
+    void *tcam;
+    entry_t *mem;
+    uint32_t size;
+    uint32_t key_words;
+    double secs_start;
+    double pace_start;
+    uint64_t rec_start;
+    uint64_t writes;
+    work_result_t res;
+} replay_bank_t;
+
+/* Ends the replay of the bank 'rb' and prints its row number 'row' */
+static void replay_end(FILE *out, int format, int row, replay_bank_t *rb)
+{
+    struct rusage usage;
+    tcam_stats_t stats;
+    tcam_frag_t frag;
+
+    rb->res.secs = bench_clock(CLOCK_MONOTONIC) - rb->secs_start;
+    tcam_get_stats(rb->tcam, &stats);
+    tcam_get_frag(rb->tcam, &frag);
+    rb->res.writes = stats.hw_writes - rb->writes;
+    tcam_get_latency(rb->tcam, TCAM_LAT_INSERT, &rb->res.insert);
+    tcam_get_latency(rb->tcam, TCAM_LAT_REMOVE, &rb->res.remove);
+    getrusage(RUSAGE_SELF, &usage);
+    rb->res.rss_kb = usage.ru_maxrss;
+    work_print(out, format, row, "replay", rb->size,
+               (uint64_t) (rb->size - frag.free_slots) * 100 / rb->size, &rb->res);
+    tcam_cache_destroy(rb->tcam);
+    free(rb->mem);
+    rb->tcam = NULL;
+    rb->mem = NULL;
+}
+
+/* Starts the measure of the replay of the bank 'rb' */
+static void replay_measure(replay_bank_t *rb)
+{
+    tcam_stats_t stats;
+
+    tcam_reset_latency(rb->tcam);
+    tcam_get_stats(rb->tcam, &stats);
+    rb->writes = stats.hw_writes;
+    memset(&rb->res, 0, sizeof(rb->res));
+    rb->secs_start = bench_clock(CLOCK_MONOTONIC);
+}
+
+/* Returns 1 if the payload of the record 'rec' has the size its op needs,
+ * with keys of 'key_words' words, or if its op is of a later version
+ */
+static int replay_rec_valid(const tcam_trace_rec_t *rec, uint32_t key_words)
+{
+    uint64_t words;
+
+    switch (rec->op) {
+    case TCAM_TRACE_INIT:
+    case TCAM_TRACE_MODIFY:
+        words = 0;
+        break;
+    case TCAM_TRACE_INSERT:
+        if (rec->arg > 1)
+            return 0;
+        words = 2 * (uint64_t) rec->num * (1 + (rec->arg ? key_words : 0));
+        break;
+    case TCAM_TRACE_REMOVE:
+        if (rec->num != 1)
+            return 0;
+        words = 1;
+        break;
+    case TCAM_TRACE_REMOVE_BATCH:
+        words = rec->num;
+        break;
+    default:
+        return 1;
+    }
+    return rec->size == (sizeof(*rec) + words * sizeof(uint32_t) + TCAM_TRACE_ALIGN - 1) /
+                        TCAM_TRACE_ALIGN * TCAM_TRACE_ALIGN;
+}
+
+/* Description :
+ *     Replays the trace 'path', recorded by tcam_set_trace(), as fast as
+ *     possible or at the pace of the recording if 'paced' is set. Each bank
+ *     of the trace is created empty and gets the calls recorded, and its
+ *     row is printed to 'out' like the ones of bench_workload(), the fill
+ *     being the one of the bank at the end. The entries of the bank at the
+ *     start of the recording are inserted before the measure starts. The
+ *     trace is read in place, see tcam_trace_open(), so it can be larger
+ *     than the memory.
+ * Return: 0 if every call returned the error code recorded
+ */
+static int bench_replay(FILE *out, int format, const char *path, int paced)
+{
+    const tcam_trace_rec_t *rec;
+    const uint32_t *payload;
+    uint32_t *ids = NULL, max_num = 0, i;
+    entry_t *entries = NULL;
+    uint64_t mismatches = 0;
+    replay_bank_t rb;
+    struct timespec until;
+    int rows = 0, setup = 0;
+    tcam_err_t ret_val;
+    double at;
+    void *reader;
+
+    if (tcam_trace_open(path, &reader) != TCAM_ERR_SUCCESS) {
+        fprintf(stderr, "cannot read the trace %s\n", path);
+        return 1;
+    }
+    if (format == WORK_TABLE)
+        fprintf(out, "replay: %s %s, latency in ns\n", path,
+                paced ? "at the recorded pace" : "as fast as possible");
+    work_header(out, format);
+    memset(&rb, 0, sizeof(rb));
+    while ((ret_val = tcam_trace_next(reader, &rec)) == TCAM_ERR_SUCCESS) {
+        payload = (const uint32_t *) (rec + 1);
+        if (!replay_rec_valid(rec, rb.key_words)) {
+            ret_val = TCAM_ERR_EINVAL;
+            break;
+        }
+        if (rec->op == TCAM_TRACE_INIT) {
+            if (rb.tcam != NULL)
+                replay_end(out, format, rows++, &rb);
+            rb.size = rec->arg;
+            rb.key_words = rec->arg2 / 32;
+            rb.mem = calloc(rb.size, sizeof(entry_t));
+            if ((rb.mem == NULL) || (tcam_init(rb.mem, rb.size, &rb.tcam) != TCAM_ERR_SUCCESS) ||
+                (tcam_set_option(rb.tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE) != TCAM_ERR_SUCCESS) ||
+                (tcam_set_option(rb.tcam, TCAM_OPT_KEY_BITS, rec->arg2) != TCAM_ERR_SUCCESS) ||
+                (tcam_set_option(rb.tcam, TCAM_OPT_LATENCY, 1) != TCAM_ERR_SUCCESS) ||
+                ((rec->num & TCAM_TRACE_INIT_SPILL) &&
+                 (tcam_set_option(rb.tcam, TCAM_OPT_SPILL, 1) != TCAM_ERR_SUCCESS))) {
+                fprintf(stderr, "tcam_init failed\n");
+                ret_val = TCAM_ERR_EINVAL;
+                break;
+            }
+            rb.rec_start = rec->ns;
+            rb.pace_start = bench_clock(CLOCK_MONOTONIC);
+            setup = rec->num & TCAM_TRACE_INIT_SNAPSHOT;
+            replay_measure(&rb);
+            continue;
+        }
+        if (rb.tcam == NULL) {
+            ret_val = TCAM_ERR_EINVAL;
+            break;
+        }
+        if ((rec->op == TCAM_TRACE_INSERT) || (rec->op == TCAM_TRACE_REMOVE_BATCH)) {
+            if (rec->num > max_num) {
+                max_num = rec->num;
+                free(entries);
+                free(ids);
+                entries = malloc(max_num * sizeof(entry_t));
+                ids = malloc(max_num * sizeof(uint32_t));
+                if ((entries == NULL) || (ids == NULL)) {
+                    ret_val = TCAM_ERR_MEM_ALLOC_FAIL;
+                    break;
+                }
+            }
+        }
+        if (paced && !setup) {
+            at = rb.pace_start + (rec->ns - rb.rec_start) / 1e9;
+            until.tv_sec = at;
+            until.tv_nsec = (at - until.tv_sec) * 1e9;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+        }
+        switch (rec->op) {
+        case TCAM_TRACE_INSERT:
+            for (i = 0; i < rec->num; i++) {
+                entries[i].id = payload[2 * i];
+                entries[i].prio = payload[2 * i + 1];
+                entries[i].key_ref = 0;
+            }
+            ret_val = tcam_insert_keys(rb.tcam, entries, rec->arg ? &payload[2 * rec->num] : NULL,
+                                       rec->num);
+            rb.res.ops += rec->num;
+            break;
+        case TCAM_TRACE_REMOVE:
+            ret_val = tcam_remove(rb.tcam, payload[0]);
+            rb.res.ops++;
+            break;
+        case TCAM_TRACE_REMOVE_BATCH:
+            memcpy(ids, payload, rec->num * sizeof(uint32_t));
+            ret_val = tcam_remove_batch(rb.tcam, ids, rec->num, NULL);
+            rb.res.ops += rec->num;
+            break;
+        case TCAM_TRACE_MODIFY:
+            ret_val = tcam_modify_prio(rb.tcam, rec->arg, rec->arg2);
+            rb.res.ops++;
+            break;
+        default:
+            // a record of a later version
+            continue;
+        }
+        if (ret_val != rec->ret)
+            mismatches++;
+        if (setup) {
+            setup = 0;
+            replay_measure(&rb);
+        }
+    }
+    if (rb.tcam != NULL)
+        replay_end(out, format, rows++, &rb);
+    if (format == WORK_JSON)
+        fprintf(out, "\n]\n");
+    tcam_trace_close(reader);
+    free(entries);
+    free(ids);
+    if (ret_val != TCAM_ERR_NO_MATCH) {
+        fprintf(stderr, "the trace %s is malformed or could not be read\n", path);
+        return 1;
+    }
+    if (mismatches > 0) {
+        fprintf(stderr, "%llu calls returned another error code than the recorded one\n",
+                (unsigned long long) mismatches);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *bench = (argc > 1) ? argv[1] : NULL;
+    int num = 4, max = 8, ret = 0;
+    long write_ns = 1000, size = WORK_SIZE, fill = WORK_FILL;
+    const char *work = NULL, *trace = NULL, *form = NULL;
+    int format = WORK_TABLE, paced = 0;
+    double secs = 2;
+    FILE *out;
+
+    if ((bench != NULL) && !strcmp(bench, "snapshot")) {
+        num = (argc > 2) ? atoi(argv[2]) : num;
+        secs = (argc > 3) ? atof(argv[3]) : secs;
+    } else if ((bench != NULL) && !strcmp(bench, "shard")) {
+        max = (argc > 2) ? atoi(argv[2]) : max;
+    } else if ((bench != NULL) && !strcmp(bench, "async")) {
+        write_ns = (argc > 2) ? atol(argv[2]) : write_ns;
+    } else if ((bench != NULL) && !strcmp(bench, "scale")) {
+    } else if ((bench != NULL) && !strcmp(bench, "lookup")) {
+    } else if ((bench != NULL) && !strcmp(bench, "tss")) {
+    } else if ((bench != NULL) && !strcmp(bench, "workload")) {
+        form = (argc > 2) ? argv[2] : NULL;
+        work = ((argc > 3) && strcmp(argv[3], "all")) ? argv[3] : NULL;
+        size = (argc > 4) ? atol(argv[4]) : size;
+        fill = (argc > 5) ? atol(argv[5]) : fill;
+        trace = (argc > 6) ? argv[6] : NULL;
+        // a trace holds the calls of a single workload
+        num = ((trace != NULL) && (work == NULL)) ? 0 : num;
+    } else if ((bench != NULL) && !strcmp(bench, "replay")) {
+        trace = (argc > 2) ? argv[2] : NULL;
+        if (argc > 3)
+            paced = !strcmp(argv[3], "paced") ? 1 : !strcmp(argv[3], "fast") ? 0 : -1;
+        form = (argc > 4) ? argv[4] : NULL;
+        num = ((trace == NULL) || (paced < 0)) ? 0 : num;
+    } else if (bench != NULL) {
+        num = 0;
+    }
+    if (form != NULL)
+        format = !strcmp(form, "csv") ? WORK_CSV : !strcmp(form, "json") ? WORK_JSON :
+                 !strcmp(form, "table") ? WORK_TABLE : -1;
+    if ((num < 1) || (num > BENCH_MAX_READERS) || (secs <= 0) || (max < 1) ||
+        (max > SHARD_MAX_BANKS) || (write_ns < 0) || (write_ns > 1000000) || (format < 0) ||
+        (size < 1024) || (size > (1 << 22)) || (fill < 1) || (fill > 100)) {
+        fprintf(stderr, "Usage: %s [snapshot [readers 1-%d] [seconds] | shard [max banks 1-%d] |\n"
+                "       async [write ns 0-1000000] | scale | lookup | tss |\n"
+                "       workload [table|csv|json] [workload|all] [bank size 1024-4194304] [fill %% 1-100]\n"
+                "                [trace to record] |\n"
+                "       replay trace|- [fast|paced] [table|csv|json]]\n",
+                argv[0], BENCH_MAX_READERS, SHARD_MAX_BANKS);
+        return 1;
+    }
+    // the banks are quiet, see TCAM_OPT_LOG_LEVEL, anything else printed on
+    // stdout is dropped
+    fflush(stdout);
+    out = fdopen(dup(1), "w");
+    freopen("/dev/null", "w", stdout);
+
+    if ((bench == NULL) || !strcmp(bench, "snapshot"))
+        ret |= bench_snapshot(out, num, secs);
+    if ((bench == NULL) || !strcmp(bench, "shard"))
+        ret |= bench_shard(out, max);
+    if ((bench == NULL) || !strcmp(bench, "async"))
+        ret |= bench_async(out, write_ns);
+    if ((bench == NULL) || !strcmp(bench, "scale"))
+        ret |= bench_scale(out);
+    if ((bench == NULL) || !strcmp(bench, "lookup")) {
+        ret |= bench_lookup(out, TCAM_KEY_BITS);
+        ret |= bench_lookup(out, TCAM_MAX_KEY_BITS);
+    }
+    if ((bench == NULL) || !strcmp(bench, "tss"))
+        ret |= bench_tss(out);
+    if ((bench == NULL) || !strcmp(bench, "workload"))
+        ret |= bench_workload(out, format, work, size, fill, trace);
+    if ((bench != NULL) && !strcmp(bench, "replay"))
+        ret |= bench_replay(out, format, trace, paced);
+    fclose(out);
+    return ret;
+}
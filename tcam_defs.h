@@ -32,34 +32,345 @@ typedef enum _tcam_error_t_ {
     TCAM_ERR_TCAM_FULL,
     TCAM_ERR_NULL_CACHE,
     TCAM_ERR_EINVAL,
-    TCAM_ERR_INVALID_PRIO
+    TCAM_ERR_INVALID_PRIO,
+    TCAM_ERR_HW_FAIL,
+    TCAM_ERR_NO_MATCH,
+    TCAM_ERR_IO
 } tcam_err_t;
 
+/* Number of error codes, see the failures of tcam_stats_t */
+#define TCAM_ERR_CODES (TCAM_ERR_IO + 1)
+
 #define    TCAM_CELL_STATE_EMPTY 0
 #define    TCAM_CELL_STATE_BUSY  1
 
 #define TCAM_MAX_ENTRIES 2048
+
+/* Width of the ternary keys of the entries, in bits, see TCAM_OPT_KEY_BITS.
+ * The default holds an IPv4 5-tuple, the maximum an IPv6 one with room to
+ * spare.
+ */
+#define TCAM_KEY_BITS     160
+#define TCAM_MAX_KEY_BITS 640
+/* Maximum number of results kept by the flow cache, see TCAM_OPT_FLOW_CACHE */
+#define TCAM_MAX_FLOW_CACHE (1 << 24)
 typedef unsigned char bool;
 #define TRUE 1
 #define FALSE 0
 
 /* This structure would be used to represent an entry in the TCAM cache and
- * hw_tcam tables. It has 2 fields :
+ * hw_tcam tables. It has 3 fields :
  * id - Id of the entry
  * prio - priority of the entry . This will also define the insertion order
  * for the entry
+ * key_ref - record of the ternary key of the entry in the key store of its
+ * TCAM Bank handler, 0 for the key matching any key. It is set by the handler
+ * and ignored by the insertions, see tcam_insert_keys(). The keys themselves
+ * are kept apart so that moving an entry only moves these fields.
  */
 typedef struct entry_ {
     uint32_t id; //must be unique, 0 means empty TCAM entry
     uint32_t prio; //0 means the highest priority
+    uint32_t key_ref;
 
 } entry_t;
 
+/* Options of a TCAM Bank handler, see tcam_set_option()
+ * TCAM_OPT_BATCH_MERGE_MIN - batches with at least this number of entries are
+ *                            merged with the tcam cache in a single pass
+ *                            instead of being inserted entry by entry.
+ *                            0 disables the merge.
+ * TCAM_OPT_PLACEMENT       - how an entry is placed when the slot before its
+ *                            insertion point is busy, one of
+ *                            tcam_placement_t.
+ * TCAM_OPT_SHIFT_MODE      - how the entries are shifted to make room for an
+ *                            entry, one of tcam_shift_mode_t.
+ * TCAM_OPT_REBALANCE_RATE  - maximum number of writes to hw_tcam per second
+ *                            done by tcam_rebalance(). 0 disables it (default).
+ * TCAM_OPT_ASYNC_DEPTH     - number of writes the programming queue of hw_tcam
+ *                            holds. The calls then return once their writes
+ *                            are queued, see tcam_fence(). 0 programs hw_tcam
+ *                            synchronously (default).
+ * TCAM_OPT_HW_WRITE_NS     - simulated latency of a write to hw_tcam, in
+ *                            nanoseconds. 0 by default.
+ * TCAM_OPT_HW_FAIL_AT      - the n-th next write to hw_tcam fails with
+ *                            TCAM_ERR_HW_FAIL, to simulate a hw error. 0
+ *                            disables it (default).
+ * TCAM_OPT_LOOKUP          - implementation of the key compare of
+ *                            tcam_lookup(), one of tcam_lookup_impl_t.
+ * TCAM_OPT_KEY_BITS        - width of the keys of the entries, a multiple of
+ *                            32 up to TCAM_MAX_KEY_BITS. It can only be
+ *                            changed while the bank is empty.
+ *                            TCAM_KEY_BITS by default.
+ * TCAM_OPT_FLOW_CACHE      - number of results of tcam_lookup() kept by the
+ *                            flow cache, up to TCAM_MAX_FLOW_CACHE. 0
+ *                            disables it (default).
+ * TCAM_OPT_TSS             - 1 keeps the entries in a Tuple Space Search
+ *                            classifier as well, for tcam_lookup_tss(). The
+ *                            ids of the entries must then be unique. 0
+ *                            disables it (default).
+ * TCAM_OPT_SPILL           - 1 lets tcam_insert() spill the entries of the
+ *                            lowest priorities to a software table when the
+ *                            bank is full, instead of failing with
+ *                            TCAM_ERR_TCAM_FULL. They are promoted back to
+ *                            hw_tcam as slots are freed. The ids of the
+ *                            entries must then be unique. 0 disables it
+ *                            (default), once the software table is empty.
+ * TCAM_OPT_LOG_LEVEL       - messages printed by the handler on stdout, one
+ *                            of tcam_log_level_t. TCAM_LOG_ERROR by default.
+ * TCAM_OPT_LATENCY         - 1 times the calls of the API in the latency
+ *                            histograms of the handler, see
+ *                            tcam_get_latency(). 0 disables them (default)
+ *                            and drops what they recorded.
+ */
+typedef enum _tcam_option_t_ {
+    TCAM_OPT_BATCH_MERGE_MIN = 0,
+    TCAM_OPT_PLACEMENT = 1,
+    TCAM_OPT_SHIFT_MODE = 2,
+    TCAM_OPT_REBALANCE_RATE = 3,
+    TCAM_OPT_ASYNC_DEPTH = 4,
+    TCAM_OPT_HW_WRITE_NS = 5,
+    TCAM_OPT_HW_FAIL_AT = 6,
+    TCAM_OPT_LOOKUP = 7,
+    TCAM_OPT_KEY_BITS = 8,
+    TCAM_OPT_FLOW_CACHE = 9,
+    TCAM_OPT_TSS = 10,
+    TCAM_OPT_SPILL = 11,
+    TCAM_OPT_LOG_LEVEL = 12,
+    TCAM_OPT_LATENCY = 13
+} tcam_option_t;
+
+#define TCAM_BATCH_MERGE_MIN 64
+
+/* Placement policies of the entry by entry insertion
+ * TCAM_PLACEMENT_SHIFT_DOWN_FIRST - the entries are shifted down to the
+ *                                   nearest empty slot below and only shifted
+ *                                   up when there is none (default)
+ * TCAM_PLACEMENT_MIN_MOVE         - the nearest empty slots in both directions
+ *                                   are looked up and the entries are shifted
+ *                                   in the direction which needs the fewer
+ *                                   writes to hw_tcam
+ */
+typedef enum _tcam_placement_t_ {
+    TCAM_PLACEMENT_SHIFT_DOWN_FIRST = 0,
+    TCAM_PLACEMENT_MIN_MOVE = 1
+} tcam_placement_t;
+
+/* Shifting modes of the entry by entry insertion
+ * TCAM_SHIFT_MODE_ENTRIES        - every entry between the insertion point and
+ *                                  the empty slot is moved by one slot, and the
+ *                                  range is programmed once the whole batch is
+ *                                  inserted (default)
+ * TCAM_SHIFT_MODE_GROUP_BOUNDARY - the empty slot is moved across each priority
+ *                                  group by moving one entry from one end of the
+ *                                  group to the other, and every entry is
+ *                                  programmed as soon as it is placed. An
+ *                                  insertion writes at most one entry per group
+ *                                  crossed plus the new entry. The new entry is
+ *                                  still the first of its group but the order of
+ *                                  the other entries of a crossed group changes.
+ */
+typedef enum _tcam_shift_mode_t_ {
+    TCAM_SHIFT_MODE_ENTRIES = 0,
+    TCAM_SHIFT_MODE_GROUP_BOUNDARY = 1
+} tcam_shift_mode_t;
+
+/* Implementations of the key compare of the lookups in hw_tcam. They all
+ * return the same slot, only their speed differs.
+ * TCAM_LOOKUP_AUTO   - the fastest one the cpu supports, chosen at run time
+ *                      (default)
+ * TCAM_LOOKUP_SCALAR - one entry at a time
+ * TCAM_LOOKUP_SSE2   - four entries at a time
+ * TCAM_LOOKUP_AVX2   - eight entries at a time
+ * An implementation the cpu does not support is rejected with
+ * TCAM_ERR_EINVAL.
+ */
+typedef enum _tcam_lookup_impl_t_ {
+    TCAM_LOOKUP_AUTO = 0,
+    TCAM_LOOKUP_SCALAR = 1,
+    TCAM_LOOKUP_SSE2 = 2,
+    TCAM_LOOKUP_AVX2 = 3
+} tcam_lookup_impl_t;
+
+/* Called after each write to a hw tcam with the slot written, see
+ * tcam_set_watch(). It runs in the thread doing the write.
+ */
+typedef void (*tcam_watch_fn_t)(void *arg, uint32_t position);
+
+/* Messages printed by a TCAM Bank handler, see TCAM_OPT_LOG_LEVEL. Each
+ * level prints the messages of the levels below it as well.
+ * TCAM_LOG_NONE  - nothing, the calls do no stdio
+ * TCAM_LOG_ERROR - the errors of hw_tcam and the calls undone (default)
+ * TCAM_LOG_DEBUG - a trace of every insertion, with its shift policy and
+ *                  its writes to hw_tcam
+ * The messages above TCAM_LOG_MAX are not compiled in, building with
+ * -DTCAM_LOG_MAX=TCAM_LOG_ERROR leaves only the tests of the errors.
+ */
+typedef enum _tcam_log_level_t_ {
+    TCAM_LOG_NONE = 0,
+    TCAM_LOG_ERROR = 1,
+    TCAM_LOG_DEBUG = 2
+} tcam_log_level_t;
+
+#ifndef TCAM_LOG_MAX
+#define TCAM_LOG_MAX TCAM_LOG_DEBUG
+#endif
+
+/* Shift policy of an insertion: the directions in which it moved the
+ * entries of the bank
+ */
 enum tcam_entry_shift_policy_t {
     TCAM_ENTRY_SHIFT_NO_SHIFT = 0,
     TCAM_ENTRY_SHIFT_UP = 1,
     TCAM_ENTRY_SHIFT_DOWN = 2,
     TCAM_ENTRY_SHIFT_UP_DOWN = 3
 };
+#define TCAM_ENTRY_SHIFT_POLICIES 4
+
+/* Latency histograms of a TCAM Bank handler, see TCAM_OPT_LATENCY
+ * TCAM_LAT_INSERT          - calls to tcam_insert() and tcam_insert_keys()
+ * TCAM_LAT_REMOVE          - calls to tcam_remove() and tcam_remove_batch()
+ * TCAM_LAT_MODIFY          - calls to tcam_modify_prio()
+ * TCAM_LAT_PROGRAM         - writes to hw_tcam by tcam_program(). With
+ *                            TCAM_OPT_ASYNC_DEPTH they only queue the write
+ * TCAM_LAT_INSERT_NO_SHIFT - successful calls to tcam_insert() by the shift
+ * ... TCAM_LAT_INSERT_UP_DOWN policy of their insertion in hw_tcam, in the
+ *                            order of enum tcam_entry_shift_policy_t
+ */
+typedef enum _tcam_lat_op_t_ {
+    TCAM_LAT_INSERT = 0,
+    TCAM_LAT_REMOVE = 1,
+    TCAM_LAT_MODIFY = 2,
+    TCAM_LAT_PROGRAM = 3,
+    TCAM_LAT_INSERT_NO_SHIFT = 4,
+    TCAM_LAT_INSERT_UP = 5,
+    TCAM_LAT_INSERT_DOWN = 6,
+    TCAM_LAT_INSERT_UP_DOWN = 7
+} tcam_lat_op_t;
+#define TCAM_LAT_OPS 8
+
+/* Latency of the calls of a histogram, see tcam_get_latency(), in
+ * nanoseconds. The histogram has 16 buckets per power of two, so the
+ * percentiles, the upper bound of their bucket, are at most 1/16 above the
+ * latency they stand for.
+ * count - number of calls timed
+ * min   - lowest latency
+ * mean  - average latency
+ * p50   - median latency
+ * p99   - latency of the 99th percentile
+ * p999  - latency of the 99.9th percentile
+ * max   - highest latency
+ */
+typedef struct tcam_latency_ {
+    uint64_t count;
+    uint64_t min;
+    uint64_t mean;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+} tcam_latency_t;
+
+/* Statistics of a TCAM Bank handler, see tcam_get_stats()
+ * insert_calls     - number of successful calls to tcam_insert()
+ * inserted_entries - number of entries inserted by these calls
+ * insert_hw_writes - number of writes to hw_tcam done by these calls
+ * shifts_up        - number of entry insertions which shifted entries up
+ * shifts_down      - number of entry insertions which shifted entries down
+ * shifted_entries  - number of entries moved to another slot by the insertions
+ * writes_saved     - number of writes to hw_tcam saved by
+ *                    TCAM_PLACEMENT_MIN_MOVE compared to shifting down first
+ * rebalance_writes - number of writes to hw_tcam done by tcam_rebalance()
+ * coalesced_writes - number of writes to hw_tcam dropped by the programming
+ *                    queue, see TCAM_OPT_ASYNC_DEPTH
+ * modify_calls     - number of successful calls to tcam_modify_prio() which
+ *                    changed a priority
+ * modify_hw_writes - number of writes to hw_tcam done by these calls
+ * flow_hits        - number of calls to tcam_lookup() answered by the flow
+ *                    cache, see TCAM_OPT_FLOW_CACHE
+ * flow_misses      - number of calls to tcam_lookup() which searched hw_tcam
+ *                    while the flow cache is enabled
+ * spills           - number of entries moved or inserted to the software
+ *                    table of the spill tier, see TCAM_OPT_SPILL
+ * promotions       - number of entries moved back from the software table
+ *                    to hw_tcam
+ * promote_failures - number of times free slots were left empty because
+ *                    the spilled entries could not be programmed in them.
+ *                    They stay in the software table and are retried as
+ *                    slots are freed
+ * spill_entries    - number of entries in the software table
+ * remove_calls     - number of successful calls to tcam_remove() and
+ *                    tcam_remove_batch()
+ * removed_entries  - number of entries deleted by these calls
+ * failures         - number of failed calls to tcam_insert(),
+ *                    tcam_remove(), tcam_remove_batch() and
+ *                    tcam_modify_prio(), by the error code returned
+ * slots_scanned    - number of slots passed over by the searches of the
+ *                    nearest free or busy slot
+ * moved_bytes      - number of bytes moved in memory by the shifts of the
+ *                    entries, in the tcam_cache and the spill tier
+ * policy_inserts   - number of successful calls to tcam_insert() which
+ *                    wrote hw_tcam, by shift policy (enum
+ *                    tcam_entry_shift_policy_t)
+ * policy_hw_writes - number of writes to hw_tcam done by these calls, by
+ *                    shift policy
+ * max_shift        - largest number of entries moved by the insertion of a
+ *                    single entry, or by a batch merged in one pass
+ * hw_writes        - number of writes to hw_tcam since tcam_init(), see
+ *                    tcam_get_hw_access_cnt()
+ */
+typedef struct tcam_stats_ {
+    uint64_t insert_calls;
+    uint64_t inserted_entries;
+    uint64_t insert_hw_writes;
+    uint64_t shifts_up;
+    uint64_t shifts_down;
+    uint64_t shifted_entries;
+    uint64_t writes_saved;
+    uint64_t rebalance_writes;
+    uint64_t coalesced_writes;
+    uint64_t modify_calls;
+    uint64_t modify_hw_writes;
+    uint64_t flow_hits;
+    uint64_t flow_misses;
+    uint64_t spills;
+    uint64_t promotions;
+    uint64_t promote_failures;
+    uint64_t spill_entries;
+    uint64_t remove_calls;
+    uint64_t removed_entries;
+    uint64_t failures[TCAM_ERR_CODES];
+    uint64_t slots_scanned;
+    uint64_t moved_bytes;
+    uint64_t policy_inserts[TCAM_ENTRY_SHIFT_POLICIES];
+    uint64_t policy_hw_writes[TCAM_ENTRY_SHIFT_POLICIES];
+    uint64_t max_shift;
+    uint64_t hw_writes;
+} tcam_stats_t;
+
+/* Fragmentation metrics of a TCAM Bank handler, see tcam_get_frag(). A gap
+ * is the range of empty slots before a priority group or after the last one.
+ * free_slots       - number of empty slots
+ * groups           - number of priority groups
+ * gap_free_slots   - number of empty slots in the gaps
+ * group_free_slots - number of empty slots between entries of the same group
+ * empty_gaps       - number of gaps without an empty slot. An entry inserted
+ *                    at the start of the group after such a gap needs a shift
+ * max_gap          - number of empty slots of the largest gap
+ * gap_share        - number of empty slots each gap has when they are evenly
+ *                    spread, i.e gap_free_slots / (groups + 1)
+ * imbalance        - number of empty slots which have to be moved to spread
+ *                    them evenly
+ */
+typedef struct tcam_frag_ {
+    uint32_t free_slots;
+    uint32_t groups;
+    uint32_t gap_free_slots;
+    uint32_t group_free_slots;
+    uint32_t empty_gaps;
+    uint32_t max_gap;
+    uint32_t gap_share;
+    uint32_t imbalance;
+} tcam_frag_t;
 
 #endif
@@ -19,380 +19,3798 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "tcam_defs.h"
 #include "tcam_entry_mgr.h"
 #include "tcam.h"
+#include "tcam_tss.h"
+#include "tcam_trace.h"
 
-/*
- * Indicates the number of entries in the  TCAM Bank handler
+/* State of a TCAM Bank handler (A.K.A TCAM cache). The handle returned by
+ * tcam_init() points to it, so that any number of banks can be managed at
+ * the same time, each one from its own thread.
  */
-static int32_t total_tcam_entries ;
-// Maximum size of the TCAM bank handler memory
-static uint32_t max_tcam_entries ;
-// Pointer to the hw_tcam . This used by the tcam_insert()/tcam_remove() to
-// program the hw tcam
-static entry_t *hw_tcam_local = NULL;
+typedef struct tcam_bank_ {
+    // The tcam_cache, a mirror copy of the hw_tcam
+    entry_t *tcam_cache;
+    // Indicates the number of entries in the  TCAM Bank handler
+    int32_t total_tcam_entries;
+    // Maximum size of the TCAM bank handler memory
+    uint32_t max_tcam_entries;
+    // The hw_tcam . This used by the tcam_insert()/tcam_remove() to
+    // program the hw tcam
+    hw_tcam_t hw_tcam;
 
-// Maintains the state of the entries in the TCAM bank handler memory
-// Each entry can have either of the 2 states :
-// TCAM_CELL_STATE_EMPTY or TCAM_CELL_STATE_BUSY
-// This will point to an array of size max_tcam_entries and will be updated
-// and looked up whenever an entry has to inserted into the TCAM bank
-// handler and subsequently hw_tcam
-bool *insert_list ;
+    // Slots of the tcam_cache changed by a call which are not programmed
+    // yet, see plan_program(). Sized for a whole bank, only the first
+    // num_insert_slots are used by a call
+    uint32_t *insert_slots;
+    uint32_t num_insert_slots;
+    // The layout programmed in hw_tcam so far, see plan_program()
+    entry_t *hw_layout;
+    // Keys of the entries, see key_store_init(). key_free is the stack of
+    // the free records and key_refs the records taken for the running batch
+    uint32_t *key_store;
+    uint32_t key_words;
+    uint32_t key_rec;
+    uint32_t *key_free;
+    uint32_t key_free_top;
+    uint32_t *key_refs;
+    // Flow cache of tcam_lookup(), see flow_cache_init(). flow_sets is 0
+    // when it is disabled
+    struct flow_slot_ *flow;
+    uint32_t *flow_keys;
+    uint8_t *flow_next;
+    uint32_t flow_sets;
+    // Tuple Space Search classifier of the entries, see TCAM_OPT_TSS. NULL
+    // when it is disabled
+    void *tss;
+    // Spill tier, see spill_insert(). NULL spill_tss when it is disabled
+    entry_t *spill;
+    uint32_t *spill_keys;
+    uint32_t num_spill;
+    uint32_t spill_max;
+    void *spill_tss;
+    // Work arrays of plan_program(), sized for a whole bank. plan_src has the
+    // old slot of the entry moved to a slot, -1 if none, and plan_dst the new
+    // slot of the entry moved from a slot
+    int32_t *plan_src;
+    int32_t *plan_dst;
+    uint32_t *plan_order;
 
-/* When the tcam_cache cells are shifted up and down, the entire range of indices has to be recorded, 
- * the entries within that range will have to be programmed in hw_tcam. This array is used to
- * record that range .
- */ 
-bool *shift_window ;
+    // Index from the id of an entry to its slot, see id_index_add()
+    struct id_index_ent_ *id_index;
+    uint32_t id_index_mask;
+    // Occupancy bitmap and its summaries, see occ_init()
+    uint64_t *occ_map;
+    uint64_t *occ_free_sum;
+    uint64_t *occ_busy_sum;
+    uint32_t occ_words;
+    // Priority groups, see prio_group_add()
+    struct prio_group_ *prio_groups;
+    uint32_t num_prio_groups;
 
+    // Batches with at least this number of entries are merged with the
+    // tcam_cache, 0 disables it. See TCAM_OPT_BATCH_MERGE_MIN
+    uint32_t batch_merge_min;
+    // Placement of an entry when the slot before its insertion point is busy.
+    // See TCAM_OPT_PLACEMENT
+    uint32_t placement;
+    // How the entries are shifted to make room for an entry. See TCAM_OPT_SHIFT_MODE
+    uint32_t shift_mode;
+    // Budget of the rebalancer in writes to hw_tcam per second, 0 disables it.
+    // See TCAM_OPT_REBALANCE_RATE
+    uint32_t rebalance_rate;
+    // Writes the rebalancer may still do, refilled at rebalance_rate per second
+    // up to one second worth of writes, and the time of the last refill
+    double rebalance_tokens;
+    struct timespec rebalance_time;
+    // Empty slot being moved across a group by the rebalancer, -1 if none, and
+    // the direction it moves in (-1 towards the lower slots, +1 the higher ones)
+    int32_t rebalance_hole;
+    int32_t rebalance_dir;
+    // Statistics of the TCAM Bank handler, see tcam_get_stats()
+    tcam_stats_t tcam_stats;
+    // Shift policy of the last insertion, for the statistics
+    uint32_t insert_policy;
+    // Messages printed, see TCAM_OPT_LOG_LEVEL
+    uint32_t log_level;
+    // Latency histograms, TCAM_LAT_OPS of them, NULL when TCAM_OPT_LATENCY
+    // is disabled
+    struct lat_hist_ *lat;
+    // Recorder of the calls, see tcam_set_trace(), NULL when not recording
+    void *trace;
+
+    // Copies of the tcam_cache for the readers, see tcam_snapshot(). The
+    // readers use snap[0] while snap_seq is even and snap[1] while it is odd.
+    // [snap_lo, snap_hi] is the range of slots changed since the last
+    // publication, empty if snap_lo > snap_hi
+    entry_t *snap[2];
+    uint64_t snap_seq;
+    uint32_t snap_lo;
+    uint32_t snap_hi;
+
+    // Undo journal of the running call, see undo_log(). undo_last
+    // has the last record programming each slot, -1 if none
+    struct undo_rec_ *undo;
+    uint32_t undo_len;
+    uint32_t undo_size;
+    int32_t *undo_last;
+    bool undo_on;
+} tcam_bank_t;
+
+/* Prints a message of the handler at the given level, see TCAM_OPT_LOG_LEVEL.
+ * The levels above TCAM_LOG_MAX are left out at compile time.
+ */
+#define TCAM_LOG(bank, level, ...)                                          \
+    do {                                                                    \
+        if(((level) <= TCAM_LOG_MAX) && ((level) <= (bank)->log_level))     \
+            printf(__VA_ARGS__);                                            \
+    } while(0)
+
+// Names of the shift policies in the messages
+static const char *policy_names[TCAM_ENTRY_SHIFT_POLICIES] = {
+    "TCAM_ENTRY_NO_SHIFT", "TCAM_ENTRY_SHIFT_UP", "TCAM_ENTRY_SHIFT_DOWN", "TCAM_ENTRY_SHIFT_UP_DOWN"
+};
+
+/* Latency histograms.
+ *
+ * The latencies, in nanoseconds, are counted in log-linear buckets: the
+ * values below LAT_SUB have a bucket each, and every power of two above is
+ * split in LAT_SUB buckets of the same width, so that a bucket is at most
+ * 1/LAT_SUB of its values wide whatever their magnitude. Recording a value
+ * is a clz and an increment, and a percentile is a walk over the buckets.
+ */
+#define LAT_SUB_BITS    4
+#define LAT_SUB         (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS     ((64 - LAT_SUB_BITS + 1) * LAT_SUB)
+
+typedef struct lat_hist_ {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[LAT_BUCKETS];
+} lat_hist_t;
+
+/* Returns the time a call starts at, 0 when the calls are neither timed nor
+ * recorded
+ */
+static uint64_t lat_start(tcam_bank_t *bank)
+{
+    struct timespec now;
+
+    if((bank->lat == NULL) && (bank->trace == NULL))
+        return 0;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static uint32_t lat_bucket(uint64_t ns)
+{
+    uint32_t e;
+
+    if(ns < LAT_SUB)
+        return ns;
+    e = 63 - __builtin_clzll(ns);
+    return (e - LAT_SUB_BITS + 1) * LAT_SUB + ((ns >> (e - LAT_SUB_BITS)) & (LAT_SUB - 1));
+}
+
+/* Returns the highest value of the bucket */
+static uint64_t lat_bucket_max(uint32_t b)
+{
+    uint32_t e;
+
+    if(b < LAT_SUB)
+        return b;
+    e = b / LAT_SUB + LAT_SUB_BITS - 1;
+    return ((uint64_t) (LAT_SUB + b % LAT_SUB + 1) << (e - LAT_SUB_BITS)) - 1;
+}
+
+static void lat_add(lat_hist_t *hist, uint64_t ns)
+{
+    hist->buckets[lat_bucket(ns)]++;
+    if((hist->count == 0) || (ns < hist->min))
+        hist->min = ns;
+    if(ns > hist->max)
+        hist->max = ns;
+    hist->count++;
+    hist->sum += ns;
+}
+
+/* Returns the latency below which 'permille' / 1000 of the calls are */
+static uint64_t lat_percentile(lat_hist_t *hist, uint32_t permille)
+{
+    uint64_t rank = (hist->count * permille + 999) / 1000, seen = 0;
+    uint32_t b;
+
+    for(b = 0; b < LAT_BUCKETS; b++) {
+        seen += hist->buckets[b];
+        if((seen >= rank) && (seen > 0))
+            break;
+    }
+    return (lat_bucket_max(b) < hist->max) ? lat_bucket_max(b) : hist->max;
+}
+
+/* Ends a call of the API timed in the histogram 'op' from 'start', see
+ * lat_start(): a failed call is counted in the statistics by its error
+ * code, and a successful insertion is timed by shift policy as well.
+ */
+static tcam_err_t call_result(tcam_bank_t *bank, uint32_t op, uint64_t start, tcam_err_t ret_val)
+{
+    uint64_t ns;
+
+    if((ret_val != TCAM_ERR_SUCCESS) && ((uint32_t) ret_val < TCAM_ERR_CODES))
+        bank->tcam_stats.failures[ret_val]++;
+    if(bank->lat == NULL)
+        return ret_val;
+    ns = lat_start(bank) - start;
+    lat_add(&bank->lat[op], ns);
+    if((op == TCAM_LAT_INSERT) && (ret_val == TCAM_ERR_SUCCESS))
+        lat_add(&bank->lat[TCAM_LAT_INSERT_NO_SHIFT + bank->insert_policy], ns);
+    return ret_val;
+}
+
+/* Programs an entry and its key at the slot of hw_tcam, see tcam_program() */
+static tcam_err_t bank_program(tcam_bank_t *bank, entry_t *ent, const uint32_t *key, uint32_t slot)
+{
+    uint64_t start = lat_start(bank);
+    tcam_err_t ret_val;
+
+    ret_val = tcam_program(&bank->hw_tcam, ent, key, slot);
+    if(bank->lat != NULL)
+        lat_add(&bank->lat[TCAM_LAT_PROGRAM], lat_start(bank) - start);
+    return ret_val;
+}
+
+/* Index from the id of an entry to its slot in the tcam_cache. It is an open
+ * addressed hash table with linear probing and it is sized to twice the
+ * number of slots (rounded up to a power of 2), so a probe sequence is short
+ * and always ends at an unused bucket. Every write to the tcam_cache
+ * (insertion, shift, deletion) has to keep this table in sync.
+ * The same id can be present in more than one slot, in which case each slot
+ * has its own bucket and the lowest slot is reported by the lookup.
+ */
+typedef struct id_index_ent_ {
+    uint32_t id;      // TCAM_CELL_STATE_EMPTY means unused bucket
+    uint32_t slot;
+} id_index_ent_t;
+
+static uint32_t id_index_hash(tcam_bank_t *bank, uint32_t id)
+{
+    return (id * 0x9E3779B1U) & bank->id_index_mask;
+}
+
+static tcam_err_t id_index_init(tcam_bank_t *bank, uint32_t size)
+{
+    uint32_t buckets = 1;
+
+    while(buckets < (2 * size))
+        buckets <<= 1;
+    if(bank->id_index != NULL)
+        free(bank->id_index);
+    bank->id_index = calloc(buckets, sizeof(id_index_ent_t));
+    if(bank->id_index == NULL)
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    bank->id_index_mask = buckets - 1;
+    return TCAM_ERR_SUCCESS;
+}
+
+static void id_index_add(tcam_bank_t *bank, uint32_t id, uint32_t slot)
+{
+    uint32_t b;
+
+    for(b = id_index_hash(bank, id); bank->id_index[b].id != TCAM_CELL_STATE_EMPTY; b = (b + 1) & bank->id_index_mask);
+    bank->id_index[b].id = id;
+    bank->id_index[b].slot = slot;
+}
+
+/* Returns the bucket holding the (id, slot) pair or -1 */
+static int32_t id_index_bucket(tcam_bank_t *bank, uint32_t id, uint32_t slot)
+{
+    uint32_t b;
+
+    for(b = id_index_hash(bank, id); bank->id_index[b].id != TCAM_CELL_STATE_EMPTY; b = (b + 1) & bank->id_index_mask) {
+        if((bank->id_index[b].id == id) && (bank->id_index[b].slot == slot))
+            return b;
+    }
+    return -1;
+}
+
+/* Removes the (id, slot) pair. The buckets following it in the probe
+ * sequence are moved back so that no tombstones are needed.
+ */
+static void id_index_del(tcam_bank_t *bank, uint32_t id, uint32_t slot)
+{
+    int32_t hole;
+    uint32_t b, home;
+
+    if((hole = id_index_bucket(bank, id, slot)) < 0)
+        return;
+    for(b = (hole + 1) & bank->id_index_mask; bank->id_index[b].id != TCAM_CELL_STATE_EMPTY; b = (b + 1) & bank->id_index_mask) {
+        home = id_index_hash(bank, bank->id_index[b].id);
+        // The bucket can be moved to the hole only if its home is not
+        // in the cyclic range (hole, b]
+        if(((b - home) & bank->id_index_mask) >= ((b - hole) & bank->id_index_mask)) {
+            bank->id_index[hole] = bank->id_index[b];
+            hole = b;
+        }
+    }
+    bank->id_index[hole].id = TCAM_CELL_STATE_EMPTY;
+    bank->id_index[hole].slot = 0;
+}
+
+static void id_index_move(tcam_bank_t *bank, uint32_t id, uint32_t from, uint32_t to)
+{
+    int32_t b;
+
+    if((b = id_index_bucket(bank, id, from)) >= 0)
+        bank->id_index[b].slot = to;
+}
+
+/* Returns the lowest slot holding the id or -1 */
+static int32_t id_index_lookup(tcam_bank_t *bank, uint32_t id)
+{
+    uint32_t b;
+    int32_t slot = -1;
+
+    for(b = id_index_hash(bank, id); bank->id_index[b].id != TCAM_CELL_STATE_EMPTY; b = (b + 1) & bank->id_index_mask) {
+        if((bank->id_index[b].id == id) && ((slot < 0) || (bank->id_index[b].slot < slot)))
+            slot = bank->id_index[b].slot;
+    }
+    return slot;
+}
+
+/* Returns the slot of the entry with the given id and priority, -1 if none */
+static int32_t id_index_lookup_prio(tcam_bank_t *bank, uint32_t id, uint32_t prio)
+{
+    uint32_t b;
+
+    for(b = id_index_hash(bank, id); bank->id_index[b].id != TCAM_CELL_STATE_EMPTY; b = (b + 1) & bank->id_index_mask) {
+        if((bank->id_index[b].id == id) && (bank->tcam_cache[bank->id_index[b].slot].prio == prio))
+            return bank->id_index[b].slot;
+    }
+    return -1;
+}
+
+/* Returns the slot of the same entry as 'ent', with its id, priority and key
+ * record, -1 if none. The copies of an id are told apart by their key.
+ */
+static int32_t id_index_lookup_ent(tcam_bank_t *bank, const entry_t *ent)
+{
+    entry_t *cur;
+    uint32_t b;
+
+    for(b = id_index_hash(bank, ent->id); bank->id_index[b].id != TCAM_CELL_STATE_EMPTY; b = (b + 1) & bank->id_index_mask) {
+        cur = &bank->tcam_cache[bank->id_index[b].slot];
+        if((bank->id_index[b].id == ent->id) && (cur->prio == ent->prio) && (cur->key_ref == ent->key_ref))
+            return bank->id_index[b].slot;
+    }
+    return -1;
+}
+
+/* Occupancy bitmap of the tcam_cache, one bit per slot (set means busy).
+ * Two summaries with one bit per 64 bit word of the bitmap tell which words
+ * have a free slot and which have a busy slot, so the nearest free or busy
+ * slot on either side of a slot is found with a few ctz/clz over 64 bit words
+ * instead of loading the entries one by one. The bits beyond the last slot
+ * are kept free and the searches ignore them.
+ */
+#define OCC_WORD(slot)  ((slot) >> 6)
+#define OCC_BIT(slot)   (1ULL << ((slot) & 63))
+
+static tcam_err_t occ_init(tcam_bank_t *bank, uint32_t size)
+{
+    uint32_t w, sum_words;
+
+    bank->occ_words = (size + 63) / 64;
+    sum_words = (bank->occ_words + 63) / 64;
+    free(bank->occ_map);
+    free(bank->occ_free_sum);
+    free(bank->occ_busy_sum);
+    bank->occ_map = calloc(bank->occ_words, sizeof(uint64_t));
+    bank->occ_free_sum = calloc(sum_words, sizeof(uint64_t));
+    bank->occ_busy_sum = calloc(sum_words, sizeof(uint64_t));
+    if((bank->occ_map == NULL) || (bank->occ_free_sum == NULL) || (bank->occ_busy_sum == NULL))
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    for(w = 0; w < bank->occ_words; w++)
+        bank->occ_free_sum[OCC_WORD(w)] |= OCC_BIT(w);
+    return TCAM_ERR_SUCCESS;
+}
+
+static void occ_destroy(tcam_bank_t *bank)
+{
+    free(bank->occ_map);
+    free(bank->occ_free_sum);
+    free(bank->occ_busy_sum);
+    bank->occ_map = bank->occ_free_sum = bank->occ_busy_sum = NULL;
+    bank->occ_words = 0;
+}
+
+static void occ_update_sum(tcam_bank_t *bank, uint32_t w)
+{
+    if(bank->occ_map[w] != ~0ULL)
+        bank->occ_free_sum[OCC_WORD(w)] |= OCC_BIT(w);
+    else
+        bank->occ_free_sum[OCC_WORD(w)] &= ~OCC_BIT(w);
+    if(bank->occ_map[w] != 0)
+        bank->occ_busy_sum[OCC_WORD(w)] |= OCC_BIT(w);
+    else
+        bank->occ_busy_sum[OCC_WORD(w)] &= ~OCC_BIT(w);
+}
+
+static void occ_set(tcam_bank_t *bank, uint32_t slot)
+{
+    bank->occ_map[OCC_WORD(slot)] |= OCC_BIT(slot);
+    occ_update_sum(bank, OCC_WORD(slot));
+}
+
+static void occ_clear(tcam_bank_t *bank, uint32_t slot)
+{
+    bank->occ_map[OCC_WORD(slot)] &= ~OCC_BIT(slot);
+    occ_update_sum(bank, OCC_WORD(slot));
+}
+
+/* First set bit >= 'bit' in a summary covering 'nbits' bits, or -1 */
+static int32_t occ_sum_next(const uint64_t *sum, uint32_t nbits, uint32_t bit)
+{
+    uint32_t w;
+    uint64_t bits;
+
+    if(bit >= nbits)
+        return -1;
+    w = OCC_WORD(bit);
+    bits = sum[w] & (~0ULL << (bit & 63));
+    while(bits == 0) {
+        if(++w >= OCC_WORD(nbits - 1) + 1)
+            return -1;
+        bits = sum[w];
+    }
+    bit = (w << 6) + __builtin_ctzll(bits);
+    return (bit < nbits) ? (int32_t) bit : -1;
+}
+
+/* Last set bit <= 'bit' in a summary, or -1 */
+static int32_t occ_sum_prev(const uint64_t *sum, int32_t bit)
+{
+    int32_t w;
+    uint64_t bits;
+
+    if(bit < 0)
+        return -1;
+    w = OCC_WORD(bit);
+    bits = sum[w] & (~0ULL >> (63 - (bit & 63)));
+    while(bits == 0) {
+        if(--w < 0)
+            return -1;
+        bits = sum[w];
+    }
+    return (w << 6) + 63 - __builtin_clzll(bits);
+}
+
+/* Returns the first free slot >= 'slot' or -1 */
+static int32_t occ_next_free(tcam_bank_t *bank, int32_t slot)
+{
+    int32_t w, found;
+    uint64_t bits;
+
+    if((slot < 0) || (slot >= bank->max_tcam_entries))
+        return -1;
+    w = OCC_WORD(slot);
+    bits = ~bank->occ_map[w] & (~0ULL << (slot & 63));
+    if(bits == 0) {
+        if((w = occ_sum_next(bank->occ_free_sum, bank->occ_words, w + 1)) < 0) {
+            bank->tcam_stats.slots_scanned += bank->max_tcam_entries - slot;
+            return -1;
+        }
+        bits = ~bank->occ_map[w];
+    }
+    found = (w << 6) + __builtin_ctzll(bits);
+    if(found >= bank->max_tcam_entries)
+        found = bank->max_tcam_entries;
+    bank->tcam_stats.slots_scanned += found - slot;
+    return (found < bank->max_tcam_entries) ? found : -1;
+}
+
+/* Returns the last free slot <= 'slot' or -1 */
+static int32_t occ_prev_free(tcam_bank_t *bank, int32_t slot)
+{
+    int32_t w, found;
+    uint64_t bits;
+
+    if(slot < 0)
+        return -1;
+    w = OCC_WORD(slot);
+    bits = ~bank->occ_map[w] & (~0ULL >> (63 - (slot & 63)));
+    if(bits == 0) {
+        if((w = occ_sum_prev(bank->occ_free_sum, w - 1)) < 0) {
+            bank->tcam_stats.slots_scanned += slot + 1;
+            return -1;
+        }
+        bits = ~bank->occ_map[w];
+    }
+    found = (w << 6) + 63 - __builtin_clzll(bits);
+    bank->tcam_stats.slots_scanned += slot - found;
+    return found;
+}
+
+/* Returns the first busy slot >= 'slot' or -1 */
+static int32_t occ_next_busy(tcam_bank_t *bank, int32_t slot)
+{
+    int32_t w, found;
+    uint64_t bits;
+
+    if((slot < 0) || (slot >= bank->max_tcam_entries))
+        return -1;
+    w = OCC_WORD(slot);
+    bits = bank->occ_map[w] & (~0ULL << (slot & 63));
+    if(bits == 0) {
+        if((w = occ_sum_next(bank->occ_busy_sum, bank->occ_words, w + 1)) < 0) {
+            bank->tcam_stats.slots_scanned += bank->max_tcam_entries - slot;
+            return -1;
+        }
+        bits = bank->occ_map[w];
+    }
+    found = (w << 6) + __builtin_ctzll(bits);
+    bank->tcam_stats.slots_scanned += found - slot;
+    return found;
+}
+
+/* Returns the last busy slot <= 'slot' or -1 */
+static int32_t occ_prev_busy(tcam_bank_t *bank, int32_t slot)
+{
+    int32_t w, found;
+    uint64_t bits;
+
+    if(slot < 0)
+        return -1;
+    w = OCC_WORD(slot);
+    bits = bank->occ_map[w] & (~0ULL >> (63 - (slot & 63)));
+    if(bits == 0) {
+        if((w = occ_sum_prev(bank->occ_busy_sum, w - 1)) < 0) {
+            bank->tcam_stats.slots_scanned += slot + 1;
+            return -1;
+        }
+        bits = bank->occ_map[w];
+    }
+    found = (w << 6) + 63 - __builtin_clzll(bits);
+    bank->tcam_stats.slots_scanned += slot - found;
+    return found;
+}
+
+/* Ordered index of the priority groups present in the tcam_cache. Since the
+ * cache is sorted on the priority, the entries of a group occupy the range
+ * [first, last] (possibly with empty slots in between) and the groups are
+ * sorted both on the priority and on the slots. The table is kept sorted on
+ * the priority so that a group, or the first group above a priority, is found
+ * with a binary search.
+ */
+typedef struct prio_group_ {
+    uint32_t prio;
+    uint32_t first;   // slot of the first entry of the group
+    uint32_t last;    // slot of the last entry of the group
+    uint32_t count;   // number of entries in the group
+} prio_group_t;
+
+static tcam_err_t prio_group_init(tcam_bank_t *bank, uint32_t size)
+{
+    if(bank->prio_groups != NULL)
+        free(bank->prio_groups);
+    bank->prio_groups = calloc(size, sizeof(prio_group_t));
+    if(bank->prio_groups == NULL)
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    bank->num_prio_groups = 0;
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Returns the index of the first group with a priority >= prio. It is
+ * num_prio_groups if there is no such group.
+ */
+static uint32_t prio_group_lower_bound(tcam_bank_t *bank, uint32_t prio)
+{
+    uint32_t lo = 0, hi = bank->num_prio_groups, mid;
+
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(bank->prio_groups[mid].prio < prio)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Returns the index of the first group whose last slot is >= slot */
+static uint32_t prio_group_slot_bound(tcam_bank_t *bank, uint32_t slot)
+{
+    uint32_t lo = 0, hi = bank->num_prio_groups, mid;
+
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(bank->prio_groups[mid].last < slot)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void prio_group_add(tcam_bank_t *bank, uint32_t prio, uint32_t slot)
+{
+    uint32_t g = prio_group_lower_bound(bank, prio);
+
+    if((g < bank->num_prio_groups) && (bank->prio_groups[g].prio == prio)) {
+        if(slot < bank->prio_groups[g].first)
+            bank->prio_groups[g].first = slot;
+        if(slot > bank->prio_groups[g].last)
+            bank->prio_groups[g].last = slot;
+        bank->prio_groups[g].count++;
+        return;
+    }
+    memmove(&bank->prio_groups[g+1], &bank->prio_groups[g], (bank->num_prio_groups - g) * sizeof(prio_group_t));
+    bank->prio_groups[g].prio = prio;
+    bank->prio_groups[g].first = bank->prio_groups[g].last = slot;
+    bank->prio_groups[g].count = 1;
+    bank->num_prio_groups++;
+}
+
+/* Removes the entry at 'slot' from its group. The slot has to be already
+ * cleared in the occupancy bitmap so that the new boundaries of the group
+ * can be looked up.
+ */
+static void prio_group_del(tcam_bank_t *bank, uint32_t prio, uint32_t slot)
+{
+    uint32_t g = prio_group_lower_bound(bank, prio);
+
+    if((g >= bank->num_prio_groups) || (bank->prio_groups[g].prio != prio))
+        return;
+    if(--bank->prio_groups[g].count == 0) {
+        bank->num_prio_groups--;
+        memmove(&bank->prio_groups[g], &bank->prio_groups[g+1], (bank->num_prio_groups - g) * sizeof(prio_group_t));
+        return;
+    }
+    if(slot == bank->prio_groups[g].first)
+        bank->prio_groups[g].first = occ_next_busy(bank, slot + 1);
+    else if(slot == bank->prio_groups[g].last)
+        bank->prio_groups[g].last = occ_prev_busy(bank, slot - 1);
+}
+
+/* The entries in the slots [start, end] were moved by 'delta' (+1 or -1)
+ * slots. Adjusts the boundaries of the groups which fall in that range.
+ */
+static void prio_group_shift(tcam_bank_t *bank, uint32_t start, uint32_t end, int32_t delta)
+{
+    uint32_t g;
+
+    for(g = prio_group_slot_bound(bank, start); (g < bank->num_prio_groups) && (bank->prio_groups[g].first <= end); g++) {
+        if(bank->prio_groups[g].first >= start)
+            bank->prio_groups[g].first += delta;
+        if(bank->prio_groups[g].last <= end)
+            bank->prio_groups[g].last += delta;
+    }
+}
+
+/* Rebuilds the group table from the occupied slots of the tcam_cache */
+static void prio_group_rebuild(tcam_bank_t *bank)
+{
+    int32_t slot;
+    prio_group_t *grp = NULL;
+
+    bank->num_prio_groups = 0;
+    for(slot = occ_next_busy(bank, 0); slot >= 0; slot = occ_next_busy(bank, slot + 1)) {
+        if((grp == NULL) || (grp->prio != bank->tcam_cache[slot].prio)) {
+            grp = &bank->prio_groups[bank->num_prio_groups++];
+            grp->prio = bank->tcam_cache[slot].prio;
+            grp->first = slot;
+            grp->count = 0;
+        }
+        grp->last = slot;
+        grp->count++;
+    }
+}
+
+/* Snapshots of the tcam_cache.
+ *
+ * The readers must neither wait for the writer nor see the tcam_cache in the
+ * middle of a batch. So the tcam_cache is published, once a batch is done, in
+ * two copies with a sequence counter (a seqlock latch). The writer updates one
+ * copy while the readers use the other one, then the other way round. A reader
+ * only retries when a publication switched copies while it was reading.
+ * Only the range of slots changed since the previous publication is copied.
+ */
+
+/* Records that the slots [lo, hi] of the tcam_cache changed */
+static void snap_dirty(tcam_bank_t *bank, uint32_t lo, uint32_t hi)
+{
+    if(lo < bank->snap_lo)
+        bank->snap_lo = lo;
+    if(hi > bank->snap_hi)
+        bank->snap_hi = hi;
+}
+
+/* Publishes the changes of the tcam_cache to the readers */
+static void snap_publish(tcam_bank_t *bank)
+{
+    uint32_t k, lo = bank->snap_lo, hi = bank->snap_hi;
+
+    if(lo > hi)
+        return;
+    for(k = 0; k < 2; k++) {
+        // move the readers to the other copy before updating this one
+        __atomic_add_fetch(&bank->snap_seq, 1, __ATOMIC_RELEASE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        memcpy(&bank->snap[k][lo], &bank->tcam_cache[lo], (hi - lo + 1) * sizeof(entry_t));
+    }
+    bank->snap_lo = UINT32_MAX;
+    bank->snap_hi = 0;
+}
+
+/* Key store.
+ *
+ * The keys of the entries are kept apart from the tcam_cache, so that the
+ * shifts, the journal and the snapshots only move the id and priority of the
+ * entries and the handle of their key (key_ref). The store has a record per
+ * slot of the bank, plus the record 0 which is the key matching any key. A
+ * record holds the value then the mask of a key and takes a whole number of
+ * cache lines. An entry takes a record when it is inserted with a key and
+ * gives it back when it is deleted, its copies made by tcam_modify_prio()
+ * share it.
+ */
+
+// number of words of a record of the key store is a multiple of this
+#define KEY_REC_ALIGN 16
+
+/* Allocates the key store of the bank for keys of 'key_words' words, with
+ * every record free
+ */
+static tcam_err_t key_store_init(tcam_bank_t *bank, uint32_t key_words)
+{
+    uint32_t rec = (2 * key_words + KEY_REC_ALIGN - 1) / KEY_REC_ALIGN * KEY_REC_ALIGN;
+    uint32_t *store, k;
+
+    store = aligned_alloc(KEY_REC_ALIGN * sizeof(uint32_t),
+                          (bank->max_tcam_entries + 1) * rec * sizeof(uint32_t));
+    if(store == NULL)
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    memset(store, 0, rec * sizeof(uint32_t));
+    free(bank->key_store);
+    bank->key_store = store;
+    bank->key_words = key_words;
+    bank->key_rec = rec;
+    // the lowest records are taken first
+    for(k = 0; k < bank->max_tcam_entries; k++)
+        bank->key_free[k] = bank->max_tcam_entries - k;
+    bank->key_free_top = bank->max_tcam_entries;
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Returns the value then the mask of the key of 'ent', NULL for an empty
+ * slot, whose key does not matter
+ */
+static const uint32_t *key_of(tcam_bank_t *bank, const entry_t *ent)
+{
+    if(ent->id == TCAM_CELL_STATE_EMPTY)
+        return NULL;
+    return &bank->key_store[ent->key_ref * bank->key_rec];
+}
+
+/* Gives back the record of the key of a deleted entry */
+static void key_release(tcam_bank_t *bank, uint32_t ref)
+{
+    if(ref != 0)
+        bank->key_free[bank->key_free_top++] = ref;
+}
+
+/* Returns the i-th entry of a batch with the record of its key, 'refs' is
+ * NULL for the entries matching any key
+ */
+static entry_t batch_entry(entry_t *entries, uint32_t *refs, uint32_t i)
+{
+    entry_t ent = entries[i];
+
+    ent.key_ref = (refs != NULL) ? refs[i] : 0;
+    return ent;
+}
+
+/* Flow cache.
+ *
+ * tcam_lookup() compares the key with every slot of hw_tcam, while the same
+ * few keys are usually looked up again and again. The flow cache keeps the
+ * result of the recent lookups, keyed on the whole key, in a set associative
+ * table of flow_sets sets of FLOW_WAYS results. A key can only be in the set
+ * given by its hash. The metadata of a set fits in a cache line, the keys are
+ * kept apart and only compared when the tag matches.
+ * A result holds for the content of hw_tcam it was computed on, which is
+ * numbered by the writes done in it, see hw_tcam_done(). The result is kept
+ * with that number and is stale as soon as a write is done, so any change of
+ * the layout, by this handler or by the programming queue, invalidates the
+ * whole cache at once. A stale result is replaced first, else the results of
+ * a set are replaced in turn.
+ */
+
+// number of results of a set of the flow cache
+#define FLOW_WAYS 4
+
+/* A result of the flow cache.
+ * gen  - hw_tcam_done() + 1 when the result was computed, 0 if unused
+ * tag  - upper half of the hash of the key
+ * slot - matching slot, -1 for no match
+ */
+typedef struct flow_slot_ {
+    uint64_t gen;
+    uint32_t tag;
+    int32_t slot;
+} flow_slot_t;
+
+/* Allocates an empty flow cache holding at least 'size' results, or frees
+ * it if 'size' is 0. The number of sets is a power of two.
+ */
+static tcam_err_t flow_cache_init(tcam_bank_t *bank, uint32_t size)
+{
+    uint32_t sets = 1;
+
+    free(bank->flow);
+    free(bank->flow_keys);
+    free(bank->flow_next);
+    bank->flow = NULL;
+    bank->flow_keys = NULL;
+    bank->flow_next = NULL;
+    bank->flow_sets = 0;
+    if(size == 0)
+        return TCAM_ERR_SUCCESS;
+    while(sets * FLOW_WAYS < size)
+        sets <<= 1;
+    bank->flow = calloc(sets * FLOW_WAYS, sizeof(flow_slot_t));
+    bank->flow_keys = malloc((size_t) sets * FLOW_WAYS * bank->key_words * sizeof(uint32_t));
+    bank->flow_next = calloc(sets, sizeof(uint8_t));
+    if((bank->flow == NULL) || (bank->flow_keys == NULL) || (bank->flow_next == NULL)) {
+        flow_cache_init(bank, 0);
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    }
+    bank->flow_sets = sets;
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Returns the hash of a key, every bit of the key reaches the lower half */
+static uint64_t flow_hash(tcam_bank_t *bank, const uint32_t *key)
+{
+    uint64_t h = 0;
+    uint32_t w;
+
+    for(w = 0; w < bank->key_words; w++)
+        h = (h + key[w]) * 0x9e3779b97f4a7c15ULL;
+    return h ^ (h >> 32);
+}
+
+/* Looks up a key in hw_tcam through the flow cache */
+static tcam_err_t flow_lookup(tcam_bank_t *bank, const uint32_t *key, uint32_t *position)
+{
+    uint64_t h = flow_hash(bank, key);
+    uint64_t gen = hw_tcam_done(&bank->hw_tcam) + 1;
+    uint32_t set = h & (bank->flow_sets - 1), tag = h >> 32;
+    uint32_t words = bank->key_words, w;
+    flow_slot_t *fs = &bank->flow[set * FLOW_WAYS];
+    uint32_t *keys = &bank->flow_keys[(size_t) set * FLOW_WAYS * words];
+    tcam_err_t ret_val;
+
+    for(w = 0; w < FLOW_WAYS; w++) {
+        if((fs[w].gen == gen) && (fs[w].tag == tag) &&
+           (memcmp(&keys[w * words], key, words * sizeof(uint32_t)) == 0)) {
+            bank->tcam_stats.flow_hits++;
+            if(fs[w].slot < 0)
+                return TCAM_ERR_NO_MATCH;
+            *position = fs[w].slot;
+            return TCAM_ERR_SUCCESS;
+        }
+    }
+    bank->tcam_stats.flow_misses++;
+    ret_val = hw_tcam_lookup(&bank->hw_tcam, key, position);
+    if((ret_val != TCAM_ERR_SUCCESS) && (ret_val != TCAM_ERR_NO_MATCH))
+        return ret_val;
+    // the programming queue may have written hw_tcam during the search, the
+    // result is then not kept
+    if(hw_tcam_done(&bank->hw_tcam) + 1 != gen)
+        return ret_val;
+    for(w = 0; (w < FLOW_WAYS) && (fs[w].gen == gen); w++)
+        ;
+    if(w == FLOW_WAYS)
+        w = bank->flow_next[set]++ % FLOW_WAYS;
+    fs[w].gen = gen;
+    fs[w].tag = tag;
+    fs[w].slot = (ret_val == TCAM_ERR_SUCCESS) ? (int32_t) *position : -1;
+    memcpy(&keys[w * words], key, words * sizeof(uint32_t));
+    return ret_val;
+}
+
+/* Software classifier.
+ *
+ * With TCAM_OPT_TSS the entries are also kept in a Tuple Space Search
+ * classifier, see tcam_tss.h, which looks up keys without hw_tcam. The
+ * classifier is changed along with the tcam_cache: the entries of a batch
+ * are added to it first, in the order of the batch so that the last one
+ * inserted matches first like in its priority group, and taken out again if
+ * the insertion fails.
+ */
+
+/* (Re)builds the classifier from the tcam_cache. The entries are added from
+ * the last slot to the first, so that the first one of a group is the last
+ * one inserted
+ */
+static tcam_err_t tss_build(tcam_bank_t *bank)
+{
+    tcam_err_t ret_val;
+    void *tss;
+    int32_t slot;
+
+    if((ret_val = tcam_tss_init(bank->key_words * 32, &tss)) != TCAM_ERR_SUCCESS)
+        return ret_val;
+    for(slot = occ_prev_busy(bank, bank->max_tcam_entries - 1); slot >= 0;
+        slot = (slot > 0) ? occ_prev_busy(bank, slot - 1) : -1) {
+        ret_val = tcam_tss_insert(tss, &bank->tcam_cache[slot], key_of(bank, &bank->tcam_cache[slot]));
+        if(ret_val != TCAM_ERR_SUCCESS) {
+            tcam_tss_destroy(tss);
+            return ret_val;
+        }
+    }
+    tcam_tss_destroy(bank->tss);
+    bank->tss = tss;
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Takes the first 'num' entries of a batch out of the classifier */
+static void tss_remove(tcam_bank_t *bank, entry_t *entries, uint32_t num)
+{
+    uint32_t i;
+
+    for(i = num; (bank->tss != NULL) && (i > 0); i--)
+        tcam_tss_remove(bank->tss, entries[i - 1].id);
+}
+
+/* Adds a batch of entries and their keys, as given to tcam_insert_keys(), to
+ * the classifier. Nothing is added if one of them cannot be.
+ */
+static tcam_err_t tss_insert(tcam_bank_t *bank, entry_t *entries, const uint32_t *keys, uint32_t num)
+{
+    tcam_err_t ret_val;
+    uint32_t i;
+
+    for(i = 0; (bank->tss != NULL) && (i < num); i++) {
+        ret_val = tcam_tss_insert(bank->tss, &entries[i], (keys != NULL) ? &keys[i * 2 * bank->key_words] : NULL);
+        if(ret_val != TCAM_ERR_SUCCESS) {
+            tss_remove(bank, entries, i);
+            return ret_val;
+        }
+    }
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Undo journal.
+ *
+ * tcam_insert() changes the tcam_cache entry by entry and then programs
+ * hw_tcam. Every change is recorded in the journal so that
+ * a batch which fails half way is undone by replaying the journal backwards:
+ * the tcam_cache is restored first, then the writes to hw_tcam are undone from
+ * the last one to the first. Each undo write puts back the value the slot had
+ * before the write, so hw_tcam goes back through the same states it went
+ * through and stays hitless. The cost of an undo is the cost of the changes
+ * done so far.
+ */
+typedef enum _undo_op_t_ {
+    UNDO_PLACE,         // an entry was placed at slot 'a'
+    UNDO_SHIFT_DOWN,    // [a, b) was shifted down by tcam_cache_shift_down()
+    UNDO_SHIFT_UP,      // (a, b] was shifted up by tcam_cache_shift_up()
+    UNDO_MOVE,          // the entry at 'a' was moved to 'b'
+    UNDO_CLEAR,         // the entry 'ent' at slot 'a' was removed
+    UNDO_MERGE,         // the slots [a, b] were merged, undo_saved has them
+    UNDO_PROGRAM        // 'ent' was programmed at slot 'a' of hw_tcam
+} undo_op_t;
+
+typedef struct undo_rec_ {
+    uint32_t op;
+    int32_t a;
+    int32_t b;
+    int32_t prev;       // UNDO_PROGRAM: previous record programming slot 'a'
+    entry_t ent;
+} undo_rec_t;
+
+/* Makes room for 'n' more records. The room is reserved before the changes
+ * are done, so that a change is never done without its record.
+ */
+static tcam_err_t undo_reserve(tcam_bank_t *bank, uint32_t n)
+{
+    undo_rec_t *undo;
+    uint32_t size = bank->undo_size;
+
+    if(bank->undo_len + n <= size)
+        return TCAM_ERR_SUCCESS;
+    while(size < bank->undo_len + n)
+        size = (size == 0) ? 64 : 2 * size;
+    undo = realloc(bank->undo, size * sizeof(undo_rec_t));
+    if(undo == NULL)
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    bank->undo = undo;
+    bank->undo_size = size;
+    return TCAM_ERR_SUCCESS;
+}
+
+static void undo_log(tcam_bank_t *bank, undo_op_t op, int32_t a, int32_t b)
+{
+    undo_rec_t *rec;
+
+    if(!bank->undo_on)
+        return;
+    rec = &bank->undo[bank->undo_len++];
+    rec->op = op;
+    rec->a = a;
+    rec->b = b;
+}
+
+/* Programs 'ent' at the slot of hw_tcam and records the write in the
+ * journal.
+ */
+static tcam_err_t undo_program_ent(tcam_bank_t *bank, entry_t *ent, uint32_t slot)
+{
+    tcam_err_t ret_val;
+
+    if((ret_val = bank_program(bank, ent, key_of(bank, ent), slot)) != TCAM_ERR_SUCCESS)
+        return ret_val;
+    bank->hw_layout[slot] = *ent;
+    if(!bank->undo_on)
+        return TCAM_ERR_SUCCESS;
+    bank->undo[bank->undo_len].ent = *ent;
+    bank->undo[bank->undo_len].prev = bank->undo_last[slot];
+    bank->undo_last[slot] = bank->undo_len;
+    undo_log(bank, UNDO_PROGRAM, slot, 0);
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Programs the slot of hw_tcam with its entry of the tcam_cache and records
+ * the write in the journal.
+ */
+static tcam_err_t undo_program(tcam_bank_t *bank, uint32_t slot)
+{
+    return undo_program_ent(bank, &bank->tcam_cache[slot], slot);
+}
+
+// Marks of plan_src, besides the old slot of a moved entry
+#define PLAN_NONE   -1      // nothing to program
+#define PLAN_LISTED -2      // the slot is in insert_slots
+#define PLAN_TEMP   -3      // a temporary copy is programmed in the slot
+#define PLAN_DONE   -4      // the slot is programmed
+
+/* Starts a new list of the slots to be programmed by plan_program() */
+static void plan_begin(tcam_bank_t *bank)
+{
+    uint32_t k;
+
+    for(k = 0; k < bank->num_insert_slots; k++)
+        bank->plan_src[bank->insert_slots[k]] = PLAN_NONE;
+    bank->num_insert_slots = 0;
+}
+
+/* Adds the slot to the slots to be programmed by plan_program(), once */
+static void plan_add(tcam_bank_t *bank, uint32_t slot)
+{
+    if(bank->plan_src[slot] == PLAN_LISTED)
+        return;
+    bank->plan_src[slot] = PLAN_LISTED;
+    bank->insert_slots[bank->num_insert_slots++] = slot;
+}
+
+/* Copies the entry to the empty 'slot' of the tcam_cache and adds it to the
+ * indexes.
+ */
+static void tcam_cache_place(tcam_bank_t *bank, uint32_t slot, entry_t *ent)
+{
+    bank->tcam_cache[slot] = *ent;
+    snap_dirty(bank, slot, slot);
+    occ_set(bank, slot);
+    id_index_add(bank, ent->id, slot);
+    prio_group_add(bank, ent->prio, slot);
+    undo_log(bank, UNDO_PLACE, slot, 0);
+}
+
+/* Empties the busy 'slot' of the tcam_cache and removes its entry from the
+ * indexes.
+ */
+static void tcam_cache_clear(tcam_bank_t *bank, uint32_t slot)
+{
+    entry_t *ent = &bank->tcam_cache[slot];
+
+    if(bank->undo_on)
+        bank->undo[bank->undo_len].ent = *ent;
+    id_index_del(bank, ent->id, slot);
+    occ_clear(bank, slot);
+    prio_group_del(bank, ent->prio, slot);
+    memset(ent, 0, sizeof(entry_t));
+    snap_dirty(bank, slot, slot);
+    undo_log(bank, UNDO_CLEAR, slot, 0);
+}
+
+/* Moves the entries in [start, end) one slot down i.e to [start+1, end].
+ * The slot 'end' has to be empty and the slot 'start' is left empty. The
+ * index is updated starting from the last entry so that an id present in
+ * adjacent slots is not confused.
+ */
+static void tcam_cache_shift_down(tcam_bank_t *bank, int32_t start, int32_t end)
+{
+    int32_t k;
+
+    memmove(&bank->tcam_cache[start+1], &bank->tcam_cache[start], (end - start) * sizeof(entry_t));
+    bank->tcam_stats.moved_bytes += (end - start) * sizeof(entry_t);
+    memset(&bank->tcam_cache[start], 0, sizeof(entry_t));
+    snap_dirty(bank, start, end);
+    occ_set(bank, end);
+    occ_clear(bank, start);
+    for(k = end - 1; k >= start; k--)
+        id_index_move(bank, bank->tcam_cache[k+1].id, k, k+1);
+    prio_group_shift(bank, start, end - 1, 1);
+    undo_log(bank, UNDO_SHIFT_DOWN, start, end);
+}
+
+/* Moves the entries in [start+1, end] one slot up i.e to [start, end).
+ * The slot 'start' has to be empty and the slot 'end' is left empty.
+ */
+static void tcam_cache_shift_up(tcam_bank_t *bank, int32_t start, int32_t end)
+{
+    int32_t k;
+
+    memmove(&bank->tcam_cache[start], &bank->tcam_cache[start+1], (end - start) * sizeof(entry_t));
+    bank->tcam_stats.moved_bytes += (end - start) * sizeof(entry_t);
+    memset(&bank->tcam_cache[end], 0, sizeof(entry_t));
+    snap_dirty(bank, start, end);
+    occ_set(bank, start);
+    occ_clear(bank, end);
+    for(k = start + 1; k <= end; k++)
+        id_index_move(bank, bank->tcam_cache[k-1].id, k, k-1);
+    prio_group_shift(bank, start + 1, end, -1);
+    undo_log(bank, UNDO_SHIFT_UP, start, end);
+}
+
+/* Moves the entry at 'from' to the empty slot 'to' inside its priority group
+ * or to the slot right after or before it.
+ */
+static void tcam_cache_move(tcam_bank_t *bank, int32_t from, int32_t to)
+{
+    prio_group_t *grp = &bank->prio_groups[prio_group_lower_bound(bank, bank->tcam_cache[from].prio)];
+
+    bank->tcam_cache[to] = bank->tcam_cache[from];
+    memset(&bank->tcam_cache[from], 0, sizeof(entry_t));
+    bank->tcam_stats.moved_bytes += sizeof(entry_t);
+    snap_dirty(bank, (from < to) ? from : to, (from < to) ? to : from);
+    occ_set(bank, to);
+    occ_clear(bank, from);
+    id_index_move(bank, bank->tcam_cache[to].id, from, to);
+    if(to < grp->first)
+        grp->first = to;
+    if(to > grp->last)
+        grp->last = to;
+    if(from == grp->first)
+        grp->first = occ_next_busy(bank, from + 1);
+    else if(from == grp->last)
+        grp->last = occ_prev_busy(bank, from - 1);
+    undo_log(bank, UNDO_MOVE, from, to);
+}
+
+/* Group boundary shifting. The entries of a priority group share the same
+ * priority, so the empty slot 'hole' crosses a whole group by moving a single
+ * entry of the group from one end of it to the other. The slots between
+ * 'hole' and 'pos' have to be busy. The hole is moved to 'pos' group by group
+ * and the slots the moved entries land on are added to insert_slots. 'moved'
+ * is increased by the number of moved entries, which is the number of groups
+ * crossed.
+ * Coming from below, the hole takes the first entry of each group, which
+ * becomes the last one of the group. Coming from above, it takes the last
+ * entry, which becomes the first one. The new entry still goes first in its
+ * group but the other entries of a crossed group are rotated.
+ */
+static void tcam_cache_move_hole(tcam_bank_t *bank, int32_t hole, int32_t pos, uint64_t *moved)
+{
+    prio_group_t *grp;
+    int32_t from;
+
+    while(hole != pos) {
+        if(hole > pos) {
+            grp = &bank->prio_groups[prio_group_slot_bound(bank, hole - 1)];
+            from = (grp->first > pos) ? grp->first : pos;
+        } else {
+            grp = &bank->prio_groups[prio_group_slot_bound(bank, hole + 1)];
+            from = (grp->last < pos) ? grp->last : pos;
+        }
+        tcam_cache_move(bank, from, hole);
+        plan_add(bank, hole);
+        hole = from;
+        (*moved)++;
+    }
+}
+
+/* Starts recording the changes of a call in the journal */
+static void undo_begin(tcam_bank_t *bank)
+{
+    bank->undo_len = 0;
+    bank->undo_on = TRUE;
+}
+
+/* Stops recording, the changes recorded are kept */
+static void undo_end(tcam_bank_t *bank)
+{
+    uint32_t k;
+
+    for(k = 0; k < bank->undo_len; k++) {
+        if(bank->undo[k].op == UNDO_PROGRAM)
+            bank->undo_last[bank->undo[k].a] = -1;
+    }
+    bank->undo_len = 0;
+    bank->undo_on = FALSE;
+}
+
+/* Undoes the merge of the slots [lo, hi], whose previous content is in
+ * 'saved'
+ */
+static void undo_merge(tcam_bank_t *bank, int32_t lo, int32_t hi, entry_t *saved)
+{
+    int32_t x;
+
+    for(x = lo; x <= hi; x++) {
+        if(bank->tcam_cache[x].id != TCAM_CELL_STATE_EMPTY)
+            id_index_del(bank, bank->tcam_cache[x].id, x);
+    }
+    memcpy(&bank->tcam_cache[lo], &saved[lo], (hi - lo + 1) * sizeof(entry_t));
+    snap_dirty(bank, lo, hi);
+    for(x = lo; x <= hi; x++) {
+        if(bank->tcam_cache[x].id != TCAM_CELL_STATE_EMPTY) {
+            occ_set(bank, x);
+            id_index_add(bank, bank->tcam_cache[x].id, x);
+        } else {
+            occ_clear(bank, x);
+        }
+    }
+    prio_group_rebuild(bank);
+}
+
+/* Undoes the changes recorded since undo_begin() and stops recording. For
+ * UNDO_MERGE, 'saved' has the previous content of the merged slots.
+ */
+static void undo_rollback(tcam_bank_t *bank, entry_t *saved)
+{
+    int32_t k;
+    undo_rec_t *rec;
+    entry_t *old;
+
+    bank->undo_on = FALSE;
+    // The tcam_cache first, so that it has the value of every slot before
+    // the call
+    for(k = (int32_t) bank->undo_len - 1; k >= 0; k--) {
+        rec = &bank->undo[k];
+        switch(rec->op) {
+        case UNDO_PLACE:
+            tcam_cache_clear(bank, rec->a);
+            break;
+        case UNDO_SHIFT_DOWN:
+            tcam_cache_shift_up(bank, rec->a, rec->b);
+            break;
+        case UNDO_SHIFT_UP:
+            tcam_cache_shift_down(bank, rec->a, rec->b);
+            break;
+        case UNDO_MOVE:
+            tcam_cache_move(bank, rec->b, rec->a);
+            break;
+        case UNDO_CLEAR:
+            tcam_cache_place(bank, rec->a, &rec->ent);
+            break;
+        case UNDO_MERGE:
+            undo_merge(bank, rec->a, rec->b, saved);
+            break;
+        default:
+            break;
+        }
+    }
+    // Then hw_tcam, every slot gets back the value it had before the write
+    for(k = (int32_t) bank->undo_len - 1; k >= 0; k--) {
+        rec = &bank->undo[k];
+        if(rec->op != UNDO_PROGRAM)
+            continue;
+        old = (rec->prev >= 0) ? &bank->undo[rec->prev].ent : &bank->tcam_cache[rec->a];
+        if(bank_program(bank, old, key_of(bank, old), rec->a) != TCAM_ERR_SUCCESS)
+            TCAM_LOG(bank, TCAM_LOG_ERROR, "ERROR : Could'nt restore the slot %d of hw_tcam\n", rec->a);
+        bank->hw_layout[rec->a] = *old;
+    }
+    undo_end(bank);
+}
+
+
+static int slot_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* Hitless programming.
+ *
+ * A call changes the tcam_cache first, adding the slots it changes to
+ * insert_slots, and then plan_program() brings hw_tcam from its layout, kept
+ * in hw_layout, to the layout of the tcam_cache. Each slot which differs is written once, in an order such that
+ * at every step each entry of both layouts is in hw_tcam and is matched before
+ * the entries with a higher priority value:
+ *  - a slot is overwritten only once the entry it holds is written to its new
+ *    slot
+ *  - first the slots getting an entry from a higher slot, in ascending order,
+ *    so that a new copy never gets ahead of an entry with a lower priority
+ *    value which is still to be moved
+ *  - then in descending order the slots getting an entry from a lower slot
+ *    and the slots whose entry moved to a higher slot, so that an entry never
+ *    loses its old copy while an entry with a higher priority value is still
+ *    ahead of its new one
+ *  - then the other slots: the new entries, which can no longer get ahead of
+ *    an entry, the entries changed in place and the slots whose entry was
+ *    removed or moved to a lower slot.
+ * The entries keep their relative order, except inside the priority groups
+ * rotated by the group boundary shifting, so a slot can only wait for another
+ * one written after it when entries of the same priority cross. The entry it
+ * holds is then copied to a temporary empty slot next to its group, which is
+ * cleared at the end. These are the only writes on top of one per slot which
+ * differs.
+ */
+
+/* Returns TRUE if the slot differs between hw_tcam and the tcam_cache */
+static bool plan_differs(tcam_bank_t *bank, uint32_t slot)
+{
+    entry_t *old = &bank->hw_layout[slot], *ent = &bank->tcam_cache[slot];
+
+    if((old->id == TCAM_CELL_STATE_EMPTY) && (ent->id == TCAM_CELL_STATE_EMPTY))
+        return FALSE;
+    return (old->id != ent->id) || (old->prio != ent->prio) || (old->key_ref != ent->key_ref);
+}
+
+/* Returns the slot of the tcam_cache where the entry hw_tcam has at the slot
+ * goes, -1 if none. An entry whose priority changed is not the same one, nor
+ * is another copy of its id with another key.
+ * 'guess' is tried first: the entries of a shifted range move by the same
+ * number of slots.
+ */
+static int32_t plan_dest(tcam_bank_t *bank, uint32_t slot, int32_t guess)
+{
+    entry_t *old = &bank->hw_layout[slot], *ent;
+
+    if(old->id == TCAM_CELL_STATE_EMPTY)
+        return -1;
+    if((guess >= 0) && (guess < bank->max_tcam_entries)) {
+        ent = &bank->tcam_cache[guess];
+        if((ent->id == old->id) && (ent->prio == old->prio) && (ent->key_ref == old->key_ref))
+            return guess;
+    }
+    return id_index_lookup_ent(bank, old);
+}
+
+/* Returns TRUE if the entry hw_tcam has at the slot is not waiting to be
+ * written to its new slot, so that the slot can be overwritten
+ */
+static bool plan_ready(tcam_bank_t *bank, uint32_t slot)
+{
+    int32_t to = bank->plan_dst[slot];
+
+    return (to < 0) || (bank->plan_src[to] != (int32_t) slot);
+}
+
+/* Returns a slot, empty in both layouts, for a temporary copy of the entry
+ * hw_tcam has at 'slot': the slots between them only have entries of the
+ * same priority. Returns -1 if there is none.
+ */
+static int32_t plan_temp_slot(tcam_bank_t *bank, int32_t slot)
+{
+    entry_t *old, *ent;
+    uint32_t prio = bank->hw_layout[slot].prio;
+    int32_t t, dir;
+
+    for(dir = -1; dir <= 1; dir += 2) {
+        for(t = slot + dir; (t >= 0) && (t < (int32_t) bank->max_tcam_entries); t += dir) {
+            old = &bank->hw_layout[t];
+            ent = &bank->tcam_cache[t];
+            if((old->id == TCAM_CELL_STATE_EMPTY) && (ent->id == TCAM_CELL_STATE_EMPTY)) {
+                if(bank->plan_src[t] == PLAN_NONE)
+                    return t;
+                break;
+            }
+            if(((old->id != TCAM_CELL_STATE_EMPTY) && (old->prio != prio)) ||
+               ((ent->id != TCAM_CELL_STATE_EMPTY) && (ent->prio != prio)))
+                break;
+        }
+    }
+    return -1;
+}
+
+/* Programs the slots of insert_slots which differ between hw_tcam and the
+ * tcam_cache, in the order described above, and empties insert_slots. Every
+ * slot changed since the last programming has to be in insert_slots. The
+ * writes are recorded in the journal.
+ */
+static tcam_err_t plan_program(tcam_bank_t *bank)
+{
+    uint32_t *slots = bank->insert_slots, *order = bank->plan_order;
+    uint32_t k, n = 0, up = 0, down = bank->max_tcam_entries, temps = 0;
+    int32_t x, to, t, delta = 0;
+    entry_t *old = bank->hw_layout;
+    tcam_err_t ret_val = TCAM_ERR_SUCCESS;
+
+    for(k = 0; k < bank->num_insert_slots; k++)
+        bank->plan_src[slots[k]] = PLAN_NONE;
+    for(k = 1; (k < bank->num_insert_slots) && (slots[k-1] < slots[k]); k++);
+    if(k < bank->num_insert_slots)
+        qsort(slots, bank->num_insert_slots, sizeof(uint32_t), slot_cmp);
+    // Only the slots which differ are kept, and each moved entry gets the
+    // slot it comes from, unless hw_tcam already has it there (a copy of
+    // the same entry)
+    for(k = 0; k < bank->num_insert_slots; k++) {
+        if(!plan_differs(bank, slots[k]))
+            continue;
+        x = slots[n++] = slots[k];
+        to = bank->plan_dst[x] = plan_dest(bank, x, x + delta);
+        if((to >= 0) && (to != x)) {
+            if(plan_differs(bank, to))
+                bank->plan_src[to] = x;
+            delta = to - x;
+        }
+    }
+    bank->num_insert_slots = 0;
+    // The slots written in ascending order first in 'order', the ones written
+    // in descending order at its end, the others are left for the end
+    for(k = 0; k < n; k++) {
+        x = slots[k];
+        if(bank->plan_src[x] > x)
+            order[up++] = x;
+        else if((bank->plan_src[x] >= 0) || (bank->plan_dst[x] > x))
+            order[--down] = x;
+    }
+    if((ret_val = undo_reserve(bank, n)) != TCAM_ERR_SUCCESS)
+        goto done;
+
+    for(k = 0; k < up + bank->max_tcam_entries - down; k++) {
+        x = (k < up) ? order[k] : order[down + k - up];
+        if(!plan_ready(bank, x)) {
+            // Entries of the same priority cross, the entry hw_tcam has at
+            // the slot is copied to a temporary slot first. The temporary
+            // slots go in the unused middle of 'order'.
+            if((t = plan_temp_slot(bank, x)) >= 0) {
+                if(((ret_val = undo_reserve(bank, 2)) != TCAM_ERR_SUCCESS) ||
+                   ((ret_val = undo_program_ent(bank, &old[x], t)) != TCAM_ERR_SUCCESS))
+                    goto done;
+                bank->plan_src[t] = PLAN_TEMP;
+                order[up + temps++] = t;
+            } else {
+                // Overwriting the slot would miss the entry, the caller
+                // undoes the writes done so far
+                TCAM_LOG(bank, TCAM_LOG_ERROR, "ERROR : No empty slot to keep the entry %u while its slot %d is written\n",
+                       old[x].id, x);
+                ret_val = TCAM_ERR_TCAM_FULL;
+                goto done;
+            }
+        }
+        bank->plan_src[x] = PLAN_DONE;
+        if((ret_val = undo_program(bank, x)) != TCAM_ERR_SUCCESS)
+            goto done;
+    }
+    for(k = 0; k < n; k++) {
+        x = slots[k];
+        if((bank->plan_src[x] != PLAN_DONE) && ((ret_val = undo_program(bank, x)) != TCAM_ERR_SUCCESS))
+            goto done;
+    }
+    for(k = 0; k < temps; k++) {
+        if((ret_val = undo_program(bank, order[up + k])) != TCAM_ERR_SUCCESS)
+            goto done;
+    }
+
+done:
+    for(k = 0; k < n; k++)
+        bank->plan_src[slots[k]] = PLAN_NONE;
+    for(k = 0; k < temps; k++)
+        bank->plan_src[order[up + k]] = PLAN_NONE;
+    return ret_val;
+}
+
+/*  Description:
+ *     This API initializes a TCAM bank handler (TCAM cache ) serving the given
+ *     hw_tcam. 
+ *     It returns  in case of success and a pointer to the handler
+ *
+ * Arguments
+ *  hw_tcam - address of hardware tcam memory
+ *  size    - size of the memory to be allocated 
+ *  tcam    - pointer to memory allocated 
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+
+tcam_err_t tcam_init(entry_t *hw_tcam, uint32_t size, void **tcam)
+{
+    tcam_bank_t *bank;
+
+    *tcam = NULL;
+    bank = calloc(1, sizeof(tcam_bank_t));
+    if(bank == NULL)
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    bank->max_tcam_entries = size;
+    bank->tcam_cache = calloc(size, sizeof(entry_t));
+    bank->insert_slots = calloc(size, sizeof(uint32_t));
+    bank->snap[0] = calloc(size, sizeof(entry_t));
+    bank->snap[1] = calloc(size, sizeof(entry_t));
+    bank->undo_last = malloc(size * sizeof(int32_t));
+    bank->hw_layout = calloc(size, sizeof(entry_t));
+    bank->plan_src = malloc(size * sizeof(int32_t));
+    bank->plan_dst = malloc(size * sizeof(int32_t));
+    bank->plan_order = malloc(size * sizeof(uint32_t));
+    bank->key_free = malloc(size * sizeof(uint32_t));
+    bank->key_refs = malloc(size * sizeof(uint32_t));
+    if((bank->key_free == NULL) || (bank->key_refs == NULL) ||
+       (key_store_init(bank, TCAM_KEY_BITS / 32) != TCAM_ERR_SUCCESS) ||
+       (bank->tcam_cache == NULL) || (bank->insert_slots == NULL) || (bank->hw_layout == NULL) ||
+       (bank->plan_src == NULL) || (bank->plan_dst == NULL) || (bank->plan_order == NULL) ||
+       (bank->snap[0] == NULL) || (bank->snap[1] == NULL) || (bank->undo_last == NULL) ||
+       (id_index_init(bank, size) != TCAM_ERR_SUCCESS) ||
+       (occ_init(bank, size) != TCAM_ERR_SUCCESS) ||
+       (prio_group_init(bank, size) != TCAM_ERR_SUCCESS)) {
+        tcam_cache_destroy(bank);
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    }
+    hw_tcam_init(&bank->hw_tcam, hw_tcam, size);
+    if(hw_tcam_set_key_width(&bank->hw_tcam, bank->key_words) != TCAM_ERR_SUCCESS) {
+        tcam_cache_destroy(bank);
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    }
+    memset(bank->undo_last, 0xff, size * sizeof(int32_t));
+    memset(bank->plan_src, 0xff, size * sizeof(int32_t));
+
+    bank->batch_merge_min = TCAM_BATCH_MERGE_MIN;
+    bank->placement = TCAM_PLACEMENT_SHIFT_DOWN_FIRST;
+    bank->shift_mode = TCAM_SHIFT_MODE_ENTRIES;
+    bank->rebalance_rate = 0;
+    bank->rebalance_hole = -1;
+    bank->log_level = TCAM_LOG_ERROR;
+    bank->snap_lo = UINT32_MAX;
+    bank->snap_hi = 0;
+    *tcam = bank;
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Batch insertion by merge.
+ *
+ * A batch of at least 'batch_merge_min' entries is not placed entry by entry.
+ * The batch is put in its final order (ascending priority, and in a group the
+ * latest entry of the batch first) and then merged with the tcam_cache in a
+ * single pass over the slots. The pass reproduces the placement rules of the
+ * entry by entry insertion, as if the entries were inserted in ascending
+ * priority order:
+ *  - an entry whose next entry has an empty slot before it takes that slot,
+ *    as do the following entries of the same priority while the empty slots
+ *    last
+ *  - otherwise it is inserted before the next entry which, together with the
+ *    entries that follow it, is pushed down to the nearest empty slot
+ *  - the entries after the last one are appended after it
+ *  - when no empty slot is left below, the entries are pushed up instead into
+ *    the nearest empty slots above
+ * So the layout is the same as the one of the entry by entry insertion when
+ * the batch is already in priority order or when the bank is empty. For an
+ * unsorted batch the order of the entries is the same and only the choice of
+ * the empty slots which absorb them can differ.
+ * The slots which change are in a single range which is then programmed in
+ * hw_tcam by plan_program(), every slot at most once.
+ */
+
+// Source of a slot in the merged layout : the slot of an existing entry,
+// -(k+1) for the k-th entry of the batch, or an empty slot
+#define MERGE_HOLE INT32_MIN
+#define MERGE_BATCH(k) (-((int32_t)(k)) - 1)
+#define MERGE_BATCH_IDX(code) (-(code) - 1)
+
+typedef struct merge_key_ {
+    uint32_t prio;
+    uint32_t idx;
+} merge_key_t;
+
+static int merge_key_cmp(const void *a, const void *b)
+{
+    const merge_key_t *ka = a, *kb = b;
+
+    if(ka->prio != kb->prio)
+        return (ka->prio < kb->prio) ? -1 : 1;
+    // the latest entry of the batch is the first of its group
+    return (ka->idx > kb->idx) ? -1 : (ka->idx < kb->idx);
+}
+
+/* Fills 'order' with the indexes of the batch entries in their final order.
+ * A batch in ascending or descending priority order is not sorted.
+ */
+static tcam_err_t tcam_merge_order(entry_t *entries, uint32_t num, uint32_t *order)
+{
+    uint32_t i, k, start;
+    bool ascending = TRUE, descending = TRUE;
+    merge_key_t *keys;
+
+    for(i = 1; i < num; i++) {
+        if(entries[i].prio < entries[i-1].prio)
+            ascending = FALSE;
+        if(entries[i].prio > entries[i-1].prio)
+            descending = FALSE;
+    }
+    if(descending) {
+        // the reversed batch is in ascending order with the latest entries first
+        for(i = 0; i < num; i++)
+            order[i] = num - 1 - i;
+    } else if(ascending) {
+        // only the entries of each group have to be reversed
+        for(start = 0; start < num; start = i) {
+            for(i = start; (i < num) && (entries[i].prio == entries[start].prio); i++);
+            for(k = start; k < i; k++)
+                order[k] = start + i - 1 - k;
+        }
+    } else {
+        if((keys = malloc(num * sizeof(merge_key_t))) == NULL)
+            return TCAM_ERR_MEM_ALLOC_FAIL;
+        for(i = 0; i < num; i++) {
+            keys[i].prio = entries[i].prio;
+            keys[i].idx = i;
+        }
+        qsort(keys, num, sizeof(merge_key_t), merge_key_cmp);
+        for(i = 0; i < num; i++)
+            order[i] = keys[i].idx;
+        free(keys);
+    }
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Computes the merged layout of the tcam_cache and the batch. 'out' gets the
+ * source of every slot. 'queue' holds the entries pushed down by the
+ * insertions and has room for max_tcam_entries + num codes.
+ */
+static void tcam_merge_layout(tcam_bank_t *bank, entry_t *entries, uint32_t num,
+                              uint32_t *order, int32_t *out, int32_t *queue)
+{
+    int32_t x, w, h, last_out = -1, free_before;
+    uint32_t bi = 0, st, r, run, k, qh = 0, qt = 0;
+
+    for(x = 0; x < bank->max_tcam_entries; x++) {
+        if(bank->tcam_cache[x].id != TCAM_CELL_STATE_EMPTY) {
+            // the batch entries which go before the entry at x
+            for(st = bi; (bi < num) && (entries[order[bi]].prio <= bank->tcam_cache[x].prio); bi++);
+            free_before = x - 1 - last_out;
+            if((st < bi) && (qh == qt) && (free_before > 0)) {
+                // the first group of them can take the empty slots before x
+                for(r = st; (r < bi) && (entries[order[r]].prio == entries[order[st]].prio); r++);
+                run = r - st;
+                if(run <= free_before) {
+                    for(k = 0; k < run; k++)
+                        out[x - run + k] = MERGE_BATCH(order[st + k]);
+                    st = r;
+                } else {
+                    for(k = 0; k < free_before; k++)
+                        out[x - free_before + k] = MERGE_BATCH(order[st + k]);
+                    st += free_before;
+                }
+            }
+            for(; st < bi; st++)
+                queue[qt++] = MERGE_BATCH(order[st]);
+            queue[qt++] = x;
+        }
+        if(qh < qt) {
+            out[x] = queue[qh++];
+            last_out = x;
+        } else {
+            out[x] = MERGE_HOLE;
+        }
+    }
+    // the batch entries which go after all the others
+    for(; bi < num; bi++)
+        queue[qt++] = MERGE_BATCH(order[bi]);
+    for(x = last_out + 1; (x < bank->max_tcam_entries) && (qh < qt); x++)
+        out[x] = queue[qh++];
+    if(qh < qt) {
+        // No empty slot is left below, so the remaining entries are pushed up
+        // into the nearest empty slots above
+        for(k = qt - qh, h = bank->max_tcam_entries - 1; h >= 0; h--) {
+            if((out[h] == MERGE_HOLE) && (--k == 0))
+                break;
+        }
+        for(x = w = h; x < bank->max_tcam_entries; x++) {
+            if(out[x] != MERGE_HOLE)
+                out[w++] = out[x];
+        }
+        while(qh < qt)
+            out[w++] = queue[qh++];
+    }
+}
+
+static tcam_err_t tcam_insert_merge(tcam_bank_t *bank, entry_t *entries, uint32_t *refs, uint32_t num)
+{
+    int32_t x, lo = -1, hi = -1, code;
+    int32_t *out, *queue;
+    uint32_t *order;
+    entry_t *merged, entry;
+    uint64_t n1, n2;
+    bool moved_up = FALSE, moved_down = FALSE;
+    uint32_t moved = 0, policy;
+    tcam_err_t ret_val;
+
+    out = malloc(bank->max_tcam_entries * sizeof(int32_t));
+    queue = malloc((bank->max_tcam_entries + num) * sizeof(int32_t));
+    order = malloc(num * sizeof(uint32_t));
+    merged = malloc(bank->max_tcam_entries * sizeof(entry_t));
+    if((out == NULL) || (queue == NULL) || (order == NULL) || (merged == NULL)) {
+        ret_val = TCAM_ERR_MEM_ALLOC_FAIL;
+        goto done;
+    }
+    if((ret_val = tcam_merge_order(entries, num, order)) != TCAM_ERR_SUCCESS)
+        goto done;
+    tcam_merge_layout(bank, entries, num, order, out, queue);
+
+    // The range of slots which change
+    for(x = 0; x < bank->max_tcam_entries; x++) {
+        if((out[x] != x) && (out[x] != MERGE_HOLE)) {
+            if(lo < 0)
+                lo = x;
+            hi = x;
+        }
+    }
+
+    if((ret_val = undo_reserve(bank, 1)) != TCAM_ERR_SUCCESS)
+        goto done;
+
+    for(x = lo; x <= hi; x++) {
+        code = out[x];
+        if(code == MERGE_HOLE) {
+            memset(&merged[x], 0, sizeof(entry_t));
+        } else if(code >= 0) {
+            merged[x] = bank->tcam_cache[code];
+            if(code != x) {
+                id_index_del(bank, bank->tcam_cache[code].id, code);
+                moved++;
+            }
+            if(code < x)
+                moved_down = TRUE;
+            else if(code > x)
+                moved_up = TRUE;
+        } else {
+            merged[x] = batch_entry(entries, refs, MERGE_BATCH_IDX(code));
+        }
+    }
+    // merged keeps the previous content of the range for the undo
+    for(x = lo; x <= hi; x++) {
+        entry = bank->tcam_cache[x];
+        bank->tcam_cache[x] = merged[x];
+        merged[x] = entry;
+    }
+    snap_dirty(bank, lo, hi);
+    undo_begin(bank);
+    undo_log(bank, UNDO_MERGE, lo, hi);
+    plan_begin(bank);
+    for(x = lo; x <= hi; x++) {
+        if(out[x] == MERGE_HOLE) {
+            occ_clear(bank, x);
+        } else {
+            occ_set(bank, x);
+            if(out[x] != x) {
+                id_index_add(bank, bank->tcam_cache[x].id, x);
+                plan_add(bank, x);
+            }
+        }
+    }
+    prio_group_rebuild(bank);
+    bank->total_tcam_entries += num;
+
+    policy = (moved_up ? TCAM_ENTRY_SHIFT_UP : 0) | (moved_down ? TCAM_ENTRY_SHIFT_DOWN : 0);
+    TCAM_LOG(bank, TCAM_LOG_DEBUG, "Shift policy = %s\n", policy_names[policy]);
+    TCAM_LOG(bank, TCAM_LOG_DEBUG, "Merged %d entries, writing entries from %d to %d\n", num, lo, hi);
+
+    n1 = tcam_get_hw_access_cnt(&bank->hw_tcam);
+    if((ret_val = plan_program(bank)) != TCAM_ERR_SUCCESS) {
+        TCAM_LOG(bank, TCAM_LOG_ERROR, "ERROR : Could'nt program hw_tcam, the merge is undone\n");
+        undo_rollback(bank, merged);
+        bank->total_tcam_entries -= num;
+        snap_publish(bank);
+        goto done;
+    }
+    undo_end(bank);
+    n2 = tcam_get_hw_access_cnt(&bank->hw_tcam);
+    TCAM_LOG(bank, TCAM_LOG_DEBUG, "The number of programming to hw_tcam for %d entries is %llu\n",num, (unsigned long long) (n2-n1));
+    bank->tcam_stats.insert_calls++;
+    bank->tcam_stats.inserted_entries += num;
+    bank->tcam_stats.insert_hw_writes += n2 - n1;
+    bank->tcam_stats.shifted_entries += n2 - n1 - num;
+    bank->tcam_stats.moved_bytes += moved * sizeof(entry_t);
+    bank->insert_policy = policy;
+    bank->tcam_stats.policy_inserts[policy]++;
+    bank->tcam_stats.policy_hw_writes[policy] += n2 - n1;
+    if(moved > bank->tcam_stats.max_shift)
+        bank->tcam_stats.max_shift = moved;
+    snap_publish(bank);
+
+done:
+    free(out);
+    free(queue);
+    free(order);
+    free(merged);
+    return ret_val;
+}
+
+/* Extends the window [*start, *end] of the slots changed by tcam_insert()
+ * to [lo, hi]
+ */
+static void shift_window_add(int32_t *start, int32_t *end, int32_t lo, int32_t hi)
+{
+    if(lo < *start)
+        *start = lo;
+    if(hi > *end)
+        *end = hi;
+}
+
+/* Inserts the entries one by one in the tcam_cache and lists the slots which
+ * changed in insert_slots, for plan_program(). 'refs' has the records of
+ * their keys, see batch_entry(). The changes are recorded in the journal,
+ * which the caller has started, and they are not undone on a failure.
+ */
+static tcam_err_t tcam_insert_entries(tcam_bank_t *bank, entry_t *entries, uint32_t *refs, uint32_t num)
+{
+    int32_t i , j, top , bottom  ;
+    uint32_t g;
+    int32_t  insert_pos, shift_pos;
+    entry_t entry;
+    entry_t *tcam_cache = bank->tcam_cache;
+    bool shift_up = FALSE, shift_down = FALSE, found = FALSE;
+    int32_t shift_start , shift_end;
+    int32_t up_pos, up_cost, down_cost;
+    bool use_up;
+    uint64_t shifted;
+    tcam_err_t ret_val = TCAM_ERR_SUCCESS;
+
+    // Only the slots changed by this call are tracked, so that its cost does
+    // not depend on the size of the bank
+    plan_begin(bank);
+    shift_start = INT32_MAX;
+    shift_end = -1;
+        
+    i = 0;
+    top = bank->max_tcam_entries;
+    // First entry
+    if(bank->total_tcam_entries <= 0) {
+        if((ret_val = undo_reserve(bank, 1)) != TCAM_ERR_SUCCESS)
+            return ret_val;
+        bank->total_tcam_entries  = 1;
+        insert_pos = 0;
+        entry = batch_entry(entries, refs, 0);
+        tcam_cache_place(bank, insert_pos, &entry);
+        i = 1;
+        plan_add(bank, insert_pos);
+        shift_window_add(&shift_start, &shift_end, insert_pos, insert_pos);
+    } 
+
+    shift_up = shift_down = FALSE;
+   
+    for(; i < num; i++) {        
+        found = FALSE;
+        insert_pos = 0;
+        shifted = bank->tcam_stats.shifted_entries;
+        // At most a move per group crossed, the shift and the placement
+        if((ret_val = undo_reserve(bank, bank->num_prio_groups + 2)) != TCAM_ERR_SUCCESS)
+            return ret_val;
+        // The first non-empty slot with a prio >= to that of this element
+        // is the first slot of the first priority group >= to it
+        g = prio_group_lower_bound(bank, entries[i].prio);
+        if(g < bank->num_prio_groups) {
+            j = bank->prio_groups[g].first;
+            found = TRUE;
+        }
+        
+        if(found) {
+            // We found a non-empty entry which either has prio >= to that
+            // of this element. So we need to check for a empty slot to
+            // insert. So first let's check if we can insert at the previous
+            // slot else we may need to shift the old entries by one position
+            if((j == 0) || ((j > 0) && (tcam_cache[j-1].id != TCAM_CELL_STATE_EMPTY))) {
+
+                // We have to shift the entries  by one cell to make
+                // way for the new entry. Look up the first empty slot after j
+                shift_pos = occ_next_free(bank, j+1);
+                use_up = (shift_pos < 0);
+
+                if((bank->placement == TCAM_PLACEMENT_MIN_MOVE) && (shift_pos >= 0) &&
+                   ((up_pos = occ_prev_free(bank, j-1)) >= 0)) {
+                    // Shifting down rewrites the entries in [j, shift_pos-1] and the new
+                    // entry, shifting up the ones in [up_pos+1, j-1] and the new entry.
+                    // With the group boundary shifting, one entry per group in these
+                    // ranges is rewritten. Take the direction with the fewer writes,
+                    // down on a tie
+                    if(bank->shift_mode == TCAM_SHIFT_MODE_GROUP_BOUNDARY) {
+                        down_cost = prio_group_slot_bound(bank, shift_pos - 1) - g + 2;
+                        up_cost = g - prio_group_slot_bound(bank, up_pos + 1) + 1;
+                    } else {
+                        down_cost = shift_pos - j + 1;
+                        up_cost = j - up_pos;
+                    }
+                    if(up_cost < down_cost) {
+                        use_up = TRUE;
+                        bank->tcam_stats.writes_saved += down_cost - up_cost;
+                    }
+                }
+
+                if(use_up) {
+                    // We could'nt find an entry to shift down . So let's check if we can find an empty entry to shift upwards
+                    insert_pos = (j-1);
+                    shift_pos = occ_prev_free(bank, insert_pos);
+
+                    if(shift_pos < 0) {
+                        TCAM_LOG(bank, TCAM_LOG_ERROR, "ERROR : Could'nt find an empty entry slot  \n");
+                        return TCAM_ERR_TCAM_FULL;
+                    }
+                    bank->tcam_stats.shifts_up++;
+                    // Indicate that we had to shift up
+                    shift_up = TRUE;
+                    if(bank->shift_mode == TCAM_SHIFT_MODE_GROUP_BOUNDARY) {
+                        tcam_cache_move_hole(bank, shift_pos, insert_pos, &bank->tcam_stats.shifted_entries);
+                        goto place;
+                    }
+                    tcam_cache_shift_up(bank, shift_pos, insert_pos);
+                    bank->tcam_stats.shifted_entries += insert_pos - shift_pos;
+                    // since the entries are shifted , we have to record the start and end of the range of entries.
+                    // The entry at j does not move, so the range ends at the new entry
+                    shift_window_add(&shift_start, &shift_end, shift_pos, insert_pos);
+                } else {
+                    insert_pos = j;
+                    bank->tcam_stats.shifts_down++;
+                    // Indicate that we had to shift down
+                    shift_down = TRUE;
+                    if(bank->shift_mode == TCAM_SHIFT_MODE_GROUP_BOUNDARY) {
+                        tcam_cache_move_hole(bank, shift_pos, insert_pos, &bank->tcam_stats.shifted_entries);
+                        goto place;
+                    }
+                    tcam_cache_shift_down(bank, insert_pos, shift_pos);
+                    bank->tcam_stats.shifted_entries += shift_pos - insert_pos;
+                    // since the entries are shifted , we have to record the start and end of the range of entries
+                    shift_window_add(&shift_start, &shift_end, j, shift_pos);
+                }
+            } else  { // empty slot found
+                insert_pos = j-1;
+                /* Even when entries are not shifted , we have to record the position , since there may be other entries
+                 * in the input for which shfiting has to be done. This index is recorded so that it may not be missed 
+                 */
+                shift_window_add(&shift_start, &shift_end, insert_pos, insert_pos);
+            }
+        } else {
+            /* No valid slot found. There are 3 reasons for this to happen :
+             * 1. We could not find an empty slot at all
+             * 2. There are empty slots in the middle of the tcam cache but this entry has to be inserted at the 
+             *     end of the table.
+             * 3. There are empty slots at the end of the tcam cache and this entry has to be inserted at the
+             *    first such entry
+             *    So we have to first start from the end of the cache and iterate backwards to find an empty slot .
+             *    If no empty slot is found, then we have to return an error. 
+             *    To check for case 2 mentioned above, let's check if the last entry (for e.g, 2047th) entry is occupied . This means 
+             *    we have to shift the entries upwards and insert the new entry at the end 
+             *    If the last entry is empty, then we just iterate backwards until we find the first non-empty entry and then 
+             *    insert this new entry after that position 
+             */
+
+            insert_pos = bank->max_tcam_entries-1;
+            if(tcam_cache[insert_pos].id != TCAM_CELL_STATE_EMPTY) {
+
+                shift_pos = occ_prev_free(bank, insert_pos);
+
+                if(shift_pos < 0 ) {
+                    // All entries are full. Not empty slot found  found . Return an error
+                    TCAM_LOG(bank, TCAM_LOG_ERROR, "ERROR : Could'nt find an empty slot to shift the entries upwards \n");
+                    return TCAM_ERR_TCAM_FULL;
+                }
+                bank->tcam_stats.shifts_up++;
+                shift_up = TRUE;
+                if(bank->shift_mode == TCAM_SHIFT_MODE_GROUP_BOUNDARY) {
+                    tcam_cache_move_hole(bank, shift_pos, insert_pos, &bank->tcam_stats.shifted_entries);
+                    goto place;
+                }
+                tcam_cache_shift_up(bank, shift_pos, insert_pos);
+                bank->tcam_stats.shifted_entries += insert_pos - shift_pos;
+                // since the entries are shifted , we have to record the start and end of the range of entries
+                shift_window_add(&shift_start, &shift_end, shift_pos, insert_pos);
+            } else {
+                /* The last non-empty slot is the last slot of the last priority group. Then we just insert
+                 * the new entry at the (non-empty slot index + 1)
+                 */
+                shift_pos = (bank->num_prio_groups > 0) ? bank->prio_groups[bank->num_prio_groups-1].last : -1;
+                
+                /*  Found an entry or none at all. If found, we insert at the 'j'th index or at the '0'th index.
+                 *  There is a small caveat here . If in case the value of j < 0, then that means that all entries 
+                 *  are emtpy from end to start of the cache. Should'nt happen but that also will be handled, when we 
+                 *  insert at the '0'th index 
+                 */
+                insert_pos = shift_pos+1;
+                /* Even when entries are not shifted , we have to record the position , since there may be other entries
+                 * in the input for which shfiting has to be done. This index is recorded so that it may not be missed 
+                 */
+                shift_window_add(&shift_start, &shift_end, insert_pos, insert_pos);
+            }
+        }
+place:
+        // Now let's copy the entry at the intended position , i.e "insert_pos"
+        entry = batch_entry(entries, refs, i);
+        tcam_cache_place(bank, insert_pos, &entry);
+        plan_add(bank, insert_pos);
+        if(bank->tcam_stats.shifted_entries - shifted > bank->tcam_stats.max_shift)
+            bank->tcam_stats.max_shift = bank->tcam_stats.shifted_entries - shifted;
+        // The groups rotated for an entry by the group boundary shifting are
+        // programmed before the next entry rotates them again, so that the
+        // entries of a group never have to cross each other in hw_tcam
+        if((bank->shift_mode == TCAM_SHIFT_MODE_GROUP_BOUNDARY) &&
+           ((ret_val = plan_program(bank)) != TCAM_ERR_SUCCESS))
+            return ret_val;
+        bank->total_tcam_entries++;
+    }
+    /* if the entries were either shifted up or down, then [shift_start, shift_end] is the window of the
+     * slots which changed. This range of entries has to be programmed in hw_tcam. The group boundary
+     * shifting has already programmed every entry it placed
+     */
+    bank->insert_policy = (shift_up ? TCAM_ENTRY_SHIFT_UP : 0) | (shift_down ? TCAM_ENTRY_SHIFT_DOWN : 0);
+    TCAM_LOG(bank, TCAM_LOG_DEBUG, "Shift policy = %s\n", policy_names[bank->insert_policy]);
+    if((shift_up || shift_down) && (bank->shift_mode != TCAM_SHIFT_MODE_GROUP_BOUNDARY)) {
+        TCAM_LOG(bank, TCAM_LOG_DEBUG, "Writing entries from %d to %d\n",shift_start, shift_end);
+        plan_begin(bank);
+        for(i = shift_start; i <= shift_end; i++)
+            plan_add(bank, i);
+    }
+    return ret_val;
+}
+
+
+/* Inserts a batch of entries whose keys have the records 'refs', see
+ * tcam_insert_keys()
+ */
+static tcam_err_t tcam_insert_refs(tcam_bank_t *bank, entry_t *entries, uint32_t *refs, uint32_t num)
+{
+    uint64_t n1 , n2 ;
+    int32_t saved_total;
+    tcam_stats_t saved_stats;
+    tcam_err_t ret_val;
+
+    // Large batches are merged with the cache in a single pass
+    if((bank->batch_merge_min > 0) && (num >= bank->batch_merge_min))
+        return tcam_insert_merge(bank, entries, refs, num);
+
+    n1 = tcam_get_hw_access_cnt(&bank->hw_tcam);
+    // Every change is recorded so that a failure leaves nothing half applied
+    saved_total = bank->total_tcam_entries;
+    saved_stats = bank->tcam_stats;
+    undo_begin(bank);
+    if(((ret_val = tcam_insert_entries(bank, entries, refs, num)) != TCAM_ERR_SUCCESS) ||
+       ((ret_val = plan_program(bank)) != TCAM_ERR_SUCCESS)) {
+        // Nothing of the batch is kept, the readers still see the tcam_cache
+        // as it was before the call
+        TCAM_LOG(bank, TCAM_LOG_ERROR, "ERROR : The insertion of the batch is undone\n");
+        undo_rollback(bank, NULL);
+        bank->total_tcam_entries = saved_total;
+        bank->tcam_stats = saved_stats;
+        snap_publish(bank);
+        return ret_val;
+    }
+    undo_end(bank);
+
+    n2 = tcam_get_hw_access_cnt(&bank->hw_tcam);
+    TCAM_LOG(bank, TCAM_LOG_DEBUG, "The number of programming to hw_tcam for %d entries is %llu\n",num, (unsigned long long) (n2-n1)); 
+    bank->tcam_stats.insert_calls++;
+    bank->tcam_stats.inserted_entries += num;
+    bank->tcam_stats.insert_hw_writes += n2 - n1;
+    bank->tcam_stats.policy_inserts[bank->insert_policy]++;
+    bank->tcam_stats.policy_hw_writes[bank->insert_policy] += n2 - n1;
+    snap_publish(bank);
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Inserts a batch of entries and their keys in the bank, which has room for
+ * them, see tcam_insert_keys()
+ */
+static tcam_err_t tcam_insert_hw(tcam_bank_t *bank, entry_t *entries, const uint32_t *keys, uint32_t num)
+{
+    uint32_t i, ref, *refs = NULL;
+    tcam_err_t ret_val;
+
+    if((ret_val = tss_insert(bank, entries, keys, num)) != TCAM_ERR_SUCCESS)
+        return ret_val;
+    // Every entry has a free record, there are as many as slots
+    if(keys != NULL) {
+        refs = bank->key_refs;
+        for(i = 0; i < num; i++) {
+            ref = refs[i] = bank->key_free[--bank->key_free_top];
+            memcpy(&bank->key_store[ref * bank->key_rec], &keys[i * 2 * bank->key_words],
+                   2 * bank->key_words * sizeof(uint32_t));
+        }
+    }
+    if((ret_val = tcam_insert_refs(bank, entries, refs, num)) != TCAM_ERR_SUCCESS) {
+        for(i = num; (refs != NULL) && (i > 0); i--)
+            key_release(bank, refs[i - 1]);
+        tss_remove(bank, entries, num);
+    }
+    return ret_val;
+}
+
+/* Deletes the entries of the busy 'slots', in ascending order, like
+ * tcam_remove_batch()
+ */
+static tcam_err_t tcam_remove_slots(tcam_bank_t *bank, uint32_t *slots, uint32_t num, uint32_t *writes)
+{
+    uint64_t n1;
+    entry_t entry;
+    tcam_err_t ret_val;
+    uint32_t k;
+
+    if((ret_val = undo_reserve(bank, num)) != TCAM_ERR_SUCCESS)
+        return ret_val;
+
+    // hw_tcam first, the tcam_cache keeps the entries until the burst is
+    // done so that the journal can restore them
+    n1 = tcam_get_hw_access_cnt(&bank->hw_tcam);
+    undo_begin(bank);
+    for(k = 0; k < num; k++) {
+        entry = bank->tcam_cache[slots[k]];
+        entry.id = TCAM_CELL_STATE_EMPTY;
+        if((ret_val = undo_program_ent(bank, &entry, slots[k])) != TCAM_ERR_SUCCESS) {
+            TCAM_LOG(bank, TCAM_LOG_ERROR, "ERROR : Could'nt program hw_tcam, the deletion is undone\n");
+            undo_rollback(bank, NULL);
+            return ret_val;
+        }
+    }
+    undo_end(bank);
+    if(writes != NULL)
+        *writes = tcam_get_hw_access_cnt(&bank->hw_tcam) - n1;
+
+    for(k = 0; k < num; k++) {
+        if(bank->tss != NULL)
+            tcam_tss_remove(bank->tss, bank->tcam_cache[slots[k]].id);
+        key_release(bank, bank->tcam_cache[slots[k]].key_ref);
+        tcam_cache_clear(bank, slots[k]);
+    }
+    bank->total_tcam_entries -= num;
+    snap_publish(bank);
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Spill tier.
+ *
+ * With TCAM_OPT_SPILL, the entries which do not fit in hw_tcam are kept in a
+ * software table and looked up by tcam_lookup() when no entry of hw_tcam
+ * matches the key. No spilled entry ranks above an entry of hw_tcam, so the
+ * result is the one of a bank large enough for all the entries. The table is
+ * ordered from the lowest ranking entry to the highest one, and a Tuple
+ * Space Search classifier of its entries serves the lookups.
+ * A full bank takes a new entry by spilling the entry of its last busy slot,
+ * after it was added to the table (make before break), unless the new entry
+ * ranks lower. As slots are freed, the highest ranking spilled entry is
+ * programmed after the last busy slot, since it ranks below all of them.
+ */
+
+/* (Re)creates the empty classifier of the spilled entries */
+static tcam_err_t spill_init(tcam_bank_t *bank)
+{
+    tcam_tss_destroy(bank->spill_tss);
+    bank->spill_tss = NULL;
+    return tcam_tss_init(32 * bank->key_words, &bank->spill_tss);
+}
+
+/* Returns the number of spilled entries with a priority >= prio. A new
+ * entry of this priority goes at this index, above the older ones.
+ */
+static uint32_t spill_bound(tcam_bank_t *bank, uint32_t prio)
+{
+    uint32_t lo = 0, hi = bank->num_spill, mid;
+
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(bank->spill[mid].prio >= prio)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Returns the index of the spilled entry with the given id or -1 */
+static int32_t spill_find(tcam_bank_t *bank, uint32_t id)
+{
+    entry_t ent;
+    int32_t k;
+
+    if((bank->spill_tss == NULL) || (id == TCAM_CELL_STATE_EMPTY) ||
+       (tcam_tss_get(bank->spill_tss, id, &ent) != TCAM_ERR_SUCCESS))
+        return -1;
+    for(k = (int32_t) spill_bound(bank, ent.prio) - 1; (k >= 0) && (bank->spill[k].prio == ent.prio); k--) {
+        if(bank->spill[k].id == id)
+            return k;
+    }
+    return -1;
+}
+
+/* Puts the entry and its key at the index 'k' of the table, which has room
+ * for it
+ */
+static void spill_put(tcam_bank_t *bank, uint32_t k, const entry_t *ent, const uint32_t *key)
+{
+    uint32_t words = 2 * bank->key_words;
+
+    memmove(&bank->spill[k + 1], &bank->spill[k], (bank->num_spill - k) * sizeof(entry_t));
+    memmove(&bank->spill_keys[(k + 1) * words], &bank->spill_keys[k * words],
+            (bank->num_spill - k) * words * sizeof(uint32_t));
+    bank->tcam_stats.moved_bytes += (bank->num_spill - k) * (sizeof(entry_t) + words * sizeof(uint32_t));
+    bank->spill[k] = *ent;
+    bank->spill[k].key_ref = 0;
+    if(key != NULL)
+        memcpy(&bank->spill_keys[k * words], key, words * sizeof(uint32_t));
+    else
+        memset(&bank->spill_keys[k * words], 0, words * sizeof(uint32_t));
+    bank->num_spill++;
+}
+
+/* Takes the entry at the index 'k' out of the table */
+static void spill_cut(tcam_bank_t *bank, uint32_t k)
+{
+    uint32_t words = 2 * bank->key_words;
+
+    bank->num_spill--;
+    memmove(&bank->spill[k], &bank->spill[k + 1], (bank->num_spill - k) * sizeof(entry_t));
+    memmove(&bank->spill_keys[k * words], &bank->spill_keys[(k + 1) * words],
+            (bank->num_spill - k) * words * sizeof(uint32_t));
+    bank->tcam_stats.moved_bytes += (bank->num_spill - k) * (sizeof(entry_t) + words * sizeof(uint32_t));
+}
+
+/* Adds an entry and its key, NULL matching any key, to the spill tier. It
+ * ranks above the spilled entries of the same priority.
+ */
+static tcam_err_t spill_add(tcam_bank_t *bank, const entry_t *ent, const uint32_t *key)
+{
+    uint32_t size = bank->spill_max;
+    entry_t *spill;
+    uint32_t *spill_keys;
+    tcam_err_t ret_val;
+
+    if(bank->num_spill == size) {
+        size = (size == 0) ? 64 : 2 * size;
+        if((spill = realloc(bank->spill, size * sizeof(entry_t))) == NULL)
+            return TCAM_ERR_MEM_ALLOC_FAIL;
+        bank->spill = spill;
+        if((spill_keys = realloc(bank->spill_keys, size * 2 * bank->key_words * sizeof(uint32_t))) == NULL)
+            return TCAM_ERR_MEM_ALLOC_FAIL;
+        bank->spill_keys = spill_keys;
+        bank->spill_max = size;
+    }
+    if((ret_val = tcam_tss_insert(bank->spill_tss, ent, key)) != TCAM_ERR_SUCCESS)
+        return ret_val;
+    spill_put(bank, spill_bound(bank, ent->prio), ent, key);
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Deletes the spilled entry at the index 'k' */
+static void spill_del(tcam_bank_t *bank, uint32_t k)
+{
+    tcam_tss_remove(bank->spill_tss, bank->spill[k].id);
+    spill_cut(bank, k);
+}
+
+/* Programs the highest ranking spilled entries in the free slots of the
+ * bank, after its last busy slot
+ */
+static tcam_err_t spill_promote(tcam_bank_t *bank)
+{
+    int32_t last = bank->max_tcam_entries - 1, slot, k;
+    const uint32_t *key;
+    entry_t entry;
+    tcam_err_t ret_val;
+
+    while((bank->num_spill > 0) && (bank->total_tcam_entries < bank->max_tcam_entries)) {
+        entry = bank->spill[bank->num_spill - 1];
+        key = &bank->spill_keys[(bank->num_spill - 1) * 2 * bank->key_words];
+        if((ret_val = undo_reserve(bank, 2)) != TCAM_ERR_SUCCESS)
+            return ret_val;
+        if((bank->tss != NULL) && ((ret_val = tcam_tss_insert(bank->tss, &entry, key)) != TCAM_ERR_SUCCESS))
+            return ret_val;
+        entry.key_ref = bank->key_free[--bank->key_free_top];
+        memcpy(&bank->key_store[entry.key_ref * bank->key_rec], key, 2 * bank->key_words * sizeof(uint32_t));
+
+        undo_begin(bank);
+        plan_begin(bank);
+        if(bank->tcam_cache[last].id != TCAM_CELL_STATE_EMPTY) {
+            // the entries after the last free slot move up to free the last slot
+            slot = occ_prev_free(bank, last);
+            tcam_cache_shift_up(bank, slot, last);
+            for(k = slot; k < last; k++)
+                plan_add(bank, k);
+            slot = last;
+        } else {
+            slot = occ_prev_busy(bank, last) + 1;
+        }
+        tcam_cache_place(bank, slot, &entry);
+        plan_add(bank, slot);
+        bank->total_tcam_entries++;
+        if((ret_val = plan_program(bank)) != TCAM_ERR_SUCCESS) {
+            TCAM_LOG(bank, TCAM_LOG_ERROR, "ERROR : Could'nt promote the entry %u\n", entry.id);
+            undo_rollback(bank, NULL);
+            bank->total_tcam_entries--;
+            key_release(bank, entry.key_ref);
+            if(bank->tss != NULL)
+                tcam_tss_remove(bank->tss, entry.id);
+            snap_publish(bank);
+            return ret_val;
+        }
+        undo_end(bank);
+        spill_del(bank, bank->num_spill - 1);
+        bank->tcam_stats.promotions++;
+        snap_publish(bank);
+    }
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Fills the free slots with the spilled entries, like spill_promote(), for
+ * the calls whose result does not depend on it
+ */
+static void spill_refill(tcam_bank_t *bank)
+{
+    if(spill_promote(bank) != TCAM_ERR_SUCCESS)
+        bank->tcam_stats.promote_failures++;
+}
+
+/* Programs the spilled entries 'ids' back in the free 'slots' they were
+ * spilled from, when the batch which needed their room failed. The other
+ * entries did not move, so each one takes a single write and the bank is
+ * as it was before the batch.
+ */
+static tcam_err_t spill_restore(tcam_bank_t *bank, uint32_t *slots, uint32_t *ids, uint32_t num)
+{
+    const uint32_t *key;
+    entry_t entry;
+    tcam_err_t ret_val;
+    int32_t k;
+    uint32_t i;
+
+    for(i = 0; i < num; i++) {
+        if((k = spill_find(bank, ids[i])) < 0)
+            return TCAM_ERR_EINVAL;
+        entry = bank->spill[k];
+        key = &bank->spill_keys[k * 2 * bank->key_words];
+        if((ret_val = undo_reserve(bank, 2)) != TCAM_ERR_SUCCESS)
+            return ret_val;
+        if((bank->tss != NULL) && ((ret_val = tcam_tss_insert(bank->tss, &entry, key)) != TCAM_ERR_SUCCESS))
+            return ret_val;
+        entry.key_ref = bank->key_free[--bank->key_free_top];
+        memcpy(&bank->key_store[entry.key_ref * bank->key_rec], key, 2 * bank->key_words * sizeof(uint32_t));
+
+        undo_begin(bank);
+        tcam_cache_place(bank, slots[i], &entry);
+        bank->total_tcam_entries++;
+        if((ret_val = undo_program(bank, slots[i])) != TCAM_ERR_SUCCESS) {
+            TCAM_LOG(bank, TCAM_LOG_ERROR, "ERROR : Could'nt restore the spilled entry %u\n", entry.id);
+            undo_rollback(bank, NULL);
+            bank->total_tcam_entries--;
+            key_release(bank, entry.key_ref);
+            if(bank->tss != NULL)
+                tcam_tss_remove(bank->tss, entry.id);
+            snap_publish(bank);
+            return ret_val;
+        }
+        undo_end(bank);
+        spill_del(bank, k);
+        snap_publish(bank);
+    }
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Spills the entry of the last busy slot of the bank */
+static tcam_err_t spill_evict(tcam_bank_t *bank)
+{
+    int32_t last = (bank->total_tcam_entries > 0) ? occ_prev_busy(bank, bank->max_tcam_entries - 1) : -1;
+    uint32_t slot = last;
+    entry_t entry;
+    tcam_err_t ret_val;
+
+    if(last < 0)
+        return TCAM_ERR_TCAM_FULL;
+    entry = bank->tcam_cache[slot];
+    if((ret_val = spill_add(bank, &entry, key_of(bank, &entry))) != TCAM_ERR_SUCCESS)
+        return ret_val;
+    if((ret_val = tcam_remove_slots(bank, &slot, 1, NULL)) != TCAM_ERR_SUCCESS) {
+        spill_del(bank, spill_find(bank, entry.id));
+        return ret_val;
+    }
+    bank->tcam_stats.spills++;
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Inserts a batch in a bank with the spill tier, see tcam_insert_keys().
+ * The entries ranking below the highest spilled one are spilled. For the
+ * others, the lowest ranking of them and of the entries of hw_tcam are
+ * spilled until the rest fits in hw_tcam.
+ */
+static tcam_err_t spill_insert(tcam_bank_t *bank, entry_t *entries, const uint32_t *keys, uint32_t num)
+{
+    uint32_t words = 2 * bank->key_words;
+    uint32_t *order, *slots, *hw_keys, *added;
+    uint8_t *spilled;
+    entry_t *hw_entries;
+    uint32_t i, k, n, n_hw, n_evict, n_added, n_kept = 0;
+    int64_t overflow;
+    int32_t x;
+    tcam_err_t ret_val;
+
+    order = malloc(num * sizeof(uint32_t));
+    slots = malloc(num * sizeof(uint32_t));
+    added = malloc(2 * num * sizeof(uint32_t));
+    spilled = calloc(num, sizeof(uint8_t));
+    hw_entries = malloc(num * sizeof(entry_t));
+    hw_keys = (keys != NULL) ? malloc(num * words * sizeof(uint32_t)) : NULL;
+    if((order == NULL) || (slots == NULL) || (added == NULL) || (spilled == NULL) ||
+       (hw_entries == NULL) || ((keys != NULL) && (hw_keys == NULL))) {
+        ret_val = TCAM_ERR_MEM_ALLOC_FAIL;
+        goto done;
+    }
+    if((ret_val = tcam_merge_order(entries, num, order)) != TCAM_ERR_SUCCESS)
+        goto done;
+
+    n_hw = 0;
+    for(i = 0; i < num; i++) {
+        if((bank->num_spill > 0) && (entries[i].prio > bank->spill[bank->num_spill - 1].prio))
+            spilled[i] = 1;
+        else
+            n_hw++;
+    }
+    // The lowest ranking of the entries of hw_tcam and of the batch leave.
+    // A batch entry ranks above the entries of hw_tcam of its priority
+    overflow = (int64_t) bank->total_tcam_entries + n_hw - bank->max_tcam_entries;
+    x = (bank->total_tcam_entries > 0) ? occ_prev_busy(bank, bank->max_tcam_entries - 1) : -1;
+    k = num;
+    n_evict = 0;
+    for(; overflow > 0; overflow--) {
+        while((k > 0) && spilled[order[k - 1]])
+            k--;
+        if((x >= 0) && ((k == 0) || (entries[order[k - 1]].prio <= bank->tcam_cache[x].prio))) {
+            slots[n_evict++] = x;
+            x = (x > 0) ? occ_prev_busy(bank, x - 1) : -1;
+        } else {
+            spilled[order[--k]] = 1;
+        }
+    }
+
+    // Make: the spilled entries are added to the table, the lowest ranking
+    // first. Break: then their slots are invalidated
+    n_added = 0;
+    for(i = 0; i < n_evict; i++) {
+        if((ret_val = spill_add(bank, &bank->tcam_cache[slots[i]], key_of(bank, &bank->tcam_cache[slots[i]]))) != TCAM_ERR_SUCCESS)
+            goto undo;
+        added[n_added++] = bank->tcam_cache[slots[i]].id;
+    }
+    for(i = 0, n = 0; i < num; i++) {
+        if(!spilled[i]) {
+            hw_entries[n] = entries[i];
+            if(keys != NULL)
+                memcpy(&hw_keys[n * words], &keys[i * words], words * sizeof(uint32_t));
+            n++;
+            continue;
+        }
+        if((ret_val = spill_add(bank, &entries[i], (keys != NULL) ? &keys[i * words] : NULL)) != TCAM_ERR_SUCCESS)
+            goto undo;
+        added[n_added++] = entries[i].id;
+    }
+    // The slots were taken in descending order, the slot of added[i] is
+    // now slots[n_evict - 1 - i]
+    qsort(slots, n_evict, sizeof(uint32_t), slot_cmp);
+    if((ret_val = tcam_remove_slots(bank, slots, n_evict, NULL)) != TCAM_ERR_SUCCESS)
+        goto undo;
+    if((n > 0) && ((ret_val = tcam_insert_hw(bank, hw_entries, hw_keys, n)) != TCAM_ERR_SUCCESS)) {
+        // the entries spilled from hw_tcam go back to their slots
+        n_kept = n_evict;
+        goto undo;
+    }
+    bank->tcam_stats.spills += n_added;
+    spill_refill(bank);
+    goto done;
+
+undo:
+    for(i = n_added; i > n_kept; i--)
+        spill_del(bank, spill_find(bank, added[i - 1]));
+    for(i = 0; i < n_kept / 2; i++) {
+        k = added[i];
+        added[i] = added[n_kept - 1 - i];
+        added[n_kept - 1 - i] = k;
+    }
+    // Should hw_tcam fail again, the entries left in the table still match
+    // and take the first slots freed
+    if(spill_restore(bank, slots, added, n_kept) != TCAM_ERR_SUCCESS)
+        spill_refill(bank);
+done:
+    free(order);
+    free(slots);
+    free(added);
+    free(spilled);
+    free(hw_entries);
+    free(hw_keys);
+    return ret_val;
+}
 
 /*  Description:
- *     This API initializes a TCAM bank handler (TCAM cache ) serving the given
- *     hw_tcam. 
- *     It returns  in case of success and a pointer to the handler
+ *     This API inserts a batch of entries into the TCAM Bank handler (A.K.A
+ *     TCAM cache) referred to by the ‘tcam’ parameter.
+ *     The insert is either successful entirely or it fails and nothing
+ *     is inserted. A batch which fails half way, for instance on an error
+ *     of hw_tcam, is undone in the tcam cache and in hw_tcam before the
+ *     call returns. Each entry in the batch has a priority and id .
+ *     The entries are inserted into the TCAM bank handler in a sorted
+ *     manner with  the value of the priority field as a key. The
+ *     entries are sorted in ascending order . All entried of the same
+ *     priority are grouped together and the recent onces are at the start
+ *     of the group. Thus entries with a lower priority value are treated
+ *     with higher priority and are inserted at the start of the tcam  and
+ *     in each priority group, the most recent ones are at the start of the
+ *     group. Thus entries with a lower value and which are recent are
+ *     treated with higher priority. Once these entries are inserted into
+ *     'tcam' (TCAM bank handler) , they are then programmed in the hardware tcam table. The
+ *     'tcam' is represented  by an in-memory data structure "tcam_cache"
+ *     and the 'hw_tcam' is represented by a "hw_tcam_local" variables.
+ *     The entries match any key, see tcam_insert_keys() for entries with
+ *     a key.
+ *     With TCAM_OPT_SPILL, a batch which does not fit in the bank spills
+ *     the entries of the lowest priorities, its own or the ones of the bank,
+ *     to the software table of the spill tier instead of failing with
+ *     TCAM_ERR_TCAM_FULL.
+ * Arguments
+ *  tcam - in memory tcam cache
+ *  entries - entries to be inserted
+ *  num - number of entries 
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+
+tcam_err_t tcam_insert(void *tcam, entry_t *entries, uint32_t num)
+{
+    return tcam_insert_keys(tcam, entries, NULL, num);
+}
+
+/*  Description:
+ *     Inserts a batch of entries like tcam_insert(), each one with its
+ *     ternary key. A key looked up matches an entry when it has the bits of
+ *     the value of the entry where the mask of the entry is set, see
+ *     tcam_lookup(). The keys are copied in the key store of the bank.
+ * Arguments
+ *  tcam    - in memory tcam cache
+ *  entries - entries to be inserted, their key_ref is ignored
+ *  keys    - keys of the entries, for each entry the value then the mask of
+ *            its key, TCAM_OPT_KEY_BITS / 32 words each. NULL inserts
+ *            entries matching any key, like tcam_insert()
+ *  num     - number of entries
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_insert_keys(void *tcam, entry_t *entries, const uint32_t *keys, uint32_t num)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+    tcam_err_t ret_val;
+    uint64_t start;
+
+    if(bank == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    start = lat_start(bank);
+    bank->insert_policy = TCAM_ENTRY_SHIFT_NO_SHIFT;
+
+    TCAM_LOG(bank, TCAM_LOG_DEBUG, "Total number of tcam entries before insertion : %d\n",bank->total_tcam_entries);
+    TCAM_LOG(bank, TCAM_LOG_DEBUG, "The number of new entries is : %d\n", num);
+    // without the spill tier, let's check if there is enough memory in the TCAM Bank
+    // handler A.K.A tcam cache to incorporate these entries
+    if((bank->spill_tss != NULL) && (num > 0) &&
+       ((bank->num_spill > 0) || (bank->total_tcam_entries + num > bank->max_tcam_entries))) {
+        ret_val = spill_insert(bank, entries, keys, num);
+    } else if((bank->total_tcam_entries + num) > bank->max_tcam_entries) {
+        TCAM_LOG(bank, TCAM_LOG_DEBUG, "The number of entries exceed the maximum number\n");
+        ret_val = TCAM_ERR_TCAM_FULL;
+    } else {
+        ret_val = tcam_insert_hw(bank, entries, keys, num);
+    }
+    if(bank->trace != NULL)
+        tcam_trace_insert(bank->trace, start, ret_val, entries, keys, bank->key_words, num);
+    return call_result(bank, TCAM_LAT_INSERT, start, ret_val);
+}
+
+/*  Description:
+ *       This function prints the content of the TCAM Bank handler (TCAM cache).
+ *       This function accepts "tcam"  as argument and prints the contents.
+ * Arguments
+ *  tcam - in memory tcam cache
+ * Return: none
+ */
+
+void print_tcam_cache(void *tcam) {
+    int j = 0;
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+    entry_t *tcam_cache = bank->tcam_cache;
+    for(j = 0; j < bank->max_tcam_entries; j++) {
+        if(tcam_cache[j].id != TCAM_CELL_STATE_EMPTY)
+            printf("Index : %d -> Id : %d , Priority : %d\n",
+                   j,tcam_cache[j].id, tcam_cache[j].prio);
+    }
+
+}
+
+/* Deletes the entry with the given id, see tcam_remove() */
+static tcam_err_t tcam_remove_id(tcam_bank_t *bank, uint32_t id)
+{
+    entry_t *tcam_cache = bank->tcam_cache;
+    int32_t position;
+    entry_t entry;
+    tcam_err_t ret_val;
+
+    if(id == TCAM_CELL_STATE_EMPTY)
+        return TCAM_ERR_EINVAL;
+    if((position = id_index_lookup(bank, id)) < 0) {
+        if((position = spill_find(bank, id)) < 0)
+            return TCAM_ERR_EINVAL;
+        spill_del(bank, position);
+        bank->tcam_stats.remove_calls++;
+        bank->tcam_stats.removed_entries++;
+        return TCAM_ERR_SUCCESS;
+    }
+
+    //printf("The entry has to be deleted in hw_tcam at position %d\n", position);
+    entry = tcam_cache[position];
+    entry.id = TCAM_CELL_STATE_EMPTY;
+    if((ret_val = bank_program(bank, &entry, NULL, position)) != TCAM_ERR_SUCCESS)
+        return ret_val;
+    bank->hw_layout[position] = entry;
+    key_release(bank, entry.key_ref);
+    id_index_del(bank, id, position);
+    occ_clear(bank, position);
+    prio_group_del(bank, tcam_cache[position].prio, position);
+    memset(&tcam_cache[position], 0, sizeof(entry_t));
+    bank->total_tcam_entries--;
+    if(bank->tss != NULL)
+        tcam_tss_remove(bank->tss, id);
+    snap_dirty(bank, position, position);
+    snap_publish(bank);
+    bank->tcam_stats.remove_calls++;
+    bank->tcam_stats.removed_entries++;
+    // the slot freed takes the highest ranking spilled entry, the entry is
+    // removed even if it fails
+    spill_refill(bank);
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *       Delete a TCAM entry in the "tcam_cache" table as well as "hw_tcam".
+ *       This function accepts "tcam" and the id of the entry to be deleted
+ *       as arguments and deletes an entry with that id in both the
+ *       "tcam_cache" as well "hw_tcam" tables. The deletion is done by
+ *       setting the id field for that entry to 0.  
+ *       With TCAM_OPT_SPILL, the slot freed takes the highest ranking
+ *       spilled entry, and a spilled entry is deleted from the software
+ *       table.
  *
  * Arguments
- *  hw_tcam - address of hardware tcam memory
- *  size    - size of the memory to be allocated 
- *  tcam    - pointer to memory allocated 
+ *  tcam - in memory tcam cache
+ *  id   - id of the entry to be deleted 
  * Return: TCAM_ERR_SUCCESS or appropriate error code.
  */
+tcam_err_t tcam_remove(void *tcam, uint32_t id) {
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+    tcam_err_t ret_val;
+    uint64_t start;
 
-tcam_err_t tcam_init(entry_t *hw_tcam, uint32_t size, void **tcam)
+    if(bank == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    start = lat_start(bank);
+    ret_val = tcam_remove_id(bank, id);
+    if(bank->trace != NULL)
+        tcam_trace_record(bank->trace, start, TCAM_TRACE_REMOVE, ret_val, 1, 0, 0, &id, sizeof(id));
+    return call_result(bank, TCAM_LAT_REMOVE, start, ret_val);
+}
+
+/*  Description:
+ *       Deletes a batch of TCAM entries in the "tcam_cache" table as well as
+ *       "hw_tcam". The ids are looked up in the index and the entries are
+ *       invalidated in hw_tcam in a single burst, in the order of their
+ *       slots, before they are deleted from the tcam_cache. The batch is
+ *       deleted entirely or not at all: an unknown id or an id given twice
+ *       fails the call before anything is written, and an error of hw_tcam
+ *       in the middle of the burst is undone.
+ *       With TCAM_OPT_SPILL, the spilled entries of the batch are deleted
+ *       from the software table and the slots freed take the highest
+ *       ranking spilled entries.
+ *
+ * Arguments
+ *  tcam   - in memory tcam cache
+ *  ids    - ids of the entries to be deleted
+ *  num    - number of ids
+ *  writes - filled with the number of writes to hw_tcam done, can be NULL
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_remove_batch(void *tcam, uint32_t *ids, uint32_t num, uint32_t *writes)
 {
-    max_tcam_entries = size;
-    *tcam = calloc(size, sizeof(entry_t));
-    if(*tcam == NULL)
-        return TCAM_ERR_MEM_ALLOC_FAIL;
-    hw_tcam_init(hw_tcam, size);
-    hw_tcam_local = hw_tcam;
-    insert_list = calloc(size, sizeof(bool));
-    if(insert_list == NULL)
-        return TCAM_ERR_MEM_ALLOC_FAIL;
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+    uint32_t *slots = NULL, *spilled, k, n_hw = 0, n_spill = 0;
+    int32_t position;
+    tcam_err_t ret_val = TCAM_ERR_SUCCESS;
+    uint64_t start;
+
+    if(writes != NULL)
+        *writes = 0;
+    if(bank == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    start = lat_start(bank);
+    if(num == 0)
+        return TCAM_ERR_SUCCESS;
+    if(num > bank->max_tcam_entries + bank->num_spill) {
+        ret_val = TCAM_ERR_EINVAL;
+        goto done;
+    }
+    if((slots = malloc(2 * num * sizeof(uint32_t))) == NULL) {
+        ret_val = TCAM_ERR_MEM_ALLOC_FAIL;
+        goto done;
+    }
+    spilled = &slots[num];
+
+    for(k = 0; k < num; k++) {
+        if(ids[k] == TCAM_CELL_STATE_EMPTY) {
+            ret_val = TCAM_ERR_EINVAL;
+            goto done;
+        }
+        if((position = id_index_lookup(bank, ids[k])) >= 0) {
+            slots[n_hw++] = position;
+        } else if(spill_find(bank, ids[k]) >= 0) {
+            spilled[n_spill++] = ids[k];
+        } else {
+            ret_val = TCAM_ERR_EINVAL;
+            goto done;
+        }
+    }
+    qsort(slots, n_hw, sizeof(uint32_t), slot_cmp);
+    qsort(spilled, n_spill, sizeof(uint32_t), slot_cmp);
+    for(k = 1; k < n_hw; k++) {
+        if(slots[k] == slots[k-1]) {
+            ret_val = TCAM_ERR_EINVAL;
+            goto done;
+        }
+    }
+    for(k = 1; k < n_spill; k++) {
+        if(spilled[k] == spilled[k-1]) {
+            ret_val = TCAM_ERR_EINVAL;
+            goto done;
+        }
+    }
+    if((ret_val = tcam_remove_slots(bank, slots, n_hw, writes)) != TCAM_ERR_SUCCESS)
+        goto done;
+    for(k = 0; k < n_spill; k++)
+        spill_del(bank, spill_find(bank, spilled[k]));
+    bank->tcam_stats.remove_calls++;
+    bank->tcam_stats.removed_entries += num;
+    spill_refill(bank);
+
+done:
+    free(slots);
+    if(bank->trace != NULL)
+        tcam_trace_record(bank->trace, start, TCAM_TRACE_REMOVE_BATCH, ret_val, num, 0, 0, ids,
+                          num * sizeof(uint32_t));
+    return call_result(bank, TCAM_LAT_REMOVE, start, ret_val);
+}
+
+/* Changes the priority of the entry with the given id in the bank, see
+ * tcam_modify_prio()
+ */
+static tcam_err_t tcam_modify_hw(tcam_bank_t *bank, uint32_t id, uint32_t prio)
+{
+    int32_t slot, old_slot, prev, next, free_slot;
+    uint32_t g, old_prio;
+    uint64_t n1;
+    int32_t saved_total;
+    tcam_stats_t saved_stats;
+    entry_t entry;
+    tcam_err_t ret_val;
+
+    if((id == TCAM_CELL_STATE_EMPTY) || ((slot = id_index_lookup(bank, id)) < 0))
+        return TCAM_ERR_EINVAL;
+    old_prio = bank->tcam_cache[slot].prio;
+    if(old_prio == prio)
+        return TCAM_ERR_SUCCESS;
+    entry = bank->tcam_cache[slot];
+    entry.prio = prio;
+
+    // The entries around the new place of the entry, itself left aside: the
+    // last one with a lower priority and the first one of the group of the
+    // new priority (or above)
+    g = prio_group_lower_bound(bank, prio);
+    next = (g < bank->num_prio_groups) ? (int32_t) bank->prio_groups[g].first : (int32_t) bank->max_tcam_entries;
+    if(next == slot)
+        next = (slot + 1 < bank->max_tcam_entries) ? occ_next_busy(bank, slot + 1) : -1;
+    if(next < 0)
+        next = bank->max_tcam_entries;
+    prev = (g > 0) ? (int32_t) bank->prio_groups[g-1].last : -1;
+    if(prev == slot)
+        prev = (slot > 0) ? occ_prev_busy(bank, slot - 1) : -1;
+
+    n1 = tcam_get_hw_access_cnt(&bank->hw_tcam);
+    saved_total = bank->total_tcam_entries;
+    saved_stats = bank->tcam_stats;
+    if((ret_val = undo_reserve(bank, 2)) != TCAM_ERR_SUCCESS)
+        return ret_val;
+    undo_begin(bank);
+    plan_begin(bank);
+
+    if((prev < slot) && (slot < next)) {
+        // The slot of the entry is still in order, a single write switches
+        // it to the new priority
+        tcam_cache_clear(bank, slot);
+        tcam_cache_place(bank, slot, &entry);
+        plan_add(bank, slot);
+        if((ret_val = plan_program(bank)) != TCAM_ERR_SUCCESS)
+            goto undo;
+        goto done;
+    }
+
+    free_slot = (next > 0) ? occ_prev_free(bank, next - 1) : -1;
+    if((free_slot >= 0) && (free_slot > prev)) {
+        // An empty slot in the right place, the old slot is left empty
+        tcam_cache_place(bank, free_slot, &entry);
+        plan_add(bank, free_slot);
+        old_slot = slot;
+    } else {
+        // The copy is inserted like a new entry, the entries it shifts
+        // (possibly the old one) stay in hw_tcam
+        if(bank->total_tcam_entries >= bank->max_tcam_entries) {
+            ret_val = TCAM_ERR_TCAM_FULL;
+            goto undo;
+        }
+        if(((ret_val = tcam_insert_entries(bank, &entry, &entry.key_ref, 1)) != TCAM_ERR_SUCCESS) ||
+           ((ret_val = undo_reserve(bank, 1)) != TCAM_ERR_SUCCESS))
+            goto undo;
+        old_slot = id_index_lookup_prio(bank, id, old_prio);
+    }
+    // Make: both copies are programmed, the entries keep their order.
+    // Break: then the old slot is invalidated
+    if((ret_val = plan_program(bank)) != TCAM_ERR_SUCCESS)
+        goto undo;
+    entry = bank->tcam_cache[old_slot];
+    entry.id = TCAM_CELL_STATE_EMPTY;
+    if(((ret_val = undo_reserve(bank, 2)) != TCAM_ERR_SUCCESS) ||
+       ((ret_val = undo_program_ent(bank, &entry, old_slot)) != TCAM_ERR_SUCCESS))
+        goto undo;
+    tcam_cache_clear(bank, old_slot);
+    bank->total_tcam_entries = saved_total;
+
+done:
+    undo_end(bank);
+    if(bank->tss != NULL)
+        tcam_tss_modify_prio(bank->tss, id, prio);
+    bank->tcam_stats.modify_calls++;
+    bank->tcam_stats.modify_hw_writes += tcam_get_hw_access_cnt(&bank->hw_tcam) - n1;
+    snap_publish(bank);
+    return TCAM_ERR_SUCCESS;
+
+undo:
+    TCAM_LOG(bank, TCAM_LOG_ERROR, "ERROR : Could'nt change the priority of the entry %u\n", id);
+    undo_rollback(bank, NULL);
+    bank->total_tcam_entries = saved_total;
+    bank->tcam_stats = saved_stats;
+    snap_publish(bank);
+    return ret_val;
+}
+
+/* Changes the priority of the spilled entry at the index 'k' of the table of
+ * a full bank, see tcam_modify_prio()
+ */
+static tcam_err_t spill_modify(tcam_bank_t *bank, uint32_t k, uint32_t prio)
+{
+    uint32_t key[2 * TCAM_MAX_KEY_BITS / 32];
+    int32_t last = occ_prev_busy(bank, bank->max_tcam_entries - 1);
+    entry_t entry = bank->spill[k];
+    tcam_err_t ret_val;
+
+    if(entry.prio == prio)
+        return TCAM_ERR_SUCCESS;
+    memcpy(key, &bank->spill_keys[k * 2 * bank->key_words], 2 * bank->key_words * sizeof(uint32_t));
+    entry.prio = prio;
+    if((last >= 0) && (prio <= bank->tcam_cache[last].prio)) {
+        // The entry now ranks above the last entry of hw_tcam, which is
+        // spilled for it
+        if((ret_val = spill_insert(bank, &entry, key, 1)) != TCAM_ERR_SUCCESS)
+            return ret_val;
+        spill_del(bank, spill_find(bank, entry.id));
+    } else {
+        tcam_tss_modify_prio(bank->spill_tss, entry.id, prio);
+        spill_cut(bank, k);
+        spill_put(bank, spill_bound(bank, prio), &entry, key);
+    }
+    bank->tcam_stats.modify_calls++;
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Changes the priority of an entry of a bank with the spill tier, see
+ * tcam_modify_prio()
+ */
+static tcam_err_t spill_modify_prio(tcam_bank_t *bank, uint32_t id, uint32_t prio)
+{
+    uint32_t slot;
+    int32_t k;
+    entry_t entry;
+    tcam_err_t ret_val;
+
+    if(id == TCAM_CELL_STATE_EMPTY)
+        return TCAM_ERR_EINVAL;
+    if((k = id_index_lookup(bank, id)) < 0) {
+        if((k = spill_find(bank, id)) < 0)
+            return TCAM_ERR_EINVAL;
+        return spill_modify(bank, k, prio);
+    }
+    slot = k;
+    if((bank->num_spill > 0) && (prio > bank->spill[bank->num_spill - 1].prio)) {
+        // The entry now ranks below the highest spilled entry, which takes
+        // its slot
+        entry = bank->tcam_cache[slot];
+        entry.prio = prio;
+        if((ret_val = spill_add(bank, &entry, key_of(bank, &bank->tcam_cache[slot]))) != TCAM_ERR_SUCCESS)
+            return ret_val;
+        if((ret_val = tcam_remove_slots(bank, &slot, 1, NULL)) != TCAM_ERR_SUCCESS) {
+            spill_del(bank, spill_find(bank, id));
+            return ret_val;
+        }
+        bank->tcam_stats.spills++;
+        bank->tcam_stats.modify_calls++;
+        return TCAM_ERR_SUCCESS;
+    }
+    return tcam_modify_hw(bank, id, prio);
+}
+
+/* Changes the priority of an entry of a bank with the spill tier, see
+ * tcam_modify_prio()
+ */
+static tcam_err_t tcam_modify_spill(tcam_bank_t *bank, uint32_t id, uint32_t prio)
+{
+    tcam_err_t ret_val;
+
+    // The bank is full whenever entries are spilled
+    if((ret_val = spill_promote(bank)) != TCAM_ERR_SUCCESS)
+        return ret_val;
+    if((ret_val = spill_modify_prio(bank, id, prio)) == TCAM_ERR_TCAM_FULL) {
+        // The last entry of the bank makes room, it is back if the change
+        // fails
+        if((ret_val = spill_evict(bank)) != TCAM_ERR_SUCCESS)
+            return ret_val;
+        ret_val = spill_modify_prio(bank, id, prio);
+    }
+    spill_refill(bank);
+    return ret_val;
+}
+
+/*  Description:
+ *       Changes the priority of the entry with the given id. The entry goes
+ *       first in the group of its new priority, as if it was inserted again,
+ *       but it is never missing from hw_tcam: it is programmed in its new
+ *       slot before its old slot is invalidated (make before break).
+ *       - the entry is rewritten in place when its slot is still in order
+ *         with the new priority (1 write)
+ *       - otherwise it is copied to an empty slot just before the group of
+ *         its new priority, if any, and its old slot is left empty (2 writes)
+ *       - otherwise the copy is inserted like a new entry, with the shifts
+ *         of tcam_insert(), and then its old slot is invalidated.
+ *       The call fails with TCAM_ERR_TCAM_FULL in the last case when the bank
+ *       has no empty slot. A failure leaves the entry as it was.
+ *       With TCAM_OPT_SPILL, the bank is never full: its last entry is
+ *       spilled to make room, and an entry which ranks below the highest
+ *       spilled entry, or above the last entry of the bank, moves between
+ *       the software table and hw_tcam. It is added to its new place before
+ *       it leaves the old one.
+ *
+ * Arguments
+ *  tcam - in memory tcam cache
+ *  id   - id of the entry
+ *  prio - new priority of the entry
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_modify_prio(void *tcam, uint32_t id, uint32_t prio)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+    tcam_err_t ret_val;
+    uint64_t start;
+
+    if(bank == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    start = lat_start(bank);
+    if(bank->spill_tss == NULL)
+        ret_val = tcam_modify_hw(bank, id, prio);
+    else
+        ret_val = tcam_modify_spill(bank, id, prio);
+    if(bank->trace != NULL)
+        tcam_trace_record(bank->trace, start, TCAM_TRACE_MODIFY, ret_val, 0, id, prio, NULL, 0);
+    return call_result(bank, TCAM_LAT_MODIFY, start, ret_val);
+}
+
+/*  Description:
+ *  Helper function to free up the in-memory "tcam_cache" . This is used in
+ *  case the caller wants to free up the "tcam_cache" memory
+ * Arguments
+ *  tcam - in memory tcam cache
+ */
+
+void tcam_cache_destroy(void *tcam)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+
+    if(bank == NULL)
+        return;
+    hw_tcam_destroy(&bank->hw_tcam);
+    free(bank->tcam_cache);
+    free(bank->insert_slots);
+    free(bank->hw_layout);
+    free(bank->plan_src);
+    free(bank->plan_dst);
+    free(bank->plan_order);
+    free(bank->key_store);
+    free(bank->lat);
+    if(bank->trace != NULL)
+        tcam_trace_stop(bank->trace);
+    free(bank->key_free);
+    free(bank->key_refs);
+    flow_cache_init(bank, 0);
+    tcam_tss_destroy(bank->tss);
+    tcam_tss_destroy(bank->spill_tss);
+    free(bank->spill);
+    free(bank->spill_keys);
+    free(bank->snap[0]);
+    free(bank->snap[1]);
+    free(bank->undo);
+    free(bank->undo_last);
+    free(bank->id_index);
+    free(bank->prio_groups);
+    occ_destroy(bank);
+    free(bank);
+}
+
+/*  Description:
+ *       Look up the slot of the entry with the given id in the "tcam_cache".
+ *       The slot is the same as the position of the entry in "hw_tcam".
+ *       If the id is present more than once, the lowest slot is returned.
+ *       The entries of the spill tier, see TCAM_OPT_SPILL, have no slot and
+ *       are not found.
+ *
+ * Arguments
+ *  tcam     - in memory tcam cache
+ *  id       - id of the entry
+ *  position - filled with the slot of the entry
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_find(void *tcam, uint32_t id, uint32_t *position)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+    int32_t slot;
+
+    if(tcam == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if((position == NULL) || (id == TCAM_CELL_STATE_EMPTY))
+        return TCAM_ERR_EINVAL;
+    if((slot = id_index_lookup(bank, id)) < 0)
+        return TCAM_ERR_EINVAL;
+    *position = slot;
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *       Looks up a key in hw_tcam like the hardware does and returns the
+ *       matching entry of the lowest slot, which is the one of the highest
+ *       priority. Empty slots never match. The key compare is chosen with
+ *       TCAM_OPT_LOOKUP. With TCAM_OPT_ASYNC_DEPTH, only the writes done by
+ *       the programming queue are seen, see tcam_fence().
+ *       With TCAM_OPT_FLOW_CACHE, the results are kept by the flow cache
+ *       until the next write to hw_tcam. The lookups then update the
+ *       handler and must not run at the same time as other calls on it.
+ *       With TCAM_OPT_SPILL, a key no entry of hw_tcam matches is looked up
+ *       in the software table of the spilled entries. Its matching entry is
+ *       returned with the position max_tcam_entries and a key_ref of 0, and
+ *       is not kept by the flow cache.
+ *
+ * Arguments
+ *  tcam     - in memory tcam cache
+ *  key      - key of TCAM_OPT_KEY_BITS / 32 words
+ *  ent      - filled with the matching entry, can be NULL
+ *  position - filled with the slot of the matching entry
+ * Return: TCAM_ERR_SUCCESS, TCAM_ERR_NO_MATCH if no entry matches the key or
+ *         appropriate error code.
+ */
+tcam_err_t tcam_lookup(void *tcam, const uint32_t *key, entry_t *ent, uint32_t *position)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+    tcam_err_t ret_val;
+    entry_t match;
+
+    if(tcam == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if(bank->flow_sets == 0)
+        ret_val = hw_tcam_lookup(&bank->hw_tcam, key, position);
+    else if((key == NULL) || (position == NULL))
+        ret_val = TCAM_ERR_EINVAL;
+    else
+        ret_val = flow_lookup(bank, key, position);
+    if((ret_val == TCAM_ERR_NO_MATCH) && (bank->num_spill > 0) &&
+       ((ret_val = tcam_tss_lookup(bank->spill_tss, key, &match)) == TCAM_ERR_SUCCESS)) {
+        *position = bank->max_tcam_entries;
+        if(ent != NULL)
+            *ent = match;
+        return TCAM_ERR_SUCCESS;
+    }
+    if(ret_val != TCAM_ERR_SUCCESS)
+        return ret_val;
+    if(ent != NULL)
+        *ent = bank->hw_tcam.mem[*position];
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *       Looks up a key in the software classifier of the entries, see
+ *       TCAM_OPT_TSS, without reading hw_tcam. The entry returned is the one
+ *       tcam_lookup() returns once hw_tcam is programmed, except between
+ *       entries of the same priority matching the same key whose order in
+ *       their group was changed by the shifts of
+ *       TCAM_SHIFT_MODE_GROUP_BOUNDARY: the last one inserted is returned.
+ *       Only the entries of hw_tcam are kept by the classifier, the
+ *       spilled entries of TCAM_OPT_SPILL are not found.
+ *
+ * Arguments
+ *  tcam     - in memory tcam cache
+ *  key      - key of TCAM_OPT_KEY_BITS / 32 words
+ *  ent      - filled with the matching entry, can be NULL
+ *  position - filled with the slot of the matching entry
+ * Return: TCAM_ERR_SUCCESS, TCAM_ERR_NO_MATCH if no entry matches the key or
+ *         appropriate error code.
+ */
+tcam_err_t tcam_lookup_tss(void *tcam, const uint32_t *key, entry_t *ent, uint32_t *position)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+    tcam_err_t ret_val;
+    entry_t match;
+
+    if(tcam == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if((bank->tss == NULL) || (position == NULL))
+        return TCAM_ERR_EINVAL;
+    if((ret_val = tcam_tss_lookup(bank->tss, key, &match)) != TCAM_ERR_SUCCESS)
+        return ret_val;
+    *position = id_index_lookup(bank, match.id);
+    if(ent != NULL)
+        *ent = bank->tcam_cache[*position];
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *       Copies the key of the entry with the given id, its value then its
+ *       mask.
+ *
+ * Arguments
+ *  tcam - in memory tcam cache
+ *  id   - id of the entry
+ *  key  - filled with 2 * TCAM_OPT_KEY_BITS / 32 words
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_get_key(void *tcam, uint32_t id, uint32_t *key)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+    int32_t slot;
+
+    if(tcam == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if((key == NULL) || (id == TCAM_CELL_STATE_EMPTY) || ((slot = id_index_lookup(bank, id)) < 0))
+        return TCAM_ERR_EINVAL;
+    memcpy(key, key_of(bank, &bank->tcam_cache[slot]), 2 * bank->key_words * sizeof(uint32_t));
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Rebalancing of the empty slots.
+ *
+ * The gap i is the range of empty slots between the groups i-1 and i, the
+ * gap 0 being before the first group and the last gap after the last group.
+ * An entry inserted at the start of a group finds an empty slot without any
+ * shift when the gap before the group is not empty, so the rebalancer moves
+ * the empty slots from the gaps with more than their share of them to the
+ * nearest gaps with less.
+ * An empty slot crosses a group with the same moves as the insertion : one
+ * entry per group with the group boundary shifting, else every entry of the
+ * group by one slot. The moves of a call are done in the tcam_cache and then
+ * programmed in hw_tcam by plan_program(), which writes every entry to its
+ * new slot before its old one is reused and clears the slots left empty.
+ */
+
+/* Number of empty slots in the gap before the group 'g' */
+static int32_t gap_size(tcam_bank_t *bank, uint32_t g)
+{
+    int32_t start = (g > 0) ? (int32_t)bank->prio_groups[g-1].last + 1 : 0;
+    int32_t end = (g < bank->num_prio_groups) ? (int32_t)bank->prio_groups[g].first : bank->max_tcam_entries;
+
+    return end - start;
+}
+
+/* Looks up the gap 'poor' with less empty slots than its share and the
+ * nearest gap 'rich' with more. Returns FALSE if the empty slots are balanced.
+ */
+static bool rebalance_plan(tcam_bank_t *bank, uint32_t *poor, uint32_t *rich)
+{
+    uint32_t g, gaps = bank->num_prio_groups + 1, share, free_slots = 0;
+    int32_t near, best = -1;
+
+    for(g = 0; g < gaps; g++)
+        free_slots += gap_size(bank, g);
+    share = free_slots / gaps;
+    // nearest rich gap on the left of every gap, then on its right
+    for(g = 0, near = -1; g < gaps; g++) {
+        if((gap_size(bank, g) < share) && (near >= 0) && ((best < 0) || (g - near < best))) {
+            best = g - near;
+            *poor = g;
+            *rich = near;
+        }
+        if(gap_size(bank, g) > share)
+            near = g;
+    }
+    for(g = gaps, near = -1; g-- > 0;) {
+        if((gap_size(bank, g) < share) && (near >= 0) && ((best < 0) || (near - g < best))) {
+            best = near - g;
+            *poor = g;
+            *rich = near;
+        }
+        if(gap_size(bank, g) > share)
+            near = g;
+    }
+    return (best > 0);
+}
+
+/* Moves the empty slot 'hole' by one step in the direction 'dir' and lists
+ * the slot of the moved entry for plan_program(). Returns the new empty slot.
+ */
+static int32_t rebalance_step(tcam_bank_t *bank, int32_t hole, int32_t dir)
+{
+    int32_t from;
+    prio_group_t *grp;
+
+    if(dir < 0) {
+        from = occ_prev_busy(bank, hole - 1);
+        grp = &bank->prio_groups[prio_group_slot_bound(bank, from)];
+        if(bank->shift_mode == TCAM_SHIFT_MODE_GROUP_BOUNDARY)
+            from = grp->first;
+    } else {
+        from = occ_next_busy(bank, hole + 1);
+        grp = &bank->prio_groups[prio_group_slot_bound(bank, from)];
+        if(bank->shift_mode == TCAM_SHIFT_MODE_GROUP_BOUNDARY)
+            from = grp->last;
+    }
+    tcam_cache_move(bank, from, hole);
+    plan_add(bank, hole);
+    return from;
+}
+
+/* Returns TRUE if the empty slot is between two entries of the same group */
+static bool rebalance_in_group(tcam_bank_t *bank, int32_t hole)
+{
+    int32_t prev, next;
 
-    shift_window = calloc(size, sizeof(bool));
-    if(shift_window == NULL)
-        return TCAM_ERR_MEM_ALLOC_FAIL;
-    
-    return TCAM_ERR_SUCCESS;
+    if((hole < 0) || (bank->tcam_cache[hole].id != TCAM_CELL_STATE_EMPTY))
+        return FALSE;
+    prev = occ_prev_busy(bank, hole - 1);
+    next = occ_next_busy(bank, hole + 1);
+    return ((prev >= 0) && (next >= 0) && (bank->tcam_cache[prev].prio == bank->tcam_cache[next].prio));
+}
+
+/* Returns TRUE if the empty slot moved by the rebalancer has not reached the
+ * gap 'poor' yet
+ */
+static bool rebalance_on_way(tcam_bank_t *bank, int32_t hole, uint32_t poor)
+{
+    if(hole < 0)
+        return FALSE;
+    if(bank->rebalance_dir < 0)
+        return (hole > bank->prio_groups[poor].first);
+    return (hole < bank->prio_groups[poor-1].last);
 }
 
 /*  Description:
- *     This API inserts a batch of entries into the TCAM Bank handler (A.K.A
- *     TCAM cache) referred to by the ‘tcam’ parameter.
- *     The insert is either successful entirely or it fails and nothing
- *     is inserted. Each entry in the batch has a priority and id .
- *     The entries are inserted into the TCAM bank handler in a sorted
- *     manner with  the value of the priority field as a key. The
- *     entries are sorted in ascending order . All entried of the same
- *     priority are grouped together and the recent onces are at the start
- *     of the group. Thus entries with a lower priority value are treated
- *     with higher priority and are inserted at the start of the tcam  and
- *     in each priority group, the most recent ones are at the start of the
- *     group. Thus entries with a lower value and which are recent are
- *     treated with higher priority. Once these entries are inserted into
- *     'tcam' (TCAM bank handler) , they are then programmed in the hardware tcam table. The
- *     'tcam' is represented  by an in-memory data structure "tcam_cache"
- *     and the 'hw_tcam' is represented by a "hw_tcam_local" variables.
+ *       Moves the empty slots of the TCAM Bank handler (TCAM cache) between
+ *       the priority groups so that each group has its share of them before
+ *       it. It is meant to be called periodically when the TCAM is idle. The
+ *       number of writes to hw_tcam is limited by the TCAM_OPT_REBALANCE_RATE
+ *       option, and nothing is done when the option is 0. A rebalancing can
+ *       span several calls.
+ *
  * Arguments
- *  tcam - in memory tcam cache
- *  entries - entries to be inserted
- *  num - number of entries 
+ *  tcam   - in memory tcam cache
+ *  writes - filled with the number of writes to hw_tcam done, can be NULL
  * Return: TCAM_ERR_SUCCESS or appropriate error code.
  */
-
-tcam_err_t tcam_insert(void *tcam, entry_t *entries, uint32_t num)
+tcam_err_t tcam_rebalance(void *tcam, uint32_t *writes)
 {
-    int32_t i , j, top , bottom  ;
-    int32_t  insert_pos, shift_pos;
-    uint64_t n1 , n2 ;
-    entry_t entry;
-    entry_t *tcam_cache = (entry_t *) tcam;
-    bool shift_up = FALSE, shift_down = FALSE, found = FALSE;
-    int32_t shift_policy = TCAM_ENTRY_SHIFT_NO_SHIFT;
-    int32_t shift_start , shift_end;
-    
-    if(tcam_cache == NULL)
-        return TCAM_ERR_NULL_CACHE;
-
-    printf("Total number of tcam entries before insertion : %d\n",total_tcam_entries);
-    printf("The number of new entries is : %d\n", num);
-    // let's check if there is enough memory in the TCAM Bank handler A.K.A tcam cache to
-    // incorporate these entries
-    if((total_tcam_entries + num) > max_tcam_entries) {
-        printf("The number of entries exceed the maximum number\n");
-       return TCAM_ERR_TCAM_FULL;
-    }
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+    struct timespec now;
+    uint32_t poor = 0, rich = 0, budget, done = 0;
+    int32_t hole = -1, next, saved_dir;
+    uint64_t n1;
+    bool stale = FALSE, planned = FALSE;
+    tcam_err_t ret_val;
 
+    if(bank == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if(writes != NULL)
+        *writes = 0;
+    if(bank->rebalance_rate == 0)
+        return TCAM_ERR_SUCCESS;
 
-    memset(insert_list, TCAM_CELL_STATE_EMPTY, max_tcam_entries);
-    memset(shift_window, TCAM_CELL_STATE_EMPTY, max_tcam_entries);
-        
-    i = 0;
-    top = max_tcam_entries;
-    // First entry
-    if(total_tcam_entries <= 0) {
-        total_tcam_entries  = 1;
-        insert_pos = 0;
-        tcam_cache[insert_pos] = entries[0];
-        i = 1;
-        insert_list[insert_pos] = TCAM_CELL_STATE_BUSY;
-        shift_window[insert_pos] = TCAM_CELL_STATE_BUSY;
-    } 
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    bank->rebalance_tokens += bank->rebalance_rate * ((now.tv_sec - bank->rebalance_time.tv_sec) +
+                                          (now.tv_nsec - bank->rebalance_time.tv_nsec) / 1e9);
+    if(bank->rebalance_tokens > bank->rebalance_rate)
+        bank->rebalance_tokens = bank->rebalance_rate;
+    bank->rebalance_time = now;
+    // one write is kept to clear the slot left empty at the end
+    budget = (uint32_t)bank->rebalance_tokens;
+    if(budget < 2)
+        return TCAM_ERR_SUCCESS;
+    budget--;
 
-    shift_up = shift_down = FALSE;
-    shift_start = shift_end = -1;
-   
-    for(; i < num; i++) {        
-        found = FALSE;
-        insert_pos = 0;
-        for(j = 0; j < max_tcam_entries; j++) {
-            if((tcam_cache[j].id != TCAM_CELL_STATE_EMPTY) && (tcam_cache[j].prio >= entries[i].prio)) {
-                found = TRUE;
+    // First finish to move the empty slot left in the middle of a group by
+    // the previous call, if the inserts and removes did not fill it since
+    if(rebalance_in_group(bank, bank->rebalance_hole))
+        hole = bank->rebalance_hole;
+    // The moves are recorded so that a failure of hw_tcam undoes them
+    saved_dir = bank->rebalance_dir;
+    undo_begin(bank);
+    plan_begin(bank);
+    while(done < budget) {
+        // the empty slot keeps moving until it reaches the poor gap
+        if(!rebalance_in_group(bank, hole) && !(planned && rebalance_on_way(bank, hole, poor))) {
+            if(!rebalance_plan(bank, &poor, &rich))
                 break;
+            planned = TRUE;
+            // take the empty slot of the rich gap which is the nearest to the poor one
+            if(rich > poor) {
+                next = bank->prio_groups[rich-1].last + 1;
+                bank->rebalance_dir = -1;
+            } else {
+                next = bank->prio_groups[rich].first - 1;
+                bank->rebalance_dir = 1;
             }
+        } else if(bank->rebalance_dir < 0) {
+            // continue from the last of the empty slots ahead, so that none
+            // of them is left between the entries of the next group
+            next = occ_prev_busy(bank, hole - 1) + 1;
+        } else {
+            next = occ_next_busy(bank, hole + 1) - 1;
         }
-        
-        if(found) {
-            // We found a non-empty entry which either has prio >= to that
-            // of this element. So we need to check for a empty slot to
-            // insert. So first let's check if we can insert at the previous
-            // slot else we may need to shift the old entries by one position
-            if((j == 0) || ((j > 0) && (tcam_cache[j-1].id != TCAM_CELL_STATE_EMPTY))) {
+        // hw_tcam still has the last moved entry in its old slot
+        if(stale && (next != hole)) {
+            plan_add(bank, hole);
+            stale = FALSE;
+            if(++done >= budget)
+                break;
+        }
+        if((ret_val = undo_reserve(bank, 1)) != TCAM_ERR_SUCCESS)
+            goto undo;
+        hole = rebalance_step(bank, next, bank->rebalance_dir);
+        stale = TRUE;
+        done++;
+    }
+    if(stale)
+        plan_add(bank, hole);
+    n1 = tcam_get_hw_access_cnt(&bank->hw_tcam);
+    if((ret_val = plan_program(bank)) != TCAM_ERR_SUCCESS)
+        goto undo;
+    undo_end(bank);
+    done = tcam_get_hw_access_cnt(&bank->hw_tcam) - n1;
+    snap_publish(bank);
+    bank->rebalance_hole = hole;
+    bank->rebalance_tokens -= done;
+    bank->tcam_stats.rebalance_writes += done;
+    if(writes != NULL)
+        *writes = done;
+    return TCAM_ERR_SUCCESS;
 
-                // We have to shift the entries  by one cell to make
-                // way for the new entry
-                for(shift_pos = j+1 ;
-                    ((tcam_cache[shift_pos].id != TCAM_CELL_STATE_EMPTY) && (shift_pos < max_tcam_entries));shift_pos++);
-                
-                if(shift_pos >= max_tcam_entries) {
-                    // We could'nt find an entry to shift down . So let's check if we can find an empty entry to shift upwards
-                    insert_pos = (j-1);
-                    for(shift_pos = insert_pos; ((tcam_cache[shift_pos].id != TCAM_CELL_STATE_EMPTY) && (shift_pos >= 0));shift_pos--);
+undo:
+    TCAM_LOG(bank, TCAM_LOG_ERROR, "ERROR : Could'nt program hw_tcam, the rebalancing is undone\n");
+    undo_rollback(bank, NULL);
+    bank->rebalance_dir = saved_dir;
+    snap_publish(bank);
+    return ret_val;
+}
 
-                    if(shift_pos <= 0) {
-                        printf("ERROR : Could'nt find an empty entry slot  \n");
-                        return TCAM_ERR_TCAM_FULL;
-                    }
-                    memmove(&tcam_cache[shift_pos], &tcam_cache[shift_pos+1],(insert_pos-shift_pos) * sizeof(entry_t));
-                    // Indicate that we had to shift up
-                    shift_up = TRUE;
-                    // since the entries are shifted , we have to record the start and end of the range of entries
-                    shift_window[shift_pos] = TCAM_CELL_STATE_BUSY; // let's record the start
-                    shift_window[j] = TCAM_CELL_STATE_BUSY;         // record the end
-                } else {
-                    insert_pos = j;
-                    memmove(&tcam_cache[j+1], &tcam_cache[j],(shift_pos-insert_pos) * sizeof(entry_t));
-                    // Indicate that we had to shift up
-                    shift_down = TRUE;
-                    // since the entries are shifted , we have to record the start and end of the range of entries
-                    shift_window[j] = TCAM_CELL_STATE_BUSY; // let's record the start
-                    shift_window[shift_pos] = TCAM_CELL_STATE_BUSY;         // record the end
-                }
-            } else  { // empty slot found
-                insert_pos = j-1;
-                /* Even when entries are not shifted , we have to record the position , since there may be other entries
-                 * in the input for which shfiting has to be done. This index is recorded so that it may not be missed 
-                 */
-                shift_window[insert_pos] = TCAM_CELL_STATE_BUSY;  
-            }
-        } else {
-            /* No valid slot found. There are 3 reasons for this to happen :
-             * 1. We could not find an empty slot at all
-             * 2. There are empty slots in the middle of the tcam cache but this entry has to be inserted at the 
-             *     end of the table.
-             * 3. There are empty slots at the end of the tcam cache and this entry has to be inserted at the
-             *    first such entry
-             *    So we have to first start from the end of the cache and iterate backwards to find an empty slot .
-             *    If no empty slot is found, then we have to return an error. 
-             *    To check for case 2 mentioned above, let's check if the last entry (for e.g, 2047th) entry is occupied . This means 
-             *    we have to shift the entries upwards and insert the new entry at the end 
-             *    If the last entry is empty, then we just iterate backwards until we find the first non-empty entry and then 
-             *    insert this new entry after that position 
-             */
+/*  Description:
+ *       Computes the fragmentation metrics of the TCAM Bank handler
+ *       (TCAM cache), see tcam_frag_t.
+ *
+ * Arguments
+ *  tcam - in memory tcam cache
+ *  frag - filled with the metrics
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_get_frag(void *tcam, tcam_frag_t *frag)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+    uint32_t g, size, gaps;
 
-            insert_pos = max_tcam_entries-1;
-            if(tcam_cache[insert_pos].id != TCAM_CELL_STATE_EMPTY) {
+    if(bank == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if(frag == NULL)
+        return TCAM_ERR_EINVAL;
 
-                for(shift_pos = insert_pos ; (shift_pos >= 0) && (tcam_cache[shift_pos].id != TCAM_CELL_STATE_EMPTY); shift_pos--);
+    gaps = bank->num_prio_groups + 1;
 
-                if(shift_pos < 0 ) {
-                    // All entries are full. Not empty slot found  found . Return an error
-                    printf("ERROR : Could'nt find an empty slot to shift the entries upwards \n");
-                    return TCAM_ERR_TCAM_FULL;
-                }
-                memmove(&tcam_cache[shift_pos], &tcam_cache[shift_pos+1],(insert_pos-shift_pos) * sizeof(entry_t));
-                // since the entries are shifted , we have to record the start and end of the range of entries
-                shift_window[shift_pos] = TCAM_CELL_STATE_BUSY; // let's record the start
-                shift_window[insert_pos] = TCAM_CELL_STATE_BUSY;         // record the end    
-                shift_up = TRUE;
-            } else {
-                /* We iterate backwards until we hit a non-empty slot. Then we just insert the new entry at 
-                 * the (non-empty slot index + 1)
-                 */
-                for(shift_pos = insert_pos ; (shift_pos >= 0) && (tcam_cache[shift_pos].id == TCAM_CELL_STATE_EMPTY); shift_pos--);
-                
-                /*  Found an entry or none at all. If found, we insert at the 'j'th index or at the '0'th index.
-                 *  There is a small caveat here . If in case the value of j < 0, then that means that all entries 
-                 *  are emtpy from end to start of the cache. Should'nt happen but that also will be handled, when we 
-                 *  insert at the '0'th index 
-                 */
-                insert_pos = shift_pos+1;
-                /* Even when entries are not shifted , we have to record the position , since there may be other entries
-                 * in the input for which shfiting has to be done. This index is recorded so that it may not be missed 
-                 */
-                shift_window[insert_pos] = TCAM_CELL_STATE_BUSY; 
-            }
-        }
-        // Now let's copy the entry at the intended position , i.e "insert_pos"
-        tcam_cache[insert_pos] = entries[i];
-        insert_list[insert_pos] = TCAM_CELL_STATE_BUSY;
-        total_tcam_entries++;
+    memset(frag, 0, sizeof(tcam_frag_t));
+    frag->free_slots = bank->max_tcam_entries - bank->total_tcam_entries;
+    frag->groups = bank->num_prio_groups;
+    for(g = 0; g < gaps; g++) {
+        size = gap_size(bank, g);
+        frag->gap_free_slots += size;
+        if(size == 0)
+            frag->empty_gaps++;
+        if(size > frag->max_gap)
+            frag->max_gap = size;
     }
-    /* if the entries were either shifted up or down, then we have to iterate through the shift_window 
-     * to record the start and end of that window. This will help when have to program that range of entries
-     * in hw_tcam
-     */
-    if(shift_up || shift_down) {
-        for(i = 0; (i < max_tcam_entries) && (shift_window[i] != TCAM_CELL_STATE_BUSY); i++);
-        shift_start = i;
-
-        for(i =	max_tcam_entries; (i > 0) && (shift_window[i] != TCAM_CELL_STATE_BUSY); i--);
-        shift_end = i;
-    }
-    shift_policy = TCAM_ENTRY_SHIFT_NO_SHIFT;
-    if(shift_up && shift_down) {
-        shift_policy = TCAM_ENTRY_SHIFT_UP_DOWN;
-        printf("Shift policy = TCAM_ENTRY_SHIFT_UP_DOWN\n");
-    }
-    else if(shift_up) {
-        printf("Shift policy = TCAM_ENTRY_SHIFT_UP\n");
-        shift_policy = TCAM_ENTRY_SHIFT_UP;
-    }    else if(shift_down) {
-        shift_policy = TCAM_ENTRY_SHIFT_DOWN;
-        printf("Shift policy = TCAM_ENTRY_SHIFT_DOWN\n");
-    }
-
-    //printf("Total number of tcam entries : %d\n",total_tcam_entries);
-    n1 = tcam_get_hw_access_cnt();
-    
-    switch(shift_policy) {
-    case TCAM_ENTRY_SHIFT_NO_SHIFT:
-        /* No entries were shifted. So we just program the entries at that index
-         * in hw_tcam. This will be a proper O(n) solution
-         */
-        printf("Shift policy = TCAM_ENTRY_NO_SHIFT\n");
-        for(i = 0; i < max_tcam_entries; i++) {
-            if((insert_list[i]) && (tcam_cache[i].id != TCAM_CELL_STATE_EMPTY))
-                tcam_program(hw_tcam_local, &tcam_cache[i], i);
-        }
-        break;
+    frag->group_free_slots = frag->free_slots - frag->gap_free_slots;
+    frag->gap_share = frag->gap_free_slots / gaps;
+    for(g = 0; g < gaps; g++) {
+        size = gap_size(bank, g);
+        if(size > frag->gap_share)
+            frag->imbalance += size - frag->gap_share;
+    }
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *       Sets an option of the TCAM Bank handler. The options are reset to
+ *       their default value by tcam_init().
+ *
+ * Arguments
+ *  tcam  - in memory tcam cache
+ *  opt   - option to be set
+ *  value - value of the option
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_set_option(void *tcam, tcam_option_t opt, uint32_t value)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
 
-    case TCAM_ENTRY_SHIFT_UP:
-    case TCAM_ENTRY_SHIFT_UP_DOWN:
+    if(bank == NULL)
+        return TCAM_ERR_NULL_CACHE;
 
-        printf("Writing entries from %d to %d\n",shift_start, shift_end);
-        for(i = shift_start ; i <= shift_end; i++) {
-            if(tcam_cache[i].id != TCAM_CELL_STATE_EMPTY)
-                tcam_program(hw_tcam_local, &tcam_cache[i], i);
+    switch(opt) {
+    case TCAM_OPT_BATCH_MERGE_MIN:
+        bank->batch_merge_min = value;
+        break;
+    case TCAM_OPT_PLACEMENT:
+        if(value > TCAM_PLACEMENT_MIN_MOVE)
+            return TCAM_ERR_EINVAL;
+        bank->placement = value;
+        break;
+    case TCAM_OPT_SHIFT_MODE:
+        if(value > TCAM_SHIFT_MODE_GROUP_BOUNDARY)
+            return TCAM_ERR_EINVAL;
+        bank->shift_mode = value;
+        break;
+    case TCAM_OPT_REBALANCE_RATE:
+        bank->rebalance_rate = value;
+        // the budget starts full
+        bank->rebalance_tokens = value;
+        clock_gettime(CLOCK_MONOTONIC, &bank->rebalance_time);
+        break;
+    case TCAM_OPT_ASYNC_DEPTH:
+        if(value == 0) {
+            hw_tcam_stop_async(&bank->hw_tcam);
+            break;
         }
+        return hw_tcam_start_async(&bank->hw_tcam, value);
+    case TCAM_OPT_HW_WRITE_NS:
+        // only the writer of the bank and the programming thread write
+        // hw_tcam, wait for the latter
+        hw_tcam_wait(&bank->hw_tcam, hw_tcam_fence(&bank->hw_tcam));
+        bank->hw_tcam.write_ns = value;
         break;
-
-    case TCAM_ENTRY_SHIFT_DOWN:
-        printf("Writing entries from  %d backwards to %d\n",shift_end, shift_start);
-        for(i = shift_end ; i >= shift_start; i--) {
-            if(tcam_cache[i].id != TCAM_CELL_STATE_EMPTY)
-                tcam_program(hw_tcam_local, &tcam_cache[i], i);
+    case TCAM_OPT_HW_FAIL_AT:
+        bank->hw_tcam.fail_at = value;
+        break;
+    case TCAM_OPT_LOOKUP:
+        return hw_tcam_set_lookup(&bank->hw_tcam, value);
+    case TCAM_OPT_KEY_BITS:
+        if((value == 0) || (value % 32 != 0) || (value > TCAM_MAX_KEY_BITS) ||
+           (bank->total_tcam_entries != 0) || (bank->num_spill != 0))
+            return TCAM_ERR_EINVAL;
+        if(value / 32 == bank->key_words)
+            break;
+        // the table of the spill tier is sized for the keys again
+        free(bank->spill);
+        free(bank->spill_keys);
+        bank->spill = NULL;
+        bank->spill_keys = NULL;
+        bank->spill_max = 0;
+        if((key_store_init(bank, value / 32) != TCAM_ERR_SUCCESS) ||
+           (hw_tcam_set_key_width(&bank->hw_tcam, value / 32) != TCAM_ERR_SUCCESS) ||
+           (flow_cache_init(bank, bank->flow_sets * FLOW_WAYS) != TCAM_ERR_SUCCESS) ||
+           ((bank->tss != NULL) && (tss_build(bank) != TCAM_ERR_SUCCESS)) ||
+           ((bank->spill_tss != NULL) && (spill_init(bank) != TCAM_ERR_SUCCESS)))
+            return TCAM_ERR_MEM_ALLOC_FAIL;
+        break;
+    case TCAM_OPT_FLOW_CACHE:
+        if(value > TCAM_MAX_FLOW_CACHE)
+            return TCAM_ERR_EINVAL;
+        return flow_cache_init(bank, value);
+    case TCAM_OPT_TSS:
+        if(value > 1)
+            return TCAM_ERR_EINVAL;
+        if(value == 0) {
+            tcam_tss_destroy(bank->tss);
+            bank->tss = NULL;
+            break;
         }
+        return tss_build(bank);
+    case TCAM_OPT_SPILL:
+        if((value > 1) || ((value == 0) && (bank->num_spill != 0)))
+            return TCAM_ERR_EINVAL;
+        if(value == 0) {
+            tcam_tss_destroy(bank->spill_tss);
+            bank->spill_tss = NULL;
+            break;
+        }
+        return (bank->spill_tss == NULL) ? spill_init(bank) : TCAM_ERR_SUCCESS;
+    case TCAM_OPT_LOG_LEVEL:
+        if(value > TCAM_LOG_DEBUG)
+            return TCAM_ERR_EINVAL;
+        bank->log_level = value;
         break;
-
-    default :
-        printf("Invalid \n");
+    case TCAM_OPT_LATENCY:
+        if(value > 1)
+            return TCAM_ERR_EINVAL;
+        if(value == 0) {
+            free(bank->lat);
+            bank->lat = NULL;
+            break;
+        }
+        if((bank->lat == NULL) &&
+           ((bank->lat = calloc(TCAM_LAT_OPS, sizeof(lat_hist_t))) == NULL))
+            return TCAM_ERR_MEM_ALLOC_FAIL;
         break;
+    default:
+        return TCAM_ERR_EINVAL;
     }
+    return TCAM_ERR_SUCCESS;
+}
 
-    n2 = tcam_get_hw_access_cnt();
-    printf("The number of programming to hw_tcam for %d entries is %llu\n",num, (n2-n1)); 
+/*  Description:
+ *       Copies the statistics of the TCAM Bank handler. The statistics are
+ *       cleared by tcam_init().
+ *
+ * Arguments
+ *  tcam  - in memory tcam cache
+ *  stats - filled with the statistics
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_get_stats(void *tcam, tcam_stats_t *stats)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+
+    if(bank == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if(stats == NULL)
+        return TCAM_ERR_EINVAL;
+
+    *stats = bank->tcam_stats;
+    stats->coalesced_writes = bank->hw_tcam.coalesced;
+    stats->hw_writes = tcam_get_hw_access_cnt(&bank->hw_tcam);
+    stats->spill_entries = bank->num_spill;
     return TCAM_ERR_SUCCESS;
 }
 
 /*  Description:
- *       This function prints the content of the TCAM Bank handler (TCAM cache).
- *       This function accepts "tcam"  as argument and prints the contents.
+ *       Computes the latency of the calls timed by a histogram of the TCAM
+ *       Bank handler since TCAM_OPT_LATENCY was set or the last
+ *       tcam_reset_latency(). The percentiles are the upper bounds of the
+ *       buckets they fall in, within 1/16th of the value.
+ *
  * Arguments
  *  tcam - in memory tcam cache
- * Return: none
+ *  op   - histogram, one of tcam_lat_op_t
+ *  lat  - filled with the latency, all 0 when no call was timed
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
  */
+tcam_err_t tcam_get_latency(void *tcam, tcam_lat_op_t op, tcam_latency_t *lat)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+    lat_hist_t *hist;
 
-void print_tcam_cache(void *tcam) {
-    int j = 0;
-    entry_t *tcam_cache = (entry_t *) tcam;
-    for(j = 0; j < max_tcam_entries; j++) {
-        if(tcam_cache[j].id != TCAM_CELL_STATE_EMPTY)
-            printf("Index : %d -> Id : %d , Priority : %d\n",
-                   j,tcam_cache[j].id, tcam_cache[j].prio);
-    }
+    if(bank == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if((lat == NULL) || ((uint32_t) op >= TCAM_LAT_OPS) || (bank->lat == NULL))
+        return TCAM_ERR_EINVAL;
 
+    memset(lat, 0, sizeof(*lat));
+    hist = &bank->lat[op];
+    if(hist->count == 0)
+        return TCAM_ERR_SUCCESS;
+    lat->count = hist->count;
+    lat->min = hist->min;
+    lat->mean = hist->sum / hist->count;
+    lat->p50 = lat_percentile(hist, 500);
+    lat->p99 = lat_percentile(hist, 990);
+    lat->p999 = lat_percentile(hist, 999);
+    lat->max = hist->max;
+    return TCAM_ERR_SUCCESS;
 }
 
 /*  Description:
- *       Delete a TCAM entry in the "tcam_cache" table as well as "hw_tcam".
- *       This function accepts "tcam" and the id of the entry to be deleted
- *       as arguments and deletes an entry with that id in both the
- *       "tcam_cache" as well "hw_tcam" tables. The deletion is done by
- *       setting the id field for that entry to 0.  
+ *       Empties the latency histograms of the TCAM Bank handler.
  *
  * Arguments
  *  tcam - in memory tcam cache
- *  id   - id of the entry to be deleted 
  * Return: TCAM_ERR_SUCCESS or appropriate error code.
  */
-tcam_err_t tcam_remove(void *tcam, uint32_t id) {
-    uint32_t i , position = 0;
-    bool found = FALSE;
-    entry_t *tcam_cache = (entry_t *) tcam;
+tcam_err_t tcam_reset_latency(void *tcam)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
 
-    if(tcam_cache == NULL)
+    if(bank == NULL)
         return TCAM_ERR_NULL_CACHE;
-    
-    for(i = 0; i < max_tcam_entries ; i++) {
-        if(tcam_cache[i].id == id) {
-            found = TRUE;            
-            break;
-        }
+    if(bank->lat == NULL)
+        return TCAM_ERR_EINVAL;
+    memset(bank->lat, 0, TCAM_LAT_OPS * sizeof(lat_hist_t));
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *       Starts recording the calls to tcam_insert(), tcam_insert_keys(),
+ *       tcam_remove(), tcam_remove_batch() and tcam_modify_prio() of the
+ *       TCAM Bank handler to 'out', or stops it when 'out' is NULL. The
+ *       trace begins with the size and the key width of the bank, as given
+ *       to tcam_init() and TCAM_OPT_KEY_BITS, then the entries of hw_tcam
+ *       and the spilled ones with their keys as a batch inserted, so that it
+ *       can be replayed from an empty bank. The other options than
+ *       TCAM_OPT_SPILL are not recorded. See tcam_trace.h for the format.
+ *
+ * Arguments
+ *  tcam - in memory tcam cache
+ *  out  - file the trace is written to, left open, or NULL
+ * Return: TCAM_ERR_SUCCESS, TCAM_ERR_IO if a record could not be written or
+ *         appropriate error code.
+ */
+tcam_err_t tcam_set_trace(void *tcam, FILE *out)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+    uint32_t words, num = 0, j;
+    entry_t *entries;
+    uint32_t *keys;
+    tcam_err_t ret_val;
+    uint64_t start;
+
+    if(bank == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if(out == NULL) {
+        ret_val = (bank->trace != NULL) ? tcam_trace_stop(bank->trace) : TCAM_ERR_SUCCESS;
+        bank->trace = NULL;
+        return ret_val;
     }
-    if(!found)
+    if(bank->trace != NULL)
         return TCAM_ERR_EINVAL;
 
-    position = i;
-    //printf("The entry has to be deleted in hw_tcam at position %d\n", position);
-    tcam_cache[position].id = 0;
-    if(tcam_program(hw_tcam_local, &tcam_cache[position], position) == TCAM_ERR_SUCCESS) {
-        tcam_cache[position].id = TCAM_CELL_STATE_EMPTY;
-        tcam_cache[position].prio = 0;
-        total_tcam_entries--;
+    words = 2 * bank->key_words;
+    entries = malloc((bank->total_tcam_entries + bank->num_spill + 1) * sizeof(entry_t));
+    keys = malloc((bank->total_tcam_entries + bank->num_spill + 1) * words * sizeof(uint32_t));
+    if((entries == NULL) || (keys == NULL)) {
+        free(entries);
+        free(keys);
+        return TCAM_ERR_MEM_ALLOC_FAIL;
     }
-    return TCAM_ERR_SUCCESS;
+    // the latest entry of a batch is the first of its group, so the batch
+    // takes the entries from the lowest ranking one: the spilled entries,
+    // then the slots from the last one
+    for(j = 0; j < bank->num_spill; j++) {
+        entries[num] = bank->spill[j];
+        memcpy(&keys[num * words], &bank->spill_keys[j * words], words * sizeof(uint32_t));
+        num++;
+    }
+    for(j = bank->max_tcam_entries; j-- > 0; ) {
+        if(bank->tcam_cache[j].id == TCAM_CELL_STATE_EMPTY)
+            continue;
+        entries[num] = bank->tcam_cache[j];
+        memcpy(&keys[num * words], key_of(bank, &bank->tcam_cache[j]), words * sizeof(uint32_t));
+        num++;
+    }
+    if((ret_val = tcam_trace_start(out, &bank->trace)) == TCAM_ERR_SUCCESS) {
+        start = lat_start(bank);
+        tcam_trace_record(bank->trace, start, TCAM_TRACE_INIT, TCAM_ERR_SUCCESS,
+                          ((num > 0) ? TCAM_TRACE_INIT_SNAPSHOT : 0) |
+                          ((bank->spill_tss != NULL) ? TCAM_TRACE_INIT_SPILL : 0),
+                          bank->max_tcam_entries, 32 * bank->key_words, NULL, 0);
+        if(num > 0)
+            tcam_trace_insert(bank->trace, start, TCAM_ERR_SUCCESS, entries, keys, bank->key_words, num);
+    }
+    free(entries);
+    free(keys);
+    return ret_val;
 }
 
 /*  Description:
- *  Helper function to free up the in-memory "tcam_cache" . This is used in
- *  case the caller wants to free up the "tcam_cache" memory
+ *       Sets a function called after each write to the hw_tcam of the TCAM
+ *       Bank handler, with the slot written, so that a test can check every
+ *       state hw_tcam goes through. The function must not call the handler.
+ *
  * Arguments
  *  tcam - in memory tcam cache
+ *  fn   - function called with 'arg' and the slot, NULL for none
+ *  arg  - argument of fn
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
  */
+tcam_err_t tcam_set_watch(void *tcam, tcam_watch_fn_t fn, void *arg)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
 
-void tcam_cache_destroy(void *tcam)
+    if(bank == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    hw_tcam_set_watch(&bank->hw_tcam, fn, arg);
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *       Copies the slots [start, start+count) of the TCAM Bank handler (TCAM
+ *       cache) as they were when the last insertion, deletion or rebalancing
+ *       ended. It never waits for the writer of the bank nor sees the middle
+ *       of a batch, so any number of threads can call it while another thread
+ *       inserts and deletes entries. The writers of a bank still have to be
+ *       serialized by the caller.
+ *
+ * Arguments
+ *  tcam    - in memory tcam cache
+ *  start   - first slot to copy
+ *  count   - number of slots to copy
+ *  buf     - filled with the entries of the slots
+ *  version - filled with the number of publications of the bank, can be NULL
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_snapshot(void *tcam, uint32_t start, uint32_t count, entry_t *buf, uint64_t *version)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+    uint64_t seq;
+
+    if(bank == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if((buf == NULL) || (start > bank->max_tcam_entries) || (count > bank->max_tcam_entries - start))
+        return TCAM_ERR_EINVAL;
+
+    do {
+        seq = __atomic_load_n(&bank->snap_seq, __ATOMIC_ACQUIRE);
+        memcpy(buf, &bank->snap[seq & 1][start], count * sizeof(entry_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while(__atomic_load_n(&bank->snap_seq, __ATOMIC_RELAXED) != seq);
+    if(version != NULL)
+        *version = seq / 2;
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *       Returns a fence for the writes to hw_tcam of the calls made so far on
+ *       the TCAM Bank handler, to be given to tcam_fence_wait(). When hw_tcam
+ *       is programmed synchronously, the writes are always done.
+ *
+ * Arguments
+ *  tcam  - in memory tcam cache
+ *  fence - filled with the fence
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_fence(void *tcam, uint64_t *fence)
+{
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+
+    if(bank == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if(fence == NULL)
+        return TCAM_ERR_EINVAL;
+    *fence = hw_tcam_fence(&bank->hw_tcam);
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *       Waits until the writes to hw_tcam before the fence are done, so that
+ *       the calls made before tcam_fence() are effective in hw_tcam.
+ *
+ * Arguments
+ *  tcam  - in memory tcam cache
+ *  fence - fence returned by tcam_fence()
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_fence_wait(void *tcam, uint64_t fence)
 {
-    if(tcam != NULL)
-        free(tcam);
-    tcam = NULL;
-    max_tcam_entries = 0;
-    hw_tcam_local = NULL;
-    if(insert_list != NULL)
-        free(insert_list);
-    insert_list = NULL;
-    total_tcam_entries = 0;
+    tcam_bank_t *bank = (tcam_bank_t *) tcam;
+
+    if(bank == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    hw_tcam_wait(&bank->hw_tcam, fence);
+    return TCAM_ERR_SUCCESS;
 }
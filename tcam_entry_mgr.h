@@ -42,7 +42,9 @@ tcam_err_t tcam_init(entry_t *hw_tcam, uint32_t size, void **tcam);
  *     This API inserts a batch of entries into the TCAM Bank handler (A.K.A
  *     TCAM cache) referred to by the ‘tcam’ parameter.
  *     The insert is either successful entirely or it fails and nothing
- *     is inserted. Each entry in the batch has a priority and id .
+ *     is inserted. A batch which fails half way, for instance on an error
+ *     of hw_tcam, is undone in the tcam cache and in hw_tcam before the
+ *     call returns. Each entry in the batch has a priority and id .
  *     The entries are inserted into the TCAM bank handler in a sorted
  *     manner with  the value of the priority field as a key. The
  *     entries are sorted in ascending order . All entried of the same
@@ -55,6 +57,8 @@ tcam_err_t tcam_init(entry_t *hw_tcam, uint32_t size, void **tcam);
  *     'tcam' (TCAM bank handler) , they are then programmed in the hardware tcam table. The
  *     'tcam' is represented  by an in-memory data structure "tcam_cache"
  *     and the 'hw_tcam' is represented by a "hw_tcam_local" variables.
+ *     The entries match any key, see tcam_insert_keys() for entries with
+ *     a key.
  * Arguments
  *  tcam - in memory tcam cache
  *  entries - entries to be inserted
@@ -63,6 +67,22 @@ tcam_err_t tcam_init(entry_t *hw_tcam, uint32_t size, void **tcam);
  */
 tcam_err_t tcam_insert(void *tcam, entry_t *entries, uint32_t num);
 
+/*  Description:
+ *     Inserts a batch of entries like tcam_insert(), each one with its
+ *     ternary key. A key looked up matches an entry when it has the bits of
+ *     the value of the entry where the mask of the entry is set, see
+ *     tcam_lookup(). The keys are copied in the key store of the bank.
+ * Arguments
+ *  tcam    - in memory tcam cache
+ *  entries - entries to be inserted, their key_ref is ignored
+ *  keys    - keys of the entries, for each entry the value then the mask of
+ *            its key, TCAM_OPT_KEY_BITS / 32 words each. NULL inserts
+ *            entries matching any key, like tcam_insert()
+ *  num     - number of entries
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_insert_keys(void *tcam, entry_t *entries, const uint32_t *keys, uint32_t num);
+
 /*  Description:
  *       Delete a TCAM entry in the "tcam_cache" table as well as "hw_tcam".
  *       This function accepts "tcam" and the id of the entry to be deleted
@@ -77,6 +97,248 @@ tcam_err_t tcam_insert(void *tcam, entry_t *entries, uint32_t num);
  */
 tcam_err_t tcam_remove(void *tcam, uint32_t id);
 
+/*  Description:
+ *       Deletes a batch of TCAM entries in the "tcam_cache" table as well as
+ *       "hw_tcam". The entries are invalidated in hw_tcam in a single burst,
+ *       in the order of their slots. The batch is deleted entirely or not at
+ *       all: an unknown id or an id given twice fails the call before
+ *       anything is written, and an error of hw_tcam in the middle of the
+ *       burst is undone.
+ *
+ * Arguments
+ *  tcam   - in memory tcam cache
+ *  ids    - ids of the entries to be deleted
+ *  num    - number of ids
+ *  writes - filled with the number of writes to hw_tcam done, can be NULL
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_remove_batch(void *tcam, uint32_t *ids, uint32_t num, uint32_t *writes);
+
+/*  Description:
+ *       Changes the priority of the entry with the given id. The entry goes
+ *       first in the group of its new priority, as if it was inserted again,
+ *       but it is never missing from hw_tcam: it is programmed in its new
+ *       slot before its old slot is invalidated (make before break). The
+ *       entry is rewritten in place when its slot is still in order with the
+ *       new priority, and it is moved to an empty slot in the right place
+ *       when there is one. Otherwise it is inserted again with the shifts of
+ *       tcam_insert(), which fails with TCAM_ERR_TCAM_FULL when the bank has
+ *       no empty slot. A failure leaves the entry as it was.
+ *
+ * Arguments
+ *  tcam - in memory tcam cache
+ *  id   - id of the entry
+ *  prio - new priority of the entry
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_modify_prio(void *tcam, uint32_t id, uint32_t prio);
+
+/*  Description:
+ *       Look up the slot of the entry with the given id in the "tcam_cache".
+ *       The slot is the same as the position of the entry in "hw_tcam".
+ *       If the id is present more than once, the lowest slot is returned.
+ *
+ * Arguments
+ *  tcam     - in memory tcam cache
+ *  id       - id of the entry
+ *  position - filled with the slot of the entry
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_find(void *tcam, uint32_t id, uint32_t *position);
+
+/*  Description:
+ *       Looks up a key in hw_tcam like the hardware does and returns the
+ *       matching entry of the lowest slot, which is the one of the highest
+ *       priority. Empty slots never match. The key compare is chosen with
+ *       TCAM_OPT_LOOKUP. With TCAM_OPT_ASYNC_DEPTH, only the writes done by
+ *       the programming queue are seen, see tcam_fence().
+ *       With TCAM_OPT_FLOW_CACHE, the results are kept by the flow cache
+ *       until the next write to hw_tcam. The lookups then update the
+ *       handler and must not run at the same time as other calls on it.
+ *
+ * Arguments
+ *  tcam     - in memory tcam cache
+ *  key      - key of TCAM_OPT_KEY_BITS / 32 words
+ *  ent      - filled with the matching entry, can be NULL
+ *  position - filled with the slot of the matching entry
+ * Return: TCAM_ERR_SUCCESS, TCAM_ERR_NO_MATCH if no entry matches the key or
+ *         appropriate error code.
+ */
+tcam_err_t tcam_lookup(void *tcam, const uint32_t *key, entry_t *ent, uint32_t *position);
+
+/*  Description:
+ *       Looks up a key in the software classifier of the entries, see
+ *       TCAM_OPT_TSS, without reading hw_tcam. The entry returned is the one
+ *       tcam_lookup() returns once hw_tcam is programmed, except between
+ *       entries of the same priority matching the same key whose order in
+ *       their group was changed by the shifts of
+ *       TCAM_SHIFT_MODE_GROUP_BOUNDARY: the last one inserted is returned.
+ *
+ * Arguments
+ *  tcam     - in memory tcam cache
+ *  key      - key of TCAM_OPT_KEY_BITS / 32 words
+ *  ent      - filled with the matching entry, can be NULL
+ *  position - filled with the slot of the matching entry
+ * Return: TCAM_ERR_SUCCESS, TCAM_ERR_NO_MATCH if no entry matches the key or
+ *         appropriate error code.
+ */
+tcam_err_t tcam_lookup_tss(void *tcam, const uint32_t *key, entry_t *ent, uint32_t *position);
+
+/*  Description:
+ *       Copies the key of the entry with the given id, its value then its
+ *       mask.
+ *
+ * Arguments
+ *  tcam - in memory tcam cache
+ *  id   - id of the entry
+ *  key  - filled with 2 * TCAM_OPT_KEY_BITS / 32 words
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_get_key(void *tcam, uint32_t id, uint32_t *key);
+
+/*  Description:
+ *       Sets an option of the TCAM Bank handler. The options are reset to
+ *       their default value by tcam_init().
+ *
+ * Arguments
+ *  tcam  - in memory tcam cache
+ *  opt   - option to be set
+ *  value - value of the option
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_set_option(void *tcam, tcam_option_t opt, uint32_t value);
+
+/*  Description:
+ *       Copies the statistics of the TCAM Bank handler. The statistics are
+ *       cleared by tcam_init().
+ *
+ * Arguments
+ *  tcam  - in memory tcam cache
+ *  stats - filled with the statistics
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_get_stats(void *tcam, tcam_stats_t *stats);
+
+/*  Description:
+ *       Computes the latency of the calls timed by a histogram of the TCAM
+ *       Bank handler since TCAM_OPT_LATENCY was set or the last
+ *       tcam_reset_latency().
+ *
+ * Arguments
+ *  tcam - in memory tcam cache
+ *  op   - histogram, one of tcam_lat_op_t
+ *  lat  - filled with the latency, all 0 when no call was timed
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_get_latency(void *tcam, tcam_lat_op_t op, tcam_latency_t *lat);
+
+/*  Description:
+ *       Empties the latency histograms of the TCAM Bank handler.
+ *
+ * Arguments
+ *  tcam - in memory tcam cache
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_reset_latency(void *tcam);
+
+/*  Description:
+ *       Starts recording the calls to tcam_insert(), tcam_insert_keys(),
+ *       tcam_remove(), tcam_remove_batch() and tcam_modify_prio() of the
+ *       TCAM Bank handler to 'out', or stops it when 'out' is NULL. The
+ *       trace begins with the size and the key width of the bank, then its
+ *       entries as a batch inserted, the spilled ones included, so that it
+ *       can be replayed from an empty bank, see tcam_trace.h.
+ *
+ * Arguments
+ *  tcam - in memory tcam cache
+ *  out  - file the trace is written to, left open, or NULL
+ * Return: TCAM_ERR_SUCCESS, TCAM_ERR_IO if a record could not be written or
+ *         appropriate error code.
+ */
+tcam_err_t tcam_set_trace(void *tcam, FILE *out);
+
+/*  Description:
+ *       Sets a function called after each write to the hw_tcam of the TCAM
+ *       Bank handler, with the slot written, so that a test can check every
+ *       state hw_tcam goes through. The function must not call the handler.
+ *
+ * Arguments
+ *  tcam - in memory tcam cache
+ *  fn   - function called with 'arg' and the slot, NULL for none
+ *  arg  - argument of fn
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_set_watch(void *tcam, tcam_watch_fn_t fn, void *arg);
+
+/*  Description:
+ *       Moves the empty slots of the TCAM Bank handler (TCAM cache) between
+ *       the priority groups so that each group has its share of them before
+ *       it. It is meant to be called periodically when the TCAM is idle. The
+ *       number of writes to hw_tcam is limited by the TCAM_OPT_REBALANCE_RATE
+ *       option, and nothing is done when the option is 0. A rebalancing can
+ *       span several calls.
+ *
+ * Arguments
+ *  tcam   - in memory tcam cache
+ *  writes - filled with the number of writes to hw_tcam done, can be NULL
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_rebalance(void *tcam, uint32_t *writes);
+
+/*  Description:
+ *       Computes the fragmentation metrics of the TCAM Bank handler
+ *       (TCAM cache), see tcam_frag_t.
+ *
+ * Arguments
+ *  tcam - in memory tcam cache
+ *  frag - filled with the metrics
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_get_frag(void *tcam, tcam_frag_t *frag);
+
+/*  Description:
+ *       Copies the slots [start, start+count) of the TCAM Bank handler (TCAM
+ *       cache) as they were when the last insertion, deletion or rebalancing
+ *       ended. It never waits for the writer of the bank nor sees the middle
+ *       of a batch, so any number of threads can call it while another thread
+ *       inserts and deletes entries. The writers of a bank still have to be
+ *       serialized by the caller.
+ *
+ * Arguments
+ *  tcam    - in memory tcam cache
+ *  start   - first slot to copy
+ *  count   - number of slots to copy
+ *  buf     - filled with the entries of the slots
+ *  version - filled with the number of publications of the bank, can be NULL
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_snapshot(void *tcam, uint32_t start, uint32_t count, entry_t *buf, uint64_t *version);
+
+/*  Description:
+ *       Returns a fence for the writes to hw_tcam of the calls made so far on
+ *       the TCAM Bank handler. With TCAM_OPT_ASYNC_DEPTH, tcam_insert(),
+ *       tcam_remove(), tcam_remove_batch() and tcam_rebalance() return once
+ *       their writes are queued, and tcam_fence_wait() waits until they are
+ *       effective in hw_tcam. When hw_tcam is programmed synchronously, the writes are
+ *       always done.
+ *
+ * Arguments
+ *  tcam  - in memory tcam cache
+ *  fence - filled with the fence
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_fence(void *tcam, uint64_t *fence);
+
+/*  Description:
+ *       Waits until the writes to hw_tcam before the fence are done.
+ *
+ * Arguments
+ *  tcam  - in memory tcam cache
+ *  fence - fence returned by tcam_fence()
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_fence_wait(void *tcam, uint64_t fence);
+
 /*  Description:                    
  *  Helper function to free up the in-memory "tcam_cache" . This is used in
  *  case the caller wants to free up the "tcam_cache" memory
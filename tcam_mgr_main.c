@@ -16,7 +16,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "tcam_entry_mgr.h"
+#include "tcam_shard_mgr.h"
+#include "tcam_tss.h"
+#include "tcam_trace.h"
 static entry_t hw_tcam[TCAM_MAX_ENTRIES];
 //static uint64_t hw_access;
 
@@ -59,6 +65,18 @@ void print_hw_tcam()
     print_hw_tcam_with_index(0, TCAM_MAX_ENTRIES);
 }
 
+/* The banks of the tests below trace every insertion, the default being
+ * TCAM_LOG_ERROR
+ */
+tcam_err_t tcam_init_traced(entry_t *hw, uint32_t size, void **tcam)
+{
+    tcam_err_t ret_val;
+
+    if ((ret_val = tcam_init(hw, size, tcam)) != TCAM_ERR_SUCCESS)
+        return ret_val;
+    return tcam_set_option(*tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_DEBUG);
+}
+
 int test_tcam_program()
 {
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
@@ -66,7 +84,7 @@ int test_tcam_program()
     entry_t entry[10];
     int32_t id = 0;
     int delete_entries[2] = {3,6};
-    if((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam)) != TCAM_ERR_SUCCESS) {
+    if((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam)) != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         return FALSE;
     }
@@ -189,7 +207,7 @@ int test_invalid_id_tcam_remove()
     int result = TRUE;
     
     printf("Test to check for deletion of invalid entry in TCAM table\n");
-    if((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam)) != TCAM_ERR_SUCCESS) {
+    if((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam)) != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         
     }
@@ -239,7 +257,7 @@ int test_full_tcam()
     int result = TRUE, i, prio, id;
 
     printf("Test case to check for FULL TCAM Table\n");
-    if((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam)) != TCAM_ERR_SUCCESS) {
+    if((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam)) != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         exit(1);
     }
@@ -280,7 +298,7 @@ int test_tcam_insert_1()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
     int num = 3;
     printf("Test case to check for insert of values into TCAM \n");
-    if((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam)) != TCAM_ERR_SUCCESS) {
+    if((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam)) != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         return FALSE;
     }
@@ -324,7 +342,7 @@ int test_tcam_insert_2()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
 
     printf("Test case to check for insert of values into TCAM \n");
-    if((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam)) != TCAM_ERR_SUCCESS) {
+    if((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam)) != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         return FALSE;
     }
@@ -366,7 +384,7 @@ int test_tcam_insert_3()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
 
     printf("%s : Test case to check for insert of values into TCAM \n", __FUNCTION__);
-    if((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam)) != TCAM_ERR_SUCCESS) {
+    if((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam)) != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         return FALSE;
     }
@@ -408,7 +426,7 @@ int test_tcam_insert_4()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
 
     printf("Test case to check for insert of values into TCAM \n");
-    if((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam)) != TCAM_ERR_SUCCESS) {
+    if((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam)) != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         return FALSE;
     }
@@ -445,7 +463,7 @@ int test_full_insert_remove()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
     void *tcam = NULL;
     int result = TRUE, i, prio, id;
-    if ((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
         != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         exit(1);
@@ -503,7 +521,7 @@ int test_full_insert_remove_start()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
     void *tcam = NULL;
     int result = TRUE, i, prio, id, cnt = 25;
-    if ((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
         != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         exit(1);
@@ -561,7 +579,7 @@ int test_full_insert_remove_start_1()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
     void *tcam = NULL;
     int result = TRUE, i, prio, id, cnt = 25;
-    if ((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
         != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         exit(1);
@@ -619,7 +637,7 @@ int test_full_insert_remove_start_2()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
     void *tcam = NULL;
     int result = TRUE, i, prio, id, cnt = TCAM_MAX_ENTRIES;
-    if ((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
         != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         exit(1);
@@ -675,7 +693,7 @@ int test_full_insert_remove_end()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
     void *tcam = NULL;
     int result = TRUE, i, prio, id, cnt = TCAM_MAX_ENTRIES;
-    if ((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
         != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         exit(1);
@@ -735,7 +753,7 @@ int test_full_insert_remove_end_1()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
     void *tcam = NULL;
     int result = TRUE, i, prio, id, cnt = TCAM_MAX_ENTRIES;
-    if ((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
         != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         exit(1);
@@ -795,7 +813,7 @@ int test_full_insert_remove_middle()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
     void *tcam = NULL;
     int result = TRUE, i, prio, id, cnt = TCAM_MAX_ENTRIES;
-    if ((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
         != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         exit(1);
@@ -855,7 +873,7 @@ int test_full_insert_remove_middle_1()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
     void *tcam = NULL;
     int result = TRUE, i, prio, id, cnt = TCAM_MAX_ENTRIES;
-    if ((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
         != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         exit(1);
@@ -917,7 +935,7 @@ int test_full_insert_remove_middle_insert_end()
     int result = TRUE, i, prio, id, cnt = TCAM_MAX_ENTRIES;
 
     printf("Function to remove entries in middle and insert at the end\n");
-    if ((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
         != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         exit(1);
@@ -974,7 +992,7 @@ int test_full_insert_shift_up()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
     void *tcam = NULL;
     int result = TRUE, i, prio, id, cnt = TCAM_MAX_ENTRIES;
-    if ((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
         != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         exit(1);
@@ -1041,7 +1059,7 @@ int test_full_insert_no_shift()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
     void *tcam = NULL;
     int result = TRUE, i, prio, id, cnt = TCAM_MAX_ENTRIES;
-    if ((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
         != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         exit(1);
@@ -1108,7 +1126,7 @@ int test_full_insert_shift_up_down()
     tcam_err_t ret_val = TCAM_ERR_SUCCESS;
     void *tcam = NULL;
     int result = TRUE, i, prio, id, cnt = TCAM_MAX_ENTRIES;
-    if ((ret_val = tcam_init(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
         != TCAM_ERR_SUCCESS) {
         printf("tcam_init error\n");
         exit(1);
@@ -1163,19 +1181,2527 @@ int test_full_insert_shift_up_down()
     return TRUE;
 }
 
+/* Description :
+ *     This function tests the id to slot index of the tcam_cache. The cache is
+ *     filled, holes are punched and entries are inserted on both sides of the
+ *     holes so that the existing entries are shifted up and down. Every id
+ *     must then be reported by tcam_find() at the slot it occupies in hw_tcam,
+ *     and deleted ids must not be found anymore.
+ */
+int test_tcam_find()
+{
+    entry_t entry[TCAM_MAX_ENTRIES];
+    tcam_err_t ret_val = TCAM_ERR_SUCCESS;
+    void *tcam = NULL;
+    uint32_t position;
+    int i, prio, id, cnt = TCAM_MAX_ENTRIES;
+
+    printf("Test case to check the lookup of an entry by id\n");
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+        != TCAM_ERR_SUCCESS) {
+        printf("tcam_init error\n");
+        exit(1);
+    }
+
+    for (i = 0, prio = 20, id = 1; i < cnt; i++, id++, prio += 10) {
+        entry[i].prio = prio;
+        entry[i].id = id;
+    }
+    if ((ret_val = tcam_insert(tcam, entry, cnt)) != TCAM_ERR_SUCCESS) {
+        printf("tcam_insert failed : %d \n", ret_val);
+        return FALSE;
+    }
+    // punch 10 holes in the middle
+    for (i = 0, id = 1000; i < 10; i++, id++) {
+        if ((ret_val = tcam_remove(tcam, id)) != TCAM_ERR_SUCCESS) {
+            printf("tcam_remove(%d) failed : %d \n", id, ret_val);
+            return FALSE;
+        }
+    }
+    // 5 entries before the holes and 5 after them
+    for (i = 0, id = 5000; i < 10; i++, id++) {
+        entry[i].prio = (i < 5) ? 5000 : 15000;
+        entry[i].id = id;
+    }
+    if ((ret_val = tcam_insert(tcam, entry, 10)) != TCAM_ERR_SUCCESS) {
+        printf("tcam_insert failed : %d \n", ret_val);
+        return FALSE;
+    }
+
+    for (i = 0; i < cnt; i++) {
+        if (hw_tcam[i].id == TCAM_CELL_STATE_EMPTY)
+            continue;
+        if ((tcam_find(tcam, hw_tcam[i].id, &position) != TCAM_ERR_SUCCESS) ||
+            (position != i)) {
+            printf("Id %d at index %d not found by tcam_find\n", hw_tcam[i].id, i);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+    }
+    for (id = 1000; id < 1010; id++) {
+        if (tcam_find(tcam, id, &position) != TCAM_ERR_EINVAL) {
+            printf("Deleted id %d found by tcam_find\n", id);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+    }
+    tcam_cache_destroy(tcam);
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     Checks that the valid entries of hw_tcam are sorted on the priority.
+ *     Returns 1 if they are sorted else 0
+ */
+int check_hw_tcam_sorted(int start, int end)
+{
+    int i, last = -1;
+
+    for (i = start; i < end; i++) {
+        if (hw_tcam[i].id == TCAM_CELL_STATE_EMPTY)
+            continue;
+        if ((last >= 0) && (hw_tcam[last].prio > hw_tcam[i].prio)) {
+            printf("Index %d (prio %d) is before index %d (prio %d)\n",
+                   last, hw_tcam[last].prio, i, hw_tcam[i].prio);
+            return FALSE;
+        }
+        last = i;
+    }
+    return TRUE;
+}
+
+/* Description :
+ *     This function tests the insertion point of an entry when the boundaries
+ *     of the priority groups change. 20 groups of 10 entries are inserted,
+ *     then the first and the last entry of every group are deleted and one new
+ *     entry is inserted in every group. Each new entry has to be at the start
+ *     of its group.
+ */
+int test_tcam_prio_groups()
+{
+    entry_t entry[200];
+    tcam_err_t ret_val = TCAM_ERR_SUCCESS;
+    void *tcam = NULL;
+    uint32_t position;
+    int i, g, id;
+
+    printf("Test case to check the insertion point with changing priority groups\n");
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+        != TCAM_ERR_SUCCESS) {
+        printf("tcam_init error\n");
+        exit(1);
+    }
+    // group 'g' has the ids g*10+1 .. g*10+10 and the priority (g+1)*100
+    for (i = 0; i < 200; i++) {
+        entry[i].id = i + 1;
+        entry[i].prio = ((i / 10) + 1) * 100;
+    }
+    if ((ret_val = tcam_insert(tcam, entry, 200)) != TCAM_ERR_SUCCESS) {
+        printf("tcam_insert failed : %d \n", ret_val);
+        return FALSE;
+    }
+    for (g = 0; g < 20; g++) {
+        for (i = 0; i < 200; i++) {
+            if ((hw_tcam[i].id != TCAM_CELL_STATE_EMPTY) && (hw_tcam[i].prio == (g + 1) * 100))
+                break;
+        }
+        id = hw_tcam[i].id;
+        if ((ret_val = tcam_remove(tcam, id)) != TCAM_ERR_SUCCESS) {
+            printf("tcam_remove(%d) failed : %d \n", id, ret_val);
+            return FALSE;
+        }
+        for (i = 199; i >= 0; i--) {
+            if ((hw_tcam[i].id != TCAM_CELL_STATE_EMPTY) && (hw_tcam[i].prio == (g + 1) * 100))
+                break;
+        }
+        id = hw_tcam[i].id;
+        if ((ret_val = tcam_remove(tcam, id)) != TCAM_ERR_SUCCESS) {
+            printf("tcam_remove(%d) failed : %d \n", id, ret_val);
+            return FALSE;
+        }
+    }
+    for (g = 0; g < 20; g++) {
+        entry[g].id = 1000 + g;
+        entry[g].prio = (g + 1) * 100;
+    }
+    if ((ret_val = tcam_insert(tcam, entry, 20)) != TCAM_ERR_SUCCESS) {
+        printf("tcam_insert failed : %d \n", ret_val);
+        return FALSE;
+    }
+    if (!check_hw_tcam_sorted(0, TCAM_MAX_ENTRIES)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    for (g = 0; g < 20; g++) {
+        if (tcam_find(tcam, 1000 + g, &position) != TCAM_ERR_SUCCESS) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        for (i = 0; i < position; i++) {
+            if ((hw_tcam[i].id != TCAM_CELL_STATE_EMPTY) && (hw_tcam[i].prio >= entry[g].prio)) {
+                printf("Id %d is not at the start of its group\n", 1000 + g);
+                printf("Test case failed\n");
+                return FALSE;
+            }
+        }
+    }
+    tcam_cache_destroy(tcam);
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     This function tests the free slot search on a full TCAM. The tcam_cache
+ *     is filled completely and only the first slot is freed. Then an entry is
+ *     inserted at the end of the table, so the free slot can only be found
+ *     by searching the whole table upwards and all the entries are shifted
+ *     up by one slot.
+ */
+int test_full_insert_shift_up_first_slot()
+{
+    entry_t entry[TCAM_MAX_ENTRIES];
+    tcam_err_t ret_val = TCAM_ERR_SUCCESS;
+    void *tcam = NULL;
+    int i, prio, id, cnt = TCAM_MAX_ENTRIES;
+
+    printf("Test case to check the free slot search on a full TCAM\n");
+    if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+        != TCAM_ERR_SUCCESS) {
+        printf("tcam_init error\n");
+        exit(1);
+    }
+    for (i = 0, prio = 20, id = 1; i < cnt; i++, id++, prio += 10) {
+        entry[i].prio = prio;
+        entry[i].id = id;
+    }
+    if ((ret_val = tcam_insert(tcam, entry, cnt)) != TCAM_ERR_SUCCESS) {
+        printf("tcam_insert failed : %d \n", ret_val);
+        return FALSE;
+    }
+    if ((ret_val = tcam_remove(tcam, 1)) != TCAM_ERR_SUCCESS) {
+        printf("tcam_remove failed : %d \n", ret_val);
+        return FALSE;
+    }
+    entry[0].prio = prio;
+    entry[0].id = id;
+    if ((ret_val = tcam_insert(tcam, entry, 1)) != TCAM_ERR_SUCCESS) {
+        printf("tcam_insert failed : %d \n", ret_val);
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    print_hw_tcam_with_index(0, 5);
+    print_hw_tcam_with_index(TCAM_MAX_ENTRIES - 5, TCAM_MAX_ENTRIES);
+    if ((hw_tcam[0].id != 2) || (hw_tcam[TCAM_MAX_ENTRIES - 1].id != id) ||
+        !check_hw_tcam_sorted(0, TCAM_MAX_ENTRIES)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_cache_destroy(tcam);
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     Fills a TCAM of 'size' entries, deletes every entry whose id is not a
+ *     multiple of 3 in the first half of the table and every fourth entry in
+ *     the second half, then inserts a batch in priority order which fills
+ *     all the free slots if 'fill' is set, else half of them.
+ *     'merge_min' is the batch merge option used for all the inserts.
+ *     The final layout of hw_tcam is copied to 'layout'.
+ */
+int run_batch_merge_scenario(uint32_t size, bool fill, uint32_t merge_min, entry_t *layout)
+{
+    entry_t entry[TCAM_MAX_ENTRIES];
+    tcam_err_t ret_val = TCAM_ERR_SUCCESS;
+    void *tcam = NULL;
+    int i, cnt = 0;
+
+    if ((ret_val = tcam_init(hw_tcam, size, &tcam)) != TCAM_ERR_SUCCESS) {
+        printf("tcam_init error\n");
+        exit(1);
+    }
+    tcam_set_option(tcam, TCAM_OPT_BATCH_MERGE_MIN, merge_min);
+    for (i = 0; i < size; i++) {
+        entry[i].id = i + 1;
+        entry[i].prio = ((i % 40) + 1) * 10;
+    }
+    if ((ret_val = tcam_insert(tcam, entry, size)) != TCAM_ERR_SUCCESS) {
+        printf("tcam_insert failed : %d \n", ret_val);
+        return FALSE;
+    }
+    for (i = 1; i <= size; i++) {
+        if (((i <= size / 2) && (i % 3 != 0)) || ((i > size / 2) && (i % 4 == 0))) {
+            if ((ret_val = tcam_remove(tcam, i)) != TCAM_ERR_SUCCESS) {
+                printf("tcam_remove(%d) failed : %d \n", i, ret_val);
+                return FALSE;
+            }
+            cnt++;
+        }
+    }
+    if (!fill)
+        cnt /= 2;
+    for (i = 0; i < cnt; i++) {
+        entry[i].id = size + i + 1;
+        entry[i].prio = ((i * 81) / cnt + 1) * 5;
+    }
+    if ((ret_val = tcam_insert(tcam, entry, cnt)) != TCAM_ERR_SUCCESS) {
+        printf("tcam_insert failed : %d \n", ret_val);
+        return FALSE;
+    }
+    memcpy(layout, hw_tcam, size * sizeof(entry_t));
+    tcam_cache_destroy(tcam);
+    return TRUE;
+}
+
+/* Description :
+ *     This function tests the batch insertion by merge. The same scenario is
+ *     run entry by entry and with the merge, once with free slots left and
+ *     once until the TCAM is full, and the layouts of hw_tcam have to be the
+ *     same.
+ */
+int test_tcam_insert_batch_merge()
+{
+    static entry_t expected[TCAM_MAX_ENTRIES], merged[TCAM_MAX_ENTRIES];
+    int i;
+
+    printf("Test case to check the batch insertion by merge\n");
+    for (i = 0; i < 2; i++) {
+        if (!run_batch_merge_scenario(TCAM_MAX_ENTRIES, i, 0, expected) ||
+            !run_batch_merge_scenario(TCAM_MAX_ENTRIES, i, 1, merged)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        if (memcmp(expected, merged, sizeof(expected)) != 0) {
+            printf("Layouts differ for fill %d\n", i);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+    }
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     This function tests the placement policies. 100 entries fill the slots
+ *     0 to 99 and the entry at slot 48 is deleted. An entry inserted before
+ *     the one at slot 50 shifts 50 entries down with
+ *     TCAM_PLACEMENT_SHIFT_DOWN_FIRST but only one entry up with
+ *     TCAM_PLACEMENT_MIN_MOVE, which then reports the 49 writes saved.
+ */
+int test_tcam_placement_min_move()
+{
+    entry_t entry[100];
+    tcam_err_t ret_val = TCAM_ERR_SUCCESS;
+    tcam_stats_t stats;
+    void *tcam = NULL;
+    uint32_t position;
+    int i, policy;
+    uint64_t expected_writes[] = {51, 2}, expected_saved[] = {0, 49};
+    uint32_t expected_position[] = {50, 49};
+
+    printf("Test case to check the minimum move placement\n");
+    for (policy = TCAM_PLACEMENT_SHIFT_DOWN_FIRST; policy <= TCAM_PLACEMENT_MIN_MOVE; policy++) {
+        if ((ret_val = tcam_init_traced(hw_tcam, TCAM_MAX_ENTRIES, &tcam))
+            != TCAM_ERR_SUCCESS) {
+            printf("tcam_init error\n");
+            exit(1);
+        }
+        if (tcam_set_option(tcam, TCAM_OPT_PLACEMENT, policy) != TCAM_ERR_SUCCESS) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        for (i = 0; i < 100; i++) {
+            entry[i].id = i + 1;
+            entry[i].prio = (i + 1) * 10;
+        }
+        if (((ret_val = tcam_insert(tcam, entry, 100)) != TCAM_ERR_SUCCESS) ||
+            ((ret_val = tcam_remove(tcam, 49)) != TCAM_ERR_SUCCESS)) {
+            printf("Test case failed : %d\n", ret_val);
+            return FALSE;
+        }
+        entry[0].id = 1000;
+        entry[0].prio = 505;
+        if ((ret_val = tcam_insert(tcam, entry, 1)) != TCAM_ERR_SUCCESS) {
+            printf("tcam_insert failed : %d \n", ret_val);
+            return FALSE;
+        }
+        print_hw_tcam_with_index(46, 52);
+        if ((tcam_get_stats(tcam, &stats) != TCAM_ERR_SUCCESS) ||
+            (stats.insert_calls != 2) || (stats.inserted_entries != 101) ||
+            (stats.insert_hw_writes != 100 + expected_writes[policy]) ||
+            (stats.writes_saved != expected_saved[policy]) ||
+            (tcam_find(tcam, 1000, &position) != TCAM_ERR_SUCCESS) ||
+            (position != expected_position[policy]) ||
+            !check_hw_tcam_sorted(0, TCAM_MAX_ENTRIES)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        tcam_cache_destroy(tcam);
+    }
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     Fills the slots 0 to 199 of a TCAM of 'size' entries with 10 groups of
+ *     20 entries with the priorities 100 to 1000, deletes the entry at slot 0
+ *     if 'remove_first' is set and inserts one entry with the priority 'prio'
+ *     using the shifting mode 'mode'. The number of writes to hw_tcam done by
+ *     this insertion and the slot of the new entry are returned in 'writes'
+ *     and 'position'.
+ */
+int run_group_shift_case(uint32_t size, bool remove_first, uint32_t prio, uint32_t mode,
+                         uint64_t *writes, uint32_t *position)
+{
+    entry_t entry[200];
+    tcam_err_t ret_val = TCAM_ERR_SUCCESS;
+    tcam_stats_t before, after;
+    void *tcam = NULL;
+    int i;
+
+    if ((ret_val = tcam_init(hw_tcam, size, &tcam)) != TCAM_ERR_SUCCESS) {
+        printf("tcam_init error\n");
+        exit(1);
+    }
+    tcam_set_option(tcam, TCAM_OPT_SHIFT_MODE, mode);
+    // the slots are filled in the reverse order of the ids
+    for (i = 0; i < 200; i++) {
+        entry[i].id = 200 - i;
+        entry[i].prio = (10 - (i / 20)) * 100;
+    }
+    if ((ret_val = tcam_insert(tcam, entry, 200)) != TCAM_ERR_SUCCESS) {
+        printf("tcam_insert failed : %d \n", ret_val);
+        return FALSE;
+    }
+    if (remove_first && ((ret_val = tcam_remove(tcam, 1)) != TCAM_ERR_SUCCESS)) {
+        printf("tcam_remove failed : %d \n", ret_val);
+        return FALSE;
+    }
+    tcam_get_stats(tcam, &before);
+    entry[0].id = 1000;
+    entry[0].prio = prio;
+    if ((ret_val = tcam_insert(tcam, entry, 1)) != TCAM_ERR_SUCCESS) {
+        printf("tcam_insert failed : %d \n", ret_val);
+        return FALSE;
+    }
+    tcam_get_stats(tcam, &after);
+    *writes = after.insert_hw_writes - before.insert_hw_writes;
+    if ((tcam_find(tcam, 1000, position) != TCAM_ERR_SUCCESS) ||
+        !check_hw_tcam_sorted(0, size)) {
+        return FALSE;
+    }
+    for (i = 0; i < *position; i++) {
+        if ((hw_tcam[i].id != TCAM_CELL_STATE_EMPTY) && (hw_tcam[i].prio >= prio)) {
+            printf("Entry %d is not the first of its group\n", entry[0].id);
+            return FALSE;
+        }
+    }
+    tcam_cache_destroy(tcam);
+    return TRUE;
+}
+
+/* Description :
+ *     This function tests the number of writes to hw_tcam with the group
+ *     boundary shifting. An entry is inserted before 1 to 10 groups of 20
+ *     entries, once with an empty slot after the groups, so that they are
+ *     shifted down, and once with a full TCAM whose only empty slot is before
+ *     the groups, so that they are shifted up. Each insertion has to write one
+ *     entry per group crossed plus the new entry, while shifting all the
+ *     entries writes 20 entries per group.
+ */
+int test_tcam_group_shift_writes()
+{
+    uint64_t writes;
+    uint32_t position;
+    int k;
+
+    printf("Test case to check the writes of the group boundary shifting\n");
+    for (k = 1; k <= 10; k++) {
+        // down : the entry goes before the last k groups
+        if (!run_group_shift_case(TCAM_MAX_ENTRIES, FALSE, (11 - k) * 100 - 50,
+                                  TCAM_SHIFT_MODE_GROUP_BOUNDARY, &writes, &position) ||
+            (writes != k + 1) || (position != (10 - k) * 20)) {
+            printf("Shift down across %d groups : %llu writes\n", k, (unsigned long long) writes);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        if (!run_group_shift_case(TCAM_MAX_ENTRIES, FALSE, (11 - k) * 100 - 50,
+                                  TCAM_SHIFT_MODE_ENTRIES, &writes, &position) ||
+            (writes != 20 * k + 1)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        // up : the entry goes after the first k groups
+        if (!run_group_shift_case(200, TRUE, k * 100 + 50,
+                                  TCAM_SHIFT_MODE_GROUP_BOUNDARY, &writes, &position) ||
+            (writes != k + 1) || (position != k * 20 - 1)) {
+            printf("Shift up across %d groups : %llu writes\n", k, (unsigned long long) writes);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        if (!run_group_shift_case(200, TRUE, k * 100 + 50,
+                                  TCAM_SHIFT_MODE_ENTRIES, &writes, &position) ||
+            (writes != 20 * k)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+    }
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     This function tests the rebalancer. 10 groups of 10 entries fill the
+ *     first half of a TCAM of 200 entries so all the empty slots are after
+ *     the last group. The rebalancer is first given a budget of 10 writes,
+ *     which it has to respect, then a budget large enough to spread the empty
+ *     slots between all the groups. An entry inserted at the start of a group
+ *     must then need a single write. It is done with both shifting modes.
+ */
+int test_tcam_rebalance()
+{
+    entry_t entry[100];
+    tcam_err_t ret_val = TCAM_ERR_SUCCESS;
+    tcam_frag_t frag;
+    tcam_stats_t before, after;
+    void *tcam = NULL;
+    uint32_t writes, position;
+    int i, mode;
+
+    printf("Test case to check the rebalancing of the empty slots\n");
+    for (mode = TCAM_SHIFT_MODE_ENTRIES; mode <= TCAM_SHIFT_MODE_GROUP_BOUNDARY; mode++) {
+        if ((ret_val = tcam_init(hw_tcam, 200, &tcam)) != TCAM_ERR_SUCCESS) {
+            printf("tcam_init error\n");
+            exit(1);
+        }
+        tcam_set_option(tcam, TCAM_OPT_SHIFT_MODE, mode);
+        for (i = 0; i < 100; i++) {
+            entry[i].id = 100 - i;
+            entry[i].prio = (10 - (i / 10)) * 100;
+        }
+        if ((ret_val = tcam_insert(tcam, entry, 100)) != TCAM_ERR_SUCCESS) {
+            printf("tcam_insert failed : %d \n", ret_val);
+            return FALSE;
+        }
+        tcam_get_frag(tcam, &frag);
+        if ((frag.free_slots != 100) || (frag.groups != 10) || (frag.empty_gaps != 10) ||
+            (frag.max_gap != 100) || (frag.gap_share != 9) || (frag.imbalance != 91)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        // disabled by default
+        if ((tcam_rebalance(tcam, &writes) != TCAM_ERR_SUCCESS) || (writes != 0)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        tcam_set_option(tcam, TCAM_OPT_REBALANCE_RATE, 10);
+        if ((tcam_rebalance(tcam, &writes) != TCAM_ERR_SUCCESS) || (writes == 0) || (writes > 10)) {
+            printf("Rebalance with a budget of 10 wrote %d entries\n", writes);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        tcam_set_option(tcam, TCAM_OPT_REBALANCE_RATE, 100000);
+        tcam_rebalance(tcam, &writes);
+        tcam_get_frag(tcam, &frag);
+        printf("Rebalance wrote %d entries, %d empty gaps and an imbalance of %d left\n",
+               writes, frag.empty_gaps, frag.imbalance);
+        if ((frag.empty_gaps != 0) || (frag.max_gap > frag.gap_share + 1) ||
+            !check_hw_tcam_sorted(0, 200)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        for (i = 1; i <= 100; i++) {
+            if ((tcam_find(tcam, i, &position) != TCAM_ERR_SUCCESS) || (hw_tcam[position].id != i)) {
+                printf("Entry %d is not programmed\n", i);
+                printf("Test case failed\n");
+                return FALSE;
+            }
+        }
+        tcam_get_stats(tcam, &before);
+        entry[0].id = 1000;
+        entry[0].prio = 550;
+        if ((ret_val = tcam_insert(tcam, entry, 1)) != TCAM_ERR_SUCCESS) {
+            printf("tcam_insert failed : %d \n", ret_val);
+            return FALSE;
+        }
+        tcam_get_stats(tcam, &after);
+        if ((after.insert_hw_writes - before.insert_hw_writes != 1) ||
+            (after.rebalance_writes == 0)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        tcam_cache_destroy(tcam);
+    }
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+#define MULTI_BANKS 4
+
+typedef struct bank_run_ {
+    entry_t *hw_tcam;
+    tcam_stats_t stats;
+    int result;
+} bank_run_t;
+
+/* Description :
+ *     Runs the same inserts and removes on the bank serving the hw_tcam of
+ *     'arg' and records its statistics. It is the body of the threads of
+ *     test_tcam_multi_bank().
+ */
+void *run_bank(void *arg)
+{
+    bank_run_t *run = arg;
+    entry_t entry[50];
+    void *tcam = NULL;
+    int i, round;
+
+    run->result = FALSE;
+    if (tcam_init(run->hw_tcam, 512, &tcam) != TCAM_ERR_SUCCESS)
+        return NULL;
+    // the banks are compared with their keys
+    memset(entry, 0, sizeof(entry));
+    for (round = 0; round < 8; round++) {
+        for (i = 0; i < 50; i++) {
+            entry[i].id = round * 50 + i + 1;
+            entry[i].prio = ((i * 7 + round) % 20) * 10;
+        }
+        if (tcam_insert(tcam, entry, 10) != TCAM_ERR_SUCCESS ||
+            tcam_insert(tcam, &entry[10], 40) != TCAM_ERR_SUCCESS)
+            return NULL;
+        for (i = 0; i < 50; i += 3) {
+            if (tcam_remove(tcam, round * 50 + i + 1) != TCAM_ERR_SUCCESS)
+                return NULL;
+        }
+    }
+    tcam_get_stats(tcam, &run->stats);
+    tcam_cache_destroy(tcam);
+    run->result = TRUE;
+    return NULL;
+}
+
+/* Description :
+ *     This function tests that banks are independent. The same inserts and
+ *     removes are run on one bank alone, then on 4 banks at the same time,
+ *     each one from its own thread. Every bank has to end up with the same
+ *     layout and the same number of writes to its hw_tcam as the bank alone.
+ */
+int test_tcam_multi_bank()
+{
+    static entry_t hw_banks[MULTI_BANKS + 1][TCAM_MAX_ENTRIES];
+    bank_run_t runs[MULTI_BANKS + 1];
+    pthread_t threads[MULTI_BANKS];
+    int i;
+
+    printf("Test case to check that banks can be driven at the same time\n");
+    for (i = 0; i <= MULTI_BANKS; i++)
+        runs[i].hw_tcam = hw_banks[i];
+    // reference run, alone
+    run_bank(&runs[MULTI_BANKS]);
+    if (!runs[MULTI_BANKS].result) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    for (i = 0; i < MULTI_BANKS; i++) {
+        if (pthread_create(&threads[i], NULL, run_bank, &runs[i]) != 0) {
+            printf("pthread_create failed\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < MULTI_BANKS; i++)
+        pthread_join(threads[i], NULL);
+    for (i = 0; i < MULTI_BANKS; i++) {
+        if (!runs[i].result ||
+            (memcmp(hw_banks[i], hw_banks[MULTI_BANKS], sizeof(hw_banks[i])) != 0) ||
+            (runs[i].stats.insert_hw_writes != runs[MULTI_BANKS].stats.insert_hw_writes)) {
+            printf("Bank %d differs from the reference\n", i);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+    }
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+typedef struct snap_reader_ {
+    void *tcam;
+    volatile int stop;
+    uint64_t reads;
+    uint64_t torn;
+} snap_reader_t;
+
+/* Description :
+ *     Returns TRUE if the busy slots of 'ent' are sorted by priority, as the
+ *     tcam_cache is between two batches.
+ */
+int snapshot_sorted(entry_t *ent, int num)
+{
+    int i, last = -1;
+
+    for (i = 0; i < num; i++) {
+        if (ent[i].id == TCAM_CELL_STATE_EMPTY)
+            continue;
+        if ((last >= 0) && (ent[i].prio < ent[last].prio))
+            return FALSE;
+        last = i;
+    }
+    return TRUE;
+}
+
+/* Description :
+ *     Returns TRUE if the snapshot 'ent' holds the entries of 'hw'. The
+ *     priority of an empty slot is not compared, the hw_tcam keeps the one of
+ *     the deleted entry.
+ */
+int snapshot_equal(entry_t *ent, entry_t *hw, int num)
+{
+    int i;
+
+    for (i = 0; i < num; i++) {
+        if ((ent[i].id != hw[i].id) ||
+            ((ent[i].id != TCAM_CELL_STATE_EMPTY) && (ent[i].prio != hw[i].prio)))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* Description :
+ *     Takes snapshots of the bank of 'arg' until it is stopped and counts the
+ *     snapshots which are not sorted. It is the body of the reader threads of
+ *     test_tcam_snapshot().
+ */
+void *snap_read(void *arg)
+{
+    snap_reader_t *reader = arg;
+    entry_t buf[512];
+
+    while (!reader->stop) {
+        if (tcam_snapshot(reader->tcam, 0, 512, buf, NULL) != TCAM_ERR_SUCCESS ||
+            !snapshot_sorted(buf, 512))
+            reader->torn++;
+        reader->reads++;
+    }
+    return NULL;
+}
+
+/* Description :
+ *     This function tests tcam_snapshot(). A snapshot has to be equal to the
+ *     hw_tcam after every insertion and deletion, with a new version. Then a
+ *     thread takes snapshots while the bank is churned, none of them may show
+ *     the middle of a batch.
+ */
+int test_tcam_snapshot()
+{
+    static entry_t buf[512];
+    entry_t entry[100];
+    snap_reader_t reader;
+    pthread_t thread;
+    uint64_t version, last;
+    void *tcam = NULL;
+    int i, round, failed = 0;
+
+    printf("Test case to check the snapshots of the tcam cache\n");
+    memset(hw_tcam, 0, sizeof(hw_tcam));
+    if (tcam_init(hw_tcam, 512, &tcam) != TCAM_ERR_SUCCESS) {
+        printf("tcam_init failed\n");
+        return FALSE;
+    }
+    if ((tcam_snapshot(NULL, 0, 1, buf, NULL) != TCAM_ERR_NULL_CACHE) ||
+        (tcam_snapshot(tcam, 0, 1, NULL, NULL) != TCAM_ERR_EINVAL) ||
+        (tcam_snapshot(tcam, 500, 13, buf, NULL) != TCAM_ERR_EINVAL) ||
+        (tcam_snapshot(tcam, 0, 512, buf, &last) != TCAM_ERR_SUCCESS)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    for (i = 0; i < 100; i++) {
+        entry[i].id = i + 1;
+        entry[i].prio = (i * 37) % 50;
+    }
+    for (i = 0; i < 100; i += 10) {
+        if (tcam_insert(tcam, &entry[i], 10) != TCAM_ERR_SUCCESS ||
+            tcam_remove(tcam, i + 5) != TCAM_ERR_SUCCESS)
+            return FALSE;
+        tcam_snapshot(tcam, 0, 512, buf, &version);
+        if (!snapshot_equal(buf, hw_tcam, 512) || (version != last + 2)) {
+            printf("Snapshot differs from the hw_tcam\n");
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        last = version;
+    }
+    tcam_snapshot(tcam, 100, 50, buf, NULL);
+    if (!snapshot_equal(buf, &hw_tcam[100], 50)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+
+    memset(&reader, 0, sizeof(reader));
+    reader.tcam = tcam;
+    if (pthread_create(&thread, NULL, snap_read, &reader) != 0) {
+        printf("pthread_create failed\n");
+        exit(1);
+    }
+    for (round = 0; round < 200; round++) {
+        for (i = 0; i < 100; i++) {
+            entry[i].id = 1000 + (round % 2) * 100 + i;
+            entry[i].prio = (i * 13 + round) % 40;
+        }
+        if (tcam_insert(tcam, entry, 100) != TCAM_ERR_SUCCESS)
+            failed++;
+        // remove the entries of the previous round
+        for (i = 0; (round > 0) && (i < 100); i++) {
+            if (tcam_remove(tcam, 1000 + ((round + 1) % 2) * 100 + i) != TCAM_ERR_SUCCESS)
+                failed++;
+        }
+    }
+    reader.stop = 1;
+    pthread_join(thread, NULL);
+    tcam_cache_destroy(tcam);
+    if ((failed != 0) || (reader.torn != 0)) {
+        printf("%llu of %llu snapshots are torn\n", (unsigned long long) reader.torn,
+               (unsigned long long) reader.reads);
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     This function tests the asynchronous programming of hw_tcam. The calls
+ *     return before hw_tcam is programmed, with a simulated latency of the
+ *     writes. Once a fence is waited for, hw_tcam holds the entries of the
+ *     calls made before the fence, and going back to synchronous programming
+ *     waits for the queued writes.
+ */
+int test_tcam_async()
+{
+    static entry_t buf[512];
+    entry_t entry[64];
+    tcam_stats_t stats;
+    uint64_t fence;
+    void *tcam = NULL;
+    int i, round;
+
+    printf("Test case to check the asynchronous programming of hw_tcam\n");
+    memset(hw_tcam, 0, sizeof(hw_tcam));
+    if ((tcam_init(hw_tcam, 512, &tcam) != TCAM_ERR_SUCCESS) ||
+        (tcam_fence(tcam, &fence) != TCAM_ERR_SUCCESS) ||
+        (tcam_fence_wait(tcam, fence) != TCAM_ERR_SUCCESS) ||
+        (tcam_set_option(tcam, TCAM_OPT_ASYNC_DEPTH, 32) != TCAM_ERR_SUCCESS) ||
+        (tcam_set_option(tcam, TCAM_OPT_HW_WRITE_NS, 2000) != TCAM_ERR_SUCCESS)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    for (round = 0; round < 8; round++) {
+        for (i = 0; i < 64; i++) {
+            entry[i].id = round * 64 + i + 1;
+            entry[i].prio = (i * 11 + round) % 30;
+        }
+        if ((tcam_insert(tcam, entry, 16) != TCAM_ERR_SUCCESS) ||
+            (tcam_insert(tcam, &entry[16], 48) != TCAM_ERR_SUCCESS)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        for (i = 0; i < 64; i += 4)
+            tcam_remove(tcam, round * 64 + i + 1);
+        tcam_fence(tcam, &fence);
+        tcam_fence_wait(tcam, fence);
+        tcam_snapshot(tcam, 0, 512, buf, NULL);
+        if (!snapshot_equal(buf, hw_tcam, 512)) {
+            printf("hw_tcam is not programmed after the fence\n");
+            printf("Test case failed\n");
+            return FALSE;
+        }
+    }
+    // synchronous again, the queued writes are done
+    for (i = 0; i < 64; i++)
+        tcam_remove(tcam, 7 * 64 + i + 1);
+    tcam_set_option(tcam, TCAM_OPT_ASYNC_DEPTH, 0);
+    tcam_snapshot(tcam, 0, 512, buf, NULL);
+    tcam_get_stats(tcam, &stats);
+    if (!snapshot_equal(buf, hw_tcam, 512) ||
+        (stats.coalesced_writes > stats.insert_hw_writes + 8 * 64)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_cache_destroy(tcam);
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     This function tests that a batch which fails half way is undone. A
+ *     simulated hw error makes a write of the batch fail, with the entry by
+ *     entry insertion, the group boundary shifting and the merge. The
+ *     tcam_cache and the hw_tcam have to be as before the call, and the same
+ *     batch has to be inserted once the hw error is gone.
+ */
+int test_tcam_insert_undo()
+{
+    static entry_t before[256], buf[256];
+    entry_t entry[100];
+    tcam_stats_t stats;
+    uint32_t position, fail_at[] = {1, 7, 30};
+    void *tcam = NULL;
+    int i, mode, f;
+
+    printf("Test case to check the undo of a batch which fails half way\n");
+    for (mode = 0; mode < 3; mode++) {
+        memset(hw_tcam, 0, sizeof(hw_tcam));
+        if (tcam_init(hw_tcam, 256, &tcam) != TCAM_ERR_SUCCESS) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        tcam_set_option(tcam, TCAM_OPT_BATCH_MERGE_MIN, (mode == 2) ? 64 : 0);
+        if (mode == 1)
+            tcam_set_option(tcam, TCAM_OPT_SHIFT_MODE, TCAM_SHIFT_MODE_GROUP_BOUNDARY);
+        for (i = 0; i < 100; i++) {
+            entry[i].id = i + 1;
+            entry[i].prio = (i * 7) % 40;
+        }
+        tcam_insert(tcam, entry, 50);
+        tcam_insert(tcam, &entry[50], 50);
+        for (i = 0; i < 100; i += 3)
+            tcam_remove(tcam, i + 1);
+        tcam_snapshot(tcam, 0, 256, before, NULL);
+        for (i = 0; i < 64; i++) {
+            entry[i].id = 1000 + i;
+            entry[i].prio = (i * 13) % 45;
+        }
+        for (f = 0; f < 3; f++) {
+            tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, fail_at[f]);
+            if (tcam_insert(tcam, entry, 64) != TCAM_ERR_HW_FAIL) {
+                printf("The hw error is not reported, mode %d\n", mode);
+                printf("Test case failed\n");
+                return FALSE;
+            }
+            tcam_snapshot(tcam, 0, 256, buf, NULL);
+            tcam_get_stats(tcam, &stats);
+            if (memcmp(buf, before, sizeof(buf)) || !snapshot_equal(buf, hw_tcam, 256) ||
+                (tcam_find(tcam, 1000, &position) == TCAM_ERR_SUCCESS) ||
+                (stats.insert_calls != 2)) {
+                printf("The batch is not undone, mode %d, write %u\n", mode, fail_at[f]);
+                printf("Test case failed\n");
+                return FALSE;
+            }
+        }
+        if ((tcam_insert(tcam, entry, 64) != TCAM_ERR_SUCCESS) ||
+            (tcam_find(tcam, 1063, &position) != TCAM_ERR_SUCCESS)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        tcam_snapshot(tcam, 0, 256, buf, NULL);
+        if (!snapshot_equal(buf, hw_tcam, 256) || !snapshot_sorted(buf, 256)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        tcam_cache_destroy(tcam);
+    }
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     This function tests tcam_remove_batch(). A batch is deleted with one
+ *     write per entry. A batch with an unknown id or an id given twice, or
+ *     whose burst fails on a hw error, leaves the bank as it was.
+ */
+int test_tcam_remove_batch()
+{
+    static entry_t before[256], buf[256];
+    entry_t entry[200];
+    uint32_t ids[60], writes, position;
+    void *tcam = NULL;
+    int i;
+
+    printf("Test case to check the deletion of a batch of entries\n");
+    memset(hw_tcam, 0, sizeof(hw_tcam));
+    if (tcam_init(hw_tcam, 256, &tcam) != TCAM_ERR_SUCCESS) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    for (i = 0; i < 200; i++) {
+        entry[i].id = i + 1;
+        entry[i].prio = (i * 17) % 50;
+    }
+    tcam_insert(tcam, entry, 200);
+    for (i = 0; i < 60; i++)
+        ids[i] = 200 - 3 * i;
+    tcam_snapshot(tcam, 0, 256, before, NULL);
+
+    // an unknown id, then an id given twice
+    ids[59] = 1000;
+    if (tcam_remove_batch(tcam, ids, 60, &writes) != TCAM_ERR_EINVAL) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    ids[59] = ids[10];
+    if (tcam_remove_batch(tcam, ids, 60, &writes) != TCAM_ERR_EINVAL) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    ids[59] = 23;
+    tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, 40);
+    if (tcam_remove_batch(tcam, ids, 60, &writes) != TCAM_ERR_HW_FAIL) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_snapshot(tcam, 0, 256, buf, NULL);
+    if (memcmp(buf, before, sizeof(buf)) || !snapshot_equal(buf, hw_tcam, 256)) {
+        printf("The failed batch is not undone\n");
+        printf("Test case failed\n");
+        return FALSE;
+    }
+
+    if ((tcam_remove_batch(tcam, ids, 60, &writes) != TCAM_ERR_SUCCESS) || (writes != 60)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_snapshot(tcam, 0, 256, buf, NULL);
+    for (i = 0; i < 60; i++) {
+        if (tcam_find(tcam, ids[i], &position) == TCAM_ERR_SUCCESS) {
+            printf("Entry %u is not deleted\n", ids[i]);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+    }
+    // the slots are reused by the next insertion
+    for (i = 0; i < 100; i++) {
+        entry[i].id = 500 + i;
+        entry[i].prio = (i * 7) % 50;
+    }
+    if (!snapshot_equal(buf, hw_tcam, 256) ||
+        (tcam_insert(tcam, entry, 100) != TCAM_ERR_SUCCESS)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_snapshot(tcam, 0, 256, buf, NULL);
+    if (!snapshot_equal(buf, hw_tcam, 256) || !snapshot_sorted(buf, 256)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_cache_destroy(tcam);
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     Returns the number of writes to hw_tcam done by tcam_modify_prio() on
+ *     the bank so far.
+ */
+uint64_t modify_writes(void *tcam)
+{
+    tcam_stats_t stats;
+
+    tcam_get_stats(tcam, &stats);
+    return stats.modify_hw_writes;
+}
+
+/* Description :
+ *     This function tests tcam_modify_prio(). An entry whose slot is still
+ *     in order is rewritten in place, an entry with an empty slot in front of
+ *     its new group is moved there, and any other entry is inserted again.
+ *     The entry ends up first in its new group and hw_tcam keeps the cache.
+ */
+int test_tcam_modify_prio()
+{
+    static entry_t buf[256], before[256];
+    entry_t entry[256];
+    uint32_t position, id;
+    uint64_t writes;
+    void *tcam = NULL;
+    int i;
+
+    printf("Test case to check the change of the priority of an entry\n");
+    memset(hw_tcam, 0, sizeof(hw_tcam));
+    if (tcam_init(hw_tcam, 256, &tcam) != TCAM_ERR_SUCCESS) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    // groups of 10 entries of prio 10, 20 and 30 in the slots [0, 30)
+    for (i = 0; i < 30; i++) {
+        entry[i].id = i + 1;
+        entry[i].prio = 10 * (i / 10 + 1);
+    }
+    tcam_insert(tcam, entry, 30);
+    tcam_snapshot(tcam, 0, 256, buf, NULL);
+
+    // the last entry of the group 10 stays in its slot for prio 15
+    id = buf[9].id;
+    writes = modify_writes(tcam);
+    if ((tcam_modify_prio(tcam, id, 15) != TCAM_ERR_SUCCESS) || (modify_writes(tcam) != writes + 1) ||
+        (tcam_find(tcam, id, &position) != TCAM_ERR_SUCCESS) || (position != 9) ||
+        (hw_tcam[9].prio != 15)) {
+        printf("The entry is not rewritten in place\n");
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    // the empty slot in front of the group 30 takes an entry of prio 25
+    tcam_remove(tcam, buf[20].id);
+    id = buf[0].id;
+    writes = modify_writes(tcam);
+    if ((tcam_modify_prio(tcam, id, 25) != TCAM_ERR_SUCCESS) || (modify_writes(tcam) != writes + 2) ||
+        (tcam_find(tcam, id, &position) != TCAM_ERR_SUCCESS) || (position != 20) ||
+        (hw_tcam[0].id != TCAM_CELL_STATE_EMPTY)) {
+        printf("The entry is not moved to the empty slot\n");
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    // the last entry goes first in a new group at the start
+    id = buf[29].id;
+    if ((tcam_modify_prio(tcam, id, 5) != TCAM_ERR_SUCCESS) ||
+        (tcam_find(tcam, id, &position) != TCAM_ERR_SUCCESS)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_snapshot(tcam, 0, 256, buf, NULL);
+    for (i = 0; (i < 256) && (buf[i].id == TCAM_CELL_STATE_EMPTY); i++);
+    if ((i != position) || (buf[position].prio != 5) || !snapshot_sorted(buf, 256) ||
+        !snapshot_equal(buf, hw_tcam, 256)) {
+        printf("The entry is not first in its new group\n");
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    if (tcam_modify_prio(tcam, 999, 5) != TCAM_ERR_EINVAL) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+
+    // a failed write or a full bank leave the entry as it was
+    memcpy(before, buf, sizeof(buf));
+    tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, 1);
+    if ((tcam_modify_prio(tcam, buf[position].id, 40) != TCAM_ERR_HW_FAIL) ||
+        (tcam_snapshot(tcam, 0, 256, buf, NULL) != TCAM_ERR_SUCCESS) ||
+        memcmp(buf, before, sizeof(buf)) || !snapshot_equal(buf, hw_tcam, 256)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    for (i = 0; i < 227; i++) {
+        entry[i].id = 100 + i;
+        entry[i].prio = 50;
+    }
+    tcam_insert(tcam, entry, 227);
+    tcam_snapshot(tcam, 0, 256, buf, NULL);
+    memcpy(before, buf, sizeof(buf));
+    if ((tcam_modify_prio(tcam, buf[0].id, 60) != TCAM_ERR_TCAM_FULL) ||
+        (tcam_snapshot(tcam, 0, 256, buf, NULL) != TCAM_ERR_SUCCESS) ||
+        memcmp(buf, before, sizeof(buf)) || !snapshot_equal(buf, hw_tcam, 256)) {
+        printf("The failed change is not undone\n");
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_cache_destroy(tcam);
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+#define SHARD_BANKS 4
+#define SHARD_SIZE  256
+
+/* Description :
+ *     Checks the banks of a shard manager: the entries of each bank are in
+ *     its range and sorted, so that the banks taken in order are sorted, and
+ *     the number of entries is 'num'.
+ */
+int check_shards(void *mgr, entry_t hw_banks[][SHARD_SIZE], int num)
+{
+    uint64_t first, end;
+    int b, i, count = 0;
+    int64_t last = -1;
+
+    for (b = 0; b < SHARD_BANKS; b++) {
+        tcam_shard_get_range(mgr, b, &first, &end);
+        for (i = 0; i < SHARD_SIZE; i++) {
+            if (hw_banks[b][i].id == TCAM_CELL_STATE_EMPTY)
+                continue;
+            if ((hw_banks[b][i].prio < first) || (hw_banks[b][i].prio >= end) ||
+                ((int64_t) hw_banks[b][i].prio < last)) {
+                printf("Entry %u of prio %u out of order in bank %d\n", hw_banks[b][i].id,
+                       hw_banks[b][i].prio, b);
+                return FALSE;
+            }
+            last = hw_banks[b][i].prio;
+            count++;
+        }
+    }
+    if (count != num) {
+        printf("%d entries in the banks instead of %d\n", count, num);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Description :
+ *     This function tests the shard manager. Entries spread over the whole
+ *     priority space go to the bank of their range. Then entries of a few
+ *     priorities fill up the first bank, whose range has to give priorities
+ *     to the other banks. A batch larger than the empty slots fails without
+ *     inserting anything, and the entries can be found and deleted whatever
+ *     bank they ended up in. A batch which fails in a bank is deleted from
+ *     the other banks. A group which can not be deleted from its bank
+ *     after it is copied to the next one stays in its bank only, and a batch
+ *     which does not fit fails before any group is moved.
+ */
+int test_tcam_shard()
+{
+    static entry_t hw_banks[SHARD_BANKS][SHARD_SIZE], hw_before[SHARD_BANKS][SHARD_SIZE];
+    uint64_t first[SHARD_BANKS], range, end;
+    entry_t *hw_ptrs[SHARD_BANKS];
+    uint32_t sizes[SHARD_BANKS];
+    entry_t entry[600];
+    uint32_t bank, position;
+    void *mgr = NULL, *tcam;
+    tcam_stats_t stats;
+    int i, num = 0;
+
+    printf("Test case to check the shard manager over %d banks\n", SHARD_BANKS);
+    memset(hw_banks, 0, sizeof(hw_banks));
+    for (i = 0; i < SHARD_BANKS; i++) {
+        hw_ptrs[i] = hw_banks[i];
+        sizes[i] = SHARD_SIZE;
+    }
+    if (tcam_shard_init(hw_ptrs, sizes, SHARD_BANKS, 999, &mgr) != TCAM_ERR_SUCCESS) {
+        printf("tcam_shard_init failed\n");
+        return FALSE;
+    }
+    for (i = 0; i < 200; i++) {
+        entry[i].id = i + 1;
+        entry[i].prio = (i * 397) % 1000;
+    }
+    if ((tcam_shard_insert(mgr, entry, 200) != TCAM_ERR_SUCCESS) ||
+        !check_shards(mgr, hw_banks, num += 200)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    // each bank got its part of the batch, about a quarter
+    for (i = 0; i < SHARD_BANKS; i++) {
+        tcam_shard_get_bank(mgr, i, &tcam);
+        tcam_get_stats(tcam, &stats);
+        if ((stats.inserted_entries < 40) || (stats.inserted_entries > 60)) {
+            printf("Bank %d got %llu entries\n", i, (unsigned long long) stats.inserted_entries);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+    }
+    // bank 2 fails its part, the other banks delete theirs
+    for (i = 0; i < 200; i++) {
+        entry[i].id = 3000 + i;
+        entry[i].prio = (i * 397) % 1000;
+    }
+    tcam_shard_get_bank(mgr, 2, &tcam);
+    tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE);
+    tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, 1);
+    if ((tcam_shard_insert(mgr, entry, 200) != TCAM_ERR_HW_FAIL) ||
+        !check_shards(mgr, hw_banks, num)) {
+        printf("A failed batch is left in the banks\n");
+        printf("Test case failed\n");
+        return FALSE;
+    }
+
+    // 600 entries of priorities 0 - 59, bank 0 holds 0 - 249
+    for (i = 0; i < 600; i++) {
+        entry[i].id = 1000 + i;
+        entry[i].prio = (i * 7) % 60;
+    }
+    if ((tcam_shard_insert(mgr, entry, 300) != TCAM_ERR_SUCCESS) ||
+        (tcam_shard_insert(mgr, &entry[300], 300) != TCAM_ERR_SUCCESS) ||
+        !check_shards(mgr, hw_banks, num += 600)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    // too large, nothing is inserted
+    for (i = 0; i < 300; i++) {
+        entry[i].id = 5000 + i;
+        entry[i].prio = i;
+    }
+    if ((tcam_shard_insert(mgr, entry, 300) != TCAM_ERR_TCAM_FULL) ||
+        (tcam_shard_find(mgr, 5000, &bank, &position) == TCAM_ERR_SUCCESS) ||
+        !check_shards(mgr, hw_banks, num)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    // most of the empty slots left, a priority group can not be split
+    // between banks so the banks can not all be filled up exactly
+    for (i = 0; i < SHARD_BANKS * SHARD_SIZE - num - 24; i++) {
+        entry[i].id = 6000 + i;
+        entry[i].prio = (i * 13) % 1000;
+    }
+    if ((tcam_shard_insert(mgr, entry, i) != TCAM_ERR_SUCCESS) ||
+        !check_shards(mgr, hw_banks, num += i)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    for (i = 0; i < 600; i += 2) {
+        if ((tcam_shard_find(mgr, 1000 + i, &bank, &position) != TCAM_ERR_SUCCESS) ||
+            (hw_banks[bank][position].id != (uint32_t) 1000 + i) ||
+            (tcam_shard_remove(mgr, 1000 + i) != TCAM_ERR_SUCCESS) ||
+            (tcam_shard_find(mgr, 1000 + i, &bank, &position) == TCAM_ERR_SUCCESS)) {
+            printf("Entry %d not found or not deleted\n", 1000 + i);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        num--;
+    }
+    if (!check_shards(mgr, hw_banks, num)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_shard_destroy(mgr);
+
+    // bank 0 full with the priorities 100 - 109, a hw error while the group
+    // 109 leaves it for bank 1 puts the group back in bank 0
+    memset(hw_banks, 0, sizeof(hw_banks));
+    if (tcam_shard_init(hw_ptrs, sizes, SHARD_BANKS, 999, &mgr) != TCAM_ERR_SUCCESS) {
+        printf("tcam_shard_init failed\n");
+        return FALSE;
+    }
+    for (i = 0; i < SHARD_SIZE; i++) {
+        entry[i].id = i + 1;
+        entry[i].prio = 100 + i % 10;
+    }
+    entry[SHARD_SIZE].id = 1000;
+    entry[SHARD_SIZE].prio = 5;
+    tcam_shard_get_bank(mgr, 0, &tcam);
+    if ((tcam_shard_insert(mgr, entry, SHARD_SIZE) != TCAM_ERR_SUCCESS) ||
+        (tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE) != TCAM_ERR_SUCCESS) ||
+        (tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, 3) != TCAM_ERR_SUCCESS) ||
+        (tcam_shard_insert(mgr, &entry[SHARD_SIZE], 1) != TCAM_ERR_HW_FAIL) ||
+        !check_shards(mgr, hw_banks, SHARD_SIZE)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    for (i = 0; i < SHARD_SIZE; i++) {
+        if ((tcam_shard_find(mgr, i + 1, &bank, &position) != TCAM_ERR_SUCCESS) || (bank != 0)) {
+            printf("Entry %d left bank 0\n", i + 1);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+    }
+    if ((tcam_shard_insert(mgr, &entry[SHARD_SIZE], 1) != TCAM_ERR_SUCCESS) ||
+        !check_shards(mgr, hw_banks, SHARD_SIZE + 1)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_shard_destroy(mgr);
+
+    // bank 0 full with the priorities 100 - 107 and bank 3 with the group
+    // 800: the group 107 could go to bank 1, but the group 800 does not fit
+    // in any bank once the batch adds one entry to it
+    memset(hw_banks, 0, sizeof(hw_banks));
+    if (tcam_shard_init(hw_ptrs, sizes, SHARD_BANKS, 999, &mgr) != TCAM_ERR_SUCCESS) {
+        printf("tcam_shard_init failed\n");
+        return FALSE;
+    }
+    for (i = 0; i < 2 * SHARD_SIZE; i++) {
+        entry[i].id = i + 1;
+        entry[i].prio = (i < SHARD_SIZE) ? 100 + i % 8 : 800;
+    }
+    if (tcam_shard_insert(mgr, entry, 2 * SHARD_SIZE) != TCAM_ERR_SUCCESS) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    memcpy(hw_before, hw_banks, sizeof(hw_banks));
+    for (i = 0; i < SHARD_BANKS; i++)
+        tcam_shard_get_range(mgr, i, &first[i], &end);
+    entry[0].id = 2000;
+    entry[0].prio = 5;
+    entry[1].id = 2001;
+    entry[1].prio = 800;
+    if ((tcam_shard_insert(mgr, entry, 2) != TCAM_ERR_TCAM_FULL) ||
+        memcmp(hw_before, hw_banks, sizeof(hw_banks))) {
+        printf("A batch which does not fit moved the groups\n");
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    for (i = 0; i < SHARD_BANKS; i++) {
+        tcam_shard_get_range(mgr, i, &range, &end);
+        if (range != first[i]) {
+            printf("The range of bank %d moved\n", i);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+    }
+    tcam_shard_destroy(mgr);
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     Returns the first busy slot of hw_tcam whose entry matches the key, -1
+ *     if none, comparing the keys of the entries word by word.
+ */
+int lookup_ref(void *tcam, uint32_t size, uint32_t words, uint32_t *key)
+{
+    uint32_t rec[2 * TCAM_MAX_KEY_BITS / 32], i, w;
+
+    for (i = 0; i < size; i++) {
+        if ((hw_tcam[i].id == TCAM_CELL_STATE_EMPTY) ||
+            (tcam_get_key(tcam, hw_tcam[i].id, rec) != TCAM_ERR_SUCCESS))
+            continue;
+        for (w = 0; w < words; w++) {
+            if ((key[w] & rec[words + w]) != (rec[w] & rec[words + w]))
+                break;
+        }
+        if (w == words)
+            return i;
+    }
+    return -1;
+}
+
+/* Description :
+ *     This function tests tcam_lookup() with every key compare the cpu
+ *     supports, for keys of 160 and 640 bits. The entry returned must be the
+ *     matching one of the lowest slot, so of the highest priority, and the
+ *     slots left empty by the deletions must not match even though hw_tcam
+ *     keeps their keys. The keys are inserted through the programming queue
+ *     for the wide keys, follow the entries whose priority changes and their
+ *     records are reused once the entries are deleted. The bank size is not
+ *     a multiple of the entries compared at a time.
+ */
+int test_tcam_lookup()
+{
+    static entry_t entry[200];
+    static uint32_t keys[200 * 2 * TCAM_MAX_KEY_BITS / 32];
+    uint32_t key[TCAM_MAX_KEY_BITS / 32], rec[2 * TCAM_MAX_KEY_BITS / 32], bits[] = {160, 640};
+    uint32_t position, words, w, *k;
+    int i, b, round, impl, expected, impls;
+    uint64_t fence;
+    tcam_err_t ret_val;
+    entry_t ent;
+    void *tcam = NULL;
+
+    printf("Test case to check the lookup of a key in hw_tcam\n");
+    for (b = 0; b < 2; b++) {
+        words = bits[b] / 32;
+        memset(hw_tcam, 0, sizeof(hw_tcam));
+        if ((tcam_init(hw_tcam, 255, &tcam) != TCAM_ERR_SUCCESS) ||
+            (tcam_set_option(tcam, TCAM_OPT_KEY_BITS, 33) != TCAM_ERR_EINVAL) ||
+            (tcam_set_option(tcam, TCAM_OPT_KEY_BITS, TCAM_MAX_KEY_BITS + 32) != TCAM_ERR_EINVAL) ||
+            (tcam_set_option(tcam, TCAM_OPT_KEY_BITS, bits[b]) != TCAM_ERR_SUCCESS) ||
+            (tcam_set_option(tcam, TCAM_OPT_LOOKUP, TCAM_LOOKUP_AVX2 + 1) != TCAM_ERR_EINVAL)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        // the first word tells the rules apart, every tenth rule is a
+        // wildcard on it and the other words are compared on some bits only
+        srand(7);
+        for (i = 0; i < 200; i++) {
+            entry[i].id = i + 1;
+            entry[i].prio = (i * 7) % 50;
+            k = &keys[i * 2 * words];
+            k[0] = i % 20;
+            k[words] = (i % 10) ? 0xffffffff : 0;
+            for (w = 1; w < words; w++) {
+                k[w] = rand();
+                k[words + w] = (i % 3) ? 0 : 0x000f000f;
+            }
+        }
+        if (b == 1)
+            tcam_set_option(tcam, TCAM_OPT_ASYNC_DEPTH, 16);
+        if ((tcam_insert_keys(tcam, entry, keys, 200) != TCAM_ERR_SUCCESS) ||
+            (tcam_set_option(tcam, TCAM_OPT_KEY_BITS, 128) != TCAM_ERR_EINVAL)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        for (round = 0; round < 2; round++) {
+            if (round == 1) {
+                // the entries move with their keys
+                for (i = 2; i < 200; i += 31)
+                    tcam_modify_prio(tcam, entry[i].id, 49 - entry[i].prio);
+            }
+            tcam_fence(tcam, &fence);
+            tcam_fence_wait(tcam, fence);
+            impls = 0;
+            for (impl = TCAM_LOOKUP_SCALAR; impl <= TCAM_LOOKUP_AVX2; impl++) {
+                if (tcam_set_option(tcam, TCAM_OPT_LOOKUP, impl) != TCAM_ERR_SUCCESS)
+                    continue;
+                impls++;
+                for (i = 0; i < 1000; i++) {
+                    memcpy(key, &keys[(rand() % 200) * 2 * words], words * sizeof(uint32_t));
+                    if (i % 4 == 0)
+                        key[0] = 20 + rand() % 4;
+                    if (i % 5 == 0)
+                        key[1 + rand() % (words - 1)] ^= 1u << (rand() % 32);
+                    expected = lookup_ref(tcam, 255, words, key);
+                    ret_val = tcam_lookup(tcam, key, &ent, &position);
+                    if ((expected < 0) ? (ret_val != TCAM_ERR_NO_MATCH) :
+                        ((ret_val != TCAM_ERR_SUCCESS) || (position != (uint32_t) expected) ||
+                         (ent.id != hw_tcam[expected].id))) {
+                        printf("Lookup %d with the compare %d returned %d at %u, expected slot %d\n",
+                               i, impl, ret_val, position, expected);
+                        printf("Test case failed\n");
+                        return FALSE;
+                    }
+                }
+            }
+            // the wildcards are gone, their slots still have their keys
+            for (i = 0; i < 200; i += 10)
+                tcam_remove(tcam, entry[i].id);
+            tcam_fence(tcam, &fence);
+            tcam_fence_wait(tcam, fence);
+            memset(key, 0, sizeof(key));
+            key[0] = 20;
+            if (tcam_lookup(tcam, key, NULL, &position) != TCAM_ERR_NO_MATCH) {
+                printf("Test case failed\n");
+                return FALSE;
+            }
+            // and come back with their records reused
+            if (round == 0) {
+                for (i = 0; i < 200; i += 10) {
+                    entry[i].id += 1000;
+                    tcam_insert_keys(tcam, &entry[i], &keys[i * 2 * words], 1);
+                }
+            }
+        }
+        for (i = 0; i < 200; i++) {
+            if ((i % 10) && ((tcam_get_key(tcam, entry[i].id, rec) != TCAM_ERR_SUCCESS) ||
+                             memcmp(rec, &keys[i * 2 * words], 2 * words * sizeof(uint32_t)))) {
+                printf("The key of the entry %u is lost\n", entry[i].id);
+                printf("Test case failed\n");
+                return FALSE;
+            }
+        }
+        printf("%d key compares checked with %u bit keys\n", impls, bits[b]);
+        tcam_cache_destroy(tcam);
+    }
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     This function tests the flow cache of tcam_lookup(). A few keys are
+ *     looked up again and again while entries matching them are inserted,
+ *     deleted, moved by tcam_modify_prio() and tcam_rebalance(), so every
+ *     result must be the one of hw_tcam at the time of the lookup and never
+ *     a stale one. The cache is small enough for the results to be evicted.
+ *     The wide keys are programmed through the programming queue and set
+ *     after the cache is enabled.
+ */
+int test_tcam_flow_cache()
+{
+    static entry_t entry[150];
+    static uint32_t keys[150 * 2 * TCAM_MAX_KEY_BITS / 32];
+    uint32_t key[TCAM_MAX_KEY_BITS / 32], bits[] = {160, 640};
+    uint32_t position, words, w, *k, lookups, op;
+    int i, b, expected;
+    uint64_t fence;
+    tcam_err_t ret_val;
+    tcam_stats_t stats;
+    void *tcam = NULL;
+
+    printf("Test case to check the flow cache of the lookups\n");
+    for (b = 0; b < 2; b++) {
+        words = bits[b] / 32;
+        memset(hw_tcam, 0, sizeof(hw_tcam));
+        if ((tcam_init(hw_tcam, 255, &tcam) != TCAM_ERR_SUCCESS) ||
+            (tcam_set_option(tcam, TCAM_OPT_FLOW_CACHE, TCAM_MAX_FLOW_CACHE + 1) != TCAM_ERR_EINVAL) ||
+            (tcam_set_option(tcam, TCAM_OPT_FLOW_CACHE, 16) != TCAM_ERR_SUCCESS) ||
+            (tcam_set_option(tcam, TCAM_OPT_KEY_BITS, bits[b]) != TCAM_ERR_SUCCESS)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        if (b == 1)
+            tcam_set_option(tcam, TCAM_OPT_ASYNC_DEPTH, 16);
+        // the first word tells the keys apart, every tenth rule is a
+        // wildcard on it
+        srand(11);
+        for (i = 0; i < 150; i++) {
+            entry[i].id = i + 1;
+            entry[i].prio = rand() % 20;
+            k = &keys[i * 2 * words];
+            memset(k, 0, 2 * words * sizeof(uint32_t));
+            k[0] = i % 30;
+            k[words] = (i % 10) ? 0xffffffff : 0;
+            for (w = 1; w < words; w++)
+                k[w] = k[words + w] = (i % 3) ? 0 : 0x10 << (i % 5);
+        }
+        if (tcam_insert_keys(tcam, entry, keys, 100) != TCAM_ERR_SUCCESS) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        lookups = 0;
+        for (op = 0; op < 300; op++) {
+            i = rand() % 150;
+            switch (op % 5) {
+            case 0:
+                tcam_remove(tcam, entry[i].id);
+                break;
+            case 1:
+                tcam_insert_keys(tcam, &entry[i], &keys[i * 2 * words], 1);
+                break;
+            case 2:
+                tcam_modify_prio(tcam, entry[i].id, rand() % 20);
+                break;
+            case 3:
+                tcam_set_option(tcam, TCAM_OPT_REBALANCE_RATE, 1000000);
+                tcam_rebalance(tcam, NULL);
+                tcam_set_option(tcam, TCAM_OPT_REBALANCE_RATE, 0);
+                break;
+            default:
+                break;
+            }
+            tcam_fence(tcam, &fence);
+            tcam_fence_wait(tcam, fence);
+            for (i = 0; i < 40; i++, lookups++) {
+                // most lookups are for a few flows
+                memset(key, 0, sizeof(key));
+                key[0] = (i % 4) ? rand() % 4 : rand() % 40;
+                if (i % 3 == 0)
+                    key[words - 1] = 0x20;
+                expected = lookup_ref(tcam, 255, words, key);
+                ret_val = tcam_lookup(tcam, key, NULL, &position);
+                if ((expected < 0) ? (ret_val != TCAM_ERR_NO_MATCH) :
+                    ((ret_val != TCAM_ERR_SUCCESS) || (position != (uint32_t) expected))) {
+                    printf("Lookup of %u after the operation %u returned %d at %u, expected slot %d\n",
+                           key[0], op, ret_val, position, expected);
+                    printf("Test case failed\n");
+                    return FALSE;
+                }
+            }
+        }
+        tcam_get_stats(tcam, &stats);
+        if ((stats.flow_hits == 0) || (stats.flow_misses == 0) ||
+            (stats.flow_hits + stats.flow_misses != lookups)) {
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        printf("%llu hits and %llu misses with %u bit keys\n", (unsigned long long) stats.flow_hits,
+               (unsigned long long) stats.flow_misses, bits[b]);
+        tcam_cache_destroy(tcam);
+    }
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     This function tests the Tuple Space Search classifier, on its own and
+ *     kept by a bank. The classifier is built from the entries of the bank
+ *     and then follows the insertions, deletions, priority changes and
+ *     failed insertions of the bank. Every lookup in the classifier must
+ *     return the slot returned by the lookup in hw_tcam, the rules having a
+ *     few masks, overlapping values and shared priorities.
+ */
+int test_tcam_tss()
+{
+    static entry_t entry[40];
+    static uint32_t keys[40 * 2 * TCAM_KEY_BITS / 32];
+    uint32_t masks[][2] = {{0xffffffff, 0xffffffff}, {0xffffffff, 0}, {0xffff0000, 0xff},
+                           {0, 0xffffffff}, {0xff00ff00, 0xff00}};
+    uint32_t key[TCAM_KEY_BITS / 32], words = TCAM_KEY_BITS / 32, ids[4];
+    uint32_t position, tss_position, id = 1, op, i, n, w, *k;
+    tcam_tss_stats_t stats;
+    tcam_err_t ret_val, tss_ret;
+    entry_t ent = {0};
+    void *tss = NULL, *tcam = NULL;
+
+    printf("Test case to check the Tuple Space Search classifier\n");
+    ent.id = 5;
+    if ((tcam_tss_init(33, &tss) != TCAM_ERR_EINVAL) ||
+        (tcam_tss_init(TCAM_KEY_BITS, &tss) != TCAM_ERR_SUCCESS) ||
+        (tcam_tss_insert(tss, &ent, NULL) != TCAM_ERR_SUCCESS) ||
+        (tcam_tss_insert(tss, &ent, NULL) != TCAM_ERR_EINVAL) ||
+        (tcam_tss_remove(tss, 6) != TCAM_ERR_EINVAL) ||
+        (tcam_tss_lookup(tss, key, &ent) != TCAM_ERR_SUCCESS) || (ent.id != 5) ||
+        (tcam_tss_get_stats(tss, &stats) != TCAM_ERR_SUCCESS) ||
+        (stats.rules != 1) || (stats.tuples != 1) ||
+        (tcam_tss_remove(tss, 5) != TCAM_ERR_SUCCESS) ||
+        (tcam_tss_lookup(tss, key, &ent) != TCAM_ERR_NO_MATCH) ||
+        (tcam_tss_get_stats(tss, &stats) != TCAM_ERR_SUCCESS) || (stats.tuples != 0)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_tss_destroy(tss);
+
+    memset(hw_tcam, 0, sizeof(hw_tcam));
+    tcam_init(hw_tcam, 255, &tcam);
+    if (tcam_lookup_tss(tcam, key, NULL, &position) != TCAM_ERR_EINVAL) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    srand(5);
+    for (op = 0; op < 400; op++) {
+        // a batch of rules with keys on the first two words
+        n = 1 + rand() % 40;
+        for (i = 0; i < n; i++) {
+            entry[i].id = id++;
+            entry[i].prio = rand() % 16;
+            k = &keys[i * 2 * words];
+            memset(k, 0, 2 * words * sizeof(uint32_t));
+            for (w = 0; w < 2; w++) {
+                k[words + w] = masks[rand() % 5][w];
+                k[w] = (rand() % 4) * 0x01010101;
+            }
+        }
+        switch (op % 8) {
+        case 0:
+        case 1:
+            tcam_insert_keys(tcam, entry, keys, n);
+            break;
+        case 2:
+            tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, 1 + rand() % 4);
+            tcam_insert_keys(tcam, entry, keys, n);
+            tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, 0);
+            break;
+        case 3:
+            for (i = 0; i < 40; i++)
+                tcam_remove(tcam, hw_tcam[rand() % 255].id);
+            break;
+        case 4:
+            for (n = 0, i = 0; i < 4; i++) {
+                ids[n] = hw_tcam[rand() % 255].id;
+                if ((ids[n] != TCAM_CELL_STATE_EMPTY) && ((n == 0) || (ids[n] != ids[n - 1])))
+                    n++;
+            }
+            tcam_remove_batch(tcam, ids, n, NULL);
+            break;
+        case 5:
+            for (i = 0; i < 8; i++)
+                tcam_modify_prio(tcam, hw_tcam[rand() % 255].id, rand() % 16);
+            break;
+        case 6:
+            tcam_set_option(tcam, TCAM_OPT_REBALANCE_RATE, 1000000);
+            tcam_rebalance(tcam, NULL);
+            tcam_set_option(tcam, TCAM_OPT_REBALANCE_RATE, 0);
+            break;
+        default:
+            // built again from the entries of the bank
+            tcam_set_option(tcam, TCAM_OPT_TSS, 0);
+            if (tcam_set_option(tcam, TCAM_OPT_TSS, 1) != TCAM_ERR_SUCCESS) {
+                printf("Test case failed\n");
+                return FALSE;
+            }
+            break;
+        }
+        if (op < 7)
+            continue;
+        for (i = 0; i < 50; i++) {
+            memset(key, 0, sizeof(key));
+            key[0] = (rand() % 4) * 0x01010101;
+            key[1] = (rand() % 4) * 0x01010101;
+            ret_val = tcam_lookup(tcam, key, NULL, &position);
+            tss_ret = tcam_lookup_tss(tcam, key, &ent, &tss_position);
+            if ((tss_ret != ret_val) || ((ret_val == TCAM_ERR_SUCCESS) &&
+                                         ((tss_position != position) || (ent.id != hw_tcam[position].id)))) {
+                printf("Lookup after the operation %u: %d at %u, the classifier %d at %u\n",
+                       op, ret_val, position, tss_ret, tss_position);
+                printf("Test case failed\n");
+                return FALSE;
+            }
+        }
+    }
+    tcam_cache_destroy(tcam);
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     This function tests the spill tier of a small bank. The batches
+ *     inserted do not fit in the bank, the deletions promote the spilled
+ *     entries back and the priority changes move the entries between the
+ *     bank and the software table, some of them failing on hw_tcam. After
+ *     every operation, no spilled entry may rank above an entry of the bank,
+ *     the bank must be full while entries are spilled, and tcam_lookup()
+ *     must return the entry a bank large enough for all the entries would:
+ *     the matching one of the lowest priority, the last one inserted or
+ *     changed on a tie. A batch failing at each write of hw_tcam in turn
+ *     must then leave the bank and the software table as they were.
+ */
+#define SPILL_SLOTS 32
+#define SPILL_ENTRIES 400
+int test_tcam_spill()
+{
+    static entry_t entry[40], ref[SPILL_ENTRIES], before[SPILL_SLOTS];
+    static uint32_t keys[40 * 2 * TCAM_KEY_BITS / 32], ref_keys[SPILL_ENTRIES * 2 * TCAM_KEY_BITS / 32];
+    static uint32_t seq[SPILL_ENTRIES];
+    uint32_t masks[] = {0xffffffff, 0xffff0000, 0xff, 0};
+    uint32_t key[TCAM_KEY_BITS / 32], words = TCAM_KEY_BITS / 32, ids[4];
+    uint32_t position, id = 1, clock = 0, num = 0, busy, op, i, j, n, w, *k;
+    int32_t best, worst_hw, best_spill;
+    uint64_t spilled, failures;
+    bool failing;
+    tcam_stats_t stats;
+    tcam_err_t ret_val;
+    entry_t ent;
+    void *tcam = NULL;
+
+    printf("Test case to check the spill tier of a full bank\n");
+    memset(hw_tcam, 0, sizeof(hw_tcam));
+    tcam_init(hw_tcam, SPILL_SLOTS, &tcam);
+    if ((tcam_set_option(tcam, TCAM_OPT_SPILL, 2) != TCAM_ERR_EINVAL) ||
+        (tcam_set_option(tcam, TCAM_OPT_SPILL, 1) != TCAM_ERR_SUCCESS)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    srand(11);
+    for (op = 0; op < 600; op++) {
+        // a failed promotion leaves free slots until the next operation
+        failing = ((op % 18 == 1) || (op % 12 == 4));
+        switch (op % 6) {
+        case 0:
+        case 1:
+            // a batch of rules with a key on the first word
+            n = 1 + rand() % ((op % 12 == 0) ? 40 : 8);
+            if (num + n > SPILL_ENTRIES)
+                break;
+            for (i = 0; i < n; i++) {
+                entry[i].id = id++;
+                entry[i].prio = rand() % 12;
+                k = &keys[i * 2 * words];
+                memset(k, 0, 2 * words * sizeof(uint32_t));
+                k[words] = masks[rand() % 4];
+                k[0] = (rand() % 4) * 0x01010101;
+            }
+            if (failing)
+                tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, 1 + rand() % 4);
+            ret_val = tcam_insert_keys(tcam, entry, keys, n);
+            tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, 0);
+            if (ret_val != TCAM_ERR_SUCCESS)
+                break;
+            for (i = 0; i < n; i++) {
+                ref[num] = entry[i];
+                seq[num] = ++clock;
+                memcpy(&ref_keys[num * 2 * words], &keys[i * 2 * words], 2 * words * sizeof(uint32_t));
+                num++;
+            }
+            break;
+        case 2:
+            for (j = 0; (j < 3) && (num > 0); j++) {
+                i = rand() % num;
+                if (tcam_remove(tcam, ref[i].id) != TCAM_ERR_SUCCESS) {
+                    printf("Couldn't remove the entry %u\n", ref[i].id);
+                    printf("Test case failed\n");
+                    return FALSE;
+                }
+                num--;
+                ref[i] = ref[num];
+                seq[i] = seq[num];
+                memcpy(&ref_keys[i * 2 * words], &ref_keys[num * 2 * words], 2 * words * sizeof(uint32_t));
+            }
+            break;
+        case 3:
+            if (num < 4)
+                break;
+            // ids of the bank and of the software table
+            for (n = 0; n < 4; n++)
+                ids[n] = ref[num - 1 - n].id;
+            if (tcam_remove_batch(tcam, ids, 4, NULL) != TCAM_ERR_SUCCESS) {
+                printf("Couldn't remove a batch\n");
+                printf("Test case failed\n");
+                return FALSE;
+            }
+            num -= 4;
+            break;
+        default:
+            for (j = 0; (j < 4) && (num > 0); j++) {
+                i = rand() % num;
+                n = rand() % 12;
+                if (failing)
+                    tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, 1 + rand() % 4);
+                ret_val = tcam_modify_prio(tcam, ref[i].id, n);
+                tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, 0);
+                if ((ret_val == TCAM_ERR_SUCCESS) && (ref[i].prio != n)) {
+                    ref[i].prio = n;
+                    seq[i] = ++clock;
+                }
+            }
+            break;
+        }
+
+        // the entries of the bank, the others are spilled
+        tcam_get_stats(tcam, &stats);
+        worst_hw = best_spill = -1;
+        for (i = 0, busy = 0; i < num; i++) {
+            if (tcam_find(tcam, ref[i].id, &position) == TCAM_ERR_SUCCESS) {
+                busy++;
+                if ((worst_hw < 0) || (ref[i].prio > ref[worst_hw].prio) ||
+                    ((ref[i].prio == ref[worst_hw].prio) && (seq[i] < seq[worst_hw])))
+                    worst_hw = i;
+            } else if ((best_spill < 0) || (ref[i].prio < ref[best_spill].prio) ||
+                       ((ref[i].prio == ref[best_spill].prio) && (seq[i] > seq[best_spill]))) {
+                best_spill = i;
+            }
+        }
+        if ((busy + stats.spill_entries != num) || ((stats.spill_entries > 0) && (busy != SPILL_SLOTS) && !failing) ||
+            ((worst_hw >= 0) && (best_spill >= 0) &&
+             ((ref[best_spill].prio < ref[worst_hw].prio) ||
+              ((ref[best_spill].prio == ref[worst_hw].prio) && (seq[best_spill] > seq[worst_hw]))))) {
+            printf("After the operation %u: %u entries, %u in the bank, %llu spilled\n",
+                   op, num, busy, (unsigned long long) stats.spill_entries);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+        for (j = 0; j < 16; j++) {
+            memset(key, 0, sizeof(key));
+            key[0] = (rand() % 4) * 0x01010101;
+            best = -1;
+            for (i = 0; i < num; i++) {
+                k = &ref_keys[i * 2 * words];
+                for (w = 0; w < words; w++) {
+                    if ((key[w] & k[words + w]) != (k[w] & k[words + w]))
+                        break;
+                }
+                if ((w == words) && ((best < 0) || (ref[i].prio < ref[best].prio) ||
+                                     ((ref[i].prio == ref[best].prio) && (seq[i] > seq[best]))))
+                    best = i;
+            }
+            ret_val = tcam_lookup(tcam, key, &ent, &position);
+            if ((best < 0) ? (ret_val != TCAM_ERR_NO_MATCH) :
+                ((ret_val != TCAM_ERR_SUCCESS) || (ent.id != ref[best].id) ||
+                 ((position == SPILL_SLOTS) != (tcam_find(tcam, ent.id, &position) != TCAM_ERR_SUCCESS)))) {
+                printf("Lookup after the operation %u: %d id %u, expected %u\n",
+                       op, ret_val, ent.id, (best < 0) ? 0 : ref[best].id);
+                printf("Test case failed\n");
+                return FALSE;
+            }
+        }
+    }
+
+    tcam_get_stats(tcam, &stats);
+    printf("%llu spills, %llu promotions\n", (unsigned long long) stats.spills,
+           (unsigned long long) stats.promotions);
+    if ((stats.spills == 0) || (stats.promotions == 0) ||
+        ((stats.spill_entries > 0) && (tcam_set_option(tcam, TCAM_OPT_SPILL, 0) != TCAM_ERR_EINVAL))) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    // a batch failing in hw_tcam puts the entries it spilled back in their
+    // slots, and leaves the software table as it was
+    for (i = 0; i < 8; i++) {
+        entry[i].id = id++;
+        entry[i].prio = 0;
+        memset(&keys[i * 2 * words], 0, 2 * words * sizeof(uint32_t));
+    }
+    memcpy(before, hw_tcam, sizeof(before));
+    spilled = stats.spill_entries;
+    failures = stats.promote_failures;
+    for (n = 1; n <= 4 * SPILL_SLOTS; n++) {
+        tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, n);
+        ret_val = tcam_insert_keys(tcam, entry, keys, 8);
+        tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, 0);
+        if (ret_val == TCAM_ERR_SUCCESS)
+            break;
+        tcam_get_stats(tcam, &stats);
+        for (i = 0; i < SPILL_SLOTS; i++) {
+            if ((hw_tcam[i].id != before[i].id) || (hw_tcam[i].prio != before[i].prio))
+                break;
+        }
+        if ((i < SPILL_SLOTS) || (stats.spill_entries != spilled) || (stats.promote_failures != failures) ||
+            (tcam_find(tcam, entry[0].id, &position) == TCAM_ERR_SUCCESS)) {
+            printf("The batch failing at the write %u changed the bank\n", n);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+    }
+    if ((n < 9) || (ret_val != TCAM_ERR_SUCCESS)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    for (i = 0; i < 8; i++)
+        tcam_remove(tcam, entry[i].id);
+
+    // the software table empties as the entries are deleted
+    while (num > 0)
+        tcam_remove(tcam, ref[--num].id);
+    tcam_get_stats(tcam, &stats);
+    if ((stats.spill_entries != 0) || (tcam_set_option(tcam, TCAM_OPT_SPILL, 0) != TCAM_ERR_SUCCESS)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_cache_destroy(tcam);
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description :
+ *     This function tests the statistics of the calls and the log level. A
+ *     bank with TCAM_LOG_NONE must not write anything on stdout, while
+ *     TCAM_LOG_DEBUG traces the insertions. The inserts, removes and their
+ *     failures by error code are counted, the writes to hw_tcam are split by
+ *     shift policy, also with the group boundary shifting, and the bytes
+ *     moved follow the entries shifted.
+ */
+int test_tcam_stats()
+{
+    entry_t entry[64];
+    uint32_t ids[4], i;
+    uint64_t inserts = 0, writes = 0;
+    long quiet, traced;
+    tcam_stats_t stats;
+    tcam_latency_t lat;
+    void *tcam = NULL;
+    FILE *out;
+    int saved;
+
+    printf("Test case to check the statistics and the log level\n");
+    memset(hw_tcam, 0, sizeof(hw_tcam));
+    tcam_init(hw_tcam, 64, &tcam);
+    if ((tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_DEBUG + 1) != TCAM_ERR_EINVAL) ||
+        (tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE) != TCAM_ERR_SUCCESS)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_set_option(tcam, TCAM_OPT_BATCH_MERGE_MIN, 0);
+
+    // stdout goes to a file while the bank is quiet, then traced
+    fflush(stdout);
+    saved = dup(1);
+    out = tmpfile();
+    dup2(fileno(out), 1);
+    for (i = 0; i < 40; i++) {
+        // in descending order, every entry shifts the previous ones down
+        entry[0].id = i + 1;
+        entry[0].prio = 100 - i;
+        tcam_insert(tcam, entry, 1);
+    }
+    tcam_remove(tcam, 1000);
+    tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, 1);
+    entry[0].id = 41;
+    entry[0].prio = 0;
+    tcam_insert(tcam, entry, 1);
+    tcam_set_option(tcam, TCAM_OPT_HW_FAIL_AT, 0);
+    fflush(stdout);
+    quiet = lseek(1, 0, SEEK_END);
+    tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_DEBUG);
+    tcam_insert(tcam, entry, 1);
+    fflush(stdout);
+    traced = lseek(1, 0, SEEK_END);
+    dup2(saved, 1);
+    close(saved);
+    fclose(out);
+    if ((quiet != 0) || (traced <= 0)) {
+        printf("%ld bytes written quiet, %ld traced\n", quiet, traced);
+        printf("Test case failed\n");
+        return FALSE;
+    }
+
+    for (i = 0; i < 30; i++) {
+        entry[i].id = 100 + i;
+        entry[i].prio = i;
+    }
+    if (tcam_insert(tcam, entry, 30) != TCAM_ERR_TCAM_FULL) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_remove(tcam, 41);
+    for (i = 0; i < 4; i++)
+        ids[i] = 2 * i + 1;
+    tcam_remove_batch(tcam, ids, 4, NULL);
+    tcam_modify_prio(tcam, 1000, 1);
+
+    tcam_get_stats(tcam, &stats);
+    for (i = 0; i < TCAM_ENTRY_SHIFT_POLICIES; i++) {
+        inserts += stats.policy_inserts[i];
+        writes += stats.policy_hw_writes[i];
+    }
+    printf("%llu inserts, %llu removes, %llu slots scanned, %llu bytes moved, longest shift %llu\n",
+           (unsigned long long) stats.insert_calls, (unsigned long long) stats.remove_calls,
+           (unsigned long long) stats.slots_scanned, (unsigned long long) stats.moved_bytes,
+           (unsigned long long) stats.max_shift);
+    if ((stats.insert_calls != 41) || (stats.inserted_entries != 41) ||
+        (stats.remove_calls != 2) || (stats.removed_entries != 5) ||
+        (stats.failures[TCAM_ERR_EINVAL] != 2) || (stats.failures[TCAM_ERR_HW_FAIL] != 1) ||
+        (stats.failures[TCAM_ERR_TCAM_FULL] != 1) || (stats.failures[TCAM_ERR_SUCCESS] != 0) ||
+        (inserts != stats.insert_calls) || (writes != stats.insert_hw_writes) ||
+        (stats.policy_inserts[TCAM_ENTRY_SHIFT_DOWN] != 40) ||
+        (stats.moved_bytes != stats.shifted_entries * sizeof(entry_t)) ||
+        (stats.max_shift != 40) || (stats.slots_scanned == 0)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_cache_destroy(tcam);
+
+    // The group boundary shifting counts the same shift policies
+    tcam = NULL;
+    memset(hw_tcam, 0, sizeof(hw_tcam));
+    tcam_init(hw_tcam, 64, &tcam);
+    tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE);
+    tcam_set_option(tcam, TCAM_OPT_SHIFT_MODE, TCAM_SHIFT_MODE_GROUP_BOUNDARY);
+    tcam_set_option(tcam, TCAM_OPT_LATENCY, 1);
+    for (i = 0; i < 40; i++) {
+        entry[0].id = i + 1;
+        entry[0].prio = 100 - i;
+        tcam_insert(tcam, entry, 1);
+    }
+    tcam_get_stats(tcam, &stats);
+    tcam_get_latency(tcam, TCAM_LAT_INSERT_DOWN, &lat);
+    inserts = writes = 0;
+    for (i = 0; i < TCAM_ENTRY_SHIFT_POLICIES; i++) {
+        inserts += stats.policy_inserts[i];
+        writes += stats.policy_hw_writes[i];
+    }
+    // only the first entry did not shift
+    if ((stats.policy_inserts[TCAM_ENTRY_SHIFT_DOWN] != 39) || (inserts != 40) ||
+        (writes != stats.insert_hw_writes) || (lat.count != 39)) {
+        printf("%llu inserts shifted down in group boundary mode\n",
+               (unsigned long long) stats.policy_inserts[TCAM_ENTRY_SHIFT_DOWN]);
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_cache_destroy(tcam);
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description : Test case to check the latency histograms: every call of the
+ * API is timed once, a successful insertion by its shift policy as well, and
+ * the percentiles are ordered.
+ */
+int test_tcam_latency()
+{
+    entry_t entry[64];
+    uint32_t ids[4], i;
+    uint64_t policies = 0;
+    tcam_latency_t lat, insert, remove, modify, program;
+    void *tcam = NULL;
+
+    printf("Test case to check the latency histograms\n");
+    memset(hw_tcam, 0, sizeof(hw_tcam));
+    tcam_init(hw_tcam, 64, &tcam);
+    tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE);
+    if ((tcam_get_latency(tcam, TCAM_LAT_INSERT, &lat) != TCAM_ERR_EINVAL) ||
+        (tcam_reset_latency(tcam) != TCAM_ERR_EINVAL) ||
+        (tcam_set_option(tcam, TCAM_OPT_LATENCY, 2) != TCAM_ERR_EINVAL) ||
+        (tcam_set_option(tcam, TCAM_OPT_LATENCY, 1) != TCAM_ERR_SUCCESS) ||
+        (tcam_get_latency(tcam, TCAM_LAT_OPS, &lat) != TCAM_ERR_EINVAL) ||
+        (tcam_get_latency(tcam, TCAM_LAT_INSERT, NULL) != TCAM_ERR_EINVAL)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+
+    for (i = 0; i < 40; i++) {
+        // in descending order, every entry shifts the previous ones down
+        entry[0].id = i + 1;
+        entry[0].prio = 100 - i;
+        tcam_insert(tcam, entry, 1);
+    }
+    for (i = 0; i < 10; i++) {
+        entry[i].id = 50 + i;
+        entry[i].prio = 200 + i;
+    }
+    tcam_insert(tcam, entry, 10);
+    for (i = 0; i < 30; i++) {
+        entry[i].id = 100 + i;
+        entry[i].prio = i;
+    }
+    tcam_insert(tcam, entry, 30);
+    tcam_remove(tcam, 1000);
+    tcam_remove(tcam, 1);
+    for (i = 0; i < 4; i++)
+        ids[i] = 2 * i + 2;
+    tcam_remove_batch(tcam, ids, 4, NULL);
+    tcam_modify_prio(tcam, 20, 1);
+    tcam_modify_prio(tcam, 21, 300);
+
+    tcam_get_latency(tcam, TCAM_LAT_INSERT, &insert);
+    tcam_get_latency(tcam, TCAM_LAT_REMOVE, &remove);
+    tcam_get_latency(tcam, TCAM_LAT_MODIFY, &modify);
+    tcam_get_latency(tcam, TCAM_LAT_PROGRAM, &program);
+    for (i = TCAM_LAT_INSERT_NO_SHIFT; i <= TCAM_LAT_INSERT_UP_DOWN; i++) {
+        tcam_get_latency(tcam, i, &lat);
+        policies += lat.count;
+    }
+    printf("insert: %llu calls, p50 %llu ns, p99 %llu ns, max %llu ns\n",
+           (unsigned long long) insert.count, (unsigned long long) insert.p50,
+           (unsigned long long) insert.p99, (unsigned long long) insert.max);
+    printf("program: %llu writes, p50 %llu ns, p99 %llu ns, max %llu ns\n",
+           (unsigned long long) program.count, (unsigned long long) program.p50,
+           (unsigned long long) program.p99, (unsigned long long) program.max);
+    if ((insert.count != 42) || (remove.count != 3) || (modify.count != 2) ||
+        (policies != 41) || (program.count == 0) ||
+        (insert.min > insert.p50) || (insert.p50 > insert.p99) ||
+        (insert.p99 > insert.p999) || (insert.p999 > insert.max) ||
+        (insert.mean < insert.min) || (insert.mean > insert.max) ||
+        (program.min > program.p50) || (program.p50 > program.p999) ||
+        (program.p999 > program.max)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+
+    tcam_reset_latency(tcam);
+    tcam_get_latency(tcam, TCAM_LAT_INSERT, &lat);
+    if ((lat.count != 0) || (lat.max != 0) ||
+        (tcam_set_option(tcam, TCAM_OPT_LATENCY, 0) != TCAM_ERR_SUCCESS) ||
+        (tcam_get_latency(tcam, TCAM_LAT_INSERT, &lat) != TCAM_ERR_EINVAL)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_cache_destroy(tcam);
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Description : Test case to check the traces of the calls: the records
+ * read back are the calls made, with the entries of the bank when the
+ * recording started first, and replaying them in an empty bank gives the
+ * same layout. A truncated trace is reported.
+ */
+int test_tcam_trace()
+{
+    static entry_t replay_hw[64];
+    uint32_t words = TCAM_KEY_BITS / 32, keys[4 * TCAM_KEY_BITS / 32], ids[3], i;
+    static const uint16_t ops[] = {TCAM_TRACE_INIT, TCAM_TRACE_INSERT, TCAM_TRACE_INSERT,
+                                   TCAM_TRACE_REMOVE, TCAM_TRACE_REMOVE_BATCH, TCAM_TRACE_MODIFY,
+                                   TCAM_TRACE_REMOVE};
+    entry_t entry[16], buf[64], replay_buf[64];
+    const tcam_trace_rec_t *rec;
+    const uint32_t *payload;
+    char path[] = "/tmp/tcam_trace_XXXXXX";
+    void *tcam = NULL, *replay = NULL, *reader;
+    uint64_t last_ns = 0;
+    tcam_err_t ret_val;
+    int fd, n = 0, ok = TRUE;
+    FILE *out;
+
+    printf("Test case to check the record and replay of the calls\n");
+    memset(hw_tcam, 0, sizeof(hw_tcam));
+    tcam_init(hw_tcam, 64, &tcam);
+    tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE);
+    for (i = 0; i < 8; i++) {
+        entry[i].id = i + 1;
+        entry[i].prio = i / 2;
+    }
+    tcam_insert(tcam, entry, 8);
+    if (((fd = mkstemp(path)) < 0) || ((out = fdopen(fd, "wb")) == NULL) ||
+        (tcam_set_trace(tcam, out) != TCAM_ERR_SUCCESS) ||
+        (tcam_set_trace(tcam, out) != TCAM_ERR_EINVAL)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    // two entries with a key, joining the groups of the first ones
+    memset(keys, 0, sizeof(keys));
+    keys[0] = 0x0a000000;
+    keys[words] = 0xff000000;
+    keys[2 * words] = 0x0b000000;
+    keys[3 * words] = 0xff000000;
+    entry[0].id = 20;
+    entry[0].prio = 1;
+    entry[1].id = 21;
+    entry[1].prio = 3;
+    tcam_insert_keys(tcam, entry, keys, 2);
+    tcam_remove(tcam, 2);
+    ids[0] = 5;
+    ids[1] = 21;
+    ids[2] = 7;
+    tcam_remove_batch(tcam, ids, 3, NULL);
+    tcam_modify_prio(tcam, 3, 0);
+    tcam_remove(tcam, 1000);
+    if ((tcam_set_trace(tcam, NULL) != TCAM_ERR_SUCCESS) || (fclose(out) != 0)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+
+    tcam_init(replay_hw, 64, &replay);
+    tcam_set_option(replay, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE);
+    if (tcam_trace_open(path, &reader) != TCAM_ERR_SUCCESS) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    while (ok && ((ret_val = tcam_trace_next(reader, &rec)) == TCAM_ERR_SUCCESS)) {
+        payload = (const uint32_t *) (rec + 1);
+        ok = (n < 7) && (rec->op == ops[n]) && (rec->ns >= last_ns) && (rec->size % TCAM_TRACE_ALIGN == 0);
+        last_ns = rec->ns;
+        if (!ok)
+            break;
+        switch (rec->op) {
+        case TCAM_TRACE_INIT:
+            ok = (rec->arg == 64) && (rec->arg2 == TCAM_KEY_BITS) && (rec->num == TCAM_TRACE_INIT_SNAPSHOT);
+            break;
+        case TCAM_TRACE_INSERT:
+            for (i = 0; i < rec->num; i++) {
+                entry[i].id = payload[2 * i];
+                entry[i].prio = payload[2 * i + 1];
+            }
+            // the second insert is the one of the keys
+            ok = (rec->arg == 1) && (rec->num == ((n == 1) ? 8 : 2)) &&
+                 ((n == 1) || ((entry[0].id == 20) && (payload[4 + words] == 0xff000000))) &&
+                 (tcam_insert_keys(replay, entry, &payload[2 * rec->num], rec->num) == rec->ret);
+            break;
+        case TCAM_TRACE_REMOVE:
+            ok = (tcam_remove(replay, payload[0]) == rec->ret) &&
+                 (rec->ret == ((n == 3) ? TCAM_ERR_SUCCESS : TCAM_ERR_EINVAL));
+            break;
+        case TCAM_TRACE_REMOVE_BATCH:
+            memcpy(ids, payload, sizeof(ids));
+            ok = (rec->num == 3) && (tcam_remove_batch(replay, ids, 3, NULL) == rec->ret);
+            break;
+        case TCAM_TRACE_MODIFY:
+            ok = (rec->arg == 3) && (rec->arg2 == 0) &&
+                 (tcam_modify_prio(replay, rec->arg, rec->arg2) == rec->ret);
+            break;
+        }
+        n++;
+    }
+    tcam_trace_close(reader);
+    tcam_snapshot(tcam, 0, 64, buf, NULL);
+    tcam_snapshot(replay, 0, 64, replay_buf, NULL);
+    for (i = 0; ok && (i < 64); i++)
+        ok = (buf[i].id == replay_buf[i].id) && (buf[i].prio == replay_buf[i].prio);
+    if (!ok || (n != 7) || (ret_val != TCAM_ERR_NO_MATCH)) {
+        printf("Record %d does not match the calls\n", n);
+        printf("Test case failed\n");
+        unlink(path);
+        return FALSE;
+    }
+    tcam_cache_destroy(replay);
+    tcam_cache_destroy(tcam);
+
+    // the last record loses its end
+    if (truncate(path, sizeof(tcam_trace_hdr_t) + 8) || (tcam_trace_open(path, &reader) != TCAM_ERR_SUCCESS) ||
+        (tcam_trace_next(reader, &rec) != TCAM_ERR_EINVAL)) {
+        printf("Test case failed\n");
+        unlink(path);
+        return FALSE;
+    }
+    tcam_trace_close(reader);
+
+    // the spilled entries are in the snapshot, and the replay spills them
+    memset(hw_tcam, 0, sizeof(hw_tcam));
+    memset(replay_hw, 0, sizeof(replay_hw));
+    tcam_init(hw_tcam, 8, &tcam);
+    tcam_init(replay_hw, 8, &replay);
+    tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE);
+    tcam_set_option(replay, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE);
+    tcam_set_option(tcam, TCAM_OPT_SPILL, 1);
+    for (i = 0; i < 12; i++) {
+        entry[i].id = i + 1;
+        entry[i].prio = (i * 5) % 7;
+    }
+    tcam_insert(tcam, entry, 12);
+    if (((out = fopen(path, "wb")) == NULL) || (tcam_set_trace(tcam, out) != TCAM_ERR_SUCCESS) ||
+        (tcam_set_trace(tcam, NULL) != TCAM_ERR_SUCCESS) || (fclose(out) != 0) ||
+        (tcam_trace_open(path, &reader) != TCAM_ERR_SUCCESS) ||
+        (tcam_trace_next(reader, &rec) != TCAM_ERR_SUCCESS) || (rec->op != TCAM_TRACE_INIT) ||
+        (rec->num != (TCAM_TRACE_INIT_SNAPSHOT | TCAM_TRACE_INIT_SPILL)) ||
+        (tcam_set_option(replay, TCAM_OPT_SPILL, 1) != TCAM_ERR_SUCCESS) ||
+        (tcam_trace_next(reader, &rec) != TCAM_ERR_SUCCESS) || (rec->op != TCAM_TRACE_INSERT) ||
+        (rec->num != 12)) {
+        printf("Test case failed\n");
+        unlink(path);
+        return FALSE;
+    }
+    payload = (const uint32_t *) (rec + 1);
+    for (i = 0; i < rec->num; i++) {
+        entry[i].id = payload[2 * i];
+        entry[i].prio = payload[2 * i + 1];
+    }
+    ok = (tcam_insert_keys(replay, entry, &payload[2 * rec->num], rec->num) == TCAM_ERR_SUCCESS);
+    tcam_trace_close(reader);
+    unlink(path);
+    tcam_snapshot(tcam, 0, 8, buf, NULL);
+    tcam_snapshot(replay, 0, 8, replay_buf, NULL);
+    for (i = 0; ok && (i < 8); i++)
+        ok = (buf[i].id == replay_buf[i].id) && (buf[i].prio == replay_buf[i].prio);
+    // the same entries are spilled, in the same order
+    for (i = 0; ok && (i < 4); i++) {
+        tcam_remove(tcam, buf[i].id);
+        tcam_remove(replay, buf[i].id);
+        tcam_snapshot(tcam, 0, 8, buf + 8, NULL);
+        tcam_snapshot(replay, 0, 8, replay_buf + 8, NULL);
+        ok = (buf[15].id == replay_buf[15].id) && (buf[15].id != TCAM_CELL_STATE_EMPTY);
+    }
+    tcam_cache_destroy(replay);
+    tcam_cache_destroy(tcam);
+    if (!ok) {
+        printf("The replay does not spill the same entries\n");
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    printf("Test case passed\n");
+    return TRUE;
+}
+
+/* Entries of hw_tcam which have to stay found while a call writes it, see
+ * hitless_watch()
+ */
+typedef struct hitless_check_ {
+    entry_t live[64];
+    uint32_t num;
+    uint32_t size;
+    bool ok;
+} hitless_check_t;
+
+/* Description :
+ *     Keeps in 'check' the entries of the 'size' first slots of hw_tcam
+ *     except the ones of the id 'skip', which the next call changes.
+ */
+void hitless_live(hitless_check_t *check, uint32_t size, uint32_t skip)
+{
+    uint32_t i;
+
+    check->num = 0;
+    check->size = size;
+    for (i = 0; i < size; i++) {
+        if ((hw_tcam[i].id != TCAM_CELL_STATE_EMPTY) && (hw_tcam[i].id != skip))
+            check->live[check->num++] = hw_tcam[i];
+    }
+}
+
+/* Description :
+ *     Called after each write to hw_tcam: the first copy of every live
+ *     entry, told apart by its priority and key, must still be in hw_tcam
+ *     and after none of a lower priority.
+ */
+void hitless_watch(void *arg, uint32_t position)
+{
+    hitless_check_t *check = arg;
+    uint32_t first[64], i, j;
+
+    for (i = 0; i < check->num; i++) {
+        for (first[i] = 0; first[i] < check->size; first[i]++) {
+            if ((hw_tcam[first[i]].id == check->live[i].id) &&
+                (hw_tcam[first[i]].prio == check->live[i].prio) &&
+                (hw_tcam[first[i]].key_ref == check->live[i].key_ref))
+                break;
+        }
+        if (first[i] == check->size) {
+            if (check->ok)
+                printf("Entry %u is lost by the write of slot %u\n", check->live[i].id, position);
+            check->ok = FALSE;
+            return;
+        }
+    }
+    for (i = 0; i < check->num; i++) {
+        for (j = 0; j < check->num; j++) {
+            if ((check->live[i].prio < check->live[j].prio) && (first[i] > first[j])) {
+                if (check->ok)
+                    printf("Entry %u is shadowed by the write of slot %u\n", check->live[i].id, position);
+                check->ok = FALSE;
+                return;
+            }
+        }
+    }
+}
+
+/* Description :
+ *     This function tests that the programming of hw_tcam is hitless: after
+ *     each write of a call, every entry the call does not change is still
+ *     found at its rank. Entries with keys and duplicate ids are inserted,
+ *     removed, moved to another priority and rebalanced in a bank of 48
+ *     slots with both shifting modes, which shifts them up, down and both
+ *     ways. A bank with a single empty slot, where two copies of an id have
+ *     to swap slots, has no slot to keep one of them: the call must fail and
+ *     leave hw_tcam as it was.
+ */
+int test_tcam_hitless_writes()
+{
+    static hitless_check_t check;
+    uint32_t words = TCAM_KEY_BITS / 32, keys[96 * 2 * TCAM_KEY_BITS / 32];
+    uint32_t mode, op, num;
+    uint32_t ids[] = {1, 2, 1, 2, 3, 3, 1, 1, 1, 2, 1, 2, 1, 99, 3, 6};
+    entry_t entry[96], before[16];
+    tcam_stats_t stats;
+    void *tcam = NULL;
+    int i;
+
+    printf("Test case to check that the writes to hw_tcam are hitless\n");
+    for (i = 0; i < 96; i++) {
+        entry[i].id = i % 24 + 1;
+        entry[i].prio = (i * 7) % 6;
+        memset(&keys[i * 2 * words], 0, 2 * words * sizeof(uint32_t));
+        keys[i * 2 * words] = i;
+        keys[i * 2 * words + words] = 0xffffffff;
+    }
+    for (mode = TCAM_SHIFT_MODE_ENTRIES; mode <= TCAM_SHIFT_MODE_GROUP_BOUNDARY; mode++) {
+        memset(hw_tcam, 0, sizeof(hw_tcam));
+        if (tcam_init(hw_tcam, 48, &tcam) != TCAM_ERR_SUCCESS) {
+            printf("tcam_init error\n");
+            exit(1);
+        }
+        tcam_set_option(tcam, TCAM_OPT_SHIFT_MODE, mode);
+        tcam_set_option(tcam, TCAM_OPT_REBALANCE_RATE, 100000);
+        tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE);
+        tcam_set_watch(tcam, hitless_watch, &check);
+        check.ok = TRUE;
+        srand(13);
+        for (op = 0; check.ok && (op < 400); op++) {
+            i = rand() % 96;
+            switch (rand() % 8) {
+            case 0:
+                hitless_live(&check, 48, entry[i].id);
+                tcam_remove(tcam, entry[i].id);
+                break;
+            case 1:
+                hitless_live(&check, 48, entry[i].id);
+                tcam_modify_prio(tcam, entry[i].id, rand() % 6);
+                break;
+            case 2:
+                hitless_live(&check, 48, TCAM_CELL_STATE_EMPTY);
+                tcam_rebalance(tcam, NULL);
+                break;
+            default:
+                hitless_live(&check, 48, TCAM_CELL_STATE_EMPTY);
+                num = ((i + 4) <= 96) ? rand() % 4 + 1 : 1;
+                tcam_insert_keys(tcam, &entry[i], &keys[i * 2 * words], num);
+                break;
+            }
+        }
+        tcam_get_stats(tcam, &stats);
+        tcam_cache_destroy(tcam);
+        if (!check.ok || (stats.shifts_up == 0) || (stats.shifts_down == 0) ||
+            ((mode == TCAM_SHIFT_MODE_ENTRIES) &&
+             (stats.policy_inserts[TCAM_ENTRY_SHIFT_UP_DOWN] == 0))) {
+            printf("Shifting mode %u : %llu up, %llu down\n", mode,
+                   (unsigned long long) stats.shifts_up, (unsigned long long) stats.shifts_down);
+            printf("Test case failed\n");
+            return FALSE;
+        }
+    }
+    // 6/0 3/0 _ 1/0 2/0 1/0 2/0 1/0 1/0 1/0 3/1 3/1 2/1 1/1 2/1 1/1 : the
+    // copy of 2 at slot 4 goes to the priority 1, the other copies of 1 and
+    // 2 of the priority 0 swap slots to stay after the ones before them
+    memset(hw_tcam, 0, sizeof(hw_tcam));
+    if (tcam_init(hw_tcam, 16, &tcam) != TCAM_ERR_SUCCESS) {
+        printf("tcam_init error\n");
+        exit(1);
+    }
+    tcam_set_option(tcam, TCAM_OPT_LOG_LEVEL, TCAM_LOG_NONE);
+    for (i = 0; i < 16; i++) {
+        entry[i].id = ids[i];
+        entry[i].prio = (i < 6) ? 1 : 0;
+    }
+    if ((tcam_insert(tcam, entry, 16) != TCAM_ERR_SUCCESS) ||
+        (tcam_remove(tcam, 99) != TCAM_ERR_SUCCESS) || (hw_tcam[2].id != TCAM_CELL_STATE_EMPTY)) {
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    memcpy(before, hw_tcam, sizeof(before));
+    hitless_live(&check, 16, TCAM_CELL_STATE_EMPTY);
+    check.ok = TRUE;
+    tcam_set_watch(tcam, hitless_watch, &check);
+    if ((tcam_modify_prio(tcam, 2, 1) != TCAM_ERR_TCAM_FULL) || !check.ok ||
+        memcmp(before, hw_tcam, sizeof(before))) {
+        printf("The entries without a slot to keep them are overwritten\n");
+        printf("Test case failed\n");
+        return FALSE;
+    }
+    tcam_cache_destroy(tcam);
+    printf("Test case passed\n");
+    return TRUE;
+}
 
 int main()
 {
-    ut_ptr_t ut_fn[21] ={test_full_tcam,test_tcam_insert_1, test_null_tcam_insert, test_null_tcam_remove,
+    ut_ptr_t ut_fn[] ={test_full_tcam,test_tcam_insert_1, test_null_tcam_insert, test_null_tcam_remove,
                          test_invalid_id_tcam_remove,test_tcam_insert_2,test_tcam_insert_3,
                          test_tcam_insert_4, test_tcam_program,test_full_insert_remove,test_full_insert_remove_start,
                          test_full_insert_remove_start_1, test_full_insert_remove_start_2, test_full_insert_remove_end,
                          test_full_insert_remove_end_1, test_full_insert_remove_middle, test_full_insert_remove_middle_1,
                          test_full_insert_shift_up,test_full_insert_no_shift, test_full_insert_shift_up_down,
-                         test_full_insert_remove_middle_insert_end};
+                         test_full_insert_remove_middle_insert_end, test_tcam_find,
+                         test_tcam_prio_groups, test_full_insert_shift_up_first_slot,
+                         test_tcam_insert_batch_merge, test_tcam_placement_min_move,
+                         test_tcam_group_shift_writes, test_tcam_rebalance,
+                         test_tcam_multi_bank, test_tcam_snapshot,
+                         test_tcam_shard, test_tcam_async, test_tcam_insert_undo,
+                         test_tcam_remove_batch, test_tcam_modify_prio,
+                         test_tcam_lookup, test_tcam_flow_cache, test_tcam_tss,
+                         test_tcam_spill, test_tcam_stats, test_tcam_latency,
+                         test_tcam_trace, test_tcam_hitless_writes};
     int result = 1, total_tests = 0;
     int fail_count = 0, pass_count = 0, i;
-    total_tests = 21;
+    total_tests = sizeof(ut_fn) / sizeof(ut_fn[0]);
     for(i = 0;i < total_tests; i++) {
         printf("\n Test Case %d\n",i+1);
         result = (*ut_fn[i])();
@@ -0,0 +1,719 @@
+/********************************************************************
+ *
+ *      File:   tcam_shard_mgr.c
+ *
+ *       Description:
+ *  This  file contains the code for the TCAM Shard manager API. The
+ *  manager spreads the entries over several hw_tcam banks, each one with
+ *  its own TCAM Bank handler, by ranges of priorities.
+ *
+ *
+ *
+ *
+ *********************************************************************
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "tcam_defs.h"
+#include "tcam_entry_mgr.h"
+#include "tcam_shard_mgr.h"
+
+/* Job of the worker thread of a bank */
+typedef enum {
+    SHARD_JOB_NONE = 0,
+    SHARD_JOB_INSERT,
+    SHARD_JOB_EXIT
+} shard_job_t;
+
+/* A bank of the TCAM Shard manager.
+ * tcam       - TCAM Bank handler of the bank
+ * size       - number of slots of the bank
+ * free_slots - number of empty slots of the bank
+ * batch      - entries of the batch routed to the bank
+ * batch_num  - number of entries in 'batch'
+ * job        - job of the worker thread, protected by the lock of the manager
+ * ret_val    - result of the last job
+ */
+typedef struct tcam_shard_ {
+    void *tcam;
+    uint32_t size;
+    uint32_t free_slots;
+    entry_t *batch;
+    uint32_t batch_num;
+    shard_job_t job;
+    tcam_err_t ret_val;
+    bool started;
+    pthread_t thread;
+    struct tcam_shard_mgr_ *mgr;
+} tcam_shard_t;
+
+/* State of a TCAM Shard manager. The handle returned by tcam_shard_init()
+ * points to it.
+ * Bank b holds the priorities [first[b], first[b+1]), first[0] is 0 and
+ * first[num_banks] is 2^32. Every entry of a bank is in its range, so that
+ * the banks searched in order find the entries in priority order.
+ */
+typedef struct tcam_shard_mgr_ {
+    tcam_shard_t *shards;
+    uint32_t num_banks;
+    uint64_t *first;
+    // planning of a batch, see shard_plan()
+    uint32_t *need;
+    uint32_t *prios;
+    uint32_t prios_size;
+    uint32_t num_prios;
+    // sorted priorities of the entries of all the banks, and the boundaries
+    // before a dry run of the plan
+    uint32_t *held;
+    uint32_t num_held;
+    uint64_t *plan_first;
+    bool dry;
+    // scratch buffers of the size of the largest bank
+    entry_t *snap;
+    entry_t *group;
+    uint32_t *ids;
+    // hand over of the jobs to the worker threads
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond;
+    pthread_cond_t done_cond;
+    uint32_t pending;
+} tcam_shard_mgr_t;
+
+/* Returns the bank whose range holds 'prio' */
+static uint32_t shard_route(tcam_shard_mgr_t *mgr, uint32_t prio)
+{
+    uint32_t lo = 0, hi = mgr->num_banks - 1, mid;
+
+    // last bank b with first[b] <= prio, the empty ranges are skipped
+    while(lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if(mgr->first[mid] <= prio)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+/* Returns the number of the sorted priorities 'prios' below 'prio' */
+static uint32_t prios_below(const uint32_t *prios, uint32_t num, uint64_t prio)
+{
+    uint32_t lo = 0, hi = num, mid;
+
+    while(lo < hi) {
+        mid = (lo + hi) / 2;
+        if(prios[mid] < prio)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Returns the number of priorities of the batch below 'prio' */
+static uint32_t batch_below(tcam_shard_mgr_t *mgr, uint64_t prio)
+{
+    return prios_below(mgr->prios, mgr->num_prios, prio);
+}
+
+/* Returns the number of entries of the banks below 'prio' */
+static uint32_t held_below(tcam_shard_mgr_t *mgr, uint64_t prio)
+{
+    return prios_below(mgr->held, mgr->num_held, prio);
+}
+
+static int prio_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* Finds the priority group at the end ('tail') or at the start of bank b,
+ * counting both the entries of the bank and the ones of the batch routed to
+ * it. Every entry is in the range of its bank, so the group is found from
+ * the boundaries and the priorities of the entries in mgr->held.
+ * Return: FALSE if the bank and its part of the batch are empty.
+ */
+static bool shard_edge_group(tcam_shard_mgr_t *mgr, uint32_t b, bool tail, uint32_t *prio,
+                             uint32_t *in_bank, uint32_t *in_batch)
+{
+    uint32_t lo = batch_below(mgr, mgr->first[b]), hi = batch_below(mgr, mgr->first[b+1]);
+    uint32_t held_lo = held_below(mgr, mgr->first[b]), held_hi = held_below(mgr, mgr->first[b+1]);
+    bool found = FALSE;
+
+    if(held_lo < held_hi) {
+        *prio = tail ? mgr->held[held_hi-1] : mgr->held[held_lo];
+        found = TRUE;
+    }
+    if(lo < hi) {
+        if(!found || (tail ? (mgr->prios[hi-1] > *prio) : (mgr->prios[lo] < *prio)))
+            *prio = tail ? mgr->prios[hi-1] : mgr->prios[lo];
+        found = TRUE;
+    }
+    if(!found)
+        return FALSE;
+    *in_bank = held_below(mgr, (uint64_t) *prio + 1) - held_below(mgr, *prio);
+    *in_batch = batch_below(mgr, (uint64_t) *prio + 1) - batch_below(mgr, *prio);
+    return TRUE;
+}
+
+/* Copies the entries of the priority group 'prio' at the end ('tail') or at
+ * the start of bank b to mgr->group, in the order of the slots.
+ * Return: number of entries copied
+ */
+static uint32_t shard_group_entries(tcam_shard_mgr_t *mgr, uint32_t b, bool tail, uint32_t prio)
+{
+    tcam_shard_t *shard = &mgr->shards[b];
+    uint32_t i, k, n = 0;
+    entry_t ent;
+
+    tcam_snapshot(shard->tcam, 0, shard->size, mgr->snap, NULL);
+    // the entries of a bank are sorted, the group is at the edge
+    for(k = 0; k < shard->size; k++) {
+        i = tail ? shard->size - 1 - k : k;
+        if(mgr->snap[i].id == TCAM_CELL_STATE_EMPTY)
+            continue;
+        if(mgr->snap[i].prio != prio)
+            break;
+        mgr->group[n++] = mgr->snap[i];
+    }
+    for(k = 0; tail && (k < n / 2); k++) {
+        ent = mgr->group[k];
+        mgr->group[k] = mgr->group[n-1-k];
+        mgr->group[n-1-k] = ent;
+    }
+    return n;
+}
+
+/* Reads the number of empty slots of bank b from its TCAM Bank handler */
+static void shard_count_free(tcam_shard_mgr_t *mgr, uint32_t b)
+{
+    tcam_frag_t frag;
+
+    tcam_get_frag(mgr->shards[b].tcam, &frag);
+    mgr->shards[b].free_slots = frag.free_slots;
+}
+
+static tcam_err_t shard_push(tcam_shard_mgr_t *mgr, uint32_t b, bool right);
+
+/* Makes 'num' slots of bank b empty by pushing its edge groups away from
+ * the bank 'from'.
+ */
+static tcam_err_t shard_make_room(tcam_shard_mgr_t *mgr, uint32_t b, uint32_t from, uint32_t num)
+{
+    tcam_err_t ret_val;
+
+    while(mgr->shards[b].free_slots < num) {
+        if((ret_val = shard_push(mgr, b, b > from)) != TCAM_ERR_SUCCESS)
+            return ret_val;
+    }
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Moves the priority group at the end of bank b to the start of bank b+1
+ * ('right'), or the one at its start to the end of bank b-1. The entries of
+ * the group are inserted in the other bank before they are deleted, so that
+ * they are always found by the hardware. The entries of the batch with the
+ * same priority are routed to the other bank by moving the boundary. When an
+ * entry can not be deleted from bank b, the group is put back in bank b and
+ * the error is returned. A dry run only moves the boundary and counts the
+ * slots.
+ */
+static tcam_err_t shard_push(tcam_shard_mgr_t *mgr, uint32_t b, bool right)
+{
+    uint32_t to = right ? b + 1 : b - 1;
+    uint32_t prio, in_bank, in_batch, i, k;
+    entry_t *batch;
+    tcam_err_t ret_val;
+
+    if(right ? (to >= mgr->num_banks) : (b == 0))
+        return TCAM_ERR_TCAM_FULL;
+    if(!shard_edge_group(mgr, b, right, &prio, &in_bank, &in_batch))
+        return TCAM_ERR_TCAM_FULL;
+
+    if((in_bank > 0) && ((ret_val = shard_make_room(mgr, to, b, in_bank)) != TCAM_ERR_SUCCESS))
+        return ret_val;
+    if((in_bank > 0) && !mgr->dry) {
+        if(shard_group_entries(mgr, b, right, prio) != in_bank)
+            return TCAM_ERR_EINVAL;
+        // a batch puts its latest entry first in a group, reverse the group
+        // to keep its order
+        batch = mgr->shards[to].batch;
+        for(i = 0; i < in_bank; i++)
+            batch[i] = mgr->group[in_bank - 1 - i];
+        if((ret_val = tcam_insert(mgr->shards[to].tcam, batch, in_bank)) != TCAM_ERR_SUCCESS)
+            return ret_val;
+        for(i = 0; i < in_bank; i++) {
+            if((ret_val = tcam_remove(mgr->shards[b].tcam, mgr->group[i].id)) != TCAM_ERR_SUCCESS)
+                break;
+        }
+        if(i < in_bank) {
+            // the range of the group is still in bank b, the entries already
+            // deleted from it go back before the group leaves bank 'to'
+            batch = mgr->shards[b].batch;
+            for(k = 0; k < i; k++)
+                batch[k] = mgr->group[i - 1 - k];
+            if((k == 0) || (tcam_insert(mgr->shards[b].tcam, batch, k) == TCAM_ERR_SUCCESS)) {
+                for(k = 0; k < in_bank; k++)
+                    tcam_remove(mgr->shards[to].tcam, mgr->group[k].id);
+            }
+            shard_count_free(mgr, b);
+            shard_count_free(mgr, to);
+            return ret_val;
+        }
+    }
+    mgr->shards[to].free_slots -= in_bank;
+    mgr->shards[b].free_slots += in_bank;
+    if(right)
+        mgr->first[b+1] = prio;
+    else
+        mgr->first[b] = (uint64_t) prio + 1;
+    mgr->need[b] -= in_batch;
+    mgr->need[to] += in_batch;
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Counts the empty slots of the banks and the entries of the batch in their
+ * ranges.
+ * Return: TRUE if every bank has room for its part of the batch.
+ */
+static bool shard_count(tcam_shard_mgr_t *mgr)
+{
+    uint32_t b;
+    bool fits = TRUE;
+
+    for(b = 0; b < mgr->num_banks; b++) {
+        shard_count_free(mgr, b);
+        mgr->need[b] = batch_below(mgr, mgr->first[b+1]) - batch_below(mgr, mgr->first[b]);
+        if(mgr->need[b] > mgr->shards[b].free_slots)
+            fits = FALSE;
+    }
+    return fits;
+}
+
+/* Moves the boundaries of the banks until each one has enough empty slots
+ * for its part of the batch. The parts are pushed to the right first, as
+ * long as the banks on the right have room for them, and then to the left.
+ */
+static tcam_err_t shard_place(tcam_shard_mgr_t *mgr)
+{
+    uint32_t b, r, n = mgr->num_banks, prio, in_bank, in_batch;
+    int64_t slack;
+    tcam_err_t ret_val;
+
+    for(b = 0; b + 1 < n; b++) {
+        while(mgr->need[b] > mgr->shards[b].free_slots) {
+            shard_edge_group(mgr, b, TRUE, &prio, &in_bank, &in_batch);
+            for(slack = 0, r = b + 1; r < n; r++)
+                slack += (int64_t) mgr->shards[r].free_slots - mgr->need[r];
+            if(slack < in_bank + in_batch)
+                break;
+            if((ret_val = shard_push(mgr, b, TRUE)) != TCAM_ERR_SUCCESS) {
+                if(ret_val != TCAM_ERR_TCAM_FULL)
+                    return ret_val;
+                break;
+            }
+        }
+    }
+    for(b = n - 1; b > 0; b--) {
+        while(mgr->need[b] > mgr->shards[b].free_slots) {
+            if((ret_val = shard_push(mgr, b, FALSE)) != TCAM_ERR_SUCCESS)
+                return ret_val;
+        }
+    }
+    return (mgr->need[0] > mgr->shards[0].free_slots) ? TCAM_ERR_TCAM_FULL : TCAM_ERR_SUCCESS;
+}
+
+/* Plans a batch whose sorted priorities are in mgr->prios. When a bank does
+ * not have room for its part, the moves of the groups are first run dry on
+ * the boundaries only, so that a batch which does not fit fails before any
+ * group is moved.
+ */
+static tcam_err_t shard_plan(tcam_shard_mgr_t *mgr)
+{
+    uint32_t b, i, n = mgr->num_banks;
+    tcam_err_t ret_val;
+
+    if(shard_count(mgr))
+        return TCAM_ERR_SUCCESS;
+    // the ranges of the banks are in order and the entries of each bank are
+    // sorted, so the priorities are read sorted
+    mgr->num_held = 0;
+    for(b = 0; b < n; b++) {
+        tcam_snapshot(mgr->shards[b].tcam, 0, mgr->shards[b].size, mgr->snap, NULL);
+        for(i = 0; i < mgr->shards[b].size; i++) {
+            if(mgr->snap[i].id != TCAM_CELL_STATE_EMPTY)
+                mgr->held[mgr->num_held++] = mgr->snap[i].prio;
+        }
+    }
+    memcpy(mgr->plan_first, mgr->first, (n + 1) * sizeof(uint64_t));
+    mgr->dry = TRUE;
+    ret_val = shard_place(mgr);
+    mgr->dry = FALSE;
+    memcpy(mgr->first, mgr->plan_first, (n + 1) * sizeof(uint64_t));
+    shard_count(mgr);
+    if(ret_val != TCAM_ERR_SUCCESS)
+        return ret_val;
+    return shard_place(mgr);
+}
+
+/* Deletes the part of a batch inserted in bank b when the batch failed in
+ * another bank
+ */
+static void shard_undo_part(tcam_shard_mgr_t *mgr, uint32_t b)
+{
+    tcam_shard_t *shard = &mgr->shards[b];
+    uint32_t i;
+
+    for(i = 0; i < shard->batch_num; i++)
+        mgr->ids[i] = shard->batch[i].id;
+    // tcam_remove_batch() refuses an id given twice, such a part is deleted
+    // an entry at a time, the latest one first
+    if(tcam_remove_batch(shard->tcam, mgr->ids, shard->batch_num, NULL) != TCAM_ERR_SUCCESS) {
+        for(i = shard->batch_num; i > 0; i--)
+            tcam_remove(shard->tcam, mgr->ids[i-1]);
+    }
+    shard_count_free(mgr, b);
+}
+
+/* Worker thread of a bank, runs the jobs given by tcam_shard_insert() */
+static void *shard_worker(void *arg)
+{
+    tcam_shard_t *shard = arg;
+    tcam_shard_mgr_t *mgr = shard->mgr;
+    tcam_err_t ret_val;
+
+    pthread_mutex_lock(&mgr->lock);
+    for(;;) {
+        while(shard->job == SHARD_JOB_NONE)
+            pthread_cond_wait(&mgr->job_cond, &mgr->lock);
+        if(shard->job == SHARD_JOB_EXIT)
+            break;
+        pthread_mutex_unlock(&mgr->lock);
+        ret_val = tcam_insert(shard->tcam, shard->batch, shard->batch_num);
+        pthread_mutex_lock(&mgr->lock);
+        shard->ret_val = ret_val;
+        shard->job = SHARD_JOB_NONE;
+        if(--mgr->pending == 0)
+            pthread_cond_signal(&mgr->done_cond);
+    }
+    pthread_mutex_unlock(&mgr->lock);
+    return NULL;
+}
+
+/*  Description:
+ *     This API initializes a TCAM Shard manager over several hw_tcam banks.
+ *     Each bank is served by its own TCAM Bank handler and worker thread.
+ *
+ * Arguments
+ *  hw_tcams  - addresses of the hardware tcam memories
+ *  sizes     - sizes of the hardware tcam memories
+ *  num_banks - number of banks
+ *  max_prio  - highest priority value expected
+ *  mgr       - pointer to the manager allocated
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_shard_init(entry_t **hw_tcams, uint32_t *sizes, uint32_t num_banks,
+                           uint32_t max_prio, void **mgr)
+{
+    tcam_shard_mgr_t *shard_mgr;
+    uint64_t total = 0, sum = 0;
+    uint32_t b, largest = 0;
+
+    if(mgr == NULL)
+        return TCAM_ERR_EINVAL;
+    *mgr = NULL;
+    if((hw_tcams == NULL) || (sizes == NULL) || (num_banks == 0))
+        return TCAM_ERR_EINVAL;
+    for(b = 0; b < num_banks; b++) {
+        if((hw_tcams[b] == NULL) || (sizes[b] == 0))
+            return TCAM_ERR_EINVAL;
+        total += sizes[b];
+        if(sizes[b] > largest)
+            largest = sizes[b];
+    }
+
+    shard_mgr = calloc(1, sizeof(tcam_shard_mgr_t));
+    if(shard_mgr == NULL)
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    shard_mgr->num_banks = num_banks;
+    shard_mgr->shards = calloc(num_banks, sizeof(tcam_shard_t));
+    shard_mgr->first = calloc(num_banks + 1, sizeof(uint64_t));
+    shard_mgr->need = calloc(num_banks, sizeof(uint32_t));
+    shard_mgr->held = calloc(total, sizeof(uint32_t));
+    shard_mgr->plan_first = calloc(num_banks + 1, sizeof(uint64_t));
+    shard_mgr->snap = calloc(largest, sizeof(entry_t));
+    shard_mgr->group = calloc(largest, sizeof(entry_t));
+    shard_mgr->ids = calloc(largest, sizeof(uint32_t));
+    pthread_mutex_init(&shard_mgr->lock, NULL);
+    pthread_cond_init(&shard_mgr->job_cond, NULL);
+    pthread_cond_init(&shard_mgr->done_cond, NULL);
+    if((shard_mgr->shards == NULL) || (shard_mgr->first == NULL) || (shard_mgr->need == NULL) ||
+       (shard_mgr->held == NULL) || (shard_mgr->plan_first == NULL) ||
+       (shard_mgr->snap == NULL) || (shard_mgr->group == NULL) || (shard_mgr->ids == NULL)) {
+        tcam_shard_destroy(shard_mgr);
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    }
+
+    for(b = 0; b < num_banks; b++) {
+        tcam_shard_t *shard = &shard_mgr->shards[b];
+
+        // ranges proportional to the sizes of the banks
+        shard_mgr->first[b] = ((uint64_t) max_prio + 1) * sum / total;
+        sum += sizes[b];
+        shard->mgr = shard_mgr;
+        shard->size = sizes[b];
+        shard->free_slots = sizes[b];
+        shard->batch = calloc(sizes[b], sizeof(entry_t));
+        if((shard->batch == NULL) || (tcam_init(hw_tcams[b], sizes[b], &shard->tcam) != TCAM_ERR_SUCCESS) ||
+           (pthread_create(&shard->thread, NULL, shard_worker, shard) != 0)) {
+            tcam_shard_destroy(shard_mgr);
+            return TCAM_ERR_MEM_ALLOC_FAIL;
+        }
+        shard->started = TRUE;
+    }
+    shard_mgr->first[num_banks] = (uint64_t) UINT32_MAX + 1;
+    *mgr = shard_mgr;
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *     Inserts a batch of entries, each one into the bank whose range holds
+ *     its priority. The banks are programmed in parallel, the calling thread
+ *     programs one of them itself. When a bank fails its part, the parts
+ *     already inserted by the other banks are deleted.
+ *
+ * Arguments
+ *  mgr     - shard manager
+ *  entries - entries to be inserted
+ *  num     - number of entries
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_shard_insert(void *mgr, entry_t *entries, uint32_t num)
+{
+    tcam_shard_mgr_t *shard_mgr = (tcam_shard_mgr_t *) mgr;
+    tcam_shard_t *shard, *inline_shard = NULL;
+    uint64_t free_slots = 0;
+    tcam_err_t ret_val = TCAM_ERR_SUCCESS;
+    uint32_t i, b;
+
+    if(shard_mgr == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if((entries == NULL) || (num == 0))
+        return TCAM_ERR_EINVAL;
+    for(b = 0; b < shard_mgr->num_banks; b++)
+        free_slots += shard_mgr->shards[b].free_slots;
+    if(num > free_slots)
+        return TCAM_ERR_TCAM_FULL;
+
+    if(num > shard_mgr->prios_size) {
+        uint32_t *prios = realloc(shard_mgr->prios, num * sizeof(uint32_t));
+
+        if(prios == NULL)
+            return TCAM_ERR_MEM_ALLOC_FAIL;
+        shard_mgr->prios = prios;
+        shard_mgr->prios_size = num;
+    }
+    for(i = 0; i < num; i++)
+        shard_mgr->prios[i] = entries[i].prio;
+    qsort(shard_mgr->prios, num, sizeof(uint32_t), prio_cmp);
+    shard_mgr->num_prios = num;
+    ret_val = shard_plan(shard_mgr);
+    shard_mgr->num_prios = 0;
+    if(ret_val != TCAM_ERR_SUCCESS)
+        return ret_val;
+
+    // split the batch, in its order
+    for(b = 0; b < shard_mgr->num_banks; b++)
+        shard_mgr->shards[b].batch_num = 0;
+    for(i = 0; i < num; i++) {
+        shard = &shard_mgr->shards[shard_route(shard_mgr, entries[i].prio)];
+        shard->batch[shard->batch_num++] = entries[i];
+    }
+
+    pthread_mutex_lock(&shard_mgr->lock);
+    for(b = 0; b < shard_mgr->num_banks; b++) {
+        shard = &shard_mgr->shards[b];
+        shard->ret_val = TCAM_ERR_SUCCESS;
+        if(shard->batch_num == 0)
+            continue;
+        if(inline_shard == NULL) {
+            inline_shard = shard;
+            continue;
+        }
+        shard->job = SHARD_JOB_INSERT;
+        shard_mgr->pending++;
+    }
+    if(shard_mgr->pending > 0)
+        pthread_cond_broadcast(&shard_mgr->job_cond);
+    pthread_mutex_unlock(&shard_mgr->lock);
+
+    if(inline_shard != NULL)
+        inline_shard->ret_val = tcam_insert(inline_shard->tcam, inline_shard->batch,
+                                            inline_shard->batch_num);
+
+    pthread_mutex_lock(&shard_mgr->lock);
+    while(shard_mgr->pending > 0)
+        pthread_cond_wait(&shard_mgr->done_cond, &shard_mgr->lock);
+    pthread_mutex_unlock(&shard_mgr->lock);
+
+    for(b = 0; b < shard_mgr->num_banks; b++) {
+        shard = &shard_mgr->shards[b];
+        if(shard->batch_num == 0)
+            continue;
+        if(shard->ret_val == TCAM_ERR_SUCCESS)
+            shard->free_slots -= shard->batch_num;
+        else if(ret_val == TCAM_ERR_SUCCESS)
+            ret_val = shard->ret_val;
+    }
+    // a bank which fails its part has undone it, the other banks undo theirs
+    for(b = 0; (ret_val != TCAM_ERR_SUCCESS) && (b < shard_mgr->num_banks); b++) {
+        shard = &shard_mgr->shards[b];
+        if((shard->batch_num > 0) && (shard->ret_val == TCAM_ERR_SUCCESS))
+            shard_undo_part(shard_mgr, b);
+    }
+    return ret_val;
+}
+
+/*  Description:
+ *     Deletes the entry with the given id from the bank holding it.
+ *
+ * Arguments
+ *  mgr - shard manager
+ *  id  - id of the entry to be deleted
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_shard_remove(void *mgr, uint32_t id)
+{
+    tcam_shard_mgr_t *shard_mgr = (tcam_shard_mgr_t *) mgr;
+    uint32_t b, position;
+    tcam_err_t ret_val;
+
+    if(shard_mgr == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if((ret_val = tcam_shard_find(mgr, id, &b, &position)) != TCAM_ERR_SUCCESS)
+        return ret_val;
+    if((ret_val = tcam_remove(shard_mgr->shards[b].tcam, id)) == TCAM_ERR_SUCCESS)
+        shard_mgr->shards[b].free_slots++;
+    return ret_val;
+}
+
+/*  Description:
+ *     Looks up the bank and the slot of the entry with the given id.
+ *
+ * Arguments
+ *  mgr      - shard manager
+ *  id       - id of the entry
+ *  bank     - filled with the index of the bank
+ *  position - filled with the slot of the entry in the bank
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_shard_find(void *mgr, uint32_t id, uint32_t *bank, uint32_t *position)
+{
+    tcam_shard_mgr_t *shard_mgr = (tcam_shard_mgr_t *) mgr;
+    uint32_t b;
+
+    if(shard_mgr == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if((bank == NULL) || (position == NULL))
+        return TCAM_ERR_EINVAL;
+    for(b = 0; b < shard_mgr->num_banks; b++) {
+        if(tcam_find(shard_mgr->shards[b].tcam, id, position) == TCAM_ERR_SUCCESS) {
+            *bank = b;
+            return TCAM_ERR_SUCCESS;
+        }
+    }
+    return TCAM_ERR_EINVAL;
+}
+
+/*  Description:
+ *     Returns the TCAM Bank handler of a bank.
+ *
+ * Arguments
+ *  mgr  - shard manager
+ *  bank - index of the bank
+ *  tcam - filled with the TCAM Bank handler
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_shard_get_bank(void *mgr, uint32_t bank, void **tcam)
+{
+    tcam_shard_mgr_t *shard_mgr = (tcam_shard_mgr_t *) mgr;
+
+    if(shard_mgr == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if((tcam == NULL) || (bank >= shard_mgr->num_banks))
+        return TCAM_ERR_EINVAL;
+    *tcam = shard_mgr->shards[bank].tcam;
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *     Returns the range of priorities of a bank, [first, end).
+ *
+ * Arguments
+ *  mgr   - shard manager
+ *  bank  - index of the bank
+ *  first - filled with the first priority of the range
+ *  end   - filled with the end of the range, 2^32 for the last bank
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_shard_get_range(void *mgr, uint32_t bank, uint64_t *first, uint64_t *end)
+{
+    tcam_shard_mgr_t *shard_mgr = (tcam_shard_mgr_t *) mgr;
+
+    if(shard_mgr == NULL)
+        return TCAM_ERR_NULL_CACHE;
+    if((first == NULL) || (end == NULL) || (bank >= shard_mgr->num_banks))
+        return TCAM_ERR_EINVAL;
+    *first = shard_mgr->first[bank];
+    *end = shard_mgr->first[bank+1];
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *     Stops the worker threads and frees the shard manager and its TCAM
+ *     Bank handlers.
+ *
+ * Arguments
+ *  mgr - shard manager
+ */
+void tcam_shard_destroy(void *mgr)
+{
+    tcam_shard_mgr_t *shard_mgr = (tcam_shard_mgr_t *) mgr;
+    uint32_t b;
+
+    if(shard_mgr == NULL)
+        return;
+    if(shard_mgr->shards != NULL) {
+        pthread_mutex_lock(&shard_mgr->lock);
+        for(b = 0; b < shard_mgr->num_banks; b++)
+            shard_mgr->shards[b].job = SHARD_JOB_EXIT;
+        pthread_cond_broadcast(&shard_mgr->job_cond);
+        pthread_mutex_unlock(&shard_mgr->lock);
+        for(b = 0; b < shard_mgr->num_banks; b++) {
+            if(shard_mgr->shards[b].started)
+                pthread_join(shard_mgr->shards[b].thread, NULL);
+            if(shard_mgr->shards[b].tcam != NULL)
+                tcam_cache_destroy(shard_mgr->shards[b].tcam);
+            free(shard_mgr->shards[b].batch);
+        }
+    }
+    pthread_mutex_destroy(&shard_mgr->lock);
+    pthread_cond_destroy(&shard_mgr->job_cond);
+    pthread_cond_destroy(&shard_mgr->done_cond);
+    free(shard_mgr->shards);
+    free(shard_mgr->first);
+    free(shard_mgr->need);
+    free(shard_mgr->held);
+    free(shard_mgr->plan_first);
+    free(shard_mgr->prios);
+    free(shard_mgr->snap);
+    free(shard_mgr->group);
+    free(shard_mgr->ids);
+    free(shard_mgr);
+}
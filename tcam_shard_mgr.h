@@ -0,0 +1,120 @@
+/********************************************************************
+ *
+ *      File:   tcam_shard_mgr.h
+ *
+ *       Description:
+ *  This header file contains the  declarations for the API of the TCAM
+ *  Shard manager, which spreads the entries over several TCAM Bank handlers
+ *
+ *
+ *
+ *
+ *********************************************************************
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "tcam_defs.h"
+
+#ifndef __TCAM_SHARD_MGR_H__
+#define __TCAM_SHARD_MGR_H__
+
+/*  Description:
+ *     This API initializes a TCAM Shard manager over several hw_tcam banks.
+ *     Each bank is served by its own TCAM Bank handler and worker thread.
+ *     The banks are searched in order by the hardware, so the priority space
+ *     is split in ranges of ascending priority values, one per bank. The
+ *     range of a bank starts proportional to its size over [0, max_prio],
+ *     the last bank also takes the priorities above max_prio. The ranges
+ *     move when a bank fills up.
+ *
+ * Arguments
+ *  hw_tcams  - addresses of the hardware tcam memories
+ *  sizes     - sizes of the hardware tcam memories
+ *  num_banks - number of banks
+ *  max_prio  - highest priority value expected
+ *  mgr       - pointer to the manager allocated
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_shard_init(entry_t **hw_tcams, uint32_t *sizes, uint32_t num_banks,
+                           uint32_t max_prio, void **mgr);
+
+/*  Description:
+ *     Inserts a batch of entries. Each entry goes to the bank whose range
+ *     holds its priority, in the same order as in the batch, and the banks
+ *     are programmed in parallel by their worker threads. When a bank does
+ *     not have enough empty slots, the priority groups at the edge of its
+ *     range are moved to the neighbour banks first. The batch fails with
+ *     TCAM_ERR_TCAM_FULL, before anything is inserted or moved, if the banks
+ *     do not have enough empty slots together. When a bank fails to insert
+ *     its part, the parts inserted by the other banks are deleted and the
+ *     error of the bank is returned: a failed batch inserts no entry,
+ *     though the groups moved for it stay in their new bank.
+ *
+ * Arguments
+ *  mgr     - shard manager
+ *  entries - entries to be inserted
+ *  num     - number of entries
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_shard_insert(void *mgr, entry_t *entries, uint32_t num);
+
+/*  Description:
+ *     Deletes the entry with the given id from the bank holding it.
+ *
+ * Arguments
+ *  mgr - shard manager
+ *  id  - id of the entry to be deleted
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_shard_remove(void *mgr, uint32_t id);
+
+/*  Description:
+ *     Looks up the bank and the slot of the entry with the given id.
+ *
+ * Arguments
+ *  mgr      - shard manager
+ *  id       - id of the entry
+ *  bank     - filled with the index of the bank
+ *  position - filled with the slot of the entry in the bank
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_shard_find(void *mgr, uint32_t id, uint32_t *bank, uint32_t *position);
+
+/*  Description:
+ *     Returns the TCAM Bank handler of a bank, to set its options or read
+ *     its statistics. Entries must only be inserted and deleted through the
+ *     shard manager.
+ *
+ * Arguments
+ *  mgr  - shard manager
+ *  bank - index of the bank
+ *  tcam - filled with the TCAM Bank handler
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_shard_get_bank(void *mgr, uint32_t bank, void **tcam);
+
+/*  Description:
+ *     Returns the range of priorities of a bank, [first, end). The range is
+ *     empty when first == end.
+ *
+ * Arguments
+ *  mgr   - shard manager
+ *  bank  - index of the bank
+ *  first - filled with the first priority of the range
+ *  end   - filled with the end of the range, 2^32 for the last bank
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_shard_get_range(void *mgr, uint32_t bank, uint64_t *first, uint64_t *end);
+
+/*  Description:
+ *     Stops the worker threads and frees the shard manager and its TCAM
+ *     Bank handlers.
+ *
+ * Arguments
+ *  mgr - shard manager
+ */
+void tcam_shard_destroy(void *mgr);
+#endif
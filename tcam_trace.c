@@ -0,0 +1,353 @@
+/********************************************************************
+ *
+ *      File:   tcam_trace.c
+ *
+ *       Description:
+ *  This  file contains the code for the traces of the calls to a TCAM
+ *  Bank handler: the recorder, which appends the records to a file, and
+ *  the reader, which maps a trace in memory or streams it from a pipe.
+ *
+ *
+ *
+ *********************************************************************
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tcam_defs.h"
+#include "tcam_trace.h"
+
+// bytes of a mapped trace read before their pages are dropped
+#define TRACE_DROP_BYTES (8 << 20)
+
+/* State of a recorder
+ * start - time the recording started, in nanoseconds of CLOCK_MONOTONIC
+ * error - a record could not be written
+ */
+typedef struct trace_writer_ {
+    FILE *out;
+    uint64_t start;
+    int error;
+} trace_writer_t;
+
+/* State of a reader. A mapped trace is read in place from 'map', a
+ * streamed one through 'buf', which holds the last record read.
+ * pos     - offset of the next record in the mapped trace
+ * dropped - offset up to which the pages of the mapped trace were dropped
+ */
+typedef struct trace_reader_ {
+    FILE *in;
+    const uint8_t *map;
+    size_t map_size;
+    size_t pos;
+    size_t dropped;
+    uint8_t *buf;
+    size_t buf_size;
+} trace_reader_t;
+
+static uint64_t trace_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void trace_write(trace_writer_t *writer, const void *data, size_t bytes)
+{
+    if((bytes > 0) && (fwrite(data, bytes, 1, writer->out) != 1))
+        writer->error = 1;
+}
+
+/*  Description:
+ *     Starts a recording to 'out', which is left open and positioned after
+ *     the header written. The records are written with the stdio buffer of
+ *     'out', see tcam_trace_stop() for the errors.
+ *
+ * Arguments
+ *  out   - file the trace is written to, a pipe works too
+ *  trace - pointer to the recorder allocated
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_trace_start(FILE *out, void **trace)
+{
+    trace_writer_t *writer;
+    tcam_trace_hdr_t hdr;
+
+    if((out == NULL) || (trace == NULL))
+        return TCAM_ERR_EINVAL;
+    if((writer = calloc(1, sizeof(trace_writer_t))) == NULL)
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TCAM_TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = TCAM_TRACE_VERSION;
+    hdr.align = TCAM_TRACE_ALIGN;
+    writer->out = out;
+    writer->start = trace_now();
+    trace_write(writer, &hdr, sizeof(hdr));
+    if(writer->error) {
+        free(writer);
+        return TCAM_ERR_IO;
+    }
+    *trace = writer;
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Writes the fixed part of a record whose payload has 'bytes' bytes, and
+ * returns the number of bytes of padding which follow the payload.
+ */
+static size_t trace_rec_begin(trace_writer_t *writer, uint64_t start, tcam_trace_op_t op,
+                              tcam_err_t ret, uint32_t num, uint32_t arg, uint32_t arg2,
+                              size_t bytes)
+{
+    size_t size = sizeof(tcam_trace_rec_t) + bytes;
+    tcam_trace_rec_t rec;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.ns = (start > writer->start) ? start - writer->start : 0;
+    rec.size = (size + TCAM_TRACE_ALIGN - 1) / TCAM_TRACE_ALIGN * TCAM_TRACE_ALIGN;
+    rec.op = op;
+    rec.ret = ret;
+    rec.num = num;
+    rec.arg = arg;
+    rec.arg2 = arg2;
+    trace_write(writer, &rec, sizeof(rec));
+    return rec.size - size;
+}
+
+/*  Description:
+ *     Appends a record to the recording. It is meant for the TCAM Bank
+ *     handler, see tcam_trace_op_t for the arguments of each call. An error
+ *     of 'out' is kept until tcam_trace_stop().
+ *
+ * Arguments
+ *  trace   - recorder
+ *  start   - time of the call, in nanoseconds of CLOCK_MONOTONIC
+ *  op      - call, one of tcam_trace_op_t
+ *  ret     - error code returned by the call
+ *  num     - number of items of the payload
+ *  arg     - argument of the call
+ *  arg2    - second argument of the call
+ *  payload - payload of the record, num items
+ *  bytes   - number of bytes of the payload
+ */
+void tcam_trace_record(void *trace, uint64_t start, tcam_trace_op_t op, tcam_err_t ret,
+                       uint32_t num, uint32_t arg, uint32_t arg2, const void *payload,
+                       size_t bytes)
+{
+    static const uint8_t zeros[TCAM_TRACE_ALIGN];
+    trace_writer_t *writer = (trace_writer_t *) trace;
+    size_t pad;
+
+    if(writer == NULL)
+        return;
+    pad = trace_rec_begin(writer, start, op, ret, num, arg, arg2, bytes);
+    trace_write(writer, payload, bytes);
+    trace_write(writer, zeros, pad);
+}
+
+/*  Description:
+ *     Appends a tcam_insert_keys() call to the recording, see
+ *     TCAM_TRACE_INSERT.
+ *
+ * Arguments
+ *  trace     - recorder
+ *  start     - time of the call, in nanoseconds of CLOCK_MONOTONIC
+ *  ret       - error code returned by the call
+ *  entries   - entries inserted
+ *  keys      - keys of the entries, NULL for entries matching any key
+ *  key_words - width of the keys in 32 bit words
+ *  num       - number of entries
+ */
+void tcam_trace_insert(void *trace, uint64_t start, tcam_err_t ret, const entry_t *entries,
+                       const uint32_t *keys, uint32_t key_words, uint32_t num)
+{
+    static const uint8_t zeros[TCAM_TRACE_ALIGN];
+    trace_writer_t *writer = (trace_writer_t *) trace;
+    size_t bytes = (size_t) num * 2 * sizeof(uint32_t), pad;
+    uint32_t pair[2], i;
+
+    if(writer == NULL)
+        return;
+    if(keys != NULL)
+        bytes += (size_t) num * 2 * key_words * sizeof(uint32_t);
+    pad = trace_rec_begin(writer, start, TCAM_TRACE_INSERT, ret, num, keys != NULL,
+                          32 * key_words, bytes);
+    for(i = 0; i < num; i++) {
+        pair[0] = entries[i].id;
+        pair[1] = entries[i].prio;
+        trace_write(writer, pair, sizeof(pair));
+    }
+    if(keys != NULL)
+        trace_write(writer, keys, (size_t) num * 2 * key_words * sizeof(uint32_t));
+    trace_write(writer, zeros, pad);
+}
+
+/*  Description:
+ *     Ends a recording and frees the recorder. 'out' is flushed but left
+ *     open.
+ *
+ * Arguments
+ *  trace - recorder
+ * Return: TCAM_ERR_SUCCESS or TCAM_ERR_IO if a record could not be written.
+ */
+tcam_err_t tcam_trace_stop(void *trace)
+{
+    trace_writer_t *writer = (trace_writer_t *) trace;
+    int error;
+
+    if(writer == NULL)
+        return TCAM_ERR_EINVAL;
+    error = writer->error || (fflush(writer->out) != 0);
+    free(writer);
+    return error ? TCAM_ERR_IO : TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *     Opens a trace for reading. A file is mapped in memory and read in
+ *     place, the pages read are dropped as the reading goes, so a trace
+ *     larger than the memory can be read. "-" reads the standard input as it
+ *     comes, one record at a time.
+ *
+ * Arguments
+ *  path   - path of the trace, or "-"
+ *  reader - pointer to the reader allocated
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_trace_open(const char *path, void **reader)
+{
+    const tcam_trace_hdr_t *hdr;
+    tcam_trace_hdr_t in_hdr;
+    trace_reader_t *rd;
+    struct stat st;
+    void *map;
+    int fd;
+
+    if((path == NULL) || (reader == NULL))
+        return TCAM_ERR_EINVAL;
+    if((rd = calloc(1, sizeof(trace_reader_t))) == NULL)
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+
+    if(!strcmp(path, "-")) {
+        rd->in = stdin;
+        if(fread(&in_hdr, sizeof(in_hdr), 1, stdin) != 1) {
+            free(rd);
+            return TCAM_ERR_IO;
+        }
+        hdr = &in_hdr;
+    } else {
+        if((fd = open(path, O_RDONLY)) < 0) {
+            free(rd);
+            return TCAM_ERR_IO;
+        }
+        if((fstat(fd, &st) != 0) || (st.st_size < (off_t) sizeof(tcam_trace_hdr_t)) ||
+           ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)) {
+            close(fd);
+            free(rd);
+            return TCAM_ERR_IO;
+        }
+        // the mapping holds its own reference to the file
+        close(fd);
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        rd->map = map;
+        rd->map_size = st.st_size;
+        rd->pos = sizeof(tcam_trace_hdr_t);
+        hdr = map;
+    }
+    if(memcmp(hdr->magic, TCAM_TRACE_MAGIC, sizeof(hdr->magic)) ||
+       (hdr->version != TCAM_TRACE_VERSION) || (hdr->align != TCAM_TRACE_ALIGN)) {
+        tcam_trace_close(rd);
+        return TCAM_ERR_EINVAL;
+    }
+    *reader = rd;
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Reads the next record of a streamed trace in the buffer of the reader */
+static tcam_err_t trace_read(trace_reader_t *rd, const tcam_trace_rec_t **rec)
+{
+    tcam_trace_rec_t head;
+    uint8_t *buf;
+
+    if(fread(&head, sizeof(head), 1, rd->in) != 1)
+        return feof(rd->in) ? TCAM_ERR_NO_MATCH : TCAM_ERR_IO;
+    if((head.size < sizeof(head)) || (head.size % TCAM_TRACE_ALIGN))
+        return TCAM_ERR_EINVAL;
+    if(head.size > rd->buf_size) {
+        if((buf = realloc(rd->buf, head.size)) == NULL)
+            return TCAM_ERR_MEM_ALLOC_FAIL;
+        rd->buf = buf;
+        rd->buf_size = head.size;
+    }
+    memcpy(rd->buf, &head, sizeof(head));
+    if((head.size > sizeof(head)) &&
+       (fread(rd->buf + sizeof(head), head.size - sizeof(head), 1, rd->in) != 1))
+        return TCAM_ERR_EINVAL;
+    *rec = (const tcam_trace_rec_t *) rd->buf;
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *     Reads the next record of a trace. The record and its payload stay
+ *     valid until the next call.
+ *
+ * Arguments
+ *  reader - reader
+ *  rec    - filled with a pointer to the record, its payload follows it
+ * Return: TCAM_ERR_SUCCESS, TCAM_ERR_NO_MATCH at the end of the trace,
+ *         TCAM_ERR_EINVAL for a truncated or malformed record or
+ *         appropriate error code.
+ */
+tcam_err_t tcam_trace_next(void *reader, const tcam_trace_rec_t **rec)
+{
+    trace_reader_t *rd = (trace_reader_t *) reader;
+    const tcam_trace_rec_t *next;
+    size_t drop;
+
+    if((rd == NULL) || (rec == NULL))
+        return TCAM_ERR_EINVAL;
+    if(rd->map == NULL)
+        return trace_read(rd, rec);
+
+    if(rd->pos == rd->map_size)
+        return TCAM_ERR_NO_MATCH;
+    next = (const tcam_trace_rec_t *) (rd->map + rd->pos);
+    if((rd->map_size - rd->pos < sizeof(tcam_trace_rec_t)) || (next->size < sizeof(tcam_trace_rec_t)) ||
+       (next->size % TCAM_TRACE_ALIGN) || (next->size > rd->map_size - rd->pos))
+        return TCAM_ERR_EINVAL;
+    // the pages before the previous record are not read again
+    drop = rd->pos / TRACE_DROP_BYTES * TRACE_DROP_BYTES;
+    if(drop > rd->dropped) {
+        madvise((void *) (rd->map + rd->dropped), drop - rd->dropped, MADV_DONTNEED);
+        rd->dropped = drop;
+    }
+    rd->pos += next->size;
+    *rec = next;
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *     Closes a trace opened by tcam_trace_open() and frees the reader.
+ *
+ * Arguments
+ *  reader - reader
+ */
+void tcam_trace_close(void *reader)
+{
+    trace_reader_t *rd = (trace_reader_t *) reader;
+
+    if(rd == NULL)
+        return;
+    if(rd->map != NULL)
+        munmap((void *) rd->map, rd->map_size);
+    free(rd->buf);
+    free(rd);
+}
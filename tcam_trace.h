@@ -0,0 +1,189 @@
+/********************************************************************
+ *
+ *      File:   tcam_trace.h
+ *
+ *       Description:
+ *  This header file contains the  declarations for the traces of the
+ *  calls to a TCAM Bank handler, their format, the recorder and the
+ *  reader used to replay them
+ *
+ *
+ *
+ *********************************************************************
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "tcam_defs.h"
+
+#ifndef __TCAM_TRACE_H__
+#define __TCAM_TRACE_H__
+
+/* A trace is a tcam_trace_hdr_t followed by records, each one a
+ * tcam_trace_rec_t followed by its payload and padded to a multiple of
+ * TCAM_TRACE_ALIGN bytes. The records are only appended, so a trace can be
+ * written to a pipe and read while it is written, and every record is
+ * aligned in place, so a trace can be mapped in memory and read without
+ * copying. The fields are in the byte order of the host which recorded it.
+ */
+#define TCAM_TRACE_MAGIC   "TCAMTRC1"
+#define TCAM_TRACE_VERSION 1
+#define TCAM_TRACE_ALIGN   8
+
+/* Calls recorded in a trace, the op of tcam_trace_rec_t
+ * TCAM_TRACE_INIT         - the bank the next records apply to: arg is its
+ *                           size and arg2 its key width in bits. num has
+ *                           the TCAM_TRACE_INIT_* flags below.
+ * TCAM_TRACE_INSERT       - tcam_insert_keys(): the payload is num pairs of
+ *                           id and priority, then when arg is 1 the num
+ *                           keys, value then mask, arg2 / 32 words each
+ * TCAM_TRACE_REMOVE       - tcam_remove(): the payload is the id
+ * TCAM_TRACE_REMOVE_BATCH - tcam_remove_batch(): the payload is num ids
+ * TCAM_TRACE_MODIFY       - tcam_modify_prio(): arg is the id and arg2 the
+ *                           new priority
+ */
+typedef enum tcam_trace_op_ {
+    TCAM_TRACE_INIT = 1,
+    TCAM_TRACE_INSERT,
+    TCAM_TRACE_REMOVE,
+    TCAM_TRACE_REMOVE_BATCH,
+    TCAM_TRACE_MODIFY
+} tcam_trace_op_t;
+
+/* Flags of a TCAM_TRACE_INIT record, its num
+ * TCAM_TRACE_INIT_SNAPSHOT - the entries of the bank at the start of the
+ *                            recording follow as a TCAM_TRACE_INSERT, the
+ *                            spilled ones included, lowest ranking first
+ * TCAM_TRACE_INIT_SPILL    - the bank has the spill tier, see
+ *                            TCAM_OPT_SPILL
+ */
+#define TCAM_TRACE_INIT_SNAPSHOT 0x1
+#define TCAM_TRACE_INIT_SPILL    0x2
+
+/* Header of a trace
+ * magic   - TCAM_TRACE_MAGIC, without its terminating 0
+ * version - TCAM_TRACE_VERSION
+ * align   - TCAM_TRACE_ALIGN
+ */
+typedef struct tcam_trace_hdr_ {
+    char magic[8];
+    uint32_t version;
+    uint32_t align;
+} tcam_trace_hdr_t;
+
+/* Record of a call
+ * ns   - time of the call, in nanoseconds since the recording started
+ * size - number of bytes of the record, payload and padding included, so
+ *        that a reader can skip the records it does not know
+ * op   - call, one of tcam_trace_op_t
+ * ret  - error code returned by the call
+ * num  - number of items of the payload
+ * arg  - argument of the call, see tcam_trace_op_t
+ * arg2 - second argument of the call, see tcam_trace_op_t
+ */
+typedef struct tcam_trace_rec_ {
+    uint64_t ns;
+    uint32_t size;
+    uint16_t op;
+    uint16_t ret;
+    uint32_t num;
+    uint32_t arg;
+    uint32_t arg2;
+    uint32_t pad;
+} tcam_trace_rec_t;
+
+/*  Description:
+ *     Starts a recording to 'out', which is left open and positioned after
+ *     the header written. The records are written with the stdio buffer of
+ *     'out', see tcam_trace_stop() for the errors.
+ *
+ * Arguments
+ *  out   - file the trace is written to, a pipe works too
+ *  trace - pointer to the recorder allocated
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_trace_start(FILE *out, void **trace);
+
+/*  Description:
+ *     Appends a record to the recording. It is meant for the TCAM Bank
+ *     handler, see tcam_trace_op_t for the arguments of each call. An error
+ *     of 'out' is kept until tcam_trace_stop().
+ *
+ * Arguments
+ *  trace   - recorder
+ *  start   - time of the call, in nanoseconds of CLOCK_MONOTONIC
+ *  op      - call, one of tcam_trace_op_t
+ *  ret     - error code returned by the call
+ *  num     - number of items of the payload
+ *  arg     - argument of the call
+ *  arg2    - second argument of the call
+ *  payload - payload of the record, num items
+ *  bytes   - number of bytes of the payload
+ */
+void tcam_trace_record(void *trace, uint64_t start, tcam_trace_op_t op, tcam_err_t ret,
+                       uint32_t num, uint32_t arg, uint32_t arg2, const void *payload,
+                       size_t bytes);
+
+/*  Description:
+ *     Appends a tcam_insert_keys() call to the recording, see
+ *     TCAM_TRACE_INSERT.
+ *
+ * Arguments
+ *  trace     - recorder
+ *  start     - time of the call, in nanoseconds of CLOCK_MONOTONIC
+ *  ret       - error code returned by the call
+ *  entries   - entries inserted
+ *  keys      - keys of the entries, NULL for entries matching any key
+ *  key_words - width of the keys in 32 bit words
+ *  num       - number of entries
+ */
+void tcam_trace_insert(void *trace, uint64_t start, tcam_err_t ret, const entry_t *entries,
+                       const uint32_t *keys, uint32_t key_words, uint32_t num);
+
+/*  Description:
+ *     Ends a recording and frees the recorder. 'out' is flushed but left
+ *     open.
+ *
+ * Arguments
+ *  trace - recorder
+ * Return: TCAM_ERR_SUCCESS or TCAM_ERR_IO if a record could not be written.
+ */
+tcam_err_t tcam_trace_stop(void *trace);
+
+/*  Description:
+ *     Opens a trace for reading. A file is mapped in memory and read in
+ *     place, the pages read are dropped as the reading goes, so a trace
+ *     larger than the memory can be read. "-" reads the standard input as it
+ *     comes, one record at a time.
+ *
+ * Arguments
+ *  path   - path of the trace, or "-"
+ *  reader - pointer to the reader allocated
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_trace_open(const char *path, void **reader);
+
+/*  Description:
+ *     Reads the next record of a trace. The record and its payload stay
+ *     valid until the next call.
+ *
+ * Arguments
+ *  reader - reader
+ *  rec    - filled with a pointer to the record, its payload follows it
+ * Return: TCAM_ERR_SUCCESS, TCAM_ERR_NO_MATCH at the end of the trace,
+ *         TCAM_ERR_EINVAL for a truncated or malformed record or
+ *         appropriate error code.
+ */
+tcam_err_t tcam_trace_next(void *reader, const tcam_trace_rec_t **rec);
+
+/*  Description:
+ *     Closes a trace opened by tcam_trace_open() and frees the reader.
+ *
+ * Arguments
+ *  reader - reader
+ */
+void tcam_trace_close(void *reader);
+
+#endif
@@ -0,0 +1,678 @@
+/********************************************************************
+ *
+ *      File:   tcam_tss.c
+ *
+ *       Description:
+ *  This  file contains the code for the Tuple Space Search classifier
+ *  API. The classifier looks up ternary rules in software with one hash
+ *  table per distinct mask of the rules.
+ *
+ *
+ *
+ *
+ *********************************************************************
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tcam_defs.h"
+#include "tcam_tss.h"
+
+// initial number of rules the classifier has room for
+#define TSS_MIN_RULES 64
+// initial number of slots of the hash table of a tuple
+#define TSS_MIN_HEADS 8
+
+/* A rule of the classifier. Its masked value is kept in 'vals'.
+ * seq  - insertion number of the rule, the highest is the last one inserted
+ * hash - hash of the masked value of the rule
+ * next - next rule with the same masked value in the tuple, in the order in
+ *        which they match, or next free rule. -1 if none
+ */
+typedef struct tss_rule_ {
+    uint32_t id;
+    uint32_t prio;
+    uint64_t seq;
+    uint32_t tuple;
+    uint32_t hash;
+    int32_t next;
+} tss_rule_t;
+
+/* A tuple, the rules of the classifier with the same mask. The hash table
+ * uses linear probing, each slot has the first rule of a masked value or -1.
+ * A free tuple has no rule and no table.
+ * min_prio  - lowest priority of the rules, min_count rules have it
+ * order_pos - position of the tuple in the probing order
+ */
+typedef struct tss_tuple_ {
+    uint32_t *mask;
+    int32_t *heads;
+    uint32_t heads_mask;
+    uint32_t values;
+    uint32_t rules;
+    uint32_t min_prio;
+    uint32_t min_count;
+    uint32_t order_pos;
+} tss_tuple_t;
+
+/* State of a Tuple Space Search classifier. The handle returned by
+ * tcam_tss_init() points to it.
+ * The rules are in a pool of num_rules_max rules, the free ones chained from
+ * rule_free. The id index is a linear probing table of the rules.
+ * order has the tuples with rules in ascending order of min_prio, the order
+ * in which a lookup probes them.
+ */
+typedef struct tcam_tss_ {
+    uint32_t key_words;
+    tss_rule_t *rules;
+    uint32_t *vals;
+    uint32_t num_rules;
+    uint32_t num_rules_max;
+    int32_t rule_free;
+    uint64_t seq;
+    int32_t *ids;
+    uint32_t ids_mask;
+    tss_tuple_t *tuples;
+    uint32_t num_tuples;
+    uint32_t *order;
+    uint32_t num_order;
+} tcam_tss_t;
+
+/* Returns the hash of a masked value */
+static uint32_t tss_hash(tcam_tss_t *tss, const uint32_t *val)
+{
+    uint64_t h = 0;
+    uint32_t w;
+
+    for(w = 0; w < tss->key_words; w++)
+        h = (h + val[w]) * 0x9e3779b97f4a7c15ULL;
+    return (h ^ (h >> 32));
+}
+
+static uint32_t tss_id_hash(uint32_t id)
+{
+    return (id * 0x9e3779b1U) ^ (id >> 16);
+}
+
+/* Returns TRUE if the rule 'a' matches before the rule 'b' */
+static bool tss_before(tcam_tss_t *tss, int32_t a, int32_t b)
+{
+    return (tss->rules[a].prio < tss->rules[b].prio) ||
+           ((tss->rules[a].prio == tss->rules[b].prio) && (tss->rules[a].seq > tss->rules[b].seq));
+}
+
+/* Id index */
+
+/* Returns the slot of the id index holding the rule 'id', or the empty slot
+ * where it goes
+ */
+static uint32_t tss_id_slot(tcam_tss_t *tss, uint32_t id)
+{
+    uint32_t i = tss_id_hash(id) & tss->ids_mask;
+
+    while((tss->ids[i] >= 0) && (tss->rules[tss->ids[i]].id != id))
+        i = (i + 1) & tss->ids_mask;
+    return i;
+}
+
+/* Sizes the id index for the pool of rules, at most half full */
+static tcam_err_t tss_id_resize(tcam_tss_t *tss, uint32_t size)
+{
+    int32_t *old = tss->ids;
+    uint32_t old_mask = tss->ids_mask, i;
+
+    tss->ids = malloc(size * sizeof(int32_t));
+    if(tss->ids == NULL) {
+        tss->ids = old;
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    }
+    memset(tss->ids, 0xff, size * sizeof(int32_t));
+    tss->ids_mask = size - 1;
+    for(i = 0; (old != NULL) && (i <= old_mask); i++) {
+        if(old[i] >= 0)
+            tss->ids[tss_id_slot(tss, tss->rules[old[i]].id)] = old[i];
+    }
+    free(old);
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Deletes the slot i of a linear probing table of 'mask' + 1 slots, the
+ * following rules of the cluster move back to stay reachable from their
+ * hash
+ */
+static void tss_table_del(int32_t *table, uint32_t mask, uint32_t i, uint32_t (*hash)(tcam_tss_t *, int32_t),
+                          tcam_tss_t *tss)
+{
+    uint32_t j = i, home;
+
+    table[i] = -1;
+    for(j = (j + 1) & mask; table[j] >= 0; j = (j + 1) & mask) {
+        home = hash(tss, table[j]) & mask;
+        // the rule stays if its home is cyclically in (i, j]
+        if(((j > i) && (home > i) && (home <= j)) || ((j < i) && ((home > i) || (home <= j))))
+            continue;
+        table[i] = table[j];
+        table[j] = -1;
+        i = j;
+    }
+}
+
+static uint32_t tss_rule_id_hash(tcam_tss_t *tss, int32_t r)
+{
+    return tss_id_hash(tss->rules[r].id);
+}
+
+static uint32_t tss_rule_val_hash(tcam_tss_t *tss, int32_t r)
+{
+    return tss->rules[r].hash;
+}
+
+/* Tuples */
+
+/* Returns the slot of the table of tuple t holding the rules of the masked
+ * value 'val', or the empty slot where they go
+ */
+static uint32_t tss_tuple_slot(tcam_tss_t *tss, tss_tuple_t *t, const uint32_t *val, uint32_t hash)
+{
+    uint32_t i = hash & t->heads_mask;
+    int32_t r;
+
+    while((r = t->heads[i]) >= 0) {
+        if((tss->rules[r].hash == hash) &&
+           (memcmp(&tss->vals[r * tss->key_words], val, tss->key_words * sizeof(uint32_t)) == 0))
+            break;
+        i = (i + 1) & t->heads_mask;
+    }
+    return i;
+}
+
+/* Sizes the table of tuple t, at most half full */
+static tcam_err_t tss_tuple_resize(tcam_tss_t *tss, tss_tuple_t *t, uint32_t size)
+{
+    int32_t *old = t->heads, r;
+    uint32_t old_mask = t->heads_mask, i;
+
+    t->heads = malloc(size * sizeof(int32_t));
+    if(t->heads == NULL) {
+        t->heads = old;
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    }
+    memset(t->heads, 0xff, size * sizeof(int32_t));
+    t->heads_mask = size - 1;
+    for(i = 0; (old != NULL) && (i <= old_mask); i++) {
+        if((r = old[i]) >= 0)
+            t->heads[tss_tuple_slot(tss, t, &tss->vals[r * tss->key_words], tss->rules[r].hash)] = r;
+    }
+    free(old);
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Moves the tuple at position 'pos' of the probing order to its place after
+ * its min_prio changed
+ */
+static void tss_order_fix(tcam_tss_t *tss, uint32_t pos)
+{
+    uint32_t t = tss->order[pos];
+    uint32_t prio = tss->tuples[t].min_prio;
+
+    while((pos > 0) && (tss->tuples[tss->order[pos - 1]].min_prio > prio)) {
+        tss->order[pos] = tss->order[pos - 1];
+        tss->tuples[tss->order[pos]].order_pos = pos;
+        pos--;
+    }
+    while((pos + 1 < tss->num_order) && (tss->tuples[tss->order[pos + 1]].min_prio < prio)) {
+        tss->order[pos] = tss->order[pos + 1];
+        tss->tuples[tss->order[pos]].order_pos = pos;
+        pos++;
+    }
+    tss->order[pos] = t;
+    tss->tuples[t].order_pos = pos;
+}
+
+/* Accounts for a rule of priority 'prio' added to tuple t */
+static void tss_tuple_add_prio(tcam_tss_t *tss, tss_tuple_t *t, uint32_t prio)
+{
+    if((t->rules++ == 0) || (prio < t->min_prio)) {
+        t->min_prio = prio;
+        t->min_count = 1;
+        tss_order_fix(tss, t->order_pos);
+    } else if(prio == t->min_prio) {
+        t->min_count++;
+    }
+}
+
+/* Accounts for a rule of priority 'prio' deleted from tuple t. The lowest
+ * priority is looked up again in the heads of the tables, which are the
+ * best rules of their masked values, once no rule has it.
+ */
+static void tss_tuple_del_prio(tcam_tss_t *tss, tss_tuple_t *t, uint32_t prio)
+{
+    uint32_t i;
+    int32_t r;
+
+    t->rules--;
+    if((prio != t->min_prio) || (--t->min_count > 0) || (t->rules == 0))
+        return;
+    t->min_prio = UINT32_MAX;
+    for(i = 0; i <= t->heads_mask; i++) {
+        for(r = t->heads[i]; r >= 0; r = tss->rules[r].next) {
+            if(tss->rules[r].prio > t->min_prio)
+                break;
+            if(tss->rules[r].prio < t->min_prio) {
+                t->min_prio = tss->rules[r].prio;
+                t->min_count = 0;
+            }
+            t->min_count++;
+        }
+    }
+    tss_order_fix(tss, t->order_pos);
+}
+
+/* Returns the tuple of the mask 'mask', a new one if there is none. Returns
+ * -1 if the new one cannot be allocated
+ */
+static int32_t tss_tuple_get(tcam_tss_t *tss, const uint32_t *mask)
+{
+    size_t mask_size = tss->key_words * sizeof(uint32_t);
+    tss_tuple_t *t, *tuples;
+    uint32_t *order;
+    int32_t free_t = -1;
+    uint32_t i;
+
+    for(i = 0; i < tss->num_tuples; i++) {
+        if(tss->tuples[i].rules == 0) {
+            if(free_t < 0)
+                free_t = i;
+        } else if(memcmp(tss->tuples[i].mask, mask, mask_size) == 0) {
+            return i;
+        }
+    }
+    if(free_t < 0) {
+        tuples = realloc(tss->tuples, (tss->num_tuples + 1) * sizeof(tss_tuple_t));
+        if(tuples == NULL)
+            return -1;
+        tss->tuples = tuples;
+        order = realloc(tss->order, (tss->num_tuples + 1) * sizeof(uint32_t));
+        if(order == NULL)
+            return -1;
+        tss->order = order;
+        free_t = tss->num_tuples++;
+        memset(&tss->tuples[free_t], 0, sizeof(tss_tuple_t));
+    }
+    t = &tss->tuples[free_t];
+    t->mask = malloc(mask_size);
+    if((t->mask == NULL) || (tss_tuple_resize(tss, t, TSS_MIN_HEADS) != TCAM_ERR_SUCCESS)) {
+        free(t->mask);
+        t->mask = NULL;
+        return -1;
+    }
+    memcpy(t->mask, mask, mask_size);
+    t->values = 0;
+    // probed last until it has a rule
+    t->min_prio = UINT32_MAX;
+    t->order_pos = tss->num_order;
+    tss->order[tss->num_order++] = free_t;
+    return free_t;
+}
+
+/* Frees the table of a tuple left without rules and takes it out of the
+ * probing order
+ */
+static void tss_tuple_put(tcam_tss_t *tss, tss_tuple_t *t)
+{
+    uint32_t pos;
+
+    for(pos = t->order_pos; pos + 1 < tss->num_order; pos++) {
+        tss->order[pos] = tss->order[pos + 1];
+        tss->tuples[tss->order[pos]].order_pos = pos;
+    }
+    tss->num_order--;
+    free(t->mask);
+    free(t->heads);
+    t->mask = NULL;
+    t->heads = NULL;
+    t->heads_mask = 0;
+}
+
+/* Links the rule r in the list of its masked value at slot i of tuple t,
+ * before the first rule it matches before
+ */
+static void tss_link(tcam_tss_t *tss, tss_tuple_t *t, uint32_t i, int32_t r)
+{
+    int32_t *prev = &t->heads[i];
+
+    if(*prev < 0)
+        t->values++;
+    while((*prev >= 0) && tss_before(tss, *prev, r))
+        prev = &tss->rules[*prev].next;
+    tss->rules[r].next = *prev;
+    *prev = r;
+}
+
+/* Unlinks the rule r from the list of its masked value at slot i of tuple t,
+ * the slot is deleted once the list is empty
+ */
+static void tss_unlink(tcam_tss_t *tss, tss_tuple_t *t, uint32_t i, int32_t r)
+{
+    int32_t *prev = &t->heads[i];
+
+    while(*prev != r)
+        prev = &tss->rules[*prev].next;
+    *prev = tss->rules[r].next;
+    if(t->heads[i] < 0) {
+        t->values--;
+        tss_table_del(t->heads, t->heads_mask, i, tss_rule_val_hash, tss);
+    }
+}
+
+/*  Description:
+ *     This API initializes an empty Tuple Space Search classifier.
+ *
+ * Arguments
+ *  key_bits - width of the keys, a multiple of 32 up to TCAM_MAX_KEY_BITS
+ *  tss      - pointer to the classifier allocated
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_tss_init(uint32_t key_bits, void **tss)
+{
+    tcam_tss_t *cls;
+    uint32_t r;
+
+    if(tss == NULL)
+        return TCAM_ERR_EINVAL;
+    *tss = NULL;
+    if((key_bits == 0) || (key_bits % 32 != 0) || (key_bits > TCAM_MAX_KEY_BITS))
+        return TCAM_ERR_EINVAL;
+    cls = calloc(1, sizeof(tcam_tss_t));
+    if(cls == NULL)
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    cls->key_words = key_bits / 32;
+    cls->num_rules_max = TSS_MIN_RULES;
+    cls->rules = malloc(TSS_MIN_RULES * sizeof(tss_rule_t));
+    cls->vals = malloc(TSS_MIN_RULES * cls->key_words * sizeof(uint32_t));
+    if((cls->rules == NULL) || (cls->vals == NULL) ||
+       (tss_id_resize(cls, 2 * TSS_MIN_RULES) != TCAM_ERR_SUCCESS)) {
+        tcam_tss_destroy(cls);
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    }
+    for(r = 0; r < TSS_MIN_RULES; r++)
+        cls->rules[r].next = (r + 1 < TSS_MIN_RULES) ? (int32_t) r + 1 : -1;
+    cls->rule_free = 0;
+    *tss = cls;
+    return TCAM_ERR_SUCCESS;
+}
+
+/* Doubles the pool of rules and the id index */
+static tcam_err_t tss_grow(tcam_tss_t *tss)
+{
+    uint32_t max = 2 * tss->num_rules_max, r;
+    tss_rule_t *rules;
+    uint32_t *vals;
+
+    rules = realloc(tss->rules, max * sizeof(tss_rule_t));
+    if(rules == NULL)
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    tss->rules = rules;
+    vals = realloc(tss->vals, (size_t) max * tss->key_words * sizeof(uint32_t));
+    if(vals == NULL)
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    tss->vals = vals;
+    if(tss_id_resize(tss, 2 * max) != TCAM_ERR_SUCCESS)
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    for(r = tss->num_rules_max; r < max; r++)
+        tss->rules[r].next = (r + 1 < max) ? (int32_t) r + 1 : tss->rule_free;
+    tss->rule_free = tss->num_rules_max;
+    tss->num_rules_max = max;
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *     Inserts a rule. The rule is left out if the call fails.
+ *
+ * Arguments
+ *  tss - classifier
+ *  ent - id and priority of the rule, the id must not be in the classifier
+ *  key - value then mask of the key of the rule, key_bits / 32 words each.
+ *        NULL for a rule matching any key
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_tss_insert(void *tss, const entry_t *ent, const uint32_t *key)
+{
+    tcam_tss_t *cls = (tcam_tss_t *) tss;
+    uint32_t mask[TCAM_MAX_KEY_BITS / 32], w, i, id_slot;
+    uint32_t *val;
+    tss_tuple_t *t;
+    int32_t tuple, r;
+
+    if(cls == NULL)
+        return TCAM_ERR_EINVAL;
+    if((ent == NULL) || (ent->id == TCAM_CELL_STATE_EMPTY))
+        return TCAM_ERR_EINVAL;
+    id_slot = tss_id_slot(cls, ent->id);
+    if(cls->ids[id_slot] >= 0)
+        return TCAM_ERR_EINVAL;
+    // the allocations are done first, so a failure changes nothing
+    if(cls->rule_free < 0) {
+        if(tss_grow(cls) != TCAM_ERR_SUCCESS)
+            return TCAM_ERR_MEM_ALLOC_FAIL;
+        id_slot = tss_id_slot(cls, ent->id);
+    }
+    for(w = 0; w < cls->key_words; w++)
+        mask[w] = (key != NULL) ? key[cls->key_words + w] : 0;
+    if((tuple = tss_tuple_get(cls, mask)) < 0)
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    t = &cls->tuples[tuple];
+    if((2 * (t->values + 1) > t->heads_mask + 1) &&
+       (tss_tuple_resize(cls, t, 2 * (t->heads_mask + 1)) != TCAM_ERR_SUCCESS)) {
+        if(t->rules == 0)
+            tss_tuple_put(cls, t);
+        return TCAM_ERR_MEM_ALLOC_FAIL;
+    }
+
+    r = cls->rule_free;
+    cls->rule_free = cls->rules[r].next;
+    cls->num_rules++;
+    cls->rules[r].id = ent->id;
+    cls->rules[r].prio = ent->prio;
+    cls->rules[r].seq = ++cls->seq;
+    cls->rules[r].tuple = tuple;
+    val = &cls->vals[r * cls->key_words];
+    for(w = 0; w < cls->key_words; w++)
+        val[w] = (key != NULL) ? key[w] & mask[w] : 0;
+    cls->rules[r].hash = tss_hash(cls, val);
+    cls->ids[id_slot] = r;
+    i = tss_tuple_slot(cls, t, val, cls->rules[r].hash);
+    tss_link(cls, t, i, r);
+    tss_tuple_add_prio(cls, t, ent->prio);
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *     Deletes the rule with the given id.
+ *
+ * Arguments
+ *  tss - classifier
+ *  id  - id of the rule
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_tss_remove(void *tss, uint32_t id)
+{
+    tcam_tss_t *cls = (tcam_tss_t *) tss;
+    uint32_t id_slot;
+    tss_tuple_t *t;
+    int32_t r;
+
+    if(cls == NULL)
+        return TCAM_ERR_EINVAL;
+    id_slot = tss_id_slot(cls, id);
+    if((id == TCAM_CELL_STATE_EMPTY) || ((r = cls->ids[id_slot]) < 0))
+        return TCAM_ERR_EINVAL;
+    t = &cls->tuples[cls->rules[r].tuple];
+    tss_unlink(cls, t, tss_tuple_slot(cls, t, &cls->vals[r * cls->key_words], cls->rules[r].hash), r);
+    tss_tuple_del_prio(cls, t, cls->rules[r].prio);
+    if(t->rules == 0)
+        tss_tuple_put(cls, t);
+    tss_table_del(cls->ids, cls->ids_mask, id_slot, tss_rule_id_hash, cls);
+    cls->rules[r].next = cls->rule_free;
+    cls->rule_free = r;
+    cls->num_rules--;
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *     Changes the priority of the rule with the given id. The rule then
+ *     counts as the last one inserted.
+ *
+ * Arguments
+ *  tss  - classifier
+ *  id   - id of the rule
+ *  prio - new priority of the rule
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_tss_modify_prio(void *tss, uint32_t id, uint32_t prio)
+{
+    tcam_tss_t *cls = (tcam_tss_t *) tss;
+    tss_tuple_t *t;
+    uint32_t i;
+    int32_t r, *prev;
+
+    if(cls == NULL)
+        return TCAM_ERR_EINVAL;
+    if((id == TCAM_CELL_STATE_EMPTY) || ((r = cls->ids[tss_id_slot(cls, id)]) < 0))
+        return TCAM_ERR_EINVAL;
+    // the rule keeps its masked value, so it is only moved in its list
+    t = &cls->tuples[cls->rules[r].tuple];
+    i = tss_tuple_slot(cls, t, &cls->vals[r * cls->key_words], cls->rules[r].hash);
+    prev = &t->heads[i];
+    while(*prev != r)
+        prev = &cls->rules[*prev].next;
+    *prev = cls->rules[r].next;
+    if(t->heads[i] < 0)
+        t->values--;
+    tss_tuple_del_prio(cls, t, cls->rules[r].prio);
+    cls->rules[r].prio = prio;
+    cls->rules[r].seq = ++cls->seq;
+    tss_link(cls, t, i, r);
+    tss_tuple_add_prio(cls, t, prio);
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *     Copies the id and the priority of the rule with the given id.
+ *
+ * Arguments
+ *  tss - classifier
+ *  id  - id of the rule
+ *  ent - filled with the id and the priority of the rule, key_ref is 0
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_tss_get(void *tss, uint32_t id, entry_t *ent)
+{
+    tcam_tss_t *cls = (tcam_tss_t *) tss;
+    int32_t r;
+
+    if(cls == NULL)
+        return TCAM_ERR_EINVAL;
+    if((ent == NULL) || (id == TCAM_CELL_STATE_EMPTY) || ((r = cls->ids[tss_id_slot(cls, id)]) < 0))
+        return TCAM_ERR_EINVAL;
+    ent->id = id;
+    ent->prio = cls->rules[r].prio;
+    ent->key_ref = 0;
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *     Looks up a key.
+ *
+ * Arguments
+ *  tss - classifier
+ *  key - key of key_bits / 32 words
+ *  ent - filled with the id and the priority of the matching rule
+ * Return: TCAM_ERR_SUCCESS, TCAM_ERR_NO_MATCH if no rule matches the key or
+ *         appropriate error code.
+ */
+tcam_err_t tcam_tss_lookup(void *tss, const uint32_t *key, entry_t *ent)
+{
+    tcam_tss_t *cls = (tcam_tss_t *) tss;
+    uint32_t val[TCAM_MAX_KEY_BITS / 32], pos, w, i;
+    int32_t best = -1, r;
+    tss_tuple_t *t;
+
+    if(cls == NULL)
+        return TCAM_ERR_EINVAL;
+    if((key == NULL) || (ent == NULL))
+        return TCAM_ERR_EINVAL;
+    for(pos = 0; pos < cls->num_order; pos++) {
+        t = &cls->tuples[cls->order[pos]];
+        // the next tuples have no rule before the one found
+        if((best >= 0) && (t->min_prio > cls->rules[best].prio))
+            break;
+        for(w = 0; w < cls->key_words; w++)
+            val[w] = key[w] & t->mask[w];
+        i = tss_tuple_slot(cls, t, val, tss_hash(cls, val));
+        if(((r = t->heads[i]) >= 0) && ((best < 0) || tss_before(cls, r, best)))
+            best = r;
+    }
+    if(best < 0)
+        return TCAM_ERR_NO_MATCH;
+    ent->id = cls->rules[best].id;
+    ent->prio = cls->rules[best].prio;
+    ent->key_ref = 0;
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *     Copies the statistics of the classifier.
+ *
+ * Arguments
+ *  tss   - classifier
+ *  stats - filled with the statistics
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_tss_get_stats(void *tss, tcam_tss_stats_t *stats)
+{
+    tcam_tss_t *cls = (tcam_tss_t *) tss;
+    uint32_t i;
+
+    if((cls == NULL) || (stats == NULL))
+        return TCAM_ERR_EINVAL;
+    stats->rules = cls->num_rules;
+    stats->tuples = cls->num_order;
+    stats->bytes = sizeof(tcam_tss_t) +
+                   (uint64_t) cls->num_rules_max * (sizeof(tss_rule_t) + cls->key_words * sizeof(uint32_t)) +
+                   (uint64_t) (cls->ids_mask + 1) * sizeof(int32_t) +
+                   (uint64_t) cls->num_tuples * (sizeof(tss_tuple_t) + sizeof(uint32_t));
+    for(i = 0; i < cls->num_tuples; i++) {
+        if(cls->tuples[i].heads != NULL)
+            stats->bytes += cls->key_words * sizeof(uint32_t) +
+                            (uint64_t) (cls->tuples[i].heads_mask + 1) * sizeof(int32_t);
+    }
+    return TCAM_ERR_SUCCESS;
+}
+
+/*  Description:
+ *     Frees the classifier.
+ *
+ * Arguments
+ *  tss - classifier
+ */
+void tcam_tss_destroy(void *tss)
+{
+    tcam_tss_t *cls = (tcam_tss_t *) tss;
+    uint32_t i;
+
+    if(cls == NULL)
+        return;
+    for(i = 0; i < cls->num_tuples; i++) {
+        free(cls->tuples[i].mask);
+        free(cls->tuples[i].heads);
+    }
+    free(cls->tuples);
+    free(cls->order);
+    free(cls->ids);
+    free(cls->rules);
+    free(cls->vals);
+    free(cls);
+}
@@ -0,0 +1,129 @@
+/********************************************************************
+ *
+ *      File:   tcam_tss.h
+ *
+ *       Description:
+ *  This header file contains the  declarations for the API of the Tuple
+ *  Space Search classifier, a software lookup of ternary rules
+ *
+ *
+ *
+ *
+ *********************************************************************
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "tcam_defs.h"
+
+#ifndef __TCAM_TSS_H__
+#define __TCAM_TSS_H__
+
+/* Statistics of a Tuple Space Search classifier, see tcam_tss_get_stats()
+ * rules  - number of rules
+ * tuples - number of distinct masks of the rules, each with its hash table
+ * bytes  - memory allocated by the classifier
+ */
+typedef struct tcam_tss_stats_ {
+    uint32_t rules;
+    uint32_t tuples;
+    uint64_t bytes;
+} tcam_tss_stats_t;
+
+/*  Description:
+ *     This API initializes an empty Tuple Space Search classifier. The rules
+ *     with the same mask are kept in the hash table of their mask, keyed on
+ *     the bits of their value under the mask. A lookup probes the tables in
+ *     ascending order of the best priority of their rules and stops once
+ *     that priority is worse than the one of the rule found so far. It
+ *     returns the same rule as tcam_lookup() on a bank holding the rules:
+ *     the matching rule with the lowest priority value, and among those the
+ *     one inserted last.
+ *
+ * Arguments
+ *  key_bits - width of the keys, a multiple of 32 up to TCAM_MAX_KEY_BITS
+ *  tss      - pointer to the classifier allocated
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_tss_init(uint32_t key_bits, void **tss);
+
+/*  Description:
+ *     Inserts a rule. The rule is left out if the call fails.
+ *
+ * Arguments
+ *  tss - classifier
+ *  ent - id and priority of the rule, the id must not be in the classifier
+ *  key - value then mask of the key of the rule, key_bits / 32 words each.
+ *        NULL for a rule matching any key
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_tss_insert(void *tss, const entry_t *ent, const uint32_t *key);
+
+/*  Description:
+ *     Deletes the rule with the given id.
+ *
+ * Arguments
+ *  tss - classifier
+ *  id  - id of the rule
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_tss_remove(void *tss, uint32_t id);
+
+/*  Description:
+ *     Changes the priority of the rule with the given id. The rule then
+ *     counts as the last one inserted, like with tcam_modify_prio(). It
+ *     never allocates memory.
+ *
+ * Arguments
+ *  tss  - classifier
+ *  id   - id of the rule
+ *  prio - new priority of the rule
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_tss_modify_prio(void *tss, uint32_t id, uint32_t prio);
+
+/*  Description:
+ *     Copies the id and the priority of the rule with the given id.
+ *
+ * Arguments
+ *  tss - classifier
+ *  id  - id of the rule
+ *  ent - filled with the id and the priority of the rule, key_ref is 0
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_tss_get(void *tss, uint32_t id, entry_t *ent);
+
+/*  Description:
+ *     Looks up a key. The classifier is only read, so any number of threads
+ *     can look up keys at the same time as long as no rule changes.
+ *
+ * Arguments
+ *  tss - classifier
+ *  key - key of key_bits / 32 words
+ *  ent - filled with the id and the priority of the matching rule, key_ref
+ *        is 0
+ * Return: TCAM_ERR_SUCCESS, TCAM_ERR_NO_MATCH if no rule matches the key or
+ *         appropriate error code.
+ */
+tcam_err_t tcam_tss_lookup(void *tss, const uint32_t *key, entry_t *ent);
+
+/*  Description:
+ *     Copies the statistics of the classifier.
+ *
+ * Arguments
+ *  tss   - classifier
+ *  stats - filled with the statistics
+ * Return: TCAM_ERR_SUCCESS or appropriate error code.
+ */
+tcam_err_t tcam_tss_get_stats(void *tss, tcam_tss_stats_t *stats);
+
+/*  Description:
+ *     Frees the classifier.
+ *
+ * Arguments
+ *  tss - classifier
+ */
+void tcam_tss_destroy(void *tss);
+#endif